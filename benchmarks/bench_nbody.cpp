@@ -0,0 +1,353 @@
+/**
+ * @file bench_nbody.cpp
+ * @brief Google Benchmark suite for the tree, force and integrator kernels
+ *
+ * @details Every benchmark runs on three particle distributions, generated
+ * with the seeded parallel generators (initial_conditions.h):
+ * - uniform: a UniformBox of massive particles
+ * - plummer: a PlummerSphere
+ * - disk: the planetary system of the viewer (star, planets and passive
+ *   debris, createPlanetarySystem)
+ *
+ * Benchmarks are named Kernel/distribution and take the particle count n,
+ * the opening angle in hundredths (theta) where relevant, and the OpenMP
+ * thread count (threads, 1 to all cores in powers of two), so one run
+ * gives thread-scaling curves for every kernel. Times are wall-clock.
+ * items_per_second is particles per second; interactions_per_second is
+ * reported by the force walks (per-particle walk always, the grouped
+ * solver in NBODY_PROFILING builds). ComputeForcesQuadrupole is the
+ * grouped solver with SolverConfig::quadrupole; ComputeForcesFmm is the
+ * fast multipole method at fmm_theta 0.5, taking the expansion order
+ * (order) instead of theta.
+ *
+ * Built with -DNBODY_BUILD_BENCHMARKS=ON:
+ * ```
+ * ./build/benchmarks/nbody_benchmarks --benchmark_filter='ComputeForces/plummer'
+ * ```
+ */
+
+#include "barneshut.h"
+#include "force_solver.h"
+#include "hermite.h"
+#include "initial_conditions.h"
+#include "interactions.h"
+#include "profiler.h"
+#include "simulation.h"
+#include "yoshida.h"
+#include <benchmark/benchmark.h>
+#include <string>
+
+/// @brief Seed of every generated distribution
+#define BENCH_SEED 12345
+
+/// @brief Timestep of the integrator and collision benchmarks
+#define BENCH_DT 0.01
+
+/**
+ * @enum distribution
+ * @brief Particle distributions of the suite
+ */
+enum distribution { UNIFORM, PLUMMER, DISK, DISTRIBUTION_COUNT };
+
+/// @brief Names of the distribution values, in enum order
+static const char *const DISTRIBUTION_NAMES[DISTRIBUTION_COUNT] = {"uniform", "plummer", "disk"};
+
+/**
+ * @brief Simulation holding n particles of a distribution, with its tree built
+ *
+ * @param dist Distribution
+ * @param n Number of particles (debris particles for DISK)
+ * @param theta Opening angle
+ * @param quadrupole Carry quadrupole moments in the tree
+ * @return New simulation
+ */
+static std::unique_ptr<Simulation> makeSimulation(int dist, int n, double theta = 0.05,
+                                                  bool quadrupole = false) {
+    SolverConfig config;
+    config.theta = theta;
+    config.quadrupole = quadrupole;
+    auto sim = std::make_unique<Simulation>(-250, -250, 500, 500, BENCH_DT, config);
+    ParticleSet &particles = sim->getParticles();
+    if (dist == UNIFORM) {
+        UniformBox box;
+        box.count = n;
+        box.mass = 1.0 / n;
+        generateUniformBox(particles, box, BENCH_SEED);
+    } else if (dist == PLUMMER) {
+        PlummerSphere cluster;
+        cluster.count = n;
+        generatePlummerSphere(particles, cluster, BENCH_SEED);
+    } else {
+        createPlanetarySystem(*sim, n, BENCH_SEED);
+    }
+    sim->rebuildTree();
+    sim->getTree()->calculateCOM();
+    return sim;
+}
+
+/**
+ * @brief Interactions of one particle's Barnes-Hut walk
+ *
+ * @details Mirrors the opening test of BarnesHutForceAndJerk: one per
+ * accepted cell plus one per source particle in every opened leaf.
+ *
+ * @param tree Current tree node
+ * @param particles Particle store
+ * @param i Target slot
+ * @param theta Opening angle
+ * @return Number of cell and particle interactions
+ */
+static long countInteractions(const QuadTree<ParticleSet> *tree, const ParticleSet &particles,
+                              int i, double theta) {
+    if (tree->totalMass <= 0)
+        return 0;
+    vector2D diff = particles.position(i) - tree->centerOfMass;
+    double dist = std::max(diff.norm(), 2 * particles.radius[i]);
+    if (tree->extent.size() < dist * theta * tree->thetaScale)
+        return 1;
+    long count = 0;
+    if (tree->is_divided) {
+        for (auto &child : tree->children)
+            count += countInteractions(child, particles, i, theta);
+    } else {
+        for (int j : tree->particles)
+            count += particles.id[j] != particles.id[i] &&
+                     particles.isSource(j, tree->config->passive_mass);
+    }
+    return count;
+}
+
+/**
+ * @brief Set the thread count and the per-particle throughput of a benchmark
+ *
+ * @param state Benchmark state (threads is its last argument)
+ * @param n Particles processed per iteration
+ */
+static void finish(benchmark::State &state, std::size_t n) {
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * n);
+    state.counters["threads"] = static_cast<double>(omp_get_max_threads());
+}
+
+/// @brief QuadTree::insert of every particle into an empty tree (serial)
+static void benchTreeInsert(benchmark::State &state, int dist) {
+    auto sim = makeSimulation(dist, static_cast<int>(state.range(0)));
+    QuadTree<ParticleSet> *tree = sim->getTree();
+    const int n = static_cast<int>(sim->getParticles().size());
+    for (auto _ : state) {
+        tree->clear();
+        for (int i = 0; i < n; i++)
+            tree->insert(i);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * n);
+}
+
+/// @brief QuadTree::insertMany of every particle into an empty tree
+static void benchTreeInsertMany(benchmark::State &state, int dist) {
+    omp_set_num_threads(static_cast<int>(state.range(1)));
+    auto sim = makeSimulation(dist, static_cast<int>(state.range(0)));
+    QuadTree<ParticleSet> *tree = sim->getTree();
+    std::vector<int> all(sim->getParticles().size());
+    for (auto _ : state) {
+        tree->clear();
+        std::iota(all.begin(), all.end(), 0);
+        tree->insertMany(all);
+    }
+    finish(state, all.size());
+}
+
+/// @brief QuadTree::updateParticles and reinsertion after one drift of dt
+static void benchTreeUpdate(benchmark::State &state, int dist) {
+    omp_set_num_threads(static_cast<int>(state.range(1)));
+    auto sim = makeSimulation(dist, static_cast<int>(state.range(0)));
+    ParticleSet &particles = sim->getParticles();
+    QuadTree<ParticleSet> *tree = sim->getTree();
+    std::vector<int> moved;
+    for (auto _ : state) {
+        state.PauseTiming();
+        drift(particles, BENCH_DT);
+        moved.clear();
+        state.ResumeTiming();
+        tree->updateParticles(moved);
+        tree->insertMany(moved);
+    }
+    finish(state, particles.size());
+}
+
+/// @brief QuadTree::calculateCOM
+static void benchCalculateCOM(benchmark::State &state, int dist) {
+    omp_set_num_threads(static_cast<int>(state.range(1)));
+    auto sim = makeSimulation(dist, static_cast<int>(state.range(0)));
+    for (auto _ : state)
+        sim->getTree()->calculateCOM();
+    finish(state, sim->getParticles().size());
+}
+
+/// @brief BarnesHutForceAndJerk for every particle (per-particle walk)
+static void benchBarnesHut(benchmark::State &state, int dist) {
+    omp_set_num_threads(static_cast<int>(state.range(2)));
+    const double theta = state.range(1) / 100.0;
+    auto sim = makeSimulation(dist, static_cast<int>(state.range(0)), theta);
+    ParticleSet &particles = sim->getParticles();
+    const QuadTree<ParticleSet> *tree = sim->getTree();
+    const int n = static_cast<int>(particles.size());
+
+    long interactions = 0;
+#pragma omp parallel for reduction(+ : interactions) schedule(dynamic, CHUNK_SIZE)
+    for (int i = 0; i < n; i++)
+        interactions += countInteractions(tree, particles, i, theta);
+
+    for (auto _ : state) {
+#pragma omp parallel for schedule(dynamic, CHUNK_SIZE)
+        for (int i = 0; i < n; i++) {
+            Particle p = particles.get(i);
+            p.acceleration = {0, 0};
+            p.jerk = {0, 0};
+            BarnesHutForceAndJerk(&p, tree, theta);
+            particles.ax[i] = p.acceleration.x;
+            particles.ay[i] = p.acceleration.y;
+        }
+        benchmark::ClobberMemory();
+    }
+    finish(state, n);
+    state.counters["interactions_per_second"] = benchmark::Counter(
+        static_cast<double>(interactions) * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+/// @brief Grouped force and jerk evaluation (computeForces), as used by the integrators
+static void benchComputeForces(benchmark::State &state, int dist, bool quadrupole) {
+    omp_set_num_threads(static_cast<int>(state.range(2)));
+    auto sim = makeSimulation(dist, static_cast<int>(state.range(0)), state.range(1) / 100.0,
+                              quadrupole);
+    ParticleSet &particles = sim->getParticles();
+    NBODY_PROFILE_ONLY(double interactions = 0;)
+    for (auto _ : state) {
+        NBODY_PROFILE_ONLY(profiler().beginStep();)
+        getAccelerationAndJerk(particles, sim->getTree(), sim->getConfig());
+        benchmark::ClobberMemory();
+#ifdef NBODY_PROFILING
+        profiler().endStep(0, particles.size(), 0, 0);
+        interactions += lastStepMetrics()->counts[COUNTER_CELLS] +
+                        lastStepMetrics()->counts[COUNTER_PARTICLES];
+#endif
+    }
+    finish(state, particles.size());
+    NBODY_PROFILE_ONLY(state.counters["interactions_per_second"] =
+                           benchmark::Counter(interactions, benchmark::Counter::kIsRate);)
+}
+
+/// @brief Fast multipole force and jerk evaluation with its upward pass (FmmSolver)
+static void benchFmmForces(benchmark::State &state, int dist) {
+    omp_set_num_threads(static_cast<int>(state.range(2)));
+    auto sim = makeSimulation(dist, static_cast<int>(state.range(0)));
+    SolverConfig config = sim->getConfig();
+    config.method = FAST_MULTIPOLE;
+    config.fmm_order = static_cast<int>(state.range(1));
+    sim->setConfig(config);
+    ParticleSet &particles = sim->getParticles();
+    FmmSolver<QuadTree<ParticleSet>> solver(sim->getTree());
+    for (auto _ : state) {
+        solver.refit();
+        solver.accelerationsAndJerks(particles);
+        benchmark::ClobberMemory();
+    }
+    finish(state, particles.size());
+}
+
+/// @brief checkCollisions (detection and merging) on a fresh copy of the state
+static void benchCollisions(benchmark::State &state, int dist) {
+    omp_set_num_threads(static_cast<int>(state.range(1)));
+    auto sim = makeSimulation(dist, static_cast<int>(state.range(0)));
+    getAccelerationAndJerk(sim->getParticles(), sim->getTree(), sim->getConfig());
+    const ParticleSet initial = sim->getParticles();
+    for (auto _ : state) {
+        state.PauseTiming();
+        sim->getParticles() = initial;
+        sim->rebuildTree();
+        state.ResumeTiming();
+        checkCollisions(sim->getParticles(), sim->getTree(), BENCH_DT);
+    }
+    finish(state, initial.size());
+}
+
+/// @brief One full Simulation::step with an integrator
+static void benchFullStep(benchmark::State &state, int dist, transport_type integrator) {
+    omp_set_num_threads(static_cast<int>(state.range(1)));
+    const transport_type saved = TRANSPORT_TYPE;
+    TRANSPORT_TYPE = integrator;
+    auto sim = makeSimulation(dist, static_cast<int>(state.range(0)));
+    sim->step(); // Bootstrap the Hermite force history outside the timing
+    for (auto _ : state)
+        sim->step();
+    finish(state, sim->getParticles().size());
+    TRANSPORT_TYPE = saved;
+}
+
+/**
+ * @brief Report wall-clock time in milliseconds
+ *
+ * @details CPU time would add up the OpenMP threads.
+ *
+ * @param bench Registered benchmark
+ * @return bench, for chaining
+ */
+static benchmark::internal::Benchmark *wallClock(benchmark::internal::Benchmark *bench) {
+    return bench->UseRealTime()->Unit(benchmark::kMillisecond);
+}
+
+/**
+ * @brief Register the suite and run the benchmarks selected on the command line
+ *
+ * @return 0 on success, 1 on unknown options
+ */
+int main(int argc, char **argv) {
+    using benchmark::RegisterBenchmark;
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    const std::vector<int64_t> sizes = {1 << 12, 1 << 15, 1 << 17};
+    const std::vector<int64_t> thetas = {5, 20, 50};
+    const std::vector<int64_t> orders = {4, 8};
+    std::vector<int64_t> threads;
+    for (int t = 1; t < omp_get_num_procs(); t *= 2)
+        threads.push_back(t);
+    threads.push_back(omp_get_num_procs());
+
+    const std::pair<const char *, transport_type> integrators[] = {
+        {"RK2", RK2}, {"Yoshida", YOSHIDA}, {"Hermite", HERMITE}};
+
+    for (int dist = 0; dist < DISTRIBUTION_COUNT; dist++) {
+        auto name = [dist](const std::string &kernel) {
+            return kernel + "/" + DISTRIBUTION_NAMES[dist];
+        };
+        wallClock(RegisterBenchmark(name("TreeInsert").c_str(), benchTreeInsert, dist))
+            ->ArgNames({"n"})->ArgsProduct({sizes});
+        wallClock(RegisterBenchmark(name("TreeInsertMany").c_str(), benchTreeInsertMany, dist))
+            ->ArgNames({"n", "threads"})->ArgsProduct({sizes, threads});
+        wallClock(RegisterBenchmark(name("TreeUpdate").c_str(), benchTreeUpdate, dist))
+            ->ArgNames({"n", "threads"})->ArgsProduct({sizes, threads});
+        wallClock(RegisterBenchmark(name("CalculateCOM").c_str(), benchCalculateCOM, dist))
+            ->ArgNames({"n", "threads"})->ArgsProduct({sizes, threads});
+        wallClock(RegisterBenchmark(name("BarnesHut").c_str(), benchBarnesHut, dist))
+            ->ArgNames({"n", "theta", "threads"})->ArgsProduct({sizes, thetas, threads});
+        wallClock(RegisterBenchmark(name("ComputeForces").c_str(), benchComputeForces, dist,
+                                    false))
+            ->ArgNames({"n", "theta", "threads"})->ArgsProduct({sizes, thetas, threads});
+        wallClock(RegisterBenchmark(name("ComputeForcesQuadrupole").c_str(), benchComputeForces,
+                                    dist, true))
+            ->ArgNames({"n", "theta", "threads"})->ArgsProduct({sizes, thetas, threads});
+        wallClock(RegisterBenchmark(name("ComputeForcesFmm").c_str(), benchFmmForces, dist))
+            ->ArgNames({"n", "order", "threads"})->ArgsProduct({sizes, orders, threads});
+        wallClock(RegisterBenchmark(name("CheckCollisions").c_str(), benchCollisions, dist))
+            ->ArgNames({"n", "threads"})->ArgsProduct({sizes, threads});
+        for (const auto &[kernel, integrator] : integrators) {
+            wallClock(RegisterBenchmark(name("Step" + std::string(kernel)).c_str(), benchFullStep,
+                                        dist, integrator))
+                ->ArgNames({"n", "threads"})->ArgsProduct({sizes, threads});
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
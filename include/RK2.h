@@ -8,7 +8,7 @@
 
 #pragma once
 
-#include "barneshut.h"
+#include "force_solver.h"
 #include "global.h"
 
 /**
@@ -23,12 +23,14 @@
  * This provides better accuracy than Euler's method but is not symplectic,
  * so it may have energy drift over long integrations.
  *
- * @param particles Vector of particles to integrate
- * @param tree QuadTree for Barnes-Hut force calculation
+ * @tparam Solver ForceSolver over the particle store
+ *
+ * @param particles Particle store to integrate
+ * @param solver Force solver (accelerations only, no jerk)
  * @param dt Timestep size
  *
  * @note Non-symplectic (not ideal for long-term orbit integration)
  * @note Cost: 2 force evaluations per step
  * @note Better suited for short-term high-accuracy calculations
  */
-void RK2step(std::vector<std::shared_ptr<Particle>> &, QuadTree<Particle> *, double);
+template <ForceSolver Solver> void RK2step(ParticleSet &, Solver &, double);
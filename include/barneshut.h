@@ -10,18 +10,165 @@
 
 #include "global.h"
 #include "quadtree.h"
+#include "linear_quadtree.h"
 #include "particle.h"
+#include "particle_set.h"
+#include "solver_config.h"
+
+/// @brief Maximum number of target particles sharing one interaction list
+#define GROUP_SIZE 32
+
+/// @brief Chunks of equal estimated cost per thread in the grouped force loop
+#define FORCE_CHUNKS_PER_THREAD 8
+
+/// @brief Point masses an exported quadrupole cell becomes (see exportSources())
+#define CELL_POINTS 4
+
+/**
+ * @struct ForceTargets
+ * @brief Particles to evaluate forces for, as views into per-particle arrays
+ *
+ * @details Indexed by the same slot indices as the tree's particle store.
+ * The target positions may differ from the source positions the tree was
+ * built from (e.g. the RK2 midpoint). jx and jy may be null to skip the
+ * jerk, pot to skip the potential. If active is set, only slots with a nonzero entry are evaluated
+ * and the outputs of the others are left untouched. If cost is set, the
+ * tree walk reads it as each target's expected work and overwrites it
+ * with the interactions the target took.
+ */
+struct ForceTargets {
+    const double *x, *y;   ///< Target positions
+    const double *vx, *vy; ///< Target velocities (used for the jerk only)
+    const double *radius;  ///< Target radii (softening)
+    const int *id;         ///< Target IDs (a matching source is skipped)
+    double *ax, *ay;       ///< Acceleration output (overwritten)
+    double *jx, *jy;       ///< Jerk output (overwritten), or null
+    double *pot;           ///< Potential per unit mass output (overwritten), or null
+    const uint8_t *active; ///< Per-slot evaluation mask, or null for all slots
+    int *cost;             ///< Per-slot interaction count (read, then overwritten), or null
+};
+
+/**
+ * @brief Targets reading from and writing to a particle store's own arrays
+ *
+ * @param particles Particle store
+ * @param with_jerk Also write jx and jy
+ * @return Views into particles; pot is set while particles.with_potential is
+ */
+inline ForceTargets storeTargets(ParticleSet &particles, bool with_jerk) {
+    ForceTargets targets;
+    targets.x = particles.x.data();
+    targets.y = particles.y.data();
+    targets.vx = particles.vx.data();
+    targets.vy = particles.vy.data();
+    targets.radius = particles.radius.data();
+    targets.id = particles.id.data();
+    targets.ax = particles.ax.data();
+    targets.ay = particles.ay.data();
+    targets.jx = with_jerk ? particles.jx.data() : nullptr;
+    targets.jy = with_jerk ? particles.jy.data() : nullptr;
+    targets.pot = particles.with_potential ? particles.pot.data() : nullptr;
+    targets.active = nullptr;
+    targets.cost = particles.cost.data();
+    return targets;
+}
+
+/**
+ * @brief Grouped Barnes-Hut force calculation for every particle
+ *
+ * @details Targets are grouped by tree leaf, up to GROUP_SIZE particles
+ * per group. Each group walks the tree once against its bounding box and
+ * collects an interaction list: the cells accepted for the whole group
+ * and the source particles of the leaves that had to be opened. The list
+ * is then evaluated for every group member in a tight loop.
+ *
+ * A cell is accepted when s < d * θ * thetaScale with d the distance from
+ * the cell's center of mass to the group's bounding box. d is never larger
+ * than any member's own distance, so the result is at least as accurate
+ * as the per-particle walk at the same θ.
+ *
+ * Groups are taken in tree (Morton) order and cut into contiguous chunks
+ * of equal estimated cost, FORCE_CHUNKS_PER_THREAD per thread, from the
+ * targets' interaction counts of the previous evaluation
+ * (ForceTargets::cost); threads take chunks dynamically, so one that
+ * finishes early takes the next chunk.
+ *
+ * Particles that are not in the tree (outside the root bounds) are
+ * evaluated as groups of one. Passive particles are targets but never
+ * sources, and when the tree holds at most SolverConfig::direct_sum_max
+ * sources the walk is replaced by direct summation over them. Store slots
+ * at or beyond n are sources only and never evaluated as targets.
+ *
+ * @tparam Tree QuadTree<ParticleSet> or LinearQuadTree<ParticleSet>
+ *
+ * @param tree Tree with up-to-date moments (sources)
+ * @param targets Arrays to read target state from and write results to
+ * @param n Number of target slots
+ * @param theta Opening angle
+ *
+ * @note Interaction lists live in per-thread buffers reused across calls
+ * @note Parallelized with OpenMP over groups
+ */
+template <class Tree>
+void computeForces(const Tree *tree, const ForceTargets &targets, int n, double theta);
+
+/**
+ * @brief Sources of a tree as seen by every target inside a box
+ *
+ * @details Walks the tree against the box exactly as computeForces() walks
+ * it for a group whose bounding box it is, and appends the result as point
+ * sources: every accepted cell becomes a pseudo-particle at its center of
+ * mass with its mass, center-of-mass velocity, zero radius and ID -1, and
+ * the source particles of opened leaves are copied. With quadrupoles
+ * (SolverConfig::quadrupole), a cell becomes CELL_POINTS point masses with
+ * its mass, center of mass and quadrupole instead. A Barnes-Hut walk over
+ * these sources reproduces the walk over the tree for targets in the box
+ * to the order of the cell expansion.
+ *
+ * @tparam Tree QuadTree<ParticleSet> or LinearQuadTree<ParticleSet>
+ *
+ * @param tree Tree with up-to-date moments
+ * @param box Region holding every target
+ * @param theta Opening angle
+ * @param[in,out] out Store to append the sources to
+ */
+template <class Tree>
+void exportSources(const Tree *tree, const Bounds &box, double theta, ParticleSet &out);
 
 /**
  * @brief Calculate acceleration for all particles using Barnes-Hut algorithm
  *
- * @param particles Vector of particles to update
- * @param tree QuadTree structure for hierarchical force calculation
+ * @tparam Tree QuadTree<ParticleSet> or LinearQuadTree<ParticleSet>
+ *
+ * @param particles Particle store to update (writes ax, ay)
+ * @param tree Tree structure for hierarchical force calculation
+ * @param config Solver parameters (opening angle)
  *
- * @note Zeros acceleration before calculation
+ * @note Grouped walk, see computeForces()
  * @note Parallelized with OpenMP
  */
-void getAcceleration(std::vector<std::shared_ptr<Particle>> &, QuadTree<Particle> *);
+template <class Tree> void getAcceleration(ParticleSet &, Tree *, const SolverConfig &);
+
+/**
+ * @brief Estimate the relative force error of the tree at a given theta
+ *
+ * @details Evaluates the tree and direct summation for samples particles
+ * spread evenly over the store and returns the mean of
+ * |a_tree - a_direct| / |a_direct|. Costs O(samples * N).
+ *
+ * Uses the per-particle walk, which opens no more cells than the grouped
+ * walk of computeForces(), so the estimate errs on the side of caution.
+ *
+ * @tparam Tree QuadTree<ParticleSet> or LinearQuadTree<ParticleSet>
+ *
+ * @param particles Particle store (not modified)
+ * @param tree Tree with up-to-date moments
+ * @param theta Opening angle to evaluate
+ * @param samples Number of particles to sample
+ * @return Mean relative acceleration error (0 if nothing was sampled)
+ */
+template <class Tree>
+double estimateForceError(const ParticleSet &, const Tree *, double theta, int samples);
 
 /**
  * @brief Calculate gravitational force and jerk between two particles
@@ -34,13 +181,14 @@ void getAcceleration(std::vector<std::shared_ptr<Particle>> &, QuadTree<Particle
  * - Jerk: da/dt = -G*m * [v/r³ - 3*(r·v)*r/r⁵]
  *
  * @param p1 First particle (particle being acted upon)
- * @param p2 Second particle (source of force)
+ * @param particles Particle store holding the source
+ * @param j Slot index of the source particle
  * @param[out] acc_out Acceleration contribution
  * @param[out] jerk_out Jerk contribution (time derivative of acceleration)
  *
  * @note Uses gravitational softening based on particle radii
  */
-void forceAndJerk(const Particle *, const Particle *, vector2D &, vector2D &);
+void forceAndJerk(const Particle *, const ParticleSet &, int, vector2D &, vector2D &);
 
 /**
  * @brief Recursively calculate force and jerk using Barnes-Hut tree
@@ -54,12 +202,28 @@ void forceAndJerk(const Particle *, const Particle *, vector2D &, vector2D &);
  * - d = distance to cell center of mass
  * - θ = opening angle (smaller = more accurate)
  *
- * @param p Particle to calculate forces for
+ * @param p Particle to calculate forces for (a gathered copy, see ParticleSet::get)
  * @param tree QuadTree node to evaluate
  * @param theta Opening angle parameter (typical: 0.05-0.5)
  *
  * @note Accumulates into p->acceleration and p->jerk
  * @note For far-field, assumes COM velocity ≈ 0 (simplification)
  */
-void BarnesHutForceAndJerk(Particle *p, const QuadTree<Particle> *tree,
+void BarnesHutForceAndJerk(Particle *p, const QuadTree<ParticleSet> *tree,
+                          double theta);
+
+/**
+ * @brief Calculate force and jerk using a LinearQuadTree
+ *
+ * @details Same opening criterion and interactions as the QuadTree
+ * overload, walking the flat node array with an explicit stack instead
+ * of recursing through child pointers.
+ *
+ * @param p Particle to calculate forces for (a gathered copy, see ParticleSet::get)
+ * @param tree LinearQuadTree to evaluate
+ * @param theta Opening angle parameter (typical: 0.05-0.5)
+ *
+ * @note Accumulates into p->acceleration and p->jerk
+ */
+void BarnesHutForceAndJerk(Particle *p, const LinearQuadTree<ParticleSet> *tree,
                           double theta);
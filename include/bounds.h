@@ -67,6 +67,52 @@ public:
                 (position.y >= getBottom()) && (position.y < getTop()));
     }
 
+    /**
+     * @brief Grow the box to include a point
+     *
+     * @param position Point to include
+     */
+    void expand(const vector2D &position)
+    {
+        xmin = std::min(xmin, position.x);
+        ymin = std::min(ymin, position.y);
+        xmax = std::max(xmax, position.x);
+        ymax = std::max(ymax, position.y);
+        width = xmax - xmin;
+        height = ymax - ymin;
+    }
+
+    /**
+     * @brief Grow the box to include another box
+     *
+     * @param other Box to include
+     */
+    void expand(const Bounds &other)
+    {
+        xmin = std::min(xmin, other.xmin);
+        ymin = std::min(ymin, other.ymin);
+        xmax = std::max(xmax, other.xmax);
+        ymax = std::max(ymax, other.ymax);
+        width = xmax - xmin;
+        height = ymax - ymin;
+    }
+
+    /// @brief Largest side of the box
+    constexpr double size() const { return std::max(width, height); }
+
+    /**
+     * @brief Distance from a point to the nearest point of the box
+     *
+     * @param position Point to measure from
+     * @return Euclidean distance (0 if the point is inside)
+     */
+    double distanceTo(const vector2D &position) const
+    {
+        double dx = std::max({xmin - position.x, 0.0, position.x - xmax});
+        double dy = std::max({ymin - position.y, 0.0, position.y - ymax});
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
     /**
      * @brief Check if this bounding box intersects another
      *
@@ -0,0 +1,93 @@
+/**
+ * @file device_solver.h
+ * @brief Direct-summation forces offloaded to an accelerator
+ *
+ * Built with -DNBODY_ENABLE_OFFLOAD=ON, which defines NBODY_OFFLOAD.
+ * The device code is OpenMP target offload, so the same source runs on
+ * any device the compiler targets (NBODY_OFFLOAD_FLAGS, e.g.
+ * -foffload=nvptx-none for GCC or -fopenmp-targets=nvptx64 for Clang)
+ * and falls back to the host when no device is present.
+ *
+ * Mass, radius and ID of the sources are mapped once per rebuild() and
+ * stay resident; refit() uploads positions and velocities only, and each
+ * evaluation moves the target state up and the accelerations (and jerks)
+ * back. The integrators, collisions and rendering stay on the host, so
+ * that is the traffic of one force evaluation: O(N) against the O(N²)
+ * device work. Each device thread sums one target over every source with
+ * the pairwise kernel of the tree walk, so results match directForces()
+ * to rounding.
+ *
+ * Rendering does not share device memory: the viewer fills its
+ * sf::VertexArray from the host frames. Writing an sf::VertexBuffer
+ * from the device would need CUDA or OpenCL GL interop, which OpenMP
+ * target offload does not provide, so it is not implemented.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "barneshut.h"
+#include "particle_set.h"
+
+/**
+ * @class DeviceSolver
+ * @brief Direct summation on an OpenMP target device (see directForces())
+ *
+ * @details Satisfies ForceSolver. Holds device copies of the sources of
+ * a particle store as of the last refit() or rebuild(); the constructor
+ * rebuilds.
+ */
+class DeviceSolver
+{
+public:
+    /**
+     * @brief Map the sources of a particle store to the default device
+     *
+     * @param _sources Particle store holding the sources (not owned)
+     * @param _passive_mass Sources lighter than this are skipped
+     */
+    DeviceSolver(const ParticleSet *_sources, double _passive_mass);
+
+    /// @brief Release the device copies
+    ~DeviceSolver();
+
+    DeviceSolver(const DeviceSolver &) = delete;
+    DeviceSolver &operator=(const DeviceSolver &) = delete;
+
+    /// @brief Accelerations of every particle
+    void accelerations(ParticleSet &particles) {
+        forces(storeTargets(particles, false), static_cast<int>(particles.size()));
+    }
+
+    /// @brief Accelerations and jerks of every particle
+    void accelerationsAndJerks(ParticleSet &particles) {
+        forces(storeTargets(particles, true), static_cast<int>(particles.size()));
+    }
+
+    /// @brief Forces on arbitrary targets (directForces() contract)
+    void forces(const ForceTargets &targets, int n);
+
+    /// @brief Upload the current source positions and velocities
+    void refit();
+
+    /// @brief Repack and remap every source column from the particle store
+    void rebuild();
+
+    /// @brief True if an offload device is present (otherwise the host runs the kernels)
+    static bool hasDevice();
+
+private:
+    const ParticleSet *sources;     ///< Particle store holding the sources
+    double passive_mass;            ///< Sources lighter than this are skipped
+    std::vector<int> slots;         ///< Store slot of each source
+    std::vector<double> x, y;       ///< Source positions (host side of the mapping)
+    std::vector<double> vx, vy;     ///< Source velocities
+    std::vector<double> mass;       ///< Source masses
+    std::vector<double> radius;     ///< Source radii
+    std::vector<int> id;            ///< Source IDs
+    int count = 0;                  ///< Mapped sources
+    bool mapped = false;            ///< Source columns are mapped to the device
+
+    /// @brief Remove the source columns from the device
+    void unmap();
+};
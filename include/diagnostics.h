@@ -0,0 +1,57 @@
+/**
+ * @file diagnostics.h
+ * @brief Conserved quantities measured in one reduction per step
+ *
+ * The recentering pass at the end of every step already streams through
+ * every particle, so it also sums the kinetic energy, linear and angular
+ * momentum. The potential energy comes from the potential the force
+ * kernels accumulate next to the acceleration (ParticleSet::pot) on the
+ * steps that ask for it, so no separate O(N²) or tree pass is needed.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "bounds.h"
+#include "particle_set.h"
+
+/**
+ * @struct Diagnostics
+ * @brief Conserved quantities of the particles inside the domain
+ *
+ * @details Only particles inside the tree domain are counted, since only
+ * those are sources of the force evaluation. The center of mass is taken
+ * before the store is recentered on it.
+ */
+struct Diagnostics {
+    double kinetic = 0;          ///< Σ ½ m v²
+    double potential = 0;        ///< Pair potential energy (zero unless with_potential)
+    double px = 0, py = 0;       ///< Linear momentum
+    double angular = 0;          ///< Angular momentum about the center of mass
+    double mass = 0;             ///< Total mass
+    double com_x = 0, com_y = 0; ///< Center of mass
+    long count = 0;              ///< Particles counted
+    bool with_potential = false; ///< potential was measured
+
+    /// @brief Total energy (kinetic only unless with_potential)
+    double energy() const { return kinetic + potential; }
+};
+
+/**
+ * @brief Sum the conserved quantities of a particle store
+ *
+ * @details One parallel pass over CHUNK_SIZE blocks whose partial sums
+ * are added in block order, so the result, and with it the recentering,
+ * is bitwise the same for any thread count. With with_potential, the potential
+ * energy is Σ w m pot with w = ½ for sources, whose pairs are seen from
+ * both sides, and w = 1 for passive particles, which no other particle
+ * feels; pot must then hold the potential at the current positions.
+ *
+ * @param particles Particle store
+ * @param bounds Domain; particles outside are left out
+ * @param passive_mass Particles lighter than this are passive
+ * @param with_potential Also sum the potential energy from particles.pot
+ * @return Measured quantities
+ */
+Diagnostics measureDiagnostics(const ParticleSet &particles, const Bounds &bounds,
+                               double passive_mass, bool with_potential);
@@ -0,0 +1,49 @@
+/**
+ * @file direct_sum.h
+ * @brief Tiled O(N²) direct summation: reference forces and energy
+ *
+ * Sums every source for every target with the same pairwise kernel as the
+ * leaf interactions of the tree walk (forceAndJerk, force_kernels.h), so
+ * the difference to computeForces() is the error of the far-field
+ * approximation alone. Sources are streamed in tiles of DIRECT_TILE that
+ * stay in cache while a group of targets runs over them.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "barneshut.h"
+#include "particle_set.h"
+
+/// @brief Sources per tile of the direct summation
+#define DIRECT_TILE 512
+
+/**
+ * @brief Direct-summation force and jerk for every target
+ *
+ * @details Same contract as computeForces(), with the tree replaced by all
+ * sources of a particle store: targets sum every source with a different
+ * ID that is not passive. Parallelized with OpenMP over groups of
+ * GROUP_SIZE targets.
+ *
+ * @param sources Particle store holding the sources
+ * @param targets Arrays to read target state from and write results to
+ *                (may be views into sources)
+ * @param n Number of target slots
+ * @param passive_mass Sources lighter than this are skipped
+ */
+void directForces(const ParticleSet &sources, const ForceTargets &targets, int n,
+                  double passive_mass);
+
+/**
+ * @brief Gravitational potential energy by direct summation
+ *
+ * @details Sums -G*m_i*m_j/r_s over every pair with at least one source,
+ * softened like the forces (r_s = max(|r|, radius_i + radius_j)).
+ * Passive-passive pairs do not interact and are left out.
+ *
+ * @param particles Particle store
+ * @param passive_mass Particles lighter than this are passive
+ * @return Potential energy
+ */
+double potentialEnergy(const ParticleSet &particles, double passive_mass);
@@ -0,0 +1,119 @@
+/**
+ * @file distributed_simulation.h
+ * @brief Stepping engine over MPI ranks (NBODY_MPI builds)
+ *
+ * Each rank integrates only the particles it owns (see
+ * domain_decomposition.h), with forces from a DistributedSolver.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "domain_decomposition.h"
+#include "force_solver.h"
+#include "particle_set.h"
+#include "solver_config.h"
+
+/**
+ * @class DistributedSimulation
+ * @brief Owns one rank's particles and advances all ranks in lockstep
+ *
+ * @details Each call to step(), collective over the ranks:
+ * 1. Integrate with a DistributedSolver
+ * 2. Resolve collisions with the halo of the neighbouring ranks: every
+ *    rank runs collideParticles() over its particles and the halo and
+ *    keeps the outcome for its own particles, so a merge across a boundary
+ *    is resolved identically on both sides
+ * 3. Recenter on the global center of mass
+ * 4. Every rebalance interval, move the splitters to the measured force
+ *    work; then migrate particles to their owners
+ *
+ * The integrators must take the same number of force evaluations on every
+ * rank, so block timesteps (BLOCK_HERMITE) are not supported.
+ */
+class DistributedSimulation
+{
+public:
+    /**
+     * @brief Construct an empty simulation on every rank of a communicator
+     *
+     * @param comm Communicator of the ranks
+     * @param xmin Left edge of the domain
+     * @param ymin Bottom edge of the domain
+     * @param width Width of the domain
+     * @param height Height of the domain
+     * @param _dt Integration timestep
+     * @param _config Force solver parameters
+     */
+    DistributedSimulation(MPI_Comm comm, double xmin, double ymin, double width, double height,
+                          double _dt, const SolverConfig &_config = SolverConfig());
+
+    DistributedSimulation(const DistributedSimulation &) = delete;
+    DistributedSimulation &operator=(const DistributedSimulation &) = delete;
+
+    /**
+     * @brief Partition particles loaded directly into the local stores
+     *
+     * @details Balances the splitters on particle counts and migrates every
+     * particle to its owner. Call it after filling getParticles() on any
+     * ranks (e.g. all initial conditions on rank 0).
+     */
+    void distribute();
+
+    /// @brief Advance every rank by one timestep dt
+    void step();
+
+    /**
+     * @brief Advance by a fixed number of steps
+     *
+     * @param nsteps Number of steps to take
+     */
+    void run(long nsteps);
+
+    /// @brief Current simulation time
+    double getTime() const { return time; }
+
+    /// @brief Integration timestep
+    double getDt() const { return dt; }
+
+    /// @brief Number of steps taken so far
+    long getStepCount() const { return step_count; }
+
+    /// @brief Steps between rebalances (0: never rebalance)
+    void setRebalanceInterval(int interval) { rebalance_interval = interval; }
+
+    /// @brief Largest rank force work over the mean at the last rebalance
+    double getImbalance() const { return imbalance; }
+
+    /// @brief Total number of particles over the ranks (collective)
+    long globalCount() const;
+
+    /// @brief Partition of the ranks
+    const DomainDecomposition &getDomain() const { return domain; }
+
+    /// @brief Particles owned by this rank
+    ParticleSet &getParticles() { return particles; }
+
+    /// @brief Particles owned by this rank (read-only)
+    const ParticleSet &getParticles() const { return particles; }
+
+    /// @brief Force solver parameters
+    const SolverConfig &getConfig() const { return config; }
+
+private:
+    SolverConfig config;         ///< Force solver parameters
+    ParticleSet particles;       ///< Particles owned by this rank
+    DomainDecomposition domain;  ///< Partition of the ranks
+    DistributedSolver solver;    ///< Forces over every rank
+    double dt;                   ///< Integration timestep
+    double time = 0;             ///< Elapsed simulation time
+    long step_count = 0;         ///< Steps taken
+    int rebalance_interval = 10; ///< Steps between rebalances
+    double imbalance = 1;        ///< Work imbalance at the last rebalance
+
+    /// @brief Resolve collisions, including those with the halo particles
+    void collide();
+
+    /// @brief Shift every rank's particles to the global center of mass
+    void recenter();
+};
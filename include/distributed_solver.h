@@ -0,0 +1,90 @@
+/**
+ * @file distributed_solver.h
+ * @brief Barnes-Hut forces over the particles of every MPI rank
+ *
+ * Forces on a rank's particles come from a tree over its own particles
+ * followed by the locally essential sources of every other rank, so a
+ * target sees the same cells and leaves as in a single-process
+ * Barnes-Hut walk. Remote cells keep their quadrupole as a set of point
+ * masses (see exportSources()).
+ */
+
+#pragma once
+
+#include "global.h"
+#include "barneshut.h"
+#include "domain_decomposition.h"
+#include "linear_quadtree.h"
+#include "particle_set.h"
+#include "solver_config.h"
+
+/**
+ * @class DistributedSolver
+ * @brief Barnes-Hut forces over the particles of every rank
+ *
+ * @details Satisfies ForceSolver; every call is collective. An evaluation
+ * gathers the bounding box of every rank's active targets. After a refit()
+ * or rebuild(), or when some rank's targets left the box its imports were
+ * built for (the RK2 midpoint), the ranks rebuild their local trees and
+ * exchange sources. The combined store holds the local particles in their
+ * own slots, so the targets index it directly, with the imports appended
+ * as source-only slots.
+ */
+class DistributedSolver
+{
+public:
+    /**
+     * @brief Solve over the particles of every rank
+     *
+     * @param _domain Partition of the ranks (not owned)
+     * @param _particles Local particles (not owned)
+     * @param _config Solver parameters (not owned)
+     */
+    DistributedSolver(DomainDecomposition *_domain, const ParticleSet *_particles,
+                      const SolverConfig *_config);
+
+    /// @brief Accelerations of every particle
+    void accelerations(ParticleSet &particles) {
+        forces(storeTargets(particles, false), static_cast<int>(particles.size()));
+    }
+
+    /// @brief Accelerations and jerks of every particle
+    void accelerationsAndJerks(ParticleSet &particles) {
+        forces(storeTargets(particles, true), static_cast<int>(particles.size()));
+    }
+
+    /**
+     * @brief Forces on the local particles (computeForces() contract)
+     *
+     * @param targets Target arrays indexed by local slot
+     * @param n Number of target slots (at most the local particle count)
+     */
+    void forces(const ForceTargets &targets, int n);
+
+    /// @brief Exchange sources again before the next evaluation
+    void refit() { stale = true; }
+
+    /// @brief Exchange sources again before the next evaluation
+    void rebuild() { stale = true; }
+
+    /// @brief Force time since the last call (seconds), then reset it
+    double takeWork();
+
+private:
+    DomainDecomposition *domain;             ///< Partition of the ranks
+    const ParticleSet *particles;            ///< Local particles
+    const SolverConfig *config;              ///< Solver parameters
+    LinearQuadTree<ParticleSet> local_tree;  ///< Tree over the local particles (exported)
+    ParticleSet sources;                     ///< Local particles, then the imported sources
+    LinearQuadTree<ParticleSet> source_tree; ///< Tree over sources (walked)
+    std::vector<Bounds> exported;            ///< Target boxes the imports were built for
+    bool stale = true;                       ///< Sources must be exchanged before evaluating
+    double work = 0;                         ///< Accumulated force time
+
+    /**
+     * @brief Rebuild the local tree, exchange sources and build the source tree
+     *
+     * @param boxes Target box of every rank
+     */
+    void exchange(const std::vector<Bounds> &boxes);
+};
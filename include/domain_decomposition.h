@@ -0,0 +1,155 @@
+/**
+ * @file domain_decomposition.h
+ * @brief MPI partition of the particles along the Morton curve
+ *
+ * Built with -DNBODY_ENABLE_MPI=ON, which defines NBODY_MPI.
+ *
+ * Every rank owns the particles whose Morton key (see morton.h) falls in
+ * its key range [splitters[r], splitters[r + 1]). Contiguous key ranges are
+ * unions of quadtree cells, so each rank's particles are spatially compact
+ * and most of the tree walk stays local. The splitters are placed so every
+ * rank carries the same measured force work, and particles that cross a
+ * boundary are migrated with one all-to-all exchange.
+ *
+ * Ranks meet each other's particles in two exchanges:
+ * - sources: each rank walks its own tree against the bounding box of
+ *   every other rank's targets and sends the result (exportSources()),
+ *   the locally essential tree of that rank
+ * - halo: each rank sends the particles within collision reach of every
+ *   other rank's bounding box, so collisions across a boundary are found
+ *   on both sides
+ */
+
+#pragma once
+
+#include "global.h"
+#include "bounds.h"
+#include "linear_quadtree.h"
+#include "particle_set.h"
+#include <mpi.h>
+
+/// @brief Bits per axis of the partition keys
+#define DOMAIN_KEY_LEVELS 16
+
+/**
+ * @brief Bounding box that holds nothing (negative width)
+ */
+inline Bounds emptyBox() {
+    Bounds box;
+    box.set_bounds(0, 0, -1, -1);
+    return box;
+}
+
+/// @brief True if a box was made by emptyBox()
+inline bool isEmptyBox(const Bounds &box) { return box.width < 0; }
+
+/**
+ * @class DomainDecomposition
+ * @brief Morton key ranges of the ranks and the exchanges between them
+ *
+ * @details Every member function is collective over the communicator:
+ * all ranks must call it, in the same order.
+ */
+class DomainDecomposition
+{
+public:
+    /**
+     * @brief Split the key space of a domain evenly among the ranks
+     *
+     * @param _comm Communicator of the ranks
+     * @param xmin Left edge of the domain (the trees' root bounds)
+     * @param ymin Bottom edge of the domain
+     * @param width Width of the domain
+     * @param height Height of the domain
+     */
+    DomainDecomposition(MPI_Comm _comm, double xmin, double ymin, double width, double height);
+
+    /// @brief Rank of this process
+    int rank() const { return rank_index; }
+
+    /// @brief Number of ranks
+    int size() const { return rank_count; }
+
+    /// @brief Region covered by the keys
+    const Bounds &getDomain() const { return domain; }
+
+    /**
+     * @brief Rank owning a position
+     *
+     * @param x Position x
+     * @param y Position y
+     * @return Owner rank (positions outside the domain are clamped onto it)
+     */
+    int owner(double x, double y) const;
+
+    /**
+     * @brief Move the splitters so every rank carries the same work
+     *
+     * @details Each rank's measured work is shared out among its particles
+     * in proportion to their interaction counts of the last force
+     * evaluation (ParticleSet::cost), so a dense cluster inside a rank
+     * moves the splitters towards it (unit weights when a rank has no
+     * measurement yet).
+     * Each splitter is found by bisection over the key space, with one
+     * reduction of the weight below every candidate per bisection step.
+     *
+     * @param particles Local particles
+     * @param work Force time of this rank since the last balance (seconds)
+     * @return Largest rank work over the mean (1 when unmeasured)
+     */
+    double balance(const ParticleSet &particles, double work);
+
+    /**
+     * @brief Send every particle to the rank owning its position
+     *
+     * @param[in,out] particles Local particles (compacted, received ones appended)
+     */
+    void migrate(ParticleSet &particles);
+
+    /**
+     * @brief Collect one box from every rank
+     *
+     * @param box This rank's box (emptyBox() if it has nothing)
+     * @return Boxes indexed by rank
+     */
+    std::vector<Bounds> gatherBoxes(const Bounds &box) const;
+
+    /**
+     * @brief Exchange locally essential sources
+     *
+     * @param tree Tree over the local particles, with current moments
+     * @param boxes Target box of every rank (from gatherBoxes())
+     * @param theta Opening angle
+     * @param[in,out] imported Store to append the sources received to
+     */
+    void exchangeSources(const LinearQuadTree<ParticleSet> &tree,
+                         const std::vector<Bounds> &boxes, double theta,
+                         ParticleSet &imported) const;
+
+    /**
+     * @brief Exchange the particles near the other ranks
+     *
+     * @param particles Local particles
+     * @param boxes Particle box of every rank (from gatherBoxes())
+     * @param margin Distance within which particles are sent
+     * @param[in,out] halo Store to append the particles received to
+     */
+    void exchangeHalo(const ParticleSet &particles, const std::vector<Bounds> &boxes,
+                      double margin, ParticleSet &halo) const;
+
+    /// @brief Sum of a value over the ranks
+    double sum(double value) const;
+
+    /// @brief Largest value over the ranks
+    double max(double value) const;
+
+private:
+    MPI_Comm comm;                   ///< Communicator of the ranks
+    int rank_index = 0;              ///< Rank of this process
+    int rank_count = 1;              ///< Number of ranks
+    Bounds domain;                   ///< Region covered by the keys
+    std::vector<uint64_t> splitters; ///< First key of every rank, plus the end of the key space
+
+    /// @brief Partition key of a position
+    uint64_t key(double x, double y) const { return mortonKey(x, y, domain, DOMAIN_KEY_LEVELS); }
+};
@@ -0,0 +1,176 @@
+/**
+ * @file fmm.h
+ * @brief Fast multipole method on the quadtree hierarchy
+ *
+ * The force law is the Newtonian 1/r potential restricted to the plane,
+ * not the 2D logarithmic kernel, so the complex-variable expansions of the
+ * 2D FMM do not apply. Cells are instead expanded in Cartesian Taylor
+ * series of 1/r up to a total order p:
+ *
+ *     M_α = Σ m (Z - x_j)^α / α!                 (multipole about Z)
+ *     L_β = Σ_α M_α ∂^(α+β)(1/r)(C - Z), |α| + |β| <= p   (M2L)
+ *
+ * with the potential Φ = -G * L about the target-cell center C. Parents
+ * collect their children's multipoles (M2M), locals are pushed down to
+ * the children (L2L) and evaluated at the targets (L2P). A dual-tree
+ * traversal pairs target and source cells: well-separated pairs
+ * interact through M2L, neighbouring leaves by direct summation with the
+ * softened particle kernels (P2P). The cost is O(N) for a fixed order.
+ *
+ * The jerk is j = -(v·∇)∇Φ + Σ_k ∂_k∇Ψ_k, where Ψ_k is the potential of
+ * the sources weighted by their velocity component v_k. Cells therefore
+ * carry two more multipoles (m·vx, m·vy), translated to locals only when
+ * a jerk is requested. Jerks use second derivatives of the locals and
+ * are one or two orders less accurate than the accelerations.
+ *
+ * Error falls roughly as fmm_theta^(p+1); see SolverConfig.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "barneshut.h"
+#include "linear_quadtree.h"
+#include "particle_set.h"
+#include "quadtree.h"
+#include "solver_config.h"
+
+/**
+ * @struct FmmCell
+ * @brief One cell of the flattened FMM hierarchy
+ */
+struct FmmCell {
+    vector2D center;        ///< Expansion center: center of mass, or the box center if massless
+    double mass;            ///< Total source mass
+    double source_radius;   ///< Largest distance of a source from center
+    double source_soft;     ///< Largest source radius (softening)
+    double target_radius;   ///< Largest distance of a target from center (per evaluation)
+    double target_soft;     ///< Largest target radius (per evaluation)
+    int targets;            ///< Active targets in the subtree (per evaluation)
+    int first_child;        ///< Index of the first of four children (-1 for a leaf)
+    int first, count;       ///< Slot range in FastMultipole::order (leaves only)
+    int source_first;       ///< First source in the source arrays (leaves only)
+    int source_count;       ///< Number of sources (leaves only)
+    int depth;              ///< Depth in the tree (root = 1)
+};
+
+/**
+ * @struct FmmTerm
+ * @brief One multiply-add of an expansion translation: out += in * aux
+ */
+struct FmmTerm {
+    int out; ///< Coefficient written
+    int in;  ///< Coefficient read
+    int aux; ///< Derivative (M2L) or shift monomial (M2M, L2L) multiplied in
+};
+
+/**
+ * @class FastMultipole
+ * @brief FMM state over the topology of a QuadTree or LinearQuadTree
+ *
+ * @details build() copies the tree shape into a flat cell array with
+ * the sources of each leaf stored contiguously, and runs the upward pass
+ * (P2M, M2M). evaluate() runs the dual-tree traversal (M2L) and the
+ * downward pass (L2L, L2P), where each target leaf also sums the sources
+ * of the leaves it met in the traversal in one block (P2P). Subtrees above
+ * TREE_TASK_DEPTH run as OpenMP tasks in every pass; each task writes
+ * only its own subtree, so results do not depend on the thread count.
+ */
+class FastMultipole
+{
+public:
+    /**
+     * @brief Flatten a pointer tree and compute its multipoles
+     *
+     * @param tree Tree with current bounds (moments are recomputed here)
+     */
+    void build(const QuadTree<ParticleSet> &tree);
+
+    /**
+     * @brief Flatten a linear tree and compute its multipoles
+     *
+     * @param tree Tree with current bounds (moments are recomputed here)
+     */
+    void build(const LinearQuadTree<ParticleSet> &tree);
+
+    /// @brief Number of sources in the hierarchy
+    int sourceCount() const { return static_cast<int>(source_x.size()); }
+
+    /**
+     * @brief Accelerations (and jerks) of the targets in the tree
+     *
+     * @details Same contract as computeForces() for the slots indexed by
+     * the tree. Active targets that are not in the tree are left untouched
+     * and flagged in outside.
+     *
+     * @param targets Target positions and outputs, indexed by store slot
+     * @param n Number of target slots
+     * @param[out] outside Per-slot flag of active targets missing from the
+     *             tree (resized to n when any exist, cleared otherwise)
+     * @return True if outside is non-empty
+     */
+    bool evaluate(const ForceTargets &targets, int n, std::vector<uint8_t> &outside);
+
+private:
+    std::vector<FmmCell> cells;    ///< Cells, root at index 0, children contiguous
+    std::vector<int> order;        ///< Slots of every leaf, leaf by leaf
+    std::vector<double> source_x, source_y;   ///< Source positions, leaf by leaf
+    std::vector<double> source_vx, source_vy; ///< Source velocities
+    std::vector<double> source_mass;          ///< Source masses
+    std::vector<double> source_radius;        ///< Source radii
+    std::vector<int> source_id;               ///< Source IDs
+    std::vector<double> multipoles; ///< 3 expansions (m, m·vx, m·vy) of terms each per cell
+    std::vector<double> locals;     ///< 3 expansions per cell, matching multipoles
+    std::vector<std::vector<int>> near; ///< Source leaves summed directly, per target leaf
+    std::vector<uint8_t> in_tree;   ///< Per-slot flag of targets found in the tree
+    std::vector<FmmTerm> m2m_terms; ///< Terms of the M2M translation at order p
+    std::vector<FmmTerm> m2l_terms; ///< Terms of the M2L translation at order p, by output
+    std::vector<int> m2l_ends;      ///< End of the M2L terms of each output coefficient
+    std::vector<FmmTerm> l2l_terms; ///< Terms of the L2L translation at order p
+    int p = 0;                      ///< Expansion order
+    int terms = 0;                  ///< Coefficients per expansion: (p + 1)(p + 2) / 2
+    double theta = 0.5;             ///< Well-separation parameter
+    const ForceTargets *targets = nullptr; ///< Targets of the running evaluation
+    int target_count = 0;                  ///< Target slots of the running evaluation
+    bool with_jerk = false;                ///< Jerks requested by the running evaluation
+
+    /**
+     * @brief Read order and theta from the config and reset the cell array
+     *
+     * @details Rebuilds the translation tables when the order changes.
+     *
+     * @param config Solver parameters (fmm_order, fmm_theta)
+     * @param node_count Cells to reserve
+     */
+    void configure(const SolverConfig &config, std::size_t node_count);
+
+    /**
+     * @brief Give a leaf its slots and append its sources to the source arrays
+     *
+     * @param cell Leaf cell
+     * @param store Particle store
+     * @param slots Slots of the leaf
+     * @param count Number of slots
+     * @param passive_mass Sources lighter than this are skipped
+     */
+    void appendLeaf(FmmCell &cell, const ParticleSet &store, const int *slots, int count,
+                    double passive_mass);
+
+    /// @brief Upward pass: multipoles of cell c and its subtree (P2M, M2M)
+    void upward(int c);
+
+    /// @brief Target counts and radii of cell c and its subtree, zeroing their locals
+    void prepareTargets(int c);
+
+    /// @brief Dual-tree traversal: contributions of source cell b to target cell a
+    void interact(int a, int b);
+
+    /// @brief Downward pass: push the locals of cell c to its subtree (L2L, L2P)
+    void downward(int c);
+
+    /// @brief Translate the multipoles of cell b into the locals of cell a
+    void multipoleToLocal(int a, int b);
+
+    /// @brief Evaluate the locals of leaf c and its near leaves' sources at its targets
+    void localToParticles(int c);
+};
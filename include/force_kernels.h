@@ -0,0 +1,151 @@
+/**
+ * @file force_kernels.h
+ * @brief Batched gravity kernels for one target against a block of sources
+ *
+ * The grouped tree walk (see computeForces) reduces every target's work to
+ * two contiguous lists: accepted cells and near-field source particles.
+ * These kernels evaluate one target against such a list several lanes at
+ * a time. The instruction set is chosen once at runtime from the CPU's
+ * features, so the library itself can be built for a generic target.
+ *
+ * With SolverConfig::mixed_precision, accepted cells are stored in float
+ * relative to the group's center and run through the float cell kernels,
+ * twice as many lanes per instruction; the near field stays in double.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "multipole.h"
+
+/**
+ * @struct KernelTarget
+ * @brief State of the particle the forces act on
+ */
+struct KernelTarget {
+    double x, y;   ///< Position
+    double vx, vy; ///< Velocity (used for the jerk only)
+    double radius; ///< Radius (softening)
+    int id;        ///< ID; sources with the same ID are masked out
+};
+
+/**
+ * @struct CellBlockOf
+ * @brief Contiguous accepted cells, reduced to their multipole moments
+ *
+ * @tparam Real Storage and arithmetic precision of the cell kernels
+ */
+template <class Real> struct CellBlockOf {
+    const Real *x, *y;             ///< Centers of mass
+    const Real *vx, *vy;           ///< Center-of-mass velocities
+    const Real *mass;              ///< Total masses
+    const Real *qxx, *qxy, *qyy;   ///< Quadrupoles (quadrupoles kernel only)
+    int count;                     ///< Number of cells
+};
+
+/// @brief Cells in double precision and absolute coordinates
+using CellBlock = CellBlockOf<double>;
+
+/**
+ * @brief Cells in single precision (mixed precision)
+ *
+ * @details Centers of mass are relative to an origin near the targets,
+ * and the target passed with them must be relative to the same origin, so
+ * float only has to resolve the separation. Velocities are absolute.
+ */
+using CellBlockF = CellBlockOf<float>;
+
+/**
+ * @struct SourceBlock
+ * @brief Contiguous source particles in structure-of-arrays form
+ */
+struct SourceBlock {
+    const double *x, *y;   ///< Positions
+    const double *vx, *vy; ///< Velocities
+    const double *mass;    ///< Masses
+    const double *radius;  ///< Radii
+    const int *id;         ///< IDs
+    int count;             ///< Number of sources
+};
+
+/**
+ * @struct ForceSum
+ * @brief Accumulated acceleration, jerk and potential of one target
+ */
+struct ForceSum {
+    double ax = 0, ay = 0; ///< Acceleration
+    double jx = 0, jy = 0; ///< Jerk (left at zero when not requested)
+    double pot = 0;        ///< Potential per unit mass (left at zero when not requested)
+};
+
+/**
+ * @struct ForceKernels
+ * @brief One implementation of the cell and particle kernels
+ *
+ * @details All kernels add to sum and match the scalar formulas:
+ * - cells: a = -G*M*r/d³ and j = -G*M*[v/d³ - 3(r·v)r/d⁵] with
+ *   d = max(|r|, 2*radius) and v relative to the cell's center-of-mass
+ *   velocity
+ * - quadrupoles: cells plus the quadrupole terms of cellInteraction()
+ * - particles: a = -G*m*r/r_s³ and j = -G*m*[v/r_s³ - 3(r·v)r/r_s⁵] with
+ *   r_s = max(|r|, radius_i + radius_j)
+ *
+ * With with_potential they also add the potential, -G*M/d for cells plus
+ * cellPotential()'s quadrupole term and -G*m/r_s for particles. It is
+ * the acceleration magnitude times the squared distance the kernels
+ * already have, one multiply-add per interaction.
+ *
+ * The *_mixed kernels take float cells (CellBlockF) and compute and
+ * accumulate in float, adding the totals to sum in double.
+ *
+ * The vector kernels compute 1/r_s from a hardware reciprocal square root
+ * estimate refined by Newton iterations, soften by taking the maximum of
+ * the squared distances, and mask out same-ID sources and the lanes past
+ * the end of the block rather than branching. The scalar cell kernels
+ * are cellInteraction() in an OpenMP simd loop.
+ */
+struct ForceKernels {
+    const char *name; ///< Instruction set name ("scalar", "avx2", "avx512", "neon")
+
+    /// @brief Far-field interaction with a block of cells (monopoles)
+    void (*cells)(const KernelTarget &, const CellBlock &, bool with_jerk, bool with_potential,
+                  ForceSum &);
+
+    /// @brief Far-field interaction with a block of cells (monopoles and quadrupoles)
+    void (*quadrupoles)(const KernelTarget &, const CellBlock &, bool with_jerk,
+                        bool with_potential, ForceSum &);
+
+    /// @brief Near-field interaction with a block of source particles
+    void (*particles)(const KernelTarget &, const SourceBlock &, bool with_jerk,
+                      bool with_potential, ForceSum &);
+
+    /// @brief Far-field monopoles in single precision (target relative to the cells' origin)
+    void (*cells_mixed)(const KernelTarget &, const CellBlockF &, bool with_jerk,
+                        bool with_potential, ForceSum &);
+
+    /// @brief Far-field monopoles and quadrupoles in single precision
+    void (*quadrupoles_mixed)(const KernelTarget &, const CellBlockF &, bool with_jerk,
+                              bool with_potential, ForceSum &);
+};
+
+/**
+ * @brief Kernels in use
+ *
+ * @details On first use, picks the widest instruction set the CPU supports
+ * (AVX-512F, then AVX2 with FMA on x86; NEON on AArch64), falling back to
+ * the scalar kernels.
+ *
+ * @return Selected kernels
+ */
+const ForceKernels &forceKernels();
+
+/**
+ * @brief Override the kernel selection
+ *
+ * @param name "auto", "scalar", "avx2", "avx512" or "neon"
+ * @return False if the kernels are unknown or not supported by this CPU
+ *         (the selection is then unchanged)
+ *
+ * @note Not thread-safe; call before any force calculation
+ */
+bool setForceKernels(const char *name);
@@ -0,0 +1,253 @@
+/**
+ * @file force_solver.h
+ * @brief Force solver interface used by the integrators
+ *
+ * An integrator only needs four operations from the gravity solver:
+ * accelerations, accelerations with jerks, a cheap refresh after the
+ * particles moved (refit) and a full rebuild. The ForceSolver concept
+ * names them, and every integrator is a template over it, so each
+ * integrator/solver combination is compiled as its own specialization
+ * with the solver calls inlined.
+ *
+ * Solvers:
+ * - TreeSolver: Barnes-Hut walk over a QuadTree or LinearQuadTree
+ * - DirectSolver: O(N²) direct summation over a particle store
+ * - FmmSolver: fast multipole method on the hierarchy of either tree
+ * - DeviceSolver: direct summation on an offload device (NBODY_OFFLOAD
+ *   builds, device_solver.h)
+ * - DistributedSolver: Barnes-Hut over the particles of every MPI rank
+ *   (NBODY_MPI builds, distributed_solver.h)
+ */
+
+#pragma once
+
+#include "global.h"
+#include "barneshut.h"
+#include "direct_sum.h"
+#include "fmm.h"
+#ifdef NBODY_OFFLOAD
+#include "device_solver.h"
+#endif
+#ifdef NBODY_MPI
+#include "distributed_solver.h"
+#endif
+#include "particle_set.h"
+#include <concepts>
+
+/// @brief FmmSolver walks the tree when fewer than 1 in this many targets are active
+#define FMM_SPARSE_RATIO 2
+
+/**
+ * @concept ForceSolver
+ * @brief Gravity solver the integrators can be instantiated with
+ *
+ * @details Requirements:
+ * - accelerations(particles): write ax, ay of every particle from the
+ *   current positions (the jerk is neither computed nor written)
+ * - accelerationsAndJerks(particles): write ax, ay, jx, jy
+ * - forces(targets, n): general evaluation with the computeForces()
+ *   contract (custom target positions, optional jerk, active mask)
+ * - refit(): refresh after the sources moved without changing mass
+ * - rebuild(): rebuild all solver state from the particle store
+ *
+ * Sources are always the particle store the solver was created for,
+ * read at its current positions after the last refit() or rebuild().
+ */
+template <class S>
+concept ForceSolver = requires(S &solver, ParticleSet &particles, const ForceTargets &targets,
+                               int n) {
+    solver.accelerations(particles);
+    solver.accelerationsAndJerks(particles);
+    solver.forces(targets, n);
+    solver.refit();
+    solver.rebuild();
+};
+
+/**
+ * @class TreeSolver
+ * @brief Barnes-Hut forces from a tree (see computeForces())
+ *
+ * @tparam Tree QuadTree<ParticleSet> or LinearQuadTree<ParticleSet>
+ */
+template <class Tree> class TreeSolver
+{
+public:
+    /**
+     * @brief Solve with a tree at a fixed opening angle
+     *
+     * @param _tree Tree over the particle store (not owned)
+     * @param _theta Opening angle
+     */
+    TreeSolver(Tree *_tree, double _theta) : tree(_tree), theta(_theta) {}
+
+    /// @brief Accelerations of every particle
+    void accelerations(ParticleSet &particles) {
+        forces(storeTargets(particles, false), static_cast<int>(particles.size()));
+    }
+
+    /// @brief Accelerations and jerks of every particle
+    void accelerationsAndJerks(ParticleSet &particles) {
+        forces(storeTargets(particles, true), static_cast<int>(particles.size()));
+    }
+
+    /// @brief Forces on arbitrary targets (computeForces() contract)
+    void forces(const ForceTargets &targets, int n) { computeForces(tree, targets, n, theta); }
+
+    /// @brief Refresh the tree moments from the current positions
+    void refit() { tree->refit(); }
+
+    /// @brief Rebuild the tree and its moments from the particle store
+    void rebuild() { tree->rebuild(); }
+
+    /// @brief Tree being walked
+    Tree *getTree() const { return tree; }
+
+private:
+    Tree *tree;   ///< Tree over the particle store
+    double theta; ///< Opening angle
+};
+
+/**
+ * @class DirectSolver
+ * @brief Direct-summation forces over every source (see directForces())
+ *
+ * @details Holds no derived state, so refit() and rebuild() are free
+ * and every evaluation reads the current positions of the store.
+ */
+class DirectSolver
+{
+public:
+    /**
+     * @brief Solve by direct summation over a particle store
+     *
+     * @param _sources Particle store holding the sources (not owned)
+     * @param _passive_mass Sources lighter than this are skipped
+     */
+    DirectSolver(const ParticleSet *_sources, double _passive_mass)
+        : sources(_sources), passive_mass(_passive_mass) {}
+
+    /// @brief Accelerations of every particle
+    void accelerations(ParticleSet &particles) {
+        forces(storeTargets(particles, false), static_cast<int>(particles.size()));
+    }
+
+    /// @brief Accelerations and jerks of every particle
+    void accelerationsAndJerks(ParticleSet &particles) {
+        forces(storeTargets(particles, true), static_cast<int>(particles.size()));
+    }
+
+    /// @brief Forces on arbitrary targets (directForces() contract)
+    void forces(const ForceTargets &targets, int n) {
+        directForces(*sources, targets, n, passive_mass);
+    }
+
+    /// @brief Nothing to refresh
+    void refit() {}
+
+    /// @brief Nothing to rebuild
+    void rebuild() {}
+
+private:
+    const ParticleSet *sources; ///< Particle store holding the sources
+    double passive_mass;        ///< Sources lighter than this are skipped
+};
+
+/**
+ * @class FmmSolver
+ * @brief Fast multipole forces over the hierarchy of a tree (see fmm.h)
+ *
+ * @details Expansion order and well-separation parameter come from the
+ * tree's SolverConfig. The expansions are rebuilt on the first evaluation
+ * after a refit() or rebuild(). Like computeForces(), the solver falls
+ * back to direct summation when at most direct_sum_max sources remain,
+ * and evaluates active targets that are not in the tree with the
+ * Barnes-Hut walk.
+ *
+ * A translation costs far more than a Barnes-Hut cell interaction and
+ * only pays off when its cell holds many targets, so evaluations with
+ * fewer than 1 in FMM_SPARSE_RATIO targets active (the small levels of
+ * block timesteps) use the Barnes-Hut walk at SolverConfig::theta.
+ *
+ * @tparam Tree QuadTree<ParticleSet> or LinearQuadTree<ParticleSet>
+ */
+template <class Tree> class FmmSolver
+{
+public:
+    /**
+     * @brief Solve with the fast multipole method on a tree's hierarchy
+     *
+     * @param _tree Tree over the particle store (not owned), with current moments
+     */
+    explicit FmmSolver(Tree *_tree) : tree(_tree) {}
+
+    /// @brief Accelerations of every particle
+    void accelerations(ParticleSet &particles) {
+        forces(storeTargets(particles, false), static_cast<int>(particles.size()));
+    }
+
+    /// @brief Accelerations and jerks of every particle
+    void accelerationsAndJerks(ParticleSet &particles) {
+        forces(storeTargets(particles, true), static_cast<int>(particles.size()));
+    }
+
+    /// @brief Forces on arbitrary targets (computeForces() contract)
+    void forces(const ForceTargets &targets, int n) {
+        const SolverConfig &config = *tree->config;
+        if (targets.active) {
+            long active = 0;
+#pragma omp parallel for reduction(+ : active) schedule(static, CHUNK_SIZE)
+            for (int i = 0; i < n; i++)
+                active += targets.active[i] != 0;
+            if (active * FMM_SPARSE_RATIO < n) {
+                computeForces(tree, targets, n, config.theta);
+                return;
+            }
+        }
+        if (stale) {
+            fmm.build(*tree);
+            stale = false;
+        }
+        if (fmm.sourceCount() <= config.direct_sum_max) {
+            computeForces(tree, targets, n, config.theta);
+            return;
+        }
+        if (fmm.evaluate(targets, n, outside)) {
+            ForceTargets rest = targets;
+            rest.active = outside.data();
+            computeForces(tree, rest, n, config.theta);
+        }
+    }
+
+    /// @brief Refresh the tree moments and the expansions from the current positions
+    void refit() {
+        tree->refit();
+        stale = true;
+    }
+
+    /// @brief Rebuild the tree and the expansions from the particle store
+    void rebuild() {
+        tree->rebuild();
+        stale = true;
+    }
+
+    /// @brief Tree whose hierarchy is used
+    Tree *getTree() const { return tree; }
+
+private:
+    Tree *tree;                   ///< Tree over the particle store
+    FastMultipole fmm;            ///< Expansions over the tree's hierarchy
+    std::vector<uint8_t> outside; ///< Active targets missing from the tree
+    bool stale = true;            ///< Expansions need a rebuild before the next evaluation
+};
+
+static_assert(ForceSolver<TreeSolver<QuadTree<ParticleSet>>>);
+static_assert(ForceSolver<TreeSolver<LinearQuadTree<ParticleSet>>>);
+static_assert(ForceSolver<DirectSolver>);
+static_assert(ForceSolver<FmmSolver<QuadTree<ParticleSet>>>);
+static_assert(ForceSolver<FmmSolver<LinearQuadTree<ParticleSet>>>);
+#ifdef NBODY_OFFLOAD
+static_assert(ForceSolver<DeviceSolver>);
+#endif
+#ifdef NBODY_MPI
+static_assert(ForceSolver<DistributedSolver>);
+#endif
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <cstdlib>
+#include <cstdint>
 #include <cstdio>
 #include <cmath>
 #include <vector>
@@ -13,7 +14,9 @@
 #include <memory>
 #include <iostream>
 #include <algorithm>
+#include <numeric>
 #include <unordered_set>
+#include <tuple>
 #include <omp.h>
 
 /// @brief OpenMP chunk size for parallel loops
@@ -33,9 +36,10 @@ const double ALPHA = 0.5;
  * @brief Available integrator types
  */
 enum transport_type {
-    RK2,     ///< 2nd order Runge-Kutta (midpoint method)
-    YOSHIDA, ///< 4th order symplectic Yoshida integrator
-    HERMITE  ///< 4th order Hermite predictor-corrector
+    RK2,          ///< 2nd order Runge-Kutta (midpoint method)
+    YOSHIDA,      ///< 4th order symplectic Yoshida integrator
+    HERMITE,      ///< 4th order Hermite predictor-corrector
+    BLOCK_HERMITE ///< Hermite with individual power-of-two block timesteps
 };
 
 /// @brief Global integrator selection
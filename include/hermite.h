@@ -13,8 +13,11 @@
 #pragma once
 
 #include "global.h"
-#include "particle.h"
+#include "force_solver.h"
+#include "particle_set.h"
 #include "quadtree.h"
+#include "linear_quadtree.h"
+#include "solver_config.h"
 
 /**
  * @brief Performs one timestep using the Hermite 4th order predictor-corrector method
@@ -31,16 +34,52 @@
  *    - v_new = v_old + (a0 + a1)*dt/2 + (jerk0 - jerk1)*dt²/12
  *    - x_new = x_old + (v_old + v_new)*dt/2 + (a0 - a1)*dt²/12
  *
- * @param particles Vector of particles to integrate
- * @param tree QuadTree for Barnes-Hut force calculation
+ * @tparam Solver ForceSolver over the particle store
+ *
+ * @param particles Particle store to integrate
+ * @param solver Force solver (accelerations and jerks, refitted to the prediction)
  * @param dt Timestep size
  *
  * @note Requires particles to have jerk field initialized
  * @note More accurate than Yoshida-4 for same timestep, with ~2x force evaluations
  * @note Non-symplectic but excellent energy conservation in practice
  */
-void hermiteStep(std::vector<std::shared_ptr<Particle>> &particles,
-                 QuadTree<Particle> *tree, double dt);
+template <ForceSolver Solver> void hermiteStep(ParticleSet &particles, Solver &solver, double dt);
+
+/**
+ * @brief Advances all particles by dt with individual block timesteps
+ *
+ * @details Aarseth-style hierarchical timesteps: particle i takes steps of
+ * dt/2^level[i], so all particles are synchronized again at t+dt. The run
+ * of dt is divided into block times where at least one particle's step
+ * ends; at each block time:
+ *
+ * 1. Every particle is predicted to the block time from its last corrected
+ *    state, and the tree is refitted to the predicted positions
+ * 2. Forces and jerks are evaluated for the active particles only (those
+ *    whose step ends there)
+ * 3. The active particles are corrected with the Hermite corrector over
+ *    their own step and get a new level from the criterion
+ *    dt_i <= SolverConfig::timestep_eta * |a| / |jerk|
+ *
+ * A level may rise (shorter step) at any block time, but only falls by one
+ * level at a time and when the block time is a multiple of the longer step,
+ * so that steps stay commensurate. Particles with no force history yet
+ * (zero acceleration and jerk) are evaluated first to pick their level.
+ *
+ * @tparam Solver ForceSolver over the particle store
+ *
+ * @param particles Particle store to integrate (reads and writes level)
+ * @param solver Force solver (masked evaluations, refitted at every block time)
+ * @param dt Synchronization step (the longest individual step)
+ * @param config Solver parameters (timestep_eta, max_block_level)
+ *
+ * @note Force evaluations scale with the number of active particles, so the
+ *       cost per unit time follows the distribution of levels rather than
+ *       the shortest step
+ */
+template <ForceSolver Solver>
+void blockHermiteStep(ParticleSet &particles, Solver &solver, double dt, const SolverConfig &config);
 
 /**
  * @brief Calculates both acceleration and jerk (time derivative of acceleration) for all particles
@@ -52,12 +91,15 @@ void hermiteStep(std::vector<std::shared_ptr<Particle>> &particles,
  *
  * where r is position difference and v is velocity difference.
  *
- * @param particles Vector of particles
- * @param tree QuadTree for hierarchical force calculation
+ * @tparam Tree QuadTree<ParticleSet> or LinearQuadTree<ParticleSet>
+ *
+ * @param particles Particle store (writes ax, ay, jx, jy)
+ * @param tree Tree for hierarchical force calculation
+ * @param config Solver parameters (opening angle)
  *
  * @note This function zeros acceleration and jerk before calculation
  * @note Parallelized with OpenMP
  */
-void getAccelerationAndJerk(std::vector<std::shared_ptr<Particle>> &particles,
-                           QuadTree<Particle> *tree);
+template <class Tree>
+void getAccelerationAndJerk(ParticleSet &particles, Tree *tree, const SolverConfig &config);
 
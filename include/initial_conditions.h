@@ -0,0 +1,146 @@
+/**
+ * @file initial_conditions.h
+ * @brief Initial conditions shared by the viewer and headless drivers
+ */
+
+#pragma once
+
+#include "global.h"
+#include "simulation.h"
+
+#define PRIMARY_PARTICLE true       ///< Particle rendered as colored circle
+#define NOT_PRIMARY_PARTICLE false  ///< Particle rendered as point
+
+/**
+ * @struct KeplerDisk
+ * @brief Particles on circular orbits around a central mass at the origin
+ *
+ * @details Orbit radii are uniform in [r_min, r_max] and phases uniform,
+ * matching the debris disk of createPlanetarySystem.
+ */
+struct KeplerDisk {
+    int count = 0;              ///< Number of particles
+    double central_mass = 1;    ///< Mass the orbits are computed for
+    double r_min = 0.25;        ///< Inner orbit radius
+    double r_max = 4.25;        ///< Outer orbit radius
+    double mass = 1e-8;         ///< Mass of each particle
+    double radius = 1e-8;       ///< Collision radius of each particle
+    bool passive = true;        ///< Flag the particles passive (test particles)
+    bool primary = false;       ///< Flag the particles primary
+};
+
+/**
+ * @struct PlummerSphere
+ * @brief Plummer model in virial equilibrium, projected onto the plane
+ *
+ * @details Radii follow the Plummer cumulative mass profile and speeds the
+ * Plummer distribution function (Aarseth, Henon & Wielen 1974); positions
+ * and velocities are isotropic in 3D and projected onto the x-y plane.
+ */
+struct PlummerSphere {
+    int count = 0;           ///< Number of particles
+    double total_mass = 1;   ///< Mass of the whole cluster (shared equally)
+    double scale = 1;        ///< Plummer scale radius
+    double cutoff = 10;      ///< Largest radius, in scale radii
+    double radius = 1e-4;    ///< Collision radius of each particle
+};
+
+/**
+ * @struct UniformBox
+ * @brief Particles uniform in a rectangle with uniform random velocities
+ */
+struct UniformBox {
+    int count = 0;           ///< Number of particles
+    double xmin = -1;        ///< Left edge
+    double ymin = -1;        ///< Bottom edge
+    double width = 2;        ///< Width of the box
+    double height = 2;       ///< Height of the box
+    double speed = 0;        ///< Velocity components uniform in [-speed, speed]
+    double mass = 1e-3;      ///< Mass of each particle
+    double radius = 1e-4;    ///< Collision radius of each particle
+    bool passive = false;    ///< Flag the particles passive (test particles)
+};
+
+/**
+ * @name Parallel generators
+ * @brief Append generated particles straight into a particle store
+ *
+ * @details The particles are written in parallel into newly sized slots.
+ * Random numbers come from a counter-based generator (CounterRNG) keyed by
+ * the seed and indexed by particle ID, so the output depends only on the
+ * seed and the IDs, never on the thread count. New IDs continue after the
+ * largest ID already in the store.
+ *
+ * Call Simulation::rebuildTree() once after the last generator or loader.
+ *
+ * @return Slot index of the first new particle
+ * @{
+ */
+int generateKeplerDisk(ParticleSet &particles, const KeplerDisk &disk, uint64_t seed);
+int generatePlummerSphere(ParticleSet &particles, const PlummerSphere &cluster, uint64_t seed);
+int generateUniformBox(ParticleSet &particles, const UniformBox &box, uint64_t seed);
+/// @}
+
+/**
+ * @brief Populate a simulation with a star, planets and a debris disk
+ *
+ * @details System setup:
+ * - 1 central star (mass = 1.0)
+ * - 5 planets in circular Keplerian orbits (0.5-6 units radius)
+ * - n_debris nearly massless test particles in a KeplerDisk (0.25-4.25
+ *   units radius), flagged passive so they feel but do not exert gravity
+ *
+ * The same seed gives the same system for any thread count.
+ *
+ * @param sim Simulation to add particles to (the tree is rebuilt)
+ * @param n_debris Number of debris particles
+ * @param seed Random seed
+ */
+void createPlanetarySystem(Simulation &sim, int n_debris, uint64_t seed);
+
+/**
+ * @brief Append particles from a CSV file
+ *
+ * @details The first non-comment line names the columns. x, y, vx, vy and
+ * mass are required; radius (default 0), id (default: continue after the
+ * largest ID in the store), primary and passive (0/1, default 0) are
+ * optional, and other columns are ignored. Lines starting with '#' are
+ * comments. Rows are parsed in parallel straight into the store.
+ *
+ * @param path CSV file
+ * @param[out] particles Store to append to
+ * @return False if the file cannot be read or a row is malformed (reported
+ *         on stderr; the store is then left unchanged)
+ */
+bool loadParticlesCSV(const char *path, ParticleSet &particles);
+
+/**
+ * @brief Load initial conditions from a CSV or snapshot file
+ *
+ * @details Snapshots (snapshot.h) are recognized by their magic and only
+ * their particles are used; anything else is read as CSV. The tree is
+ * rebuilt once after loading.
+ *
+ * @param sim Simulation to add the particles to
+ * @param path Input file
+ * @return False if the file cannot be loaded (reported on stderr)
+ */
+bool loadInitialConditions(Simulation &sim, const char *path);
+
+/**
+ * @brief Set up initial conditions by name or from a file
+ *
+ * @details The --ic option of the drivers:
+ * - planetary: createPlanetarySystem with count debris particles
+ * - disk: a unit-mass star and a KeplerDisk of count particles
+ * - plummer: a PlummerSphere of count particles
+ * - box: a UniformBox of count particles with total mass 1
+ * - anything else: a file for loadInitialConditions
+ *
+ * @param sim Simulation to add particles to (the tree is rebuilt)
+ * @param ic Name or file
+ * @param count Number of particles
+ * @param seed Generator seed
+ * @return False if the file cannot be loaded (reported on stderr)
+ */
+bool createInitialConditions(Simulation &sim, const char *ic, int count, uint64_t seed);
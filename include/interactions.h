@@ -6,58 +6,132 @@
 #pragma once
 
 #include "global.h"
+#include "RK2.h"
+#include "diagnostics.h"
+#include "force_solver.h"
+#include "hermite.h"
+#include "yoshida.h"
 #include "quadtree.h"
+#include "linear_quadtree.h"
 #include "particle.h"
+#include "particle_set.h"
+#include "solver_config.h"
+
+/**
+ * @brief Perform one integration timestep with an integrator fixed at compile time
+ *
+ * @details Each (Type, Solver) pair is its own specialization, so the
+ * integrator is compiled with the solver's calls inlined and without a
+ * runtime branch on the integrator.
+ *
+ * @tparam Type Integrator
+ * @tparam Solver ForceSolver over the particle store
+ *
+ * @param particles Particle store
+ * @param solver Force solver
+ * @param dt Timestep size
+ * @param config Solver parameters (block timestep criterion)
+ */
+template <transport_type Type, ForceSolver Solver>
+void integrate(ParticleSet &particles, Solver &solver, double dt, const SolverConfig &config) {
+    if constexpr (Type == YOSHIDA)
+        yoshidaStep(particles, solver, dt);
+    else if constexpr (Type == RK2)
+        RK2step(particles, solver, dt);
+    else if constexpr (Type == HERMITE)
+        hermiteStep(particles, solver, dt);
+    else
+        blockHermiteStep(particles, solver, dt, config);
+}
 
 /**
  * @brief Perform one integration timestep using selected integrator
  *
- * @details Dispatches to the appropriate integrator based on TRANSPORT_TYPE:
+ * @details Dispatches once per step on TRANSPORT_TYPE to integrate():
  * - YOSHIDA: 4th order symplectic integrator
  * - RK2: 2nd order Runge-Kutta
  * - HERMITE: 4th order Hermite predictor-corrector
+ * - BLOCK_HERMITE: Hermite with individual block timesteps
+ *
+ * @tparam Solver ForceSolver over the particle store
  *
- * @param particles Particle vector
- * @param tree QuadTree for force calculation
+ * @param particles Particle store
+ * @param solver Force solver
  * @param dt Timestep size
+ * @param config Solver parameters (block timestep criterion)
  */
-void transportStep(std::vector<std::shared_ptr<Particle>> &particles, QuadTree<Particle> *tree, double dt);
+template <ForceSolver Solver>
+void transportStep(ParticleSet &particles, Solver &solver, double dt, const SolverConfig &config);
 
 /**
  * @brief Main update function: integrate and handle collisions
  *
  * @details Performs one complete timestep:
- * 1. Integrate particle positions/velocities
+ * 1. Integrate particle positions/velocities with the solver of config.method
  * 2. Check and resolve collisions
- * 3. Recenter system to center of mass
+ * 3. Measure the conserved quantities and recenter the system to the
+ *    center of mass, in one reduction (measureDiagnostics())
+ *
+ * With with_potential the step also measures the potential energy. The
+ * Hermite integrators already end on a force evaluation at the end of the
+ * step (at the predicted positions), which then also writes the potential.
+ * Yoshida and RK2 do not, so they take one more evaluation on these steps.
+ * Potentials of particles merged by a collision are left from before the
+ * merge.
  *
- * @param particles Particle vector
- * @param tree QuadTree for force calculation
+ * @tparam Tree QuadTree<ParticleSet> or LinearQuadTree<ParticleSet>
+ *
+ * @param particles Particle store
+ * @param tree Tree for force calculation
  * @param dt Timestep size
+ * @param config Solver parameters (opening angle)
+ * @param with_potential Also measure the potential energy
+ * @return Conserved quantities after the step, before recentering
  */
-void updateParticles(std::vector<std::shared_ptr<Particle>> &, QuadTree<Particle> *, double);
+template <class Tree>
+Diagnostics updateParticles(ParticleSet &, Tree *, double, const SolverConfig &,
+                            bool with_potential);
 
 /**
  * @brief Detect and resolve particle collisions
  *
- * @details Uses quadtree spatial partitioning and continuous collision detection
- * to find colliding particles. Merges particles via perfectly inelastic collisions,
- * conserving momentum and mass.
+ * @details Candidate pairs come from a CollisionGrid built once per step over
+ * the tree bounds. Two phases:
+ * 1. Detect: continuous collision detection on every candidate pair in
+ *    parallel, reading the particles only and emitting CollisionEvents
+ * 2. Resolve: colliding particles are joined into connected components
+ *    (union-find) and each component is merged into its lowest-ID member
+ *    via a perfectly inelastic collision, conserving momentum and mass
  *
  * Features:
- * - Velocity-aware search radius
+ * - Velocity-aware search radius (cells sized to 2*radius + |v|*dt)
  * - Continuous collision detection (accounts for gravitational trajectories)
- * - Thread-safe with directional merging (ID-based)
- * - Removes merged particles from simulation
+ * - Results independent of thread count and scheduling
+ * - Removes merged particles from simulation (parallel compaction)
+ *
+ * @tparam Tree QuadTree<ParticleSet> or LinearQuadTree<ParticleSet>
  *
- * @param particles Particle vector (modified in-place)
- * @param tree QuadTree for spatial queries
+ * @param particles Particle store (compacted in-place)
+ * @param tree Tree giving the collision domain (remapped after compaction)
  * @param dt Timestep (for continuous collision detection)
  *
  * @note Parallelized with OpenMP
- * @note Uses race-condition prevention via ID ordering
  */
-void checkCollisions(std::vector<std::shared_ptr<Particle>> &, QuadTree<Particle> *, double dt);
+template <class Tree> void checkCollisions(ParticleSet &, Tree *, double dt);
+
+/**
+ * @brief Detect and resolve the collisions within a domain
+ *
+ * @details The work of checkCollisions() without a tree: candidates from a
+ * CollisionGrid over domain, continuous detection and merging, then
+ * compaction of the store.
+ *
+ * @param particles Particle store (compacted in-place)
+ * @param domain Region taking part in collisions
+ * @param dt Timestep (for continuous collision detection)
+ * @return Slot remap from ParticleSet::compact(), empty if nothing collided
+ */
+std::vector<int> collideParticles(ParticleSet &particles, const Bounds &domain, double dt);
 
 /**
  * @struct CollisionInfo
@@ -66,15 +140,29 @@ void checkCollisions(std::vector<std::shared_ptr<Particle>> &, QuadTree<Particle
 struct CollisionInfo {
     bool willCollide;       ///< True if particles will collide during timestep
     double collisionTime;   ///< Time within [0, dt] when collision occurs
-    double minDistance;     ///< Minimum separation distance during timestep
+    double minDistance;     ///< Minimum separation during timestep (lower bound if rejected early)
+};
+
+/**
+ * @struct CollisionEvent
+ * @brief A detected collision between two particle slots
+ */
+struct CollisionEvent {
+    int i;       ///< Slot of the lower-ID particle
+    int j;       ///< Slot of the higher-ID particle
+    double time; ///< Collision time within [0, dt]
 };
 
 /**
  * @brief Predict if and when two particles will collide
  *
  * @details Uses continuous collision detection with gravitational trajectory
- * approximation. Samples the quadratic trajectory (constant acceleration)
- * to find minimum approach distance and collision time.
+ * approximation. The squared separation along the quadratic trajectory
+ * (constant acceleration) is a quartic in t; its extrema on [0, dt] come
+ * from the roots of the cubic derivative, bracketed by the roots of the
+ * quadratic second derivative, and the collision time is the first root of
+ * the quartic minus R². Pairs that cannot close the gap on either axis are
+ * rejected before any root finding.
  *
  * Trajectory model: r(t) = r₀ + v₀*t + ½*a*t²
  *
@@ -85,6 +173,7 @@ struct CollisionInfo {
  *
  * @note Uses constant acceleration approximation
  * @note Includes gravitational effects in trajectory
- * @note Samples trajectory at multiple points for accuracy
+ * @note Exact for the trajectory model, so grazing approaches between
+ *       the old sample times are no longer missed
  */
 CollisionInfo predictCollision(const Particle *p1, const Particle *p2, double dt);
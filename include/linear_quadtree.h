@@ -0,0 +1,392 @@
+/**
+ * @file linear_quadtree.h
+ * @brief Pointer-free quadtree rebuilt from Morton-sorted particles
+ *
+ * Alternative to QuadTree for runs where a full rebuild each step is
+ * cheaper than incremental updates. Particles are sorted by Morton key,
+ * which makes every cell's particles one contiguous range, and the tree
+ * is a flat node array.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "bounds.h"
+#include "morton.h"
+#include "multipole.h"
+#include "quadtree.h"
+
+/// @brief Node stack size for walking a LinearQuadTree (depth is at most MORTON_MAX_LEVELS + 1)
+#define LINEAR_TREE_STACK (4 * (MORTON_MAX_LEVELS + 1) + 4)
+
+/**
+ * @struct LinearNode
+ * @brief One cell of a LinearQuadTree
+ *
+ * @details The four children of a divided node occupy consecutive slots
+ * starting at firstChild, in Morton order [SW, SE, NW, NE]. Every node's
+ * particles are the range [first, first + count) of LinearQuadTree::order.
+ */
+struct LinearNode {
+    Bounds bounds;         ///< Spatial region covered by this node
+    Bounds extent;         ///< Bounds grown to cover the particles (see refit)
+    vector2D centerOfMass; ///< Center of mass of all particles in subtree
+    vector2D comVelocity;  ///< Velocity of the center of mass
+    Quadrupole quadrupole; ///< Quadrupole about the center of mass (SolverConfig::quadrupole)
+    double totalMass;      ///< Total mass of all particles in subtree
+    double thetaScale;     ///< Theta scaling factor: (M_ref/M)^alpha
+    int firstChild;        ///< Index of first child node (-1 for leaf)
+    int first;             ///< First position in LinearQuadTree::order
+    int count;             ///< Number of particles in subtree
+    int depth;             ///< Depth in tree (root = 1)
+};
+
+/**
+ * @class LinearQuadTree
+ * @brief Flat quadtree built from Morton-sorted particle indices
+ *
+ * @tparam T Particle store (structure of arrays with x, y, vx, vy and mass
+ *           arrays and isSource(), e.g. ParticleSet)
+ *
+ * @details build() computes a Morton key per particle, sorts the slot
+ * indices with a parallel radix sort and then splits key ranges top-down
+ * into nodes. Cells are split with the same rules as QuadTree (more than
+ * SolverConfig::leaf_capacity particles and depth below
+ * SolverConfig::max_depth), so both trees give the same cells for the
+ * same particles. The depth is further limited by the Morton key length.
+ *
+ * There are no parent or child pointers: the node array is stored level
+ * by level, children after their parent, so calculateCOM() is a bottom-up
+ * sweep over the levels. Key generation, sorting, splitting and the
+ * moments of each level all run in parallel.
+ *
+ * @note Particles outside the root bounds are left out, as in QuadTree::insert
+ */
+template <class T> class LinearQuadTree {
+  public:
+    Bounds bounds;                 ///< Spatial region covered by the root
+    std::vector<LinearNode> nodes; ///< Node array (root at index 0)
+    std::vector<int> order;        ///< Particle slot indices sorted by Morton key
+    std::vector<uint64_t> keys;    ///< Morton keys matching order
+    const T *store;                ///< Particle store the indices refer to
+    const SolverConfig *config;    ///< Tree shape and theta scaling parameters
+
+    /**
+     * @brief Construct an empty LinearQuadTree
+     *
+     * @param xmin Left edge of region
+     * @param ymin Bottom edge of region
+     * @param width Width of region
+     * @param height Height of region
+     * @param _store Particle store the tree indexes
+     * @param _config Solver parameters (must outlive the tree)
+     */
+    LinearQuadTree(double xmin, double ymin, double width, double height, const T *_store,
+                   const SolverConfig *_config) {
+        bounds.set_bounds(xmin, ymin, width, height);
+        store = _store;
+        config = _config;
+    }
+
+    /**
+     * @brief Rebuild the tree from the current particle positions
+     *
+     * @details
+     * 1. Morton key for every particle, in parallel
+     * 2. Parallel radix sort of (key, slot) pairs
+     * 3. Level-by-level split of key ranges into nodes: every node of a
+     *    level is split in parallel, with children slots assigned by a
+     *    prefix sum so siblings stay contiguous
+     *
+     * @note Call calculateCOM() afterwards before force calculation
+     */
+    void build() {
+        const int levels = keyLevels();
+        const int n = static_cast<int>(store->x.size());
+        const uint64_t outside_bit = 1ULL << (2 * levels);
+
+        // Keys for every particle; particles outside the domain get an extra
+        // high bit so they sort to the end and can be cut off
+        keys.resize(n);
+        order.resize(n);
+        int inside = 0;
+#pragma omp parallel for schedule(static, CHUNK_SIZE) reduction(+ : inside)
+        for (int i = 0; i < n; i++) {
+            order[i] = i;
+            if (bounds.contains({store->x[i], store->y[i]})) {
+                keys[i] = mortonKey(store->x[i], store->y[i], bounds, levels);
+                inside++;
+            } else {
+                keys[i] = outside_bit;
+            }
+        }
+        radixSortByKey(keys, order, 2 * levels + 1);
+        keys.resize(inside);
+        order.resize(inside);
+
+        // Split key ranges level by level; children are appended after
+        // their parent's level, so the node array is in breadth-first order
+        nodes.clear();
+        level_offsets.clear();
+        nodes.push_back(makeNode(bounds, 0, inside, 1));
+        int level_begin = 0;
+        int level_end = 1;
+        std::vector<int> child_offset;
+
+        while (level_begin < level_end) {
+            level_offsets.push_back(level_begin);
+            const int width = level_end - level_begin;
+            child_offset.assign(width + 1, 0);
+            for (int k = 0; k < width; k++) {
+                child_offset[k + 1] = child_offset[k] + (needsSplit(nodes[level_begin + k]) ? 4 : 0);
+            }
+            nodes.resize(level_end + child_offset[width]);
+
+#pragma omp parallel for schedule(dynamic, 64)
+            for (int k = 0; k < width; k++) {
+                if (child_offset[k + 1] != child_offset[k])
+                    split(level_begin + k, level_end + child_offset[k], levels);
+            }
+
+            level_begin = level_end;
+            level_end = static_cast<int>(nodes.size());
+        }
+        level_offsets.push_back(level_end);
+    }
+
+    /**
+     * @brief Calculate center of mass and total mass for every node
+     *
+     * @details Sweeps the levels from the deepest up, so children are
+     * always done before their parent; the nodes of one level are
+     * independent and computed in parallel:
+     * - For internal nodes: weighted average of children's COM
+     * - For leaf nodes: weighted average of particles
+     * - Also computes theta scale factor: (M_ref/M)^alpha
+     */
+    void calculateCOM() { sweepMoments(true); }
+
+    /// @brief Rebuild the tree from every particle of the store (build() and calculateCOM())
+    void rebuild() {
+        build();
+        calculateCOM();
+    }
+
+    /**
+     * @brief Refresh centers of mass and extents from current positions
+     *
+     * @details Cheap update for integrator sub-stages, same contract as
+     * QuadTree::refit(): the Morton order and node ranges from the last
+     * build() are kept, total masses and theta scale factors from the
+     * last calculateCOM() are reused, and each node's center of mass and
+     * extent are recomputed bottom-up.
+     *
+     * @note Masses must not have changed since the last calculateCOM()
+     */
+    void refit() { sweepMoments(false); }
+
+    /**
+     * @brief Find all particles within query region
+     *
+     * @param query_bounds Region to search
+     * @param[out] query_particles Vector to append slot indices to
+     *
+     * @note Does not clear query_particles - appends results
+     * @note Same contract as QuadTree::query
+     */
+    void query(Bounds query_bounds, std::vector<int> &query_particles) const {
+        if (nodes.empty())
+            return;
+        int stack[LINEAR_TREE_STACK];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const LinearNode &node = nodes[stack[--top]];
+            if (node.count == 0 || !node.bounds.intersects(query_bounds))
+                continue;
+            if (node.firstChild >= 0) {
+                for (int c = 0; c < 4; c++)
+                    stack[top++] = node.firstChild + c;
+            } else {
+                for (int i = node.first; i < node.first + node.count; i++) {
+                    int particle = order[i];
+                    if (query_bounds.contains({store->x[particle], store->y[particle]}))
+                        query_particles.emplace_back(particle);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Count the nodes and the deepest level
+     *
+     * @param[in,out] node_count Incremented by the number of nodes
+     * @param[in,out] max_depth Raised to the deepest node's depth
+     */
+    void countNodes(int &node_count, int &max_depth) const {
+        node_count += static_cast<int>(nodes.size());
+        // Nodes are stored level by level
+        if (!nodes.empty())
+            max_depth = std::max(max_depth, nodes.back().depth);
+    }
+
+    /**
+     * @brief Handle compaction of the particle store
+     *
+     * @details Slot indices shift when merged particles are removed, and
+     * the tree is cheap to rebuild, so the tree is simply rebuilt.
+     *
+     * @param remap Map from old to new slot index (unused)
+     *
+     * @note Moments must be recomputed with calculateCOM() afterwards
+     */
+    void remap(const std::vector<int> &) { build(); }
+
+  private:
+    std::vector<int> level_offsets; ///< First node of each level (plus one past the end)
+
+    /// @brief Bits per axis in the Morton keys: one per level below the root
+    int keyLevels() const {
+        return std::clamp(config->max_depth - 1, 0, MORTON_MAX_LEVELS);
+    }
+
+    /**
+     * @brief Create a node with no children and no moments
+     */
+    static LinearNode makeNode(const Bounds &b, int first, int count, int depth) {
+        LinearNode node;
+        node.bounds = b;
+        node.extent = b;
+        node.centerOfMass = {0, 0};
+        node.comVelocity = {0, 0};
+        node.quadrupole = Quadrupole();
+        node.totalMass = 0;
+        node.thetaScale = 0;
+        node.firstChild = -1;
+        node.first = first;
+        node.count = count;
+        node.depth = depth;
+        return node;
+    }
+
+    /// @brief True if a node holds too many particles and may be divided
+    bool needsSplit(const LinearNode &node) const {
+        return node.count > config->leaf_capacity && node.depth <= keyLevels();
+    }
+
+    /**
+     * @brief Bottom-up sweep over the levels, parallel within each level
+     * @param full Also recompute total masses and theta scale factors
+     */
+    void sweepMoments(bool full) {
+        for (int level = static_cast<int>(level_offsets.size()) - 2; level >= 0; level--) {
+#pragma omp parallel for schedule(dynamic, 64)
+            for (int k = level_offsets[level]; k < level_offsets[level + 1]; k++) {
+                computeMoments(nodes[k], full);
+            }
+        }
+    }
+
+    /**
+     * @brief Moments of one node from its children or its particles
+     *
+     * @details Center of mass and its velocity, and with
+     * SolverConfig::quadrupole the quadrupole about the new center of
+     * mass (children shifted by the parallel-axis rule, leaf particles in
+     * a second pass).
+     *
+     * @param node Node to update
+     * @param full Also recompute total mass and theta scale factor
+     */
+    void computeMoments(LinearNode &node, bool full) const {
+        double mass = 0, mx = 0, my = 0, mvx = 0, mvy = 0;
+        node.extent = node.bounds;
+        if (node.firstChild >= 0) {
+            for (int c = node.firstChild; c < node.firstChild + 4; c++) {
+                mass += nodes[c].totalMass;
+                mx += nodes[c].centerOfMass.x * nodes[c].totalMass;
+                my += nodes[c].centerOfMass.y * nodes[c].totalMass;
+                mvx += nodes[c].comVelocity.x * nodes[c].totalMass;
+                mvy += nodes[c].comVelocity.y * nodes[c].totalMass;
+                node.extent.expand(nodes[c].extent);
+            }
+        } else {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                int particle = order[i];
+                if (!store->isSource(particle, config->passive_mass))
+                    continue;
+                double m = store->mass[particle];
+                mass += m;
+                mx += store->x[particle] * m;
+                my += store->y[particle] * m;
+                mvx += store->vx[particle] * m;
+                mvy += store->vy[particle] * m;
+                node.extent.expand(vector2D(store->x[particle], store->y[particle]));
+            }
+        }
+        if (full) {
+            node.totalMass = mass;
+            node.thetaScale = std::pow(config->mass_ref / mass, config->alpha);
+        }
+        if (node.totalMass > 0) {
+            node.centerOfMass = vector2D(mx / node.totalMass, my / node.totalMass);
+            node.comVelocity = vector2D(mvx / node.totalMass, mvy / node.totalMass);
+        } else {
+            node.centerOfMass = {0, 0};
+            node.comVelocity = {0, 0};
+        }
+
+        if (!config->quadrupole)
+            return;
+        node.quadrupole = Quadrupole();
+        if (node.firstChild >= 0) {
+            for (int c = node.firstChild; c < node.firstChild + 4; c++) {
+                node.quadrupole.addShifted(nodes[c].quadrupole, nodes[c].totalMass,
+                                           nodes[c].centerOfMass.x - node.centerOfMass.x,
+                                           nodes[c].centerOfMass.y - node.centerOfMass.y);
+            }
+        } else {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                int particle = order[i];
+                if (!store->isSource(particle, config->passive_mass))
+                    continue;
+                node.quadrupole.addPoint(store->mass[particle],
+                                         store->x[particle] - node.centerOfMass.x,
+                                         store->y[particle] - node.centerOfMass.y);
+            }
+        }
+    }
+
+    /**
+     * @brief Split node k into its four Morton-order children
+     *
+     * @details The quadrant of every particle at this level is the pair
+     * of key bits below the node's prefix. Keys are sorted, so each child
+     * is found by binary search for the first key of the next quadrant.
+     *
+     * @param k Node index
+     * @param first_child Node index for the first of the four children
+     * @param levels Bits per axis in the keys
+     */
+    void split(int k, int first_child, int levels) {
+        const LinearNode parent = nodes[k];
+        const int shift = 2 * (levels - parent.depth);
+        const double half_w = parent.bounds.width / 2;
+        const double half_h = parent.bounds.height / 2;
+
+        auto begin = keys.begin() + parent.first;
+        auto end = begin + parent.count;
+        nodes[k].firstChild = first_child;
+
+        for (int q = 0; q < 4; q++) {
+            auto next = std::partition_point(
+                begin, end, [shift, q](uint64_t key) { return static_cast<int>((key >> shift) & 3) <= q; });
+            Bounds b;
+            b.set_bounds(parent.bounds.xmin + (q & 1) * half_w,
+                         parent.bounds.ymin + (q >> 1) * half_h, half_w, half_h);
+            nodes[first_child + q] = makeNode(b, static_cast<int>(begin - keys.begin()),
+                                              static_cast<int>(next - begin), parent.depth + 1);
+            begin = next;
+        }
+    }
+};
@@ -0,0 +1,114 @@
+/**
+ * @file morton.h
+ * @brief Morton (Z-order) keys and parallel radix sort
+ *
+ * Morton keys interleave the bits of quantized x and y coordinates, so
+ * sorting particles by key places every quadtree cell's particles in one
+ * contiguous range, at every level of the tree.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "bounds.h"
+
+/// @brief Maximum bits per axis in a Morton key (keys fit in 64 bits)
+#define MORTON_MAX_LEVELS 21
+
+/**
+ * @brief Spread the low 32 bits of v so there is a zero bit between each
+ *
+ * @param v Value to spread
+ * @return Bits of v at even positions
+ */
+inline constexpr uint64_t mortonSpread(uint64_t v) {
+    v &= 0x00000000ffffffffULL;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+    v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL;
+    v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | (v << 2)) & 0x3333333333333333ULL;
+    v = (v | (v << 1)) & 0x5555555555555555ULL;
+    return v;
+}
+
+/**
+ * @brief Morton key of a position within a domain
+ *
+ * @details The domain is divided into 2^levels cells per axis. The key of
+ * a point is its cell's (x, y) integer coordinates with bits interleaved,
+ * x in the even bits and y in the odd bits. Each pair of bits, from the
+ * most significant, selects the quadrant at the next tree level:
+ * 0 = SW, 1 = SE, 2 = NW, 3 = NE.
+ *
+ * @param x Position x
+ * @param y Position y
+ * @param domain Domain covered by the key space
+ * @param levels Bits per axis (at most MORTON_MAX_LEVELS)
+ * @return Morton key (positions outside the domain are clamped)
+ */
+inline uint64_t mortonKey(double x, double y, const Bounds &domain, int levels) {
+    const double cells = static_cast<double>(1ULL << levels);
+    const double max_cell = cells - 1;
+    double fx = std::clamp((x - domain.xmin) / domain.width * cells, 0.0, max_cell);
+    double fy = std::clamp((y - domain.ymin) / domain.height * cells, 0.0, max_cell);
+    return mortonSpread(static_cast<uint64_t>(fx)) | (mortonSpread(static_cast<uint64_t>(fy)) << 1);
+}
+
+/**
+ * @brief Parallel LSD radix sort of (key, value) pairs by key
+ *
+ * @details Stable least-significant-digit radix sort on 8-bit digits.
+ * Each pass builds per-thread histograms, turns them into per-thread
+ * scatter offsets and scatters in parallel, so the result does not
+ * depend on the thread count.
+ *
+ * @param[in,out] keys Keys to sort
+ * @param[in,out] values Values permuted alongside keys
+ * @param key_bits Number of significant low bits in the keys
+ */
+inline void radixSortByKey(std::vector<uint64_t> &keys, std::vector<int> &values, int key_bits) {
+    constexpr int RADIX_BITS = 8;
+    constexpr int BUCKETS = 1 << RADIX_BITS;
+    const std::size_t n = keys.size();
+
+    std::vector<uint64_t> keys_tmp(n);
+    std::vector<int> values_tmp(n);
+    std::vector<std::size_t> hist(static_cast<std::size_t>(omp_get_max_threads()) * BUCKETS);
+
+    for (int shift = 0; shift < key_bits; shift += RADIX_BITS) {
+#pragma omp parallel
+        {
+            const int t = omp_get_thread_num();
+            const int nt = omp_get_num_threads();
+            const std::size_t lo = n * t / nt;
+            const std::size_t hi = n * (t + 1) / nt;
+            std::size_t *h = &hist[static_cast<std::size_t>(t) * BUCKETS];
+
+            std::fill(h, h + BUCKETS, 0);
+            for (std::size_t i = lo; i < hi; i++)
+                h[(keys[i] >> shift) & (BUCKETS - 1)]++;
+
+#pragma omp barrier
+#pragma omp single
+            {
+                // Exclusive scan in (bucket, thread) order keeps the sort stable
+                std::size_t offset = 0;
+                for (int b = 0; b < BUCKETS; b++) {
+                    for (int u = 0; u < nt; u++) {
+                        std::size_t count = hist[static_cast<std::size_t>(u) * BUCKETS + b];
+                        hist[static_cast<std::size_t>(u) * BUCKETS + b] = offset;
+                        offset += count;
+                    }
+                }
+            }
+
+            for (std::size_t i = lo; i < hi; i++) {
+                std::size_t pos = h[(keys[i] >> shift) & (BUCKETS - 1)]++;
+                keys_tmp[pos] = keys[i];
+                values_tmp[pos] = values[i];
+            }
+        }
+        std::swap(keys, keys_tmp);
+        std::swap(values, values_tmp);
+    }
+}
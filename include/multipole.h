@@ -0,0 +1,166 @@
+/**
+ * @file multipole.h
+ * @brief Quadrupole moments of tree cells and the far-field cell interaction
+ *
+ * A cell of total mass M with center of mass R is expanded to second
+ * order about R. Its potential at offset r = x - R from the center of mass
+ * is
+ *
+ *     Φ(r) = -G * [ M/|r| + ½ rᵀQr/|r|⁵ ]
+ *
+ * with the traceless quadrupole Q = Σ m (3 d dᵀ - |d|² I) over the cell's
+ * sources at offsets d from R. The dipole term vanishes about the center
+ * of mass. All sources and targets lie in the plane, so only the in-plane
+ * components Qxx, Qxy and Qyy contribute.
+ *
+ * The cell's center-of-mass velocity V enters the jerk through the
+ * relative velocity v = v_target - V. The time derivative of Q is
+ * neglected.
+ */
+
+#pragma once
+
+#include "global.h"
+#include <type_traits>
+
+/**
+ * @struct Quadrupole
+ * @brief In-plane components of a traceless quadrupole moment
+ */
+struct Quadrupole {
+    double xx = 0; ///< Σ m (2dx² - dy²)
+    double xy = 0; ///< Σ 3m dx dy
+    double yy = 0; ///< Σ m (2dy² - dx²)
+
+    /**
+     * @brief Add a point mass
+     *
+     * @param m Mass
+     * @param dx Offset x from the expansion center
+     * @param dy Offset y from the expansion center
+     */
+    void addPoint(double m, double dx, double dy) {
+        xx += m * (2 * dx * dx - dy * dy);
+        xy += 3 * m * dx * dy;
+        yy += m * (2 * dy * dy - dx * dx);
+    }
+
+    /**
+     * @brief Add a child cell's moment, shifted to this cell's center
+     *
+     * @param child Quadrupole of the child about its own center of mass
+     * @param m Mass of the child
+     * @param dx Child center of mass minus this center of mass, x
+     * @param dy Child center of mass minus this center of mass, y
+     */
+    void addShifted(const Quadrupole &child, double m, double dx, double dy) {
+        xx += child.xx;
+        xy += child.xy;
+        yy += child.yy;
+        addPoint(m, dx, dy);
+    }
+};
+
+/**
+ * @brief Acceleration and jerk of a target from one cell
+ *
+ * @details Monopole: a = -G*M*r/d³ and j = -G*M*[v/d³ - 3(r·v)r/d⁵] with
+ * d = max(|r|, min_dist). With quadrupole terms (WithQuad):
+ * - a += G*[Qr/d⁵ - (5/2)(rᵀQr)r/d⁷]
+ * - j += G*[Qv/d⁵ - 5(r·v)Qr/d⁷ - 5(v·Qr)r/d⁷ - (5/2)(rᵀQr)v/d⁷
+ *   + (35/2)(rᵀQr)(r·v)r/d⁹]
+ *
+ * Written for inlining into vectorized loops (see force_kernels.cpp).
+ *
+ * @tparam WithJerk Also accumulate the jerk
+ * @tparam WithQuad Add the quadrupole terms
+ * @tparam Real Arithmetic precision (float for the mixed-precision far
+ *         field, see SolverConfig::mixed_precision)
+ *
+ * @param dx Target position minus cell center of mass, x
+ * @param dy Target position minus cell center of mass, y
+ * @param dvx Target velocity minus cell velocity, x
+ * @param dvy Target velocity minus cell velocity, y
+ * @param min_d2 Square of the softening distance
+ * @param mass Cell mass
+ * @param qxx Quadrupole xx
+ * @param qxy Quadrupole xy
+ * @param qyy Quadrupole yy
+ * @param[in,out] ax Acceleration x
+ * @param[in,out] ay Acceleration y
+ * @param[in,out] jx Jerk x
+ * @param[in,out] jy Jerk y
+ */
+template <bool WithJerk, bool WithQuad, class Real = double>
+inline void cellInteraction(std::type_identity_t<Real> dx, std::type_identity_t<Real> dy,
+                            std::type_identity_t<Real> dvx, std::type_identity_t<Real> dvy,
+                            std::type_identity_t<Real> min_d2, std::type_identity_t<Real> mass,
+                            std::type_identity_t<Real> qxx, std::type_identity_t<Real> qxy,
+                            std::type_identity_t<Real> qyy, Real &ax, Real &ay, Real &jx,
+                            Real &jy) {
+    const Real r2 = std::max(dx * dx + dy * dy, min_d2);
+    const Real inv = Real(1) / std::sqrt(r2);
+    const Real inv2 = inv * inv;
+    const Real inv3 = inv2 * inv;
+    const Real mono = Real(-GRAV_G) * mass * inv3;
+    const Real rv = dx * dvx + dy * dvy;
+
+    ax += dx * mono;
+    ay += dy * mono;
+    if constexpr (WithJerk) {
+        const Real f = Real(3) * mono * rv * inv2;
+        jx += dvx * mono - dx * f;
+        jy += dvy * mono - dy * f;
+    }
+
+    if constexpr (WithQuad) {
+        const Real qrx = qxx * dx + qxy * dy;
+        const Real qry = qxy * dx + qyy * dy;
+        const Real s = dx * qrx + dy * qry;
+        const Real g5 = Real(GRAV_G) * inv3 * inv2;
+        const Real g7 = g5 * inv2;
+        ax += g5 * qrx - Real(2.5) * g7 * s * dx;
+        ay += g5 * qry - Real(2.5) * g7 * s * dy;
+        if constexpr (WithJerk) {
+            const Real qvx = qxx * dvx + qxy * dvy;
+            const Real qvy = qxy * dvx + qyy * dvy;
+            const Real vq = dvx * qrx + dvy * qry;
+            const Real radial = g7 * (Real(17.5) * s * rv * inv2 - Real(5) * vq);
+            jx += g5 * qvx - Real(5) * g7 * rv * qrx - Real(2.5) * g7 * s * dvx + radial * dx;
+            jy += g5 * qvy - Real(5) * g7 * rv * qry - Real(2.5) * g7 * s * dvy + radial * dy;
+        }
+    }
+}
+
+/**
+ * @brief Potential of a target from one cell
+ *
+ * @details Φ = -G*M/d, plus -G*rᵀQr/(2d⁵) with quadrupole terms
+ * (WithQuad), softened like cellInteraction().
+ *
+ * @tparam WithQuad Add the quadrupole term
+ * @tparam Real Arithmetic precision
+ *
+ * @param dx Target position minus cell center of mass, x
+ * @param dy Target position minus cell center of mass, y
+ * @param min_d2 Square of the softening distance
+ * @param mass Cell mass
+ * @param qxx Quadrupole xx
+ * @param qxy Quadrupole xy
+ * @param qyy Quadrupole yy
+ * @return Potential per unit target mass
+ */
+template <bool WithQuad, class Real = double>
+inline Real cellPotential(std::type_identity_t<Real> dx, std::type_identity_t<Real> dy,
+                          std::type_identity_t<Real> min_d2, std::type_identity_t<Real> mass,
+                          std::type_identity_t<Real> qxx, std::type_identity_t<Real> qxy,
+                          std::type_identity_t<Real> qyy) {
+    const Real r2 = std::max(dx * dx + dy * dy, min_d2);
+    const Real inv = Real(1) / std::sqrt(r2);
+    Real phi = Real(-GRAV_G) * mass * inv;
+    if constexpr (WithQuad) {
+        const Real s = dx * (qxx * dx + qxy * dy) + dy * (qxy * dx + qyy * dy);
+        phi -= Real(0.5 * GRAV_G) * s * inv * inv * inv * inv * inv;
+    }
+    return phi;
+}
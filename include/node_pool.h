@@ -0,0 +1,306 @@
+/**
+ * @file node_pool.h
+ * @brief Pooled storage for QuadTree nodes and their leaf particle indices
+ *
+ * The pointer tree subdivides and merges nodes every step as particles
+ * move. Instead of four new/delete calls per subdivision and a vector per
+ * node, a tree draws from two pools owned by its root:
+ * - NodePool: blocks of four sibling nodes carved from large chunks, so
+ *   the children of a node are contiguous, each block followed by the
+ *   leaf index ranges of its four nodes; freed blocks are reused
+ * - IndexArena: power-of-two ranges for the index lists that outgrow
+ *   their node's range (the root, max-depth leaves), carved from shared
+ *   pages and reused per size class
+ *
+ * Pool memory is only returned when the pool is destroyed. Allocation
+ * and release are guarded by one OpenMP critical section, since the
+ * parallel tree builds subdivide from several tasks at once; both happen
+ * far less often than the tree is walked.
+ */
+
+#pragma once
+
+#include "global.h"
+
+/// @brief Sibling blocks per NodePool chunk
+#define NODE_POOL_BLOCKS 256
+
+/// @brief Alignment of NodePool blocks (one cache line)
+#define NODE_POOL_ALIGN 64
+
+/// @brief Indices per IndexArena page (larger ranges get a page of their own)
+#define INDEX_PAGE_SIZE 65536
+
+/// @brief Smallest IndexArena range, as a power of two (8 indices)
+#define INDEX_MIN_CLASS 3
+
+/**
+ * @class NodePool
+ * @brief Storage for blocks of four contiguous sibling nodes and their leaf indices
+ *
+ * @details Each block is cache-line aligned and holds four nodes followed
+ * by room for leaf_capacity particle indices per node, so a leaf's
+ * indices sit next to the node that owns them. Only lists that outgrow
+ * that room move to an IndexArena.
+ *
+ * @tparam Node Node type; the pool hands out raw storage and the caller
+ *              constructs and destroys the nodes in it
+ */
+template <class Node> class NodePool
+{
+public:
+    /**
+     * @brief Pool for nodes holding up to leaf_capacity indices inline
+     * @param _leaf_capacity Inline indices per node
+     */
+    explicit NodePool(int _leaf_capacity) { reset(_leaf_capacity); }
+
+    NodePool(const NodePool &) = delete;
+    NodePool &operator=(const NodePool &) = delete;
+
+    /**
+     * @brief Drop all chunks and change the inline capacity
+     *
+     * @param _leaf_capacity Inline indices per node
+     *
+     * @note Every block must have been released
+     */
+    void reset(int _leaf_capacity) {
+        chunks.clear();
+        free_blocks.clear();
+        used = NODE_POOL_BLOCKS;
+        leaf_capacity = std::max(_leaf_capacity, 0);
+        indices_offset = roundUp(4 * sizeof(Node));
+        block_bytes = roundUp(indices_offset + 4 * sizeof(int) * leaf_capacity);
+    }
+
+    /// @brief Inline indices per node
+    int leafCapacity() const { return leaf_capacity; }
+
+    /**
+     * @brief Storage for four sibling nodes
+     *
+     * @param[out] leaf_storage Room for 4 * leafCapacity() indices, node c
+     *             owning [c * leafCapacity(), (c + 1) * leafCapacity())
+     * @return Uninitialized storage for Node[4], reused from a released
+     *         block when one is available
+     */
+    Node *allocate(int *&leaf_storage) {
+        unsigned char *block;
+#pragma omp critical(quadtree_pool)
+        {
+            if (free_blocks.empty()) {
+                if (used == NODE_POOL_BLOCKS) {
+                    chunks.emplace_back(static_cast<unsigned char *>(::operator new(
+                        NODE_POOL_BLOCKS * block_bytes, std::align_val_t(NODE_POOL_ALIGN))));
+                    used = 0;
+                }
+                block = chunks.back().get() + used++ * block_bytes;
+            } else {
+                block = free_blocks.back();
+                free_blocks.pop_back();
+            }
+        }
+        leaf_storage = reinterpret_cast<int *>(block + indices_offset);
+        return reinterpret_cast<Node *>(block);
+    }
+
+    /**
+     * @brief Return a block for reuse
+     *
+     * @param block Storage from allocate(), with its nodes already destroyed
+     */
+    void deallocate(Node *block) {
+#pragma omp critical(quadtree_pool)
+        free_blocks.push_back(reinterpret_cast<unsigned char *>(block));
+    }
+
+private:
+    /// @brief Frees a chunk allocated with NODE_POOL_ALIGN alignment
+    struct ChunkDeleter {
+        void operator()(unsigned char *chunk) const {
+            ::operator delete(chunk, std::align_val_t(NODE_POOL_ALIGN));
+        }
+    };
+
+    std::vector<std::unique_ptr<unsigned char, ChunkDeleter>> chunks; ///< Allocated chunks
+    std::vector<unsigned char *> free_blocks; ///< Released blocks
+    int used = NODE_POOL_BLOCKS;              ///< Blocks handed out from the last chunk
+    int leaf_capacity = 0;                    ///< Inline indices per node
+    std::size_t indices_offset = 0;           ///< Offset of the indices in a block
+    std::size_t block_bytes = 0;              ///< Size of a block
+
+    /// @brief Round up to a multiple of NODE_POOL_ALIGN
+    static std::size_t roundUp(std::size_t bytes) {
+        return (bytes + NODE_POOL_ALIGN - 1) / NODE_POOL_ALIGN * NODE_POOL_ALIGN;
+    }
+};
+
+/**
+ * @class IndexArena
+ * @brief Shared pages of particle indices, handed out as power-of-two ranges
+ */
+class IndexArena
+{
+public:
+    IndexArena() = default;
+    IndexArena(const IndexArena &) = delete;
+    IndexArena &operator=(const IndexArena &) = delete;
+
+    /**
+     * @brief Storage for at least count indices
+     *
+     * @param count Number of indices needed
+     * @param[out] capacity Size of the returned range
+     * @return Start of the range
+     */
+    int *allocate(int count, int &capacity) {
+        int size_class = INDEX_MIN_CLASS;
+        while ((1 << size_class) < count)
+            size_class++;
+        capacity = 1 << size_class;
+
+        int *range;
+#pragma omp critical(quadtree_pool)
+        {
+            std::vector<int *> &reuse = free_ranges[size_class];
+            if (!reuse.empty()) {
+                range = reuse.back();
+                reuse.pop_back();
+            } else {
+                if (pages.empty() || page_used + capacity > page_size) {
+                    page_size = std::max(INDEX_PAGE_SIZE, capacity);
+                    pages.emplace_back(new int[page_size]);
+                    page_used = 0;
+                }
+                range = pages.back().get() + page_used;
+                page_used += capacity;
+            }
+        }
+        return range;
+    }
+
+    /**
+     * @brief Return a range for reuse
+     *
+     * @param range Start of a range from allocate()
+     * @param capacity Its capacity
+     */
+    void deallocate(int *range, int capacity) {
+        int size_class = INDEX_MIN_CLASS;
+        while ((1 << size_class) < capacity)
+            size_class++;
+#pragma omp critical(quadtree_pool)
+        free_ranges[size_class].push_back(range);
+    }
+
+private:
+    std::vector<std::unique_ptr<int[]>> pages;  ///< Allocated pages
+    int page_size = 0;                          ///< Size of the last page
+    int page_used = 0;                          ///< Indices handed out from the last page
+    std::array<std::vector<int *>, 32> free_ranges; ///< Released ranges per size class
+};
+
+/**
+ * @class LeafIndices
+ * @brief Particle indices of one tree node
+ *
+ * @details A subset of the std::vector<int> interface (iteration, data(),
+ * size(), appending, shrinking), so walkers read it like a vector. The
+ * indices live in the node's inline range from its NodePool block; a list
+ * that outgrows it moves to a range of twice the size from the IndexArena,
+ * and release() returns to the inline range.
+ */
+class LeafIndices
+{
+public:
+    /**
+     * @brief Empty list
+     *
+     * @param _arena Arena for lists that outgrow the inline range
+     * @param _inline_items Inline range, or null
+     * @param _inline_room Capacity of the inline range
+     */
+    LeafIndices(IndexArena *_arena, int *_inline_items, int _inline_room)
+        : arena(_arena), inline_items(_inline_items), items(_inline_items),
+          inline_room(_inline_items ? _inline_room : 0), room(inline_room) {}
+
+    LeafIndices(const LeafIndices &) = delete;
+    LeafIndices &operator=(const LeafIndices &) = delete;
+
+    ~LeafIndices() { release(); }
+
+    int *begin() { return items; }
+    int *end() { return items + count; }
+    const int *begin() const { return items; }
+    const int *end() const { return items + count; }
+    int *data() { return items; }
+    const int *data() const { return items; }
+    int &operator[](std::size_t i) { return items[i]; }
+    int operator[](std::size_t i) const { return items[i]; }
+    std::size_t size() const { return static_cast<std::size_t>(count); }
+    bool empty() const { return count == 0; }
+    std::size_t capacity() const { return static_cast<std::size_t>(room); }
+
+    /// @brief Make room for at least n indices
+    void reserve(std::size_t n) {
+        if (static_cast<int>(n) > room)
+            grow(static_cast<int>(n));
+    }
+
+    /// @brief Append one index
+    void push_back(int particle) {
+        if (count == room)
+            grow(std::max(count + 1, 2 * room));
+        items[count++] = particle;
+    }
+
+    /// @brief Append one index
+    void emplace_back(int particle) { push_back(particle); }
+
+    /// @brief Append a range of indices
+    template <class It> void append(It first, It last) {
+        const int n = static_cast<int>(std::distance(first, last));
+        if (count + n > room)
+            grow(std::max(count + n, 2 * room));
+        std::copy(first, last, items + count);
+        count += n;
+    }
+
+    /// @brief Keep the first n indices (n must not exceed size())
+    void resize(std::size_t n) { count = static_cast<int>(n); }
+
+    /// @brief Remove all indices, keeping the storage
+    void clear() { count = 0; }
+
+    /// @brief Remove all indices and return any arena storage
+    void release() {
+        if (items != inline_items)
+            arena->deallocate(items, room);
+        items = inline_items;
+        room = inline_room;
+        count = 0;
+    }
+
+private:
+    IndexArena *arena;  ///< Arena for lists that outgrow the inline range
+    int *inline_items;  ///< Inline range, or null
+    int *items;         ///< Current storage
+    int inline_room;    ///< Capacity of the inline range
+    int room;           ///< Capacity of the current storage
+    int count = 0;      ///< Indices held
+
+    /**
+     * @brief Move to an arena range with room for n indices
+     * @param n Required capacity
+     */
+    void grow(int n) {
+        int capacity;
+        int *range = arena->allocate(n, capacity);
+        std::copy(items, items + count, range);
+        if (items != inline_items)
+            arena->deallocate(items, room);
+        items = range;
+        room = capacity;
+    }
+};
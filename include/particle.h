@@ -35,6 +35,7 @@ public:
     double radius;          ///< Particle radius (for collisions and softening)
     bool isPrimary = false; ///< True if particle should be rendered specially
     bool markForDeletion = false; ///< True if particle should be removed (merged)
+    bool isPassive = false; ///< Test particle: feels gravity but is not a source
 
     /**
      * @brief Construct a new Particle
@@ -0,0 +1,238 @@
+/**
+ * @file particle_set.h
+ * @brief Structure-of-arrays particle store for N-body simulation
+ */
+
+#pragma once
+
+#include "global.h"
+#include "particle.h"
+
+/// @name Particle flag bits (ParticleSet::flags)
+/// @{
+#define PARTICLE_PRIMARY 0x01 ///< Particle should be rendered specially
+#define PARTICLE_DELETED 0x02 ///< Particle should be removed (merged)
+#define PARTICLE_PASSIVE 0x04 ///< Test particle: feels gravity but is not a source
+/// @}
+
+/**
+ * @class ParticleSet
+ * @brief Contiguous structure-of-arrays storage for all particles
+ *
+ * @details Each kinematic and physical quantity lives in its own dense
+ * array, indexed by particle slot. Hot loops (drift, kick, predictor,
+ * corrector) stream through the arrays they need and can be
+ * auto-vectorized, and the tree refers to particles by slot index
+ * instead of by pointer.
+ *
+ * Particle is kept as a value type for building particles and as the
+ * target of a single force evaluation (see get()).
+ *
+ * @note Slot indices are stable until compact() is called
+ */
+class ParticleSet
+{
+public:
+    /// @name Kinematic state
+    /// @{
+    std::vector<double> x, y;   ///< Current position
+    std::vector<double> vx, vy; ///< Current velocity
+    std::vector<double> ax, ay; ///< Current acceleration
+    std::vector<double> jx, jy; ///< Time derivative of acceleration (Hermite)
+    /// @}
+
+    /// @name Predictor variables
+    /// @{
+    std::vector<double> x_pred, y_pred;   ///< Predicted position (Hermite/RK2 predictor)
+    std::vector<double> vx_pred, vy_pred; ///< Predicted velocity (Hermite/RK2 predictor)
+    /// @}
+
+    std::vector<uint8_t> level; ///< Block timestep level: step dt/2^level (block Hermite)
+    std::vector<int> cost;      ///< Interactions of the last force evaluation (load balancing)
+    std::vector<double> pot;    ///< Potential per unit mass (written while with_potential is set)
+
+    std::vector<double> mass;    ///< Particle mass
+    std::vector<double> radius;  ///< Particle radius (for collisions and softening)
+    std::vector<int> id;         ///< Unique particle identifier
+    std::vector<uint8_t> flags;  ///< PARTICLE_* flag bits
+
+    /// @brief Force evaluations also write pot (see storeTargets())
+    bool with_potential = false;
+
+    /// @brief Number of particles
+    std::size_t size() const { return x.size(); }
+
+    /// @brief True if the set holds no particles
+    bool empty() const { return x.empty(); }
+
+    /**
+     * @brief Reserve storage for n particles in every array
+     * @param n Number of particles
+     */
+    void reserve(std::size_t n) {
+        forEachArray([n](auto &array) { array.reserve(n); });
+    }
+
+    /**
+     * @brief Resize every array to n particles (new slots are zeroed)
+     * @param n Number of particles
+     */
+    void resize(std::size_t n) {
+        forEachArray([n](auto &array) { array.resize(n); });
+    }
+
+    /**
+     * @brief Append a particle
+     *
+     * @param p Particle to append
+     * @return Slot index of the new particle
+     */
+    int add(const Particle &p) {
+        x.push_back(p.position.x);
+        y.push_back(p.position.y);
+        vx.push_back(p.velocity.x);
+        vy.push_back(p.velocity.y);
+        ax.push_back(p.acceleration.x);
+        ay.push_back(p.acceleration.y);
+        jx.push_back(p.jerk.x);
+        jy.push_back(p.jerk.y);
+        x_pred.push_back(p.position_pred.x);
+        y_pred.push_back(p.position_pred.y);
+        vx_pred.push_back(p.velocity_pred.x);
+        vy_pred.push_back(p.velocity_pred.y);
+        mass.push_back(p.mass);
+        radius.push_back(p.radius);
+        id.push_back(p.id);
+        level.push_back(0);
+        cost.push_back(0);
+        pot.push_back(0);
+        flags.push_back((p.isPrimary ? PARTICLE_PRIMARY : 0) |
+                        (p.markForDeletion ? PARTICLE_DELETED : 0) |
+                        (p.isPassive ? PARTICLE_PASSIVE : 0));
+        return static_cast<int>(size()) - 1;
+    }
+
+    /**
+     * @brief Gather one particle into a Particle value
+     *
+     * @param i Slot index
+     * @return Copy of the particle in slot i
+     */
+    Particle get(int i) const {
+        Particle p(x[i], y[i], vx[i], vy[i], id[i], isPrimary(i));
+        p.acceleration = {ax[i], ay[i]};
+        p.jerk = {jx[i], jy[i]};
+        p.position_pred = {x_pred[i], y_pred[i]};
+        p.velocity_pred = {vx_pred[i], vy_pred[i]};
+        p.mass = mass[i];
+        p.radius = radius[i];
+        p.markForDeletion = isMarkedForDeletion(i);
+        p.isPassive = isPassive(i);
+        return p;
+    }
+
+    /// @brief Position of particle i
+    vector2D position(int i) const { return {x[i], y[i]}; }
+
+    /// @brief Velocity of particle i
+    vector2D velocity(int i) const { return {vx[i], vy[i]}; }
+
+    /// @brief True if particle i is a primary (rendered specially)
+    bool isPrimary(int i) const { return flags[i] & PARTICLE_PRIMARY; }
+
+    /// @brief True if particle i has been merged and awaits removal
+    bool isMarkedForDeletion(int i) const { return flags[i] & PARTICLE_DELETED; }
+
+    /// @brief Mark particle i for removal by compact()
+    void markForDeletion(int i) { flags[i] |= PARTICLE_DELETED; }
+
+    /// @brief True if particle i is flagged as a test particle
+    bool isPassive(int i) const { return flags[i] & PARTICLE_PASSIVE; }
+
+    /// @brief Flag or unflag particle i as a test particle
+    void setPassive(int i, bool passive) {
+        flags[i] = passive ? (flags[i] | PARTICLE_PASSIVE) : (flags[i] & ~PARTICLE_PASSIVE);
+    }
+
+    /**
+     * @brief True if particle i acts as a gravity source
+     *
+     * @param i Slot index
+     * @param passive_mass Particles lighter than this are treated as passive
+     *                     (see SolverConfig::passive_mass)
+     */
+    bool isSource(int i, double passive_mass) const {
+        return !(flags[i] & PARTICLE_PASSIVE) && mass[i] >= passive_mass;
+    }
+
+    /**
+     * @brief Find the slot holding a particle ID
+     *
+     * @param particle_id Particle identifier
+     * @return Slot index, or -1 if no particle has that ID
+     */
+    int indexOf(int particle_id) const {
+        auto it = std::find(id.begin(), id.end(), particle_id);
+        return it == id.end() ? -1 : static_cast<int>(it - id.begin());
+    }
+
+    /**
+     * @brief Remove particles marked for deletion, preserving order
+     *
+     * @details Parallel stream compaction: per-block survivor counts, a
+     * prefix sum over the blocks for the new slot indices, then every
+     * array is gathered into its new position in parallel.
+     *
+     * @return Map from old slot index to new slot index (-1 if removed)
+     *
+     * @note Any structure holding slot indices (e.g. QuadTree) must be
+     *       remapped with the returned map
+     */
+    std::vector<int> compact() {
+        const int n = static_cast<int>(size());
+        const int nblocks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        std::vector<int> remap(n);
+        std::vector<int> offset(nblocks + 1, 0);
+
+#pragma omp parallel for schedule(static)
+        for (int b = 0; b < nblocks; b++) {
+            int kept = 0;
+            for (int i = b * CHUNK_SIZE; i < std::min(n, (b + 1) * CHUNK_SIZE); i++)
+                kept += !isMarkedForDeletion(i);
+            offset[b + 1] = kept;
+        }
+        std::partial_sum(offset.begin(), offset.end(), offset.begin());
+
+#pragma omp parallel for schedule(static)
+        for (int b = 0; b < nblocks; b++) {
+            int next = offset[b];
+            for (int i = b * CHUNK_SIZE; i < std::min(n, (b + 1) * CHUNK_SIZE); i++)
+                remap[i] = isMarkedForDeletion(i) ? -1 : next++;
+        }
+
+        const int kept = offset[nblocks];
+        if (kept == n)
+            return remap;
+        forEachArray([&remap, n, kept](auto &array) {
+            std::remove_reference_t<decltype(array)> packed(kept);
+#pragma omp parallel for schedule(static, CHUNK_SIZE)
+            for (int i = 0; i < n; i++) {
+                if (remap[i] >= 0)
+                    packed[remap[i]] = array[i];
+            }
+            array.swap(packed);
+        });
+        return remap;
+    }
+
+private:
+    /**
+     * @brief Apply a function to every per-particle array
+     * @param f Callable taking a std::vector<> by reference
+     */
+    template <class F> void forEachArray(F &&f) {
+        f(x); f(y); f(vx); f(vy); f(ax); f(ay); f(jx); f(jy);
+        f(x_pred); f(y_pred); f(vx_pred); f(vy_pred);
+        f(level); f(cost); f(pot); f(mass); f(radius); f(id); f(flags);
+    }
+};
@@ -0,0 +1,75 @@
+/**
+ * @file philox.h
+ * @brief Philox4x32-10 counter-based random number generator
+ *
+ * A counter-based generator maps (key, counter) to random bits with no
+ * state, so particle i can draw its numbers from counter i on any thread
+ * and the result does not depend on the thread count or on the order the
+ * particles are generated in.
+ *
+ * Reference: Salmon et al. (2011), "Parallel random numbers: as easy as
+ * 1, 2, 3", SC11
+ */
+
+#pragma once
+
+#include "global.h"
+
+/**
+ * @brief Philox4x32 with 10 rounds
+ *
+ * @param counter 128-bit counter
+ * @param key 64-bit key
+ * @return 128 random bits
+ */
+inline std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> counter,
+                                          std::array<uint32_t, 2> key) {
+    constexpr uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+    constexpr uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+    for (int round = 0; round < 10; round++) {
+        const uint64_t p0 = static_cast<uint64_t>(M0) * counter[0];
+        const uint64_t p1 = static_cast<uint64_t>(M1) * counter[2];
+        counter = {static_cast<uint32_t>(p1 >> 32) ^ counter[1] ^ key[0], static_cast<uint32_t>(p1),
+                   static_cast<uint32_t>(p0 >> 32) ^ counter[3] ^ key[1], static_cast<uint32_t>(p0)};
+        key[0] += W0;
+        key[1] += W1;
+    }
+    return counter;
+}
+
+/**
+ * @class CounterRNG
+ * @brief Uniform doubles indexed by (item, draw) from a seed
+ */
+class CounterRNG
+{
+public:
+    /**
+     * @brief Generator for one seed and stream
+     *
+     * @param seed Key of the generator
+     * @param _stream Independent stream number (e.g. one per generator call)
+     */
+    explicit CounterRNG(uint64_t seed, uint32_t _stream = 0)
+        : key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)}, stream(_stream) {
+    }
+
+    /**
+     * @brief Two uniform doubles in [0, 1)
+     *
+     * @param item Item index (e.g. particle number)
+     * @param draw Draw number for that item (0, 1, ... for successive pairs)
+     * @return Two independent numbers with 53 random bits each
+     */
+    std::array<double, 2> uniform2(uint64_t item, uint32_t draw) const {
+        std::array<uint32_t, 4> bits = philox4x32(
+            {static_cast<uint32_t>(item), static_cast<uint32_t>(item >> 32), draw, stream}, key);
+        const uint64_t a = (static_cast<uint64_t>(bits[0]) << 32) | bits[1];
+        const uint64_t b = (static_cast<uint64_t>(bits[2]) << 32) | bits[3];
+        return {(a >> 11) * 0x1.0p-53, (b >> 11) * 0x1.0p-53};
+    }
+
+private:
+    std::array<uint32_t, 2> key; ///< Philox key (the seed)
+    uint32_t stream;             ///< Stream number (high counter word)
+};
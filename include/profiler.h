@@ -0,0 +1,225 @@
+/**
+ * @file profiler.h
+ * @brief Step-phase timers, interaction counters and per-step metrics
+ *
+ * Built only with NBODY_PROFILING (CMake option of the same name). Without
+ * it the NBODY_PROFILE_* macros expand to nothing, lastStepMetrics()
+ * returns null and no timer or counter code is compiled in.
+ *
+ * Simulation::step() times its phases with NBODY_PROFILE_PHASE and the
+ * force solver counts interactions with NBODY_PROFILE_COUNT. At the end of
+ * a step the metrics are published: lastStepMetrics() for the current
+ * process, MetricsLog for a CSV or JSON log, and the viewer's overlay.
+ */
+
+#pragma once
+
+#include "global.h"
+#include <string>
+
+/**
+ * @enum profile_phase
+ * @brief Timed phases of a step (nested phases are included in their parent)
+ */
+enum profile_phase {
+    PHASE_STEP,       ///< Whole step
+    PHASE_TREE,       ///< Tree update or rebuild
+    PHASE_MOMENTS,    ///< Mass moments (calculateCOM)
+    PHASE_THETA,      ///< Adaptive theta error estimate
+    PHASE_TRANSPORT,  ///< Integrator, including its force evaluations
+    PHASE_FORCES,     ///< Force evaluations (computeForces)
+    PHASE_COLLISIONS, ///< Collision detection and merging
+    PHASE_RECENTER,   ///< Center-of-mass recentering
+    PHASE_COUNT
+};
+
+/**
+ * @enum profile_counter
+ * @brief Event counters of a step
+ */
+enum profile_counter {
+    COUNTER_TARGETS,    ///< Force evaluations (targets summed over all evaluations)
+    COUNTER_CELLS,      ///< Target-cell interactions
+    COUNTER_PARTICLES,  ///< Target-particle interactions
+    COUNTER_COLLISIONS, ///< Colliding pairs found
+    COUNTER_COUNT
+};
+
+/**
+ * @struct StepMetrics
+ * @brief Everything measured during one step
+ */
+struct StepMetrics {
+    long step = 0;                      ///< Step count after the step
+    std::size_t particles = 0;          ///< Particles after the step
+    double seconds[PHASE_COUNT] = {0};  ///< Wall time per phase
+    long counts[COUNTER_COUNT] = {0};   ///< Events per counter
+    int tree_nodes = 0;                 ///< Nodes in the active tree
+    int tree_depth = 0;                 ///< Deepest node of the active tree
+    double busy_max = 0;                ///< Force loops: sum of the busiest thread's time
+    double busy_mean = 0;               ///< Force loops: sum of the mean thread time
+
+    /// @brief Force load imbalance: busiest thread over the mean (1 = balanced)
+    double imbalance() const { return busy_mean > 0 ? busy_max / busy_mean : 1; }
+};
+
+/// @brief Name of a phase, as used in logs ("step", "tree", ...)
+const char *phaseName(int phase);
+
+/// @brief Name of a counter, as used in logs ("targets", "cells", ...)
+const char *counterName(int counter);
+
+#ifdef NBODY_PROFILING
+
+/**
+ * @class Profiler
+ * @brief Collects the metrics of the step in progress
+ *
+ * @details Phases are timed from the stepping thread only. Counters may be
+ * added from any thread; callers add per-group totals so the atomic adds
+ * stay rare.
+ */
+class Profiler
+{
+public:
+    /// @brief Start collecting a new step
+    void beginStep() { current = StepMetrics(); }
+
+    /**
+     * @brief Publish the step's metrics
+     *
+     * @param step Step count after the step
+     * @param particles Particles after the step
+     * @param tree_nodes Nodes in the active tree
+     * @param tree_depth Deepest node of the active tree
+     */
+    void endStep(long step, std::size_t particles, int tree_nodes, int tree_depth) {
+        current.step = step;
+        current.particles = particles;
+        current.tree_nodes = tree_nodes;
+        current.tree_depth = tree_depth;
+        last = current;
+        has_last = true;
+    }
+
+    /// @brief Add wall time to a phase
+    void addTime(int phase, double seconds) { current.seconds[phase] += seconds; }
+
+    /// @brief Add events to a counter (thread-safe)
+    void count(int counter, long n) {
+#pragma omp atomic
+        current.counts[counter] += n;
+    }
+
+    /**
+     * @brief Record the per-thread busy times of one parallel force loop
+     *
+     * @param busy Seconds each thread spent in the loop
+     */
+    void addBusy(const std::vector<double> &busy) {
+        if (busy.empty())
+            return;
+        double sum = 0, most = 0;
+        for (double b : busy) {
+            sum += b;
+            most = std::max(most, b);
+        }
+        current.busy_max += most;
+        current.busy_mean += sum / busy.size();
+    }
+
+    /// @brief Metrics of the last completed step (null before the first)
+    const StepMetrics *lastStep() const { return has_last ? &last : nullptr; }
+
+private:
+    StepMetrics current;   ///< Step in progress
+    StepMetrics last;      ///< Last completed step
+    bool has_last = false; ///< A step has completed
+};
+
+/// @brief Process-wide profiler
+Profiler &profiler();
+
+/**
+ * @class ScopedPhase
+ * @brief Adds the lifetime of the object to a phase
+ */
+class ScopedPhase
+{
+public:
+    /// @brief Start timing phase
+    explicit ScopedPhase(int _phase) : phase(_phase), start(omp_get_wtime()) {}
+
+    ~ScopedPhase() { profiler().addTime(phase, omp_get_wtime() - start); }
+
+    ScopedPhase(const ScopedPhase &) = delete;
+    ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+private:
+    int phase;    ///< Phase being timed
+    double start; ///< Start time (omp_get_wtime)
+};
+
+#define NBODY_PROFILE_CONCAT_(a, b) a##b
+#define NBODY_PROFILE_CONCAT(a, b) NBODY_PROFILE_CONCAT_(a, b)
+
+/// @brief Time the rest of the enclosing scope as a phase
+#define NBODY_PROFILE_PHASE(phase) ScopedPhase NBODY_PROFILE_CONCAT(profile_phase_, __LINE__)(phase)
+
+/// @brief Add n events to a counter
+#define NBODY_PROFILE_COUNT(counter, n) profiler().count(counter, n)
+
+/// @brief Code that only exists in profiling builds
+#define NBODY_PROFILE_ONLY(...) __VA_ARGS__
+
+/// @brief Metrics of the last completed step (null before the first)
+inline const StepMetrics *lastStepMetrics() { return profiler().lastStep(); }
+
+#else
+
+#define NBODY_PROFILE_PHASE(phase) ((void)0)
+#define NBODY_PROFILE_COUNT(counter, n) ((void)0)
+#define NBODY_PROFILE_ONLY(...)
+
+/// @brief Always null: built without NBODY_PROFILING
+inline const StepMetrics *lastStepMetrics() { return nullptr; }
+
+#endif
+
+/**
+ * @class MetricsLog
+ * @brief Periodic log of step metrics
+ *
+ * @details A path ending in ".json" gets one JSON object per line, any
+ * other path a CSV file with a header row. Each record holds the step,
+ * particle count, phase times in seconds, counters, tree size and force
+ * load imbalance of one step.
+ */
+class MetricsLog
+{
+public:
+    MetricsLog() = default;
+    MetricsLog(const MetricsLog &) = delete;
+    MetricsLog &operator=(const MetricsLog &) = delete;
+
+    ~MetricsLog() { close(); }
+
+    /**
+     * @brief Create the log file
+     *
+     * @param path Output file (.json for JSON lines, otherwise CSV)
+     * @return False if the file cannot be created or the build has no
+     *         NBODY_PROFILING (reported on stderr)
+     */
+    bool open(const std::string &path);
+
+    /// @brief Append the metrics of one step
+    void write(const StepMetrics &metrics);
+
+    /// @brief Close the file
+    void close();
+
+private:
+    FILE *file = nullptr; ///< Output file
+    bool json = false;    ///< JSON lines instead of CSV
+};
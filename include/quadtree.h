@@ -1,312 +1,671 @@
-/**
- * @file quadtree.h
- * @brief QuadTree spatial data structure for Barnes-Hut algorithm
- *
- * Implements a hierarchical spatial partitioning structure that enables
- * O(N log N) force calculation in N-body simulations.
- */
-
-#pragma once
-
-#include "global.h"
-#include "bounds.h"
-
-/// @brief Maximum particles per leaf node before subdivision
-#define MAX_CAPACITY 50
-
-/// @brief Maximum tree depth to prevent infinite recursion
-#define MAX_DEPTH 15
-
-/**
- * @class QuadTree
- * @brief Hierarchical spatial partitioning tree for 2D N-body simulation
- *
- * @tparam T Particle type (must have position, mass, velocity members)
- *
- * @details The QuadTree recursively subdivides 2D space into quadrants,
- * storing particles in leaf nodes. This enables:
- * - Fast spatial queries (collision detection, neighbor search)
- * - Barnes-Hut multipole approximation for gravity
- * - O(N log N) force calculation instead of O(N²)
- *
- * Tree structure:
- * - Each node covers a rectangular region (bounds)
- * - Leaf nodes store up to MAX_CAPACITY particles
- * - Internal nodes have 4 children (quadrants: NW, NE, SW, SE)
- * - Subdivision stops at MAX_DEPTH
- *
- * Barnes-Hut properties:
- * - Each node stores total mass and center of mass
- * - Distant groups of particles treated as single mass
- * - Opening angle criterion: s/d < θ
- */
-template <class T> class QuadTree {
-  public:
-    Bounds bounds;                         ///< Spatial region covered by this node
-    double totalMass;                      ///< Total mass of all particles in subtree
-    double thetaScale;                     ///< Theta scaling factor: (M_ref/M)^alpha
-    vector2D centerOfMass;                 ///< Center of mass of all particles in subtree
-    int depth;                             ///< Depth in tree (root = 1)
-    bool is_divided = false;               ///< True if node is subdivided into children
-    std::vector<std::shared_ptr<T>> particles; ///< Particles in this leaf (empty if divided)
-    std::array<QuadTree<T> *, 4> children; ///< Child nodes [NW, NE, SW, SE]
-    QuadTree<T> *parent;                   ///< Parent node (nullptr for root)
-
-    /**
-     * @brief Construct a QuadTree node
-     *
-     * @param xmin Left edge of region
-     * @param ymin Bottom edge of region
-     * @param width Width of region
-     * @param height Height of region
-     * @param _depth Depth in tree (root = 1)
-     * @param _parent Pointer to parent node (nullptr for root)
-     */
-    QuadTree(double xmin, double ymin, double width, double height, int _depth,
-                QuadTree *_parent) {
-        bounds.set_bounds(xmin, ymin, width, height);
-        depth = _depth;
-        particles.reserve(MAX_CAPACITY);
-        totalMass = 0;
-        thetaScale = 0;
-        parent = _parent;
-    }
-
-    /**
-     * @brief Insert a particle into the tree
-     *
-     * @details Recursively finds the appropriate leaf node for the particle:
-     * 1. Check if particle is within bounds
-     * 2. If leaf has capacity, add particle
-     * 3. If leaf is full, subdivide and redistribute
-     * 4. If internal node, recurse to appropriate child
-     *
-     * @param particle Particle to insert
-     * @return True if insertion successful, false if out of bounds
-     */
-    bool insert(std::shared_ptr<T> particle) {
-        if (!bounds.contains(particle->position))
-            return false;
-
-        if (((particles.size() < MAX_CAPACITY) && (!is_divided)) || (depth == MAX_DEPTH)) {
-            particles.emplace_back(particle);
-            return true;
-        }
-        if (!is_divided) {
-            subdivide();
-        }
-        for (auto &child : children) {
-            if (child->insert(particle)) {
-                return true;
-            }
-        }
-        return false;
-    }
-
-    /**
-     * @brief Find leaf node intersecting query region
-     *
-     * @param query_bounds Region to search
-     * @param[out] query_tree Pointer to intersecting leaf node
-     *
-     * @note Returns first intersecting leaf found
-     */
-    void query_tree(Bounds query_bounds, QuadTree<T> *&query_tree) {
-        if (!this->bounds.intersects(query_bounds))
-            return;
-        if (is_divided) {
-            for (auto const &child : children) {
-                child->query_tree(query_bounds, query_tree);
-            }
-        } else {
-            query_tree = this;
-            return;
-        }
-    }
-
-    /**
-     * @brief Find all particles within query region
-     *
-     * @details Recursively searches tree, collecting particles that
-     * fall within the query bounds.
-     *
-     * @param query_bounds Region to search
-     * @param[out] query_particles Vector to append results to
-     *
-     * @note Does not clear query_particles - appends results
-     * @note Typical use for collision detection, neighbor search
-     */
-    void query(Bounds query_bounds, std::vector<T *> &query_particles) {
-        if (!this->bounds.intersects(query_bounds))
-            return;
-        if (is_divided) {
-            for (auto const &child : children) {
-                child->query(query_bounds, query_particles);
-            }
-        } else {
-            for (auto &particle : this->particles) {
-                if (query_bounds.contains(particle->position)) {
-                    query_particles.emplace_back(particle.get());
-                }
-            }
-        }
-    }
-
-    /**
-     * @brief Merge child nodes back into parent
-     *
-     * @details Combines all particles from children into this node
-     * and deletes children. Only succeeds if all children are leaf nodes.
-     *
-     * @return True if merge successful, false otherwise
-     *
-     * @note Used to coarsen tree when particles leave regions
-     */
-    bool merge() {
-        if (!is_divided)
-            return false;
-
-        // Only merge if all children are leaf nodes
-        for (auto &child : children) {
-            if (child->is_divided)
-                return false;
-        }
-
-        for (auto &child : children) {
-            std::move(child->particles.begin(), child->particles.end(),
-                      std::back_inserter(this->particles));
-            delete child;
-        }
-        this->is_divided = false;
-        return true;
-    }
-
-    /**
-     * @brief Calculate center of mass and total mass for subtree
-     *
-     * @details Recursively computes mass properties for Barnes-Hut algorithm:
-     * - For internal nodes: weighted average of children's COM
-     * - For leaf nodes: weighted average of particles
-     * - Also computes theta scale factor: (M_ref/M)^alpha
-     *
-     * @note Must be called after particle positions change
-     * @note Required before force calculation
-     */
-    void calculateCOM() {
-        centerOfMass = {0, 0};
-        totalMass = 0;
-
-        if (is_divided) {
-            for (const auto &child : children) {
-                child->calculateCOM();
-                totalMass += child->totalMass;
-                centerOfMass += (child->centerOfMass * child->totalMass);
-            }
-            centerOfMass /= totalMass;
-        } else {
-            for (auto &particle : particles) {
-                centerOfMass = (centerOfMass * totalMass + particle->position * particle->mass) /
-                               (totalMass + particle->mass);
-                totalMass += particle->mass;
-            }
-        }
-
-        thetaScale = std::pow(MASS_REF / totalMass, ALPHA);
-    }
-
-    /**
-     * @brief Conditionally merge children if particle count is low
-     *
-     * @details Checks if total particles in all children is below MAX_CAPACITY.
-     * If so, and all children are leaves, merges them into this node.
-     *
-     * @note Automatic tree coarsening for efficiency
-     */
-    void mergeIfNeeded() {
-        if (!is_divided)
-            return;
-        size_t total_particles = 0;
-
-        for (auto &child : children) {
-            total_particles += child->particles.size();
-            if (child->is_divided)
-                return; // At least one child still subdivided → don't merge
-        }
-
-        if (total_particles < MAX_CAPACITY)
-            merge();
-    }
-
-    /**
-     * @brief Remove particles that have left their cells
-     *
-     * @details Recursively checks if particles are still within bounds.
-     * Particles outside bounds are removed and added to particlesToRemove.
-     * Automatically merges nodes if they become underpopulated.
-     *
-     * @param[out] particlesToRemove Vector to collect displaced particles
-     *
-     * @note Caller must reinsert displaced particles
-     * @note Maintains tree consistency during particle motion
-     */
-    void updateParticles(std::vector<std::shared_ptr<T>> &particlesToRemove) {
-        if (is_divided) {
-            for (auto const &child : children) {
-                child->updateParticles(particlesToRemove);
-            }
-            mergeIfNeeded();
-        } else {
-            for (auto it = particles.begin(); it != particles.end();) {
-                if (!bounds.contains((*it)->position)) {
-                    particlesToRemove.emplace_back(*it);
-                    it = particles.erase(it);
-                } else {
-                    ++it;
-                }
-            }
-        }
-    }
-
-  private:
-    /**
-     * @brief Subdivide node into 4 children
-     *
-     * @details Creates 4 child quadrants (NW, NE, SW, SE) and redistributes
-     * particles from this node to children.
-     *
-     * Layout:
-     * ```
-     * [0:NW] [1:NE]
-     * [2:SW] [3:SE]
-     * ```
-     *
-     * @note Particles that don't fit in any child remain in parent
-     */
-    void subdivide() {
-        children[0] = new QuadTree<T>(bounds.xmin, bounds.ymin + bounds.height / 2,
-                                      bounds.width / 2, bounds.height / 2, depth + 1, this);
-        children[1] =
-            new QuadTree<T>(bounds.xmin + bounds.width / 2, bounds.ymin + bounds.height / 2,
-                            bounds.width / 2, bounds.height / 2, depth + 1, this);
-        children[2] = new QuadTree<T>(bounds.xmin, bounds.ymin, bounds.width / 2, bounds.height / 2,
-                                      depth + 1, this);
-        children[3] = new QuadTree<T>(bounds.xmin + bounds.width / 2, bounds.ymin, bounds.width / 2,
-                                      bounds.height / 2, depth + 1, this);
-        is_divided = true;
-
-        for (auto it = particles.begin(); it != particles.end();) {
-            bool inserted = false;
-            for (auto &child : children) {
-                if (child->insert(*it)) {
-                    inserted = true;
-                    break;
-                }
-            }
-            if (inserted) {
-                it = particles.erase(it);
-            } else {
-                ++it;
-            }
-        }
-    }
-};
+/**
+ * @file quadtree.h
+ * @brief QuadTree spatial data structure for Barnes-Hut algorithm
+ *
+ * Implements a hierarchical spatial partitioning structure that enables
+ * O(N log N) force calculation in N-body simulations.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "bounds.h"
+#include "multipole.h"
+#include "node_pool.h"
+#include "solver_config.h"
+
+/// @brief Nodes shallower than this spawn one OpenMP task per child
+#define TREE_TASK_DEPTH 4
+
+template <class T> class QuadTree;
+
+/**
+ * @struct QuadTreePools
+ * @brief Node and index storage shared by all nodes of one tree
+ */
+template <class T> struct QuadTreePools {
+    NodePool<QuadTree<T>> nodes; ///< Sibling blocks of four nodes with their leaf indices
+    IndexArena indices;          ///< Index lists that outgrow their node's range
+
+    /// @brief Pools for leaves of leaf_capacity particles
+    explicit QuadTreePools(int leaf_capacity) : nodes(leaf_capacity) {}
+};
+
+/**
+ * @class QuadTree
+ * @brief Hierarchical spatial partitioning tree for 2D N-body simulation
+ *
+ * @tparam T Particle store (structure of arrays with x, y, vx, vy and mass
+ *           arrays and isSource(), e.g. ParticleSet); leaves hold slot indices
+ *           into the store
+ *
+ * @details The QuadTree recursively subdivides 2D space into quadrants,
+ * storing particles in leaf nodes. This enables:
+ * - Fast spatial queries (collision detection, neighbor search)
+ * - Barnes-Hut multipole approximation for gravity
+ * - O(N log N) force calculation instead of O(N²)
+ *
+ * Tree structure:
+ * - Each node covers a rectangular region (bounds)
+ * - Leaf nodes store up to SolverConfig::leaf_capacity particle indices
+ * - Internal nodes have 4 children (quadrants: NW, NE, SW, SE)
+ * - Subdivision stops at SolverConfig::max_depth
+ *
+ * Barnes-Hut properties:
+ * - Each node stores total mass, center of mass and center-of-mass
+ *   velocity of its sources, plus their quadrupole with
+ *   SolverConfig::quadrupole; passive particles are indexed (for
+ *   queries) but carry no mass
+ * - Distant groups of particles treated as single mass
+ * - Opening angle criterion: s/d < θ
+ *
+ * Parallelism: insertMany(), updateParticles(), calculateCOM() and refit()
+ * run the four subtrees of every node above TREE_TASK_DEPTH as OpenMP
+ * tasks. Each task owns its subtree, so no locking is needed.
+ *
+ * Between integrator sub-stages, refit() recomputes the moments from the
+ * current positions without touching the topology. Particles may then
+ * sit outside their cell, so each node also keeps an extent: its bounds
+ * grown to cover its particles, used as the cell size in the opening
+ * criterion.
+ *
+ * Memory: the root owns a QuadTreePools. Children are placed in blocks of
+ * four contiguous siblings from its NodePool, each node with an inline
+ * range of leaf_capacity particle indices in the same block; longer lists
+ * (the root, max-depth leaves) move to the IndexArena. Subdividing and
+ * merging reuse freed blocks instead of going through the global
+ * allocator.
+ */
+template <class T> class QuadTree {
+  public:
+    std::unique_ptr<QuadTreePools<T>> owned_pools; ///< Pools of the tree (root only)
+    QuadTreePools<T> *pools;               ///< Pools of the tree (shared by all nodes)
+    Bounds bounds;                         ///< Spatial region covered by this node
+    Bounds extent;                         ///< Bounds grown to cover the particles (see refit)
+    double totalMass;                      ///< Total mass of all particles in subtree
+    double thetaScale;                     ///< Theta scaling factor: (M_ref/M)^alpha
+    int count;                             ///< Number of particles in subtree (see calculateCOM)
+    vector2D centerOfMass;                 ///< Center of mass of all particles in subtree
+    vector2D comVelocity;                  ///< Velocity of the center of mass
+    Quadrupole quadrupole;                 ///< Quadrupole about the center of mass (SolverConfig::quadrupole)
+    int depth;                             ///< Depth in tree (root = 1)
+    bool is_divided = false;               ///< True if node is subdivided into children
+    LeafIndices particles;                 ///< Particle indices in this leaf (empty if divided)
+    std::array<QuadTree<T> *, 4> children; ///< Child nodes [NW, NE, SW, SE], one contiguous block
+    QuadTree<T> *parent;                   ///< Parent node (nullptr for root)
+    const T *store;                        ///< Particle store the indices refer to
+    const SolverConfig *config;            ///< Tree shape and theta scaling parameters
+
+    /**
+     * @brief Construct a QuadTree node
+     *
+     * @param xmin Left edge of region
+     * @param ymin Bottom edge of region
+     * @param width Width of region
+     * @param height Height of region
+     * @param _depth Depth in tree (root = 1)
+     * @param _parent Pointer to parent node (nullptr for root, which creates the pools)
+     * @param _store Particle store the tree indexes
+     * @param _config Solver parameters (shared by all nodes, must outlive the tree)
+     * @param leaf_storage Inline index range from the pool block (children only)
+     */
+    QuadTree(double xmin, double ymin, double width, double height, int _depth,
+                QuadTree *_parent, const T *_store, const SolverConfig *_config,
+                int *leaf_storage = nullptr)
+        : owned_pools(_parent ? nullptr : new QuadTreePools<T>(_config->leaf_capacity)),
+          pools(_parent ? _parent->pools : owned_pools.get()),
+          particles(&pools->indices, leaf_storage, pools->nodes.leafCapacity()) {
+        bounds.set_bounds(xmin, ymin, width, height);
+        extent = bounds;
+        depth = _depth;
+        totalMass = 0;
+        thetaScale = 0;
+        count = 0;
+        parent = _parent;
+        store = _store;
+        config = _config;
+    }
+
+    QuadTree(const QuadTree &) = delete;
+    QuadTree &operator=(const QuadTree &) = delete;
+
+    /// @brief Return all child nodes to the pool
+    ~QuadTree() { clear(); }
+
+    /**
+     * @brief Remove all particles and children, leaving an empty leaf
+     */
+    void clear() {
+        if (is_divided)
+            releaseChildren();
+        // With every block back, the root may resize them for a new leaf capacity
+        if (owned_pools && owned_pools->nodes.leafCapacity() != config->leaf_capacity)
+            owned_pools->nodes.reset(config->leaf_capacity);
+        particles.clear();
+        totalMass = 0;
+        count = 0;
+        centerOfMass = {0, 0};
+        comVelocity = {0, 0};
+        quadrupole = Quadrupole();
+    }
+
+    /**
+     * @brief Insert a particle into the tree
+     *
+     * @details Recursively finds the appropriate leaf node for the particle:
+     * 1. Check if particle is within bounds
+     * 2. If leaf has capacity, add particle
+     * 3. If leaf is full, subdivide and redistribute
+     * 4. If internal node, recurse to appropriate child
+     *
+     * @param particle Slot index of the particle to insert
+     * @return True if insertion successful, false if out of bounds
+     */
+    bool insert(int particle) {
+        if (!contains(particle))
+            return false;
+
+        if (((particles.size() < static_cast<size_t>(config->leaf_capacity)) && (!is_divided)) ||
+            (depth >= config->max_depth)) {
+            if (particles.capacity() == 0)
+                particles.reserve(config->leaf_capacity);
+            particles.emplace_back(particle);
+            return true;
+        }
+        if (!is_divided) {
+            subdivide();
+        }
+        for (auto &child : children) {
+            if (child->insert(particle)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Insert a batch of particles in parallel
+     *
+     * @details Partitions the batch by quadrant at each divided node and
+     * inserts the four parts as independent OpenMP tasks down to
+     * TREE_TASK_DEPTH. A leaf that would overflow is subdivided once and
+     * the batch pushed down, giving the same cells as repeated insert().
+     * Building a tree from scratch is insertMany() on an empty root.
+     *
+     * @param batch Slot indices to insert (reordered in place)
+     * @return Number of particles inserted (those inside the bounds)
+     *
+     * @note Call from serial code; opens its own parallel region
+     */
+    int insertMany(std::vector<int> &batch) {
+        auto outside = std::partition(batch.begin(), batch.end(),
+                                      [this](int particle) { return contains(particle); });
+        batch.erase(outside, batch.end());
+
+        if (omp_in_parallel()) {
+            insertBatch(batch);
+        } else {
+#pragma omp parallel
+#pragma omp single
+            insertBatch(batch);
+        }
+        return static_cast<int>(batch.size());
+    }
+
+    /**
+     * @brief Find leaf node intersecting query region
+     *
+     * @param query_bounds Region to search
+     * @param[out] query_tree Pointer to intersecting leaf node
+     *
+     * @note Returns first intersecting leaf found
+     */
+    void query_tree(Bounds query_bounds, QuadTree<T> *&query_tree) {
+        if (!this->bounds.intersects(query_bounds))
+            return;
+        if (is_divided) {
+            for (auto const &child : children) {
+                child->query_tree(query_bounds, query_tree);
+            }
+        } else {
+            query_tree = this;
+            return;
+        }
+    }
+
+    /**
+     * @brief Find all particles within query region
+     *
+     * @details Recursively searches tree, collecting particles that
+     * fall within the query bounds.
+     *
+     * @param query_bounds Region to search
+     * @param[out] query_particles Vector to append slot indices to
+     *
+     * @note Does not clear query_particles - appends results
+     * @note Typical use for collision detection, neighbor search
+     */
+    void query(Bounds query_bounds, std::vector<int> &query_particles) const {
+        if (!this->bounds.intersects(query_bounds))
+            return;
+        if (is_divided) {
+            for (auto const &child : children) {
+                child->query(query_bounds, query_particles);
+            }
+        } else {
+            for (int particle : this->particles) {
+                if (query_bounds.contains({store->x[particle], store->y[particle]})) {
+                    query_particles.emplace_back(particle);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Count the nodes of this subtree and its deepest level
+     *
+     * @param[in,out] node_count Incremented by the number of nodes
+     * @param[in,out] max_depth Raised to the deepest node's depth
+     */
+    void countNodes(int &node_count, int &max_depth) const {
+        node_count++;
+        max_depth = std::max(max_depth, depth);
+        if (is_divided) {
+            for (auto const &child : children) {
+                child->countNodes(node_count, max_depth);
+            }
+        }
+    }
+
+    /**
+     * @brief Merge child nodes back into parent
+     *
+     * @details Combines all particles from children into this node
+     * and returns the children to the pool. Only succeeds if all children
+     * are leaf nodes.
+     *
+     * @return True if merge successful, false otherwise
+     *
+     * @note Used to coarsen tree when particles leave regions
+     */
+    bool merge() {
+        if (!is_divided)
+            return false;
+
+        // Only merge if all children are leaf nodes
+        for (auto &child : children) {
+            if (child->is_divided)
+                return false;
+        }
+
+        for (auto &child : children) {
+            this->particles.append(child->particles.begin(), child->particles.end());
+        }
+        releaseChildren();
+        return true;
+    }
+
+    /**
+     * @brief Calculate center of mass and total mass for subtree
+     *
+     * @details Recursively computes mass properties for Barnes-Hut algorithm:
+     * - For internal nodes: weighted average of children's COM
+     * - For leaf nodes: weighted average of particles
+     * - Also computes theta scale factor: (M_ref/M)^alpha
+     *
+     * @note Must be called after particle positions change or the config changes
+     * @note Required before force calculation
+     * @note Subtrees above TREE_TASK_DEPTH are computed as parallel tasks
+     */
+    void calculateCOM() {
+        if (omp_in_parallel()) {
+            computeMoments(true);
+        } else {
+#pragma omp parallel
+#pragma omp single
+            computeMoments(true);
+        }
+    }
+
+    /**
+     * @brief Rebuild the tree from every particle of the store
+     *
+     * @details clear(), one batch insert of all slots and calculateCOM(),
+     * so the tree is ready for the force walk.
+     */
+    void rebuild() {
+        clear();
+        std::vector<int> all(store->x.size());
+        std::iota(all.begin(), all.end(), 0);
+        insertMany(all);
+        calculateCOM();
+    }
+
+    /**
+     * @brief Refresh centers of mass and extents from current positions
+     *
+     * @details Cheap update for integrator sub-stages: keeps the topology,
+     * the particle lists, the total masses and the theta scale factors
+     * from the last calculateCOM(), and only recomputes each node's center
+     * of mass and extent bottom-up. Particles that drifted out of their
+     * cell stay in it and grow its extent instead.
+     *
+     * @note Masses must not have changed since the last calculateCOM()
+     * @note Subtrees above TREE_TASK_DEPTH are computed as parallel tasks
+     */
+    void refit() {
+        if (omp_in_parallel()) {
+            computeMoments(false);
+        } else {
+#pragma omp parallel
+#pragma omp single
+            computeMoments(false);
+        }
+    }
+
+    /**
+     * @brief Conditionally merge children if particle count is low
+     *
+     * @details Checks if total particles in all children is below the leaf capacity.
+     * If so, and all children are leaves, merges them into this node.
+     *
+     * @note Automatic tree coarsening for efficiency
+     */
+    void mergeIfNeeded() {
+        if (!is_divided)
+            return;
+        size_t total_particles = 0;
+
+        for (auto &child : children) {
+            total_particles += child->particles.size();
+            if (child->is_divided)
+                return; // At least one child still subdivided → don't merge
+        }
+
+        if (total_particles < static_cast<size_t>(config->leaf_capacity))
+            merge();
+    }
+
+    /**
+     * @brief Remove particles that have left their cells
+     *
+     * @details Recursively checks if particles are still within bounds.
+     * Particles outside bounds are removed and added to particlesToRemove.
+     * Automatically merges nodes if they become underpopulated.
+     *
+     * @param[out] particlesToRemove Vector to collect displaced particle indices
+     *
+     * @note Caller must reinsert displaced particles (see insertMany)
+     * @note Maintains tree consistency during particle motion
+     * @note Subtrees above TREE_TASK_DEPTH are scanned as parallel tasks
+     */
+    void updateParticles(std::vector<int> &particlesToRemove) {
+        if (omp_in_parallel()) {
+            collectDisplaced(particlesToRemove);
+        } else {
+#pragma omp parallel
+#pragma omp single
+            collectDisplaced(particlesToRemove);
+        }
+    }
+
+    /**
+     * @brief Rewrite particle indices after the store has been compacted
+     *
+     * @param remap Map from old to new slot index (-1 for removed particles),
+     *              as returned by ParticleSet::compact()
+     */
+    void remap(const std::vector<int> &remap) {
+        if (is_divided) {
+            for (auto const &child : children) {
+                child->remap(remap);
+            }
+        } else {
+            int n = 0;
+            for (int particle : particles) {
+                if (remap[particle] >= 0)
+                    particles[n++] = remap[particle];
+            }
+            particles.resize(n);
+        }
+    }
+
+  private:
+    /**
+     * @brief Recursive worker for calculateCOM() and refit()
+     *
+     * @details The quadrupole (SolverConfig::quadrupole) is taken about the
+     * new center of mass: children are shifted by the parallel-axis rule,
+     * leaf particles are summed in a second pass.
+     *
+     * @param full Also recompute total masses and theta scale factors
+     */
+    void computeMoments(bool full) {
+        extent = bounds;
+
+        if (is_divided) {
+            if (depth < TREE_TASK_DEPTH) {
+                for (int c = 0; c < 4; c++) {
+#pragma omp task firstprivate(c, full)
+                    children[c]->computeMoments(full);
+                }
+#pragma omp taskwait
+            } else {
+                for (const auto &child : children) {
+                    child->computeMoments(full);
+                }
+            }
+            if (full)
+                totalMass = 0;
+            count = 0;
+            centerOfMass = {0, 0};
+            comVelocity = {0, 0};
+            for (const auto &child : children) {
+                if (full)
+                    totalMass += child->totalMass;
+                count += child->count;
+                centerOfMass += (child->centerOfMass * child->totalMass);
+                comVelocity += (child->comVelocity * child->totalMass);
+                extent.expand(child->extent);
+            }
+            if (totalMass > 0) {
+                centerOfMass /= totalMass;
+                comVelocity /= totalMass;
+            }
+            if (config->quadrupole) {
+                quadrupole = Quadrupole();
+                for (const auto &child : children) {
+                    vector2D offset = child->centerOfMass - centerOfMass;
+                    quadrupole.addShifted(child->quadrupole, child->totalMass, offset.x, offset.y);
+                }
+            }
+        } else {
+            if (full)
+                totalMass = 0;
+            count = static_cast<int>(particles.size());
+            centerOfMass = {0, 0};
+            comVelocity = {0, 0};
+            for (int particle : particles) {
+                if (!store->isSource(particle, config->passive_mass))
+                    continue;
+                double m = store->mass[particle];
+                vector2D position(store->x[particle], store->y[particle]);
+                if (full)
+                    totalMass += m;
+                centerOfMass += position * m;
+                comVelocity += vector2D(store->vx[particle], store->vy[particle]) * m;
+                extent.expand(position);
+            }
+            if (totalMass > 0) {
+                centerOfMass /= totalMass;
+                comVelocity /= totalMass;
+            }
+            if (config->quadrupole) {
+                quadrupole = Quadrupole();
+                for (int particle : particles) {
+                    if (!store->isSource(particle, config->passive_mass))
+                        continue;
+                    quadrupole.addPoint(store->mass[particle],
+                                        store->x[particle] - centerOfMass.x,
+                                        store->y[particle] - centerOfMass.y);
+                }
+            }
+        }
+
+        if (full)
+            thetaScale = std::pow(config->mass_ref / totalMass, config->alpha);
+    }
+
+    /**
+     * @brief Recursive worker for updateParticles()
+     *
+     * @details Tasks collect into their own vectors, which the parent
+     * appends in child order once all four have finished.
+     *
+     * @param[out] displaced Vector to append displaced particle indices to
+     */
+    void collectDisplaced(std::vector<int> &displaced) {
+        if (is_divided) {
+            if (depth < TREE_TASK_DEPTH) {
+                std::array<std::vector<int>, 4> parts;
+                for (int c = 0; c < 4; c++) {
+#pragma omp task shared(parts) firstprivate(c)
+                    children[c]->collectDisplaced(parts[c]);
+                }
+#pragma omp taskwait
+                for (auto &part : parts) {
+                    displaced.insert(displaced.end(), part.begin(), part.end());
+                }
+            } else {
+                for (auto const &child : children) {
+                    child->collectDisplaced(displaced);
+                }
+            }
+            mergeIfNeeded();
+        } else {
+            int n = 0;
+            for (int particle : particles) {
+                if (contains(particle))
+                    particles[n++] = particle;
+                else
+                    displaced.emplace_back(particle);
+            }
+            particles.resize(n);
+        }
+    }
+
+    /**
+     * @brief Recursive worker for insertMany()
+     *
+     * @param batch Slot indices inside this node's bounds
+     */
+    void insertBatch(std::vector<int> &batch) {
+        if (batch.empty())
+            return;
+
+        if (!is_divided) {
+            if ((particles.size() + batch.size() <= static_cast<size_t>(config->leaf_capacity)) ||
+                (depth >= config->max_depth)) {
+                particles.append(batch.begin(), batch.end());
+                return;
+            }
+            subdivide();
+        }
+
+        // Partition the batch by child; particles no child contains stay here
+        std::array<std::vector<int>, 4> parts;
+        for (int particle : batch) {
+            bool inserted = false;
+            for (int c = 0; c < 4; c++) {
+                if (children[c]->contains(particle)) {
+                    parts[c].push_back(particle);
+                    inserted = true;
+                    break;
+                }
+            }
+            if (!inserted)
+                particles.push_back(particle);
+        }
+
+        if (depth < TREE_TASK_DEPTH) {
+            for (int c = 0; c < 4; c++) {
+#pragma omp task shared(parts) firstprivate(c)
+                children[c]->insertBatch(parts[c]);
+            }
+#pragma omp taskwait
+        } else {
+            for (int c = 0; c < 4; c++) {
+                children[c]->insertBatch(parts[c]);
+            }
+        }
+    }
+
+    /**
+     * @brief Check if a particle lies inside this node
+     * @param particle Slot index
+     */
+    bool contains(int particle) const {
+        return bounds.contains({store->x[particle], store->y[particle]});
+    }
+
+    /**
+     * @brief Destroy the children and return their block to the pool
+     */
+    void releaseChildren() {
+        for (auto &child : children) {
+            child->~QuadTree();
+        }
+        pools->nodes.deallocate(children[0]);
+        is_divided = false;
+    }
+
+    /**
+     * @brief Subdivide node into 4 children
+     *
+     * @details Creates 4 child quadrants (NW, NE, SW, SE) in one pool block
+     * and redistributes particles from this node to children.
+     *
+     * Layout:
+     * ```
+     * [0:NW] [1:NE]
+     * [2:SW] [3:SE]
+     * ```
+     *
+     * @note Particles that don't fit in any child remain in parent
+     */
+    void subdivide() {
+        const double half_w = bounds.width / 2;
+        const double half_h = bounds.height / 2;
+        int *leaves;
+        QuadTree<T> *block = pools->nodes.allocate(leaves);
+        const int room = pools->nodes.leafCapacity();
+        children[0] = new (block + 0) QuadTree<T>(bounds.xmin, bounds.ymin + half_h, half_w,
+                                                  half_h, depth + 1, this, store, config, leaves);
+        children[1] =
+            new (block + 1) QuadTree<T>(bounds.xmin + half_w, bounds.ymin + half_h, half_w,
+                                        half_h, depth + 1, this, store, config, leaves + room);
+        children[2] = new (block + 2) QuadTree<T>(bounds.xmin, bounds.ymin, half_w, half_h,
+                                                  depth + 1, this, store, config, leaves + 2 * room);
+        children[3] = new (block + 3) QuadTree<T>(bounds.xmin + half_w, bounds.ymin, half_w,
+                                                  half_h, depth + 1, this, store, config,
+                                                  leaves + 3 * room);
+        is_divided = true;
+
+        // Particles that fit no child stay here, in their original order
+        int n = 0;
+        for (int particle : particles) {
+            bool inserted = false;
+            for (auto &child : children) {
+                if (child->insert(particle)) {
+                    inserted = true;
+                    break;
+                }
+            }
+            if (!inserted)
+                particles[n++] = particle;
+        }
+        particles.resize(n);
+        if (n == 0)
+            particles.release();
+    }
+};
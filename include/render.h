@@ -7,15 +7,25 @@
 
 #include "global.h"
 #include "particle.h"
+#include "particle_set.h"
 #include "bounds.h"
 #include "quadtree.h"
-#include "interactions.h"
+#include "simulation.h"
+#include "simulation_thread.h"
 #include <SFML/Graphics.hpp>
 
 #define CELL_SIZE 1   ///< Pixel size of grid cells
 #define GRID_SIZE 800 ///< Window size in pixels
 #define START 50      ///< Margin from window edge
 
+/// @name Level of detail
+/// @{
+#define LOD_PIXELS 1.0    ///< Tree cells narrower than this on screen are drawn as one point
+#define LOD_FULL_COUNT 16 ///< Particles in an aggregated cell for full point brightness
+/// @}
+
+#define RENDER_THREADS 1 ///< OpenMP threads of the viewer (frames come with their tree)
+
 /// @name Rendering colors
 /// @{
 extern sf::Color BACKGROUND_COLOR; ///< Background color (black)
@@ -42,7 +52,10 @@ vector2D invtransform(vector2D vec);
  * @brief Main rendering class for visualization
  *
  * @details Handles SFML window creation, event processing, and rendering
- * of particles, quadtree structure, and UI elements.
+ * of particles, quadtree structure, and UI elements. The renderer is a
+ * front end: the Simulation steps on a SimulationThread, and the renderer
+ * only reads the frames it publishes, so drawing and picking never stall
+ * the integrator or race with it.
  *
  * Features:
  * - Real-time particle visualization
@@ -51,6 +64,12 @@ vector2D invtransform(vector2D vec);
  * - Zoom and pan controls
  * - Velocity-based coloring (bound vs unbound orbits)
  * - Pause/resume simulation
+ *
+ * Particles and the tree overlay are drawn by walking the LinearQuadTree
+ * the stepping thread builds with each frame: cells outside the view are
+ * culled, and cells smaller than LOD_PIXELS on screen are drawn as a
+ * single point, so frame cost follows what is visible rather than the
+ * particle count.
  */
 class Render
 {
@@ -58,24 +77,24 @@ public:
     /**
      * @brief Construct renderer
      *
-     * @param _particles Reference to particle vector
-     * @param _tree Pointer to QuadTree structure
+     * @param _sim Simulation to watch and step (owned by the stepping
+     *             thread while run() is active)
+     * @param publish_interval Steps between published frames
      */
-    Render(std::vector<std::shared_ptr<Particle>> &_particles, QuadTree<Particle> *_tree)
-        : particles(_particles), tree(_tree)
+    Render(Simulation &_sim, int publish_interval = 1) : stepper(_sim, frames, publish_interval)
     {
         window.create(sf::VideoMode(GRID_SIZE * CELL_SIZE, GRID_SIZE * CELL_SIZE), "quadtree");
         window.setFramerateLimit(120);
     }
 
     /// @brief Render debug particles (green circles)
-    void renderTestParticles(const std::vector<Particle *> particles);
+    void renderTestParticles(const std::vector<int> &indices);
 
-    /// @brief Render all particles with velocity-based coloring
-    void renderParticles(const std::vector<std::shared_ptr<Particle>> &);
+    /// @brief Render the visible particles of the frame with velocity-based coloring
+    void renderParticles();
 
-    /// @brief Render QuadTree structure overlay
-    void renderTree(QuadTree<Particle> *);
+    /// @brief Render LinearQuadTree structure overlay
+    void renderTree(const LinearQuadTree<ParticleSet> *);
 
     /// @brief Render a bounding box outline
     void renderBounds(Bounds);
@@ -83,20 +102,19 @@ public:
     /// @brief Render a line between two points
     void renderLine(vector2D, vector2D);
 
-    /// @brief Render simulation time display
-    void renderTime(double);
+    /// @brief Render simulation time display (and the frame's step metrics)
+    void renderTime(const Frame &);
 
     /// @brief Render information about tracked particle
-    void renderParticleInfo(Particle *);
+    void renderParticleInfo(const Particle &);
 
     /**
      * @brief Main render loop
      *
      * @details Handles:
      * - Event processing (mouse, keyboard)
-     * - Simulation stepping
-     * - Rendering all elements
-     * - QuadTree updates
+     * - Simulation stepping on a SimulationThread (while not paused)
+     * - Rendering all elements from the latest frame
      *
      * Controls:
      * - Mouse click: Track particle
@@ -104,28 +122,68 @@ public:
      * - T: Toggle tree visualization
      * - C: Clear particle tracking
      * - Mouse wheel: Zoom
-     *
-     * @param dt Timestep for integration
      */
-    void run(double);
+    void run();
 
 private:
     sf::RenderWindow window;                               ///< SFML render window
-    std::vector<std::shared_ptr<Particle>> &particles;     ///< Particle array reference
-    QuadTree<Particle> *tree;                              ///< QuadTree pointer
-    Particle *track_particle = nullptr;                    ///< Currently tracked particle
-    std::vector<Particle *> query_particles;               ///< Query result buffer
+    FrameBuffer frames;                                    ///< Frames from the stepping thread
+    SimulationThread stepper;                              ///< Steps the simulation
+    const Frame *frame = nullptr;                          ///< Current frame
+    const ParticleSet *particles = nullptr;                ///< Particles of the current frame
+    int track_id = -1;                                     ///< ID of tracked particle (-1 for none)
+    int track_slot = -1;                                   ///< Slot of track_id in the frame
+    std::vector<int> query_particles;                      ///< Query result buffer
     Bounds query_bounds;                                   ///< Query region
     bool shouldRenderTree = false;                         ///< Show QuadTree overlay
-    bool pauseSim = true;                                  ///< Simulation paused
     double view_width = 8;                                 ///< View width in sim units
     vector2D view_center;                                  ///< View center position
+    sf::VertexArray points{sf::Points};                    ///< Point buffer, refilled every frame
+    double lod_width = 0;                                  ///< Cell width drawn as one point (sim units)
+    double two_mu = 0;                                     ///< 2*G*M of the central particle
+    vector2D central_position;                             ///< Position of the central particle
+    vector2D central_velocity;                             ///< Velocity of the central particle
+
+    /**
+     * @brief Color of a test particle: bound or unbound to the central particle
+     *
+     * @param i Slot index of the particle
+     */
+    sf::Color particleColor(int i) const;
+
+    /**
+     * @brief Append a point to the point buffer
+     *
+     * @param position Position in simulation units
+     * @param color Point color
+     * @param brightness Color scale in (0, 1]
+     */
+    void addPoint(vector2D position, sf::Color color, double brightness);
+
+    /**
+     * @brief Append points for the visible non-primary particles of a subtree
+     *
+     * @param tree LinearQuadTree to walk
+     * @param node Index of the node in tree->nodes
+     */
+    void collectPoints(const LinearQuadTree<ParticleSet> *tree, int node);
+
+    /// @brief Switch to the latest published frame, if there is a new one
+    void acquireFrame();
 
     /**
      * @brief Find particle at mouse cursor position
      *
-     * @details Uses QuadTree spatial query to find nearest particle
-     * to mouse click location. Updates track_particle.
+     * @details Uses the frame's tree query to find nearest particle
+     * to mouse click location. Updates track_id.
      */
     void findTrackParticle();
+
+    /**
+     * @brief Slot index of the tracked particle
+     *
+     * @return Index into particles, or -1 if nothing is tracked or the
+     *         tracked particle has been merged away
+     */
+    int trackIndex() const { return track_id < 0 ? -1 : track_slot; }
 };
@@ -0,0 +1,269 @@
+/**
+ * @file simulation.h
+ * @brief Stepping engine for the N-body simulation
+ *
+ * Owns the particle state and the QuadTree and advances them in time,
+ * independent of any front end. The SFML viewer and the headless driver
+ * both drive the same engine.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "diagnostics.h"
+#include "particle.h"
+#include "particle_set.h"
+#include "quadtree.h"
+#include "linear_quadtree.h"
+#include "solver_config.h"
+
+/// @brief Factor applied to dt when the energy changes by more than the tolerance
+#define DT_REDUCTION 0.5
+
+/// @brief Smallest dt the energy trigger reduces to, relative to the dt set
+#define DT_MIN_FRACTION 1e-3
+
+/**
+ * @enum tree_type
+ * @brief Available tree structures for force calculation and queries
+ */
+enum tree_type {
+    POINTER_TREE, ///< QuadTree updated incrementally each step
+    LINEAR_TREE   ///< LinearQuadTree rebuilt from Morton-sorted particles each step
+};
+
+/**
+ * @struct EnergyTracking
+ * @brief State of the energy drift measurement (see Simulation::checkEnergy())
+ *
+ * @details Saved in snapshots with the dt set, so a restarted run keeps
+ * its drift and dt floor.
+ */
+struct EnergyTracking {
+    double reference = 0; ///< Energy of the first diagnostic step
+    double last = 0;      ///< Energy of the last diagnostic step
+    long count = -1;      ///< Particle count at last (-1 before the first)
+    double drift = 0;     ///< Relative drift of the counted intervals
+};
+
+/**
+ * @class Simulation
+ * @brief Owns particles and tree, and advances the system by fixed timesteps
+ *
+ * @details Each call to step() performs one complete timestep:
+ * 1. Update the tree: incremental remove/reinsert for POINTER_TREE, or a
+ *    full Morton-order rebuild for LINEAR_TREE
+ * 2. Calculate center of mass for Barnes-Hut
+ * 3. With adaptive theta, re-estimate the force error and rescale theta
+ *    (every SolverConfig::error_interval steps)
+ * 4. Integrate, resolve collisions and recenter (updateParticles)
+ * 5. On diagnostic steps, check the energy change and reduce dt if it is
+ *    above SolverConfig::energy_tolerance (see checkEnergy())
+ *
+ * Front ends only observe the engine through getParticles(), query(),
+ * the tree accessors and getTime(); they decide when to call step().
+ */
+class Simulation
+{
+public:
+    /**
+     * @brief Construct an empty simulation
+     *
+     * @param xmin Left edge of the tree domain
+     * @param ymin Bottom edge of the tree domain
+     * @param width Width of the tree domain
+     * @param height Height of the tree domain
+     * @param _dt Integration timestep
+     * @param _config Force solver parameters
+     */
+    Simulation(double xmin, double ymin, double width, double height, double _dt,
+               const SolverConfig &_config = SolverConfig())
+        : config(_config), tree(xmin, ymin, width, height, 1, nullptr, &particles, &config),
+          linear_tree(xmin, ymin, width, height, &particles, &config), dt(_dt), dt_set(_dt)
+    {
+    }
+
+    Simulation(const Simulation &) = delete;
+    Simulation &operator=(const Simulation &) = delete;
+
+    /**
+     * @brief Add a particle to the simulation and insert it into the tree
+     *
+     * @param particle Particle to add (copied into the particle store)
+     * @return True if the particle lies inside the tree domain
+     */
+    bool addParticle(const Particle &particle);
+
+    /**
+     * @brief Advance the system by one timestep dt
+     */
+    void step();
+
+    /**
+     * @brief Advance the system by a fixed number of steps
+     *
+     * @param nsteps Number of steps to take
+     */
+    void run(long nsteps);
+
+    /**
+     * @brief Advance the system until the simulation time reaches t_end
+     *
+     * @param t_end Target simulation time
+     *
+     * @note Stops at the step boundary nearest to t_end
+     */
+    void runUntil(double t_end);
+
+    /// @brief Current simulation time
+    double getTime() const { return time; }
+
+    /// @brief Integration timestep
+    double getDt() const { return dt; }
+
+    /// @brief Set the integration timestep (also the base of the DT_MIN_FRACTION floor)
+    void setDt(double _dt) { dt = dt_set = _dt; }
+
+    /// @brief Timestep last set with setDt() (dt may since have been reduced)
+    double getDtSet() const { return dt_set; }
+
+    /// @brief Number of steps taken so far
+    long getStepCount() const { return step_count; }
+
+    /// @brief Region covered by the trees
+    const Bounds &getBounds() const { return linear_tree.bounds; }
+
+    /**
+     * @brief Index every particle after the store was filled directly
+     *
+     * @details Bulk-builds the active tree from the whole particle store in
+     * one pass (a parallel batch insert for POINTER_TREE, a Morton-order
+     * build for LINEAR_TREE). Call it after generating or loading particles
+     * into getParticles() instead of adding them one by one.
+     */
+    void rebuildTree() { setTreeType(tree_kind); }
+
+    /**
+     * @brief Continue from a state loaded directly into the particle store
+     *
+     * @param _time Simulation time of the loaded state
+     * @param _step_count Steps taken up to the loaded state
+     * @param _dt_set Timestep originally set, the base of the dt floor
+     * @param _energy Energy drift measurement of the loaded state
+     *
+     * @note Rebuilds the active tree from the particle store
+     */
+    void resume(double _time, long _step_count, double _dt_set,
+                const EnergyTracking &_energy);
+
+    /**
+     * @brief Select the tree used for forces and queries
+     *
+     * @param type POINTER_TREE or LINEAR_TREE
+     *
+     * @note Switching rebuilds the newly selected tree from the particle store
+     */
+    void setTreeType(tree_type type);
+
+    /// @brief Tree used for forces and queries
+    tree_type getTreeType() const { return tree_kind; }
+
+    /**
+     * @brief Replace the force solver parameters
+     *
+     * @param _config New parameters
+     *
+     * @note Rebuilds the active tree, since leaf capacity and depth may change
+     */
+    void setConfig(const SolverConfig &_config);
+
+    /// @brief Force solver parameters (theta is the current value when adaptive)
+    const SolverConfig &getConfig() const { return config; }
+
+    /// @brief Mean relative force error from the last adaptive theta estimate (0 if none)
+    double getForceError() const { return force_error; }
+
+    /// @brief Conserved quantities after the last step (with the potential on diagnostic steps)
+    const Diagnostics &getDiagnostics() const { return diagnostics; }
+
+    /**
+     * @brief Relative energy drift since the first diagnostic step
+     *
+     * @details Sum of the energy changes between consecutive diagnostic
+     * steps, relative to the first measured energy. Intervals in which
+     * the particle count changed (collisions, particles leaving the
+     * domain) are left out, so only the integration error is counted.
+     */
+    double getEnergyDrift() const { return energy.drift; }
+
+    /// @brief Energy drift measurement (saved in snapshots)
+    const EnergyTracking &getEnergyTracking() const { return energy; }
+
+    /**
+     * @brief Find all particles within a region using the active tree
+     *
+     * @param query_bounds Region to search
+     * @param[out] query_particles Vector to append slot indices to
+     */
+    void query(Bounds query_bounds, std::vector<int> &query_particles) const;
+
+    /// @brief Particle store (read by front ends)
+    ParticleSet &getParticles() { return particles; }
+
+    /// @brief Particle store (read-only)
+    const ParticleSet &getParticles() const { return particles; }
+
+    /// @brief QuadTree root (valid when the tree type is POINTER_TREE)
+    QuadTree<ParticleSet> *getTree() { return &tree; }
+
+    /// @brief LinearQuadTree (valid when the tree type is LINEAR_TREE)
+    const LinearQuadTree<ParticleSet> *getLinearTree() const { return &linear_tree; }
+
+private:
+    SolverConfig config;                              ///< Force solver parameters (read by the trees)
+    ParticleSet particles;                            ///< Particle store
+    QuadTree<ParticleSet> tree;                       ///< QuadTree root (indexes particles)
+    LinearQuadTree<ParticleSet> linear_tree;          ///< Morton-ordered tree (indexes particles)
+    tree_type tree_kind = POINTER_TREE;               ///< Tree used for forces and queries
+    double dt;                                        ///< Integration timestep
+    double time = 0;                                  ///< Elapsed simulation time
+    long step_count = 0;                              ///< Steps taken
+    double force_error = 0;                           ///< Last estimated force error
+    double dt_set;                                    ///< Timestep last set (base of the dt floor)
+    Diagnostics diagnostics;                          ///< Conserved quantities after the last step
+    EnergyTracking energy;                            ///< Energy drift measurement
+
+    /**
+     * @brief Rebalance the tree after particles have moved
+     *
+     * @details Removes particles that left their cells, reinserts them as one
+     * parallel batch and recomputes the Barnes-Hut mass moments, with the
+     * tree's subtrees processed as OpenMP tasks.
+     */
+    void updateTree();
+
+    /**
+     * @brief Rescale theta towards the target force error (adaptive mode)
+     *
+     * @details Estimates the error at the current theta and rescales theta
+     * by sqrt(target / error), since the truncation error of the monopole
+     * approximation grows roughly as theta², or by cbrt(target / error)
+     * with quadrupoles, whose error grows as theta³. The factor is limited to
+     * [0.5, 2] per update and theta to [theta_min, theta_max].
+     *
+     * @param active Tree with up-to-date moments
+     */
+    template <class Tree> void adaptTheta(const Tree *active);
+
+    /**
+     * @brief Update the energy drift and reduce dt if the energy jumped
+     *
+     * @details Reads the diagnostics of a diagnostic step. If the energy
+     * changed by more than energy_tolerance relative to the previous
+     * diagnostic step, dt is multiplied by DT_REDUCTION, down to
+     * DT_MIN_FRACTION of the dt set. Steps whose particle count differs
+     * from the previous diagnostic step are only recorded, since merging
+     * collisions dissipate energy.
+     */
+    void checkEnergy();
+};
@@ -0,0 +1,168 @@
+/**
+ * @file simulation_thread.h
+ * @brief Stepping a Simulation on its own thread behind a frame triple buffer
+ *
+ * A front end that watches a run (the viewer) must not read the particle
+ * store while the integrator writes it, nor hold the integrator up while
+ * it draws. SimulationThread steps the simulation on a worker thread and
+ * publishes a Frame, a copy of the state a viewer needs, every few steps
+ * into a FrameBuffer. The frame carries its own LinearQuadTree, built on
+ * the stepping thread, so the viewer takes the latest frame without locks
+ * and does all its work (drawing, culling, picking) on that copy without
+ * an O(N) pass of its own.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "linear_quadtree.h"
+#include "particle_set.h"
+#include "profiler.h"
+#include "simulation.h"
+#include <atomic>
+#include <thread>
+
+/// @brief Sleep of the worker while paused (milliseconds)
+#define FRAME_IDLE_MS 2
+
+/**
+ * @struct Frame
+ * @brief Copy of the simulation state a viewer draws from
+ *
+ * @details Only positions, velocities, masses, radii, IDs and flags are
+ * copied; the other particle arrays are sized but left unset. The step
+ * metrics are copied too, since the profiler overwrites them every step.
+ * The tree (nodes and order, without moments) and the primary slots
+ * index this frame's particles; a frame is not copyable, since the tree
+ * points into it.
+ */
+struct Frame {
+    ParticleSet particles;     ///< Particle state at step_count
+    double time = 0;           ///< Simulation time
+    long step_count = 0;       ///< Steps taken
+    StepMetrics metrics;       ///< Metrics of the last step (profiling builds)
+    bool with_metrics = false; ///< metrics is set
+    SolverConfig tree_config;  ///< Tree shape of tree
+    LinearQuadTree<ParticleSet> tree{0, 0, 0, 0, &particles, &tree_config}; ///< Tree over particles
+    std::vector<int> primaries; ///< Slots of the primary particles
+
+    Frame() = default;
+    Frame(const Frame &) = delete;
+    Frame &operator=(const Frame &) = delete;
+};
+
+/**
+ * @brief Copy the current state of a simulation into a frame
+ *
+ * @details Also builds the frame's tree over the simulation domain and
+ * collects its primary slots.
+ *
+ * @param sim Simulation to copy (must not be stepping)
+ * @param[out] frame Frame to overwrite; its arrays keep their capacity
+ */
+void captureFrame(const Simulation &sim, Frame &frame);
+
+/**
+ * @class FrameBuffer
+ * @brief Lock-free triple buffer of frames
+ *
+ * @details One producer and one consumer. The producer writes into
+ * writeFrame() and publish()es it; the consumer calls acquire() and reads
+ * readFrame(). The two never touch the same frame: the third slot is the
+ * one handed over, and an atomic exchange of its index (with a flag for
+ * "not yet consumed") swaps it with either side. A producer faster than
+ * the consumer overwrites frames that were never read, so the consumer
+ * always gets the latest one and neither side waits.
+ */
+class FrameBuffer
+{
+public:
+    /// @brief Frame the producer may write (producer only)
+    Frame &writeFrame() { return frames[write_index]; }
+
+    /// @brief Hand the written frame over and take the spare one (producer only)
+    void publish();
+
+    /**
+     * @brief Take the latest published frame, if it is new (consumer only)
+     *
+     * @return True if readFrame() changed
+     */
+    bool acquire();
+
+    /// @brief Frame the consumer may read (consumer only)
+    const Frame &readFrame() const { return frames[read_index]; }
+
+private:
+    /// @brief Flag on the spare index: published and not yet acquired
+    static constexpr int FRESH = 4;
+
+    Frame frames[3];                 ///< Write, spare and read frames
+    int write_index = 0;             ///< Producer's frame
+    int read_index = 1;              ///< Consumer's frame
+    std::atomic<int> spare_index{2}; ///< Frame in between, plus FRESH
+};
+
+/**
+ * @class SimulationThread
+ * @brief Steps a Simulation on a worker thread and publishes frames
+ *
+ * @details Between start() and stop() the worker owns the simulation:
+ * nothing else may call into it. While running, it steps and publishes a
+ * frame every publish interval; while paused, it publishes the last step
+ * if that was not yet published and sleeps. The worker runs its parallel
+ * regions with the OpenMP thread count of the thread that constructed it.
+ */
+class SimulationThread
+{
+public:
+    /**
+     * @brief Prepare a worker for a simulation
+     *
+     * @param _sim Simulation to step
+     * @param _frames Buffer to publish into (the worker is its producer)
+     * @param _publish_interval Steps between published frames
+     */
+    SimulationThread(Simulation &_sim, FrameBuffer &_frames, int _publish_interval = 1)
+        : sim(_sim), frames(_frames), publish_interval(std::max(_publish_interval, 1)),
+          threads(omp_get_max_threads()) {}
+
+    SimulationThread(const SimulationThread &) = delete;
+    SimulationThread &operator=(const SimulationThread &) = delete;
+
+    /// @brief Stops the worker
+    ~SimulationThread() { stop(); }
+
+    /**
+     * @brief Publish the current state and start the worker
+     *
+     * @details The first frame is published before this returns, so the
+     * consumer can acquire() it right away. No-op if the worker is running.
+     */
+    void start();
+
+    /// @brief Stop the worker and wait for its current step
+    void stop();
+
+    /// @brief Pause or resume stepping
+    void setPaused(bool _paused) { paused.store(_paused, std::memory_order_relaxed); }
+
+    /// @brief True if stepping is paused
+    bool isPaused() const { return paused.load(std::memory_order_relaxed); }
+
+private:
+    Simulation &sim;                   ///< Simulation being stepped
+    FrameBuffer &frames;               ///< Buffer published into
+    int publish_interval;              ///< Steps between published frames
+    int threads;                       ///< OpenMP threads of the worker
+    long published_step = -1;          ///< Step of the last published frame
+    std::thread worker;                ///< Stepping thread
+    std::atomic<bool> paused{true};    ///< Stepping paused
+    std::atomic<bool> stopping{false}; ///< Worker asked to exit
+
+    /// @brief Worker loop
+    void loop();
+
+    /// @brief Capture and publish the current state
+    void publish();
+};
@@ -0,0 +1,147 @@
+/**
+ * @file snapshot.h
+ * @brief Binary checkpoint/restart snapshots of a Simulation
+ *
+ * A snapshot is a fixed 160-byte header followed by one column per saved
+ * per-particle array, in native byte order:
+ *
+ * | Column                         | Type     |
+ * |--------------------------------|----------|
+ * | x, y, vx, vy, ax, ay, jx, jy   | double   |
+ * | mass, radius                   | double   |
+ * | id                             | int32_t  |
+ * | flags, level                   | uint8_t  |
+ *
+ * Every column starts on an 8-byte boundary. Acceleration and jerk are
+ * saved with the positions, so the Hermite integrators resume without a
+ * bootstrap force evaluation, and the block timestep levels are saved
+ * with them.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "simulation.h"
+#include <string>
+#include <thread>
+
+/// @brief Snapshot format version (bumped on any layout change)
+#define SNAPSHOT_VERSION 2
+
+/**
+ * @struct SnapshotHeader
+ * @brief File header of a snapshot
+ */
+struct SnapshotHeader {
+    char magic[8];           ///< "NBODYSNP"
+    uint32_t version;        ///< SNAPSHOT_VERSION
+    uint32_t byte_order;     ///< 0x01020304 as written (detects foreign byte order)
+    uint64_t count;          ///< Number of particles
+    uint64_t file_bytes;     ///< Total file size (detects truncation)
+    double time;             ///< Simulation time
+    int64_t step_count;      ///< Steps taken
+    double dt;               ///< Integration timestep (possibly reduced by the energy trigger)
+    double theta;            ///< Opening angle (the adapted value when adaptive)
+    double domain[4];        ///< Tree domain: xmin, ymin, width, height
+    int32_t transport;       ///< Integrator (transport_type)
+    int32_t tree;            ///< Tree kind (tree_type)
+    double dt_set;           ///< Timestep set, the base of the dt floor
+    double energy_reference; ///< EnergyTracking::reference
+    double energy_last;      ///< EnergyTracking::last
+    double energy_drift;     ///< EnergyTracking::drift
+    int64_t energy_count;    ///< EnergyTracking::count
+    uint8_t reserved[16];    ///< Zero
+};
+static_assert(sizeof(SnapshotHeader) == 160, "snapshot header must stay 160 bytes");
+
+/**
+ * @brief Serialize a simulation into a snapshot image
+ *
+ * @param sim Simulation to save
+ * @param[out] image Bytes of the snapshot file (replaced)
+ */
+void encodeSnapshot(const Simulation &sim, std::vector<char> &image);
+
+/**
+ * @brief Write a snapshot synchronously
+ *
+ * @details Writes to path + ".tmp", flushes it to disk and renames it over
+ * path, so a preempted write never leaves a truncated snapshot behind.
+ *
+ * @param sim Simulation to save
+ * @param path Output file
+ * @return False if the file could not be written (reported on stderr)
+ */
+bool writeSnapshot(const Simulation &sim, const char *path);
+
+/**
+ * @brief Append the particles of a snapshot to a particle store
+ *
+ * @details Memory-maps the file, checks the header and copies the columns
+ * straight into the arrays. Used for restarts and to load snapshots as
+ * initial conditions.
+ *
+ * @param path Snapshot file
+ * @param[out] particles Store to append to
+ * @param[out] header Header of the file
+ * @return False if the file is missing or invalid (reported on stderr)
+ */
+bool readSnapshotParticles(const char *path, ParticleSet &particles, SnapshotHeader &header);
+
+/**
+ * @brief Restart a simulation from a snapshot
+ *
+ * @details Memory-maps the file, checks the header, copies the columns
+ * straight into the particle store and rebuilds the saved tree kind.
+ * Restores time, step count, dt and the dt set, the energy drift
+ * measurement, theta and the integrator selection (TRANSPORT_TYPE); the
+ * other solver parameters come from config.
+ *
+ * @param path Snapshot file
+ * @param config Solver parameters for the restarted run
+ * @return Restored simulation, or null if the file is missing or invalid
+ *         (reported on stderr)
+ */
+std::unique_ptr<Simulation> loadSnapshot(const char *path,
+                                         const SolverConfig &config = SolverConfig());
+
+/**
+ * @class SnapshotWriter
+ * @brief Writes snapshots on a background thread
+ *
+ * @details write() encodes the state in the calling thread, which costs a
+ * copy of the saved arrays, and hands the image to a background thread
+ * for the file I/O, so stepping continues while the snapshot is written.
+ * At most one write is in flight: a new write() first waits for the
+ * previous one.
+ */
+class SnapshotWriter
+{
+public:
+    SnapshotWriter() = default;
+    SnapshotWriter(const SnapshotWriter &) = delete;
+    SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+
+    /// @brief Waits for the last write
+    ~SnapshotWriter() { wait(); }
+
+    /**
+     * @brief Start writing a snapshot of the current state
+     *
+     * @param sim Simulation to save (may be stepped as soon as this returns)
+     * @param path Output file (written atomically, see writeSnapshot)
+     */
+    void write(const Simulation &sim, const std::string &path);
+
+    /**
+     * @brief Wait for the write in flight, if any
+     *
+     * @return False if the last write failed
+     */
+    bool wait();
+
+private:
+    std::thread worker;      ///< Thread doing the file I/O
+    std::vector<char> image; ///< Snapshot being written
+    bool ok = true;          ///< Result of the last finished write
+};
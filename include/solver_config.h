@@ -0,0 +1,105 @@
+/**
+ * @file solver_config.h
+ * @brief Runtime parameters of the Barnes-Hut force solver
+ */
+
+#pragma once
+
+#include "global.h"
+
+/// @brief Default maximum particles per leaf node before subdivision
+#define MAX_CAPACITY 50
+
+/// @brief Default maximum tree depth to prevent infinite recursion
+#define MAX_DEPTH 15
+
+/// @brief Highest supported FMM expansion order (SolverConfig::fmm_order)
+#define FMM_MAX_ORDER 12
+
+/// @brief Deepest supported block timestep level (steps down to dt/2^BLOCK_MAX_LEVEL)
+#define BLOCK_MAX_LEVEL 30
+
+/// @brief Force solver used by the simulation
+enum force_method {BARNES_HUT, FAST_MULTIPOLE, DEVICE_DIRECT};
+
+/**
+ * @struct SolverConfig
+ * @brief Accuracy and tree-shape parameters for the force calculation
+ *
+ * @details The trees read leaf_capacity, max_depth, mass_ref and alpha
+ * when they are built and when their moments are computed; the force
+ * walk reads theta. Defaults reproduce the compile-time constants.
+ *
+ * With adaptive_theta set, Simulation re-estimates the force error every
+ * error_interval steps by comparing the tree against direct summation for
+ * error_samples particles, and rescales theta towards target_error within
+ * [theta_min, theta_max].
+ *
+ * Passive (test) particles feel gravity but are left out of the tree
+ * moments and leaf interactions. A particle is passive if it is flagged
+ * (Particle::isPassive) or lighter than passive_mass. When at most
+ * direct_sum_max sources remain, forces come from direct summation over
+ * the sources instead of a tree walk.
+ *
+ * The block Hermite integrator gives each particle a step dt/2^level with
+ * the smallest level for which the step is at most
+ * timestep_eta * |a| / |jerk|, limited to max_block_level.
+ *
+ * Opening criterion: a cell of size s at distance d is accepted when
+ * s < d * theta * (mass_ref / M)^alpha, so a larger theta is faster and
+ * less accurate.
+ *
+ * With quadrupole set, the trees also carry quadrupole moments and
+ * accepted cells are evaluated to second order (see multipole.h). The
+ * force error then falls as theta³ instead of theta², so the same error
+ * is reached at a larger theta.
+ *
+ * With method FAST_MULTIPOLE, forces come from the fast multipole method
+ * (see fmm.h) instead of the Barnes-Hut walk: cells are expanded to
+ * fmm_order and a target cell of radius r_t and a source cell of radius
+ * r_s at distance d interact through their expansions when
+ * r_t + r_s < fmm_theta * d. The error falls roughly as
+ * fmm_theta^(fmm_order + 1). Adaptive theta only applies to Barnes-Hut.
+ *
+ * With mixed_precision, the Barnes-Hut walk stores accepted cells in float
+ * relative to the center of each target group and evaluates them with
+ * the float cell kernels (see force_kernels.h). Positions, the near field
+ * and the integrator state stay in double. The float rounding (about
+ * 1e-7 relative) is far below the truncation error of any useful theta.
+ *
+ * Method DEVICE_DIRECT sums every source directly on an offload device
+ * (see device_solver.h); it is only available in builds with
+ * NBODY_OFFLOAD. The tree is still kept for collisions and queries.
+ *
+ * Every diagnostics_interval steps, Simulation also measures the total
+ * energy from the potential the force kernels accumulate (see
+ * diagnostics.h). With energy_tolerance set, a relative energy change
+ * above it between two such steps halves dt (see Simulation::step()).
+ */
+struct SolverConfig {
+    double theta = 0.05;              ///< Opening angle
+    double alpha = ALPHA;             ///< Mass-scaling exponent of the opening angle
+    double mass_ref = MASS_REF;       ///< Reference mass of the opening angle scaling
+    int leaf_capacity = MAX_CAPACITY; ///< Particles per leaf before subdivision
+    int max_depth = MAX_DEPTH;        ///< Maximum tree depth (root = 1)
+    double passive_mass = 0;          ///< Particles lighter than this are passive
+    int direct_sum_max = 64;          ///< Direct summation up to this many sources
+    bool quadrupole = false;          ///< Add quadrupole moments to accepted cells
+    bool mixed_precision = false;     ///< Accepted cells in float, relative to each group
+    force_method method = BARNES_HUT; ///< Tree walk, fast multipole or device direct sum
+    int fmm_order = 6;                ///< FMM expansion order (2 to FMM_MAX_ORDER)
+    double fmm_theta = 0.5;           ///< FMM well-separation parameter
+
+    bool adaptive_theta = false;      ///< Adjust theta to meet target_error
+    double target_error = 1e-3;       ///< Target mean relative acceleration error
+    int error_samples = 64;           ///< Particles sampled per error estimate
+    int error_interval = 10;          ///< Steps between error estimates
+    double theta_min = 0.01;          ///< Lower limit for adaptive theta
+    double theta_max = 1.0;           ///< Upper limit for adaptive theta
+
+    double timestep_eta = 0.02;       ///< Accuracy parameter of the block timestep criterion
+    int max_block_level = 10;         ///< Smallest block step is dt/2^max_block_level
+
+    int diagnostics_interval = 0;     ///< Steps between energy measurements (0 to disable)
+    double energy_tolerance = 0;      ///< Relative energy change that reduces dt (0 to disable)
+};
@@ -0,0 +1,144 @@
+/**
+ * @file trajectory_writer.h
+ * @brief Streaming trajectory output written by a background thread
+ *
+ * The file is a 16-byte header followed by chunks of frames:
+ *
+ * - File header: "NBODYTRJ", uint32 version (TRAJECTORY_VERSION), uint32
+ *   flags (TRAJECTORY_FLOAT32 if real-valued columns are float)
+ * - Chunk: uint32 codec (0 raw, 1 zstd), uint32 frame count, uint64 raw
+ *   payload bytes, uint64 stored bytes, then the stored payload
+ * - Frame (inside a payload): double time, int64 step, uint32 particle
+ *   count n, uint32 field mask (TRAJECTORY_* bits), n int32 IDs, then for
+ *   every field in the mask, in bit order, its columns of n values each
+ *   (x then y for vector fields)
+ *
+ * All values are in native byte order. The particle subset can change
+ * between frames (merges), so every frame carries its IDs.
+ */
+
+#pragma once
+
+#include "global.h"
+#include "simulation.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/// @brief Trajectory format version
+#define TRAJECTORY_VERSION 1
+
+/// @brief File header flag: real-valued columns are stored as float
+#define TRAJECTORY_FLOAT32 0x01
+
+/// @name Trajectory field bits (frame field mask)
+/// @{
+#define TRAJECTORY_POSITION 0x01     ///< x, y
+#define TRAJECTORY_VELOCITY 0x02     ///< vx, vy
+#define TRAJECTORY_ACCELERATION 0x04 ///< ax, ay
+#define TRAJECTORY_MASS 0x08         ///< mass
+#define TRAJECTORY_RADIUS 0x10       ///< radius
+/// @}
+
+/// @brief Number of trajectory fields
+#define TRAJECTORY_FIELDS 5
+
+/**
+ * @struct TrajectoryConfig
+ * @brief What to write and how often
+ *
+ * @details Field k is written every every[k] steps (0 = never), in the
+ * order of the TRAJECTORY_* bits: position, velocity, acceleration, mass,
+ * radius. A particle is written if it passes both subset filters.
+ */
+struct TrajectoryConfig {
+    int every[TRAJECTORY_FIELDS] = {1, 0, 0, 0, 0}; ///< Cadence per field in steps
+    bool primaries_only = false;                    ///< Only particles flagged primary
+    int id_stride = 1;                              ///< Only particles with id % id_stride == 0
+    bool float32 = false;                           ///< Quantize real columns to float
+    int compression = 0;                            ///< zstd level (0 = off; needs NBODY_WITH_ZSTD)
+    int frames_per_chunk = 16;                      ///< Frames buffered per chunk
+};
+
+/**
+ * @brief Parse a field cadence list such as "pos=1,vel=10,mass=100"
+ *
+ * @param spec Comma-separated name=steps pairs; names are pos, vel, acc,
+ *             mass and radius
+ * @param[out] config Cadences to update (unlisted fields are unchanged)
+ * @return False on an unknown name or malformed entry
+ */
+bool parseTrajectoryFields(const char *spec, TrajectoryConfig &config);
+
+/**
+ * @class TrajectoryWriter
+ * @brief Double-buffered trajectory output with a background writer
+ *
+ * @details capture() copies the selected fields of the selected particles
+ * into the chunk being filled, in the calling thread. A full chunk is
+ * handed to the writer thread, which compresses and writes it while the
+ * next chunk fills, so the integrator only waits if the disk falls a whole
+ * chunk behind.
+ */
+class TrajectoryWriter
+{
+public:
+    TrajectoryWriter() = default;
+    TrajectoryWriter(const TrajectoryWriter &) = delete;
+    TrajectoryWriter &operator=(const TrajectoryWriter &) = delete;
+
+    /// @brief Flushes and closes the file
+    ~TrajectoryWriter() { close(); }
+
+    /**
+     * @brief Create the output file and start the writer thread
+     *
+     * @param path Output file
+     * @param _config Fields, cadences and subset
+     * @return False if the file cannot be created, its header cannot be
+     *         written or the options are not supported by this build
+     *         (reported on stderr)
+     */
+    bool open(const std::string &path, const TrajectoryConfig &_config);
+
+    /// @brief True between a successful open() and close()
+    bool isOpen() const { return file != nullptr; }
+
+    /**
+     * @brief Record the fields due at the simulation's current step
+     *
+     * @param sim Simulation to sample (no frame if no field is due)
+     */
+    void capture(const Simulation &sim);
+
+    /**
+     * @brief Write the partly filled chunk, stop the thread and close the file
+     *
+     * @return False if any write failed
+     */
+    bool close();
+
+private:
+    TrajectoryConfig config;   ///< Output options
+    FILE *file = nullptr;      ///< Output file
+    std::thread worker;        ///< Background writer
+
+    std::vector<char> filling; ///< Chunk being filled by capture()
+    int filling_frames = 0;    ///< Frames in filling
+
+    std::mutex mutex;             ///< Guards the fields below
+    std::condition_variable cond; ///< Signals hand-offs and completion
+    std::vector<char> pending;    ///< Full chunk waiting for the writer
+    int pending_frames = 0;       ///< Frames in pending (0 if none)
+    bool stopping = false;        ///< No more chunks will come
+    bool ok = true;               ///< No write has failed
+
+    std::vector<int> selected; ///< Scratch: slots selected for a frame
+
+    /// @brief Hand the filled chunk to the writer, waiting if it is still busy
+    void handOff();
+
+    /// @brief Writer thread body
+    void run();
+};
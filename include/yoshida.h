@@ -15,7 +15,7 @@
 #pragma once
 
 #include "global.h"
-#include "barneshut.h"
+#include "force_solver.h"
 
 /// @name Yoshida coefficients
 /// @{
@@ -37,20 +37,20 @@ const double d3 = w1;                ///< Kick coefficient 3
  *
  * @details x_new = x_old + v * dt
  *
- * @param particles Particle vector
+ * @param particles Particle store
  * @param dt Timestep (may be fractional for substeps)
  */
-void drift(std::vector<Particle> &, double);
+void drift(ParticleSet &, double);
 
 /**
  * @brief Kick step: update velocities using current accelerations
  *
  * @details v_new = v_old + a * dt
  *
- * @param particles Particle vector
+ * @param particles Particle store
  * @param dt Timestep (may be fractional for substeps)
  */
-void kick(std::vector<Particle> &, double);
+void kick(ParticleSet &, double);
 
 /**
  * @brief Perform one timestep using Yoshida 4th order symplectic method
@@ -66,12 +66,14 @@ void kick(std::vector<Particle> &, double);
  * - 4th order accuracy: error ~ O(dt⁵)
  * - Excellent long-term energy conservation
  *
- * @param particles Vector of particles to integrate
- * @param tree QuadTree for Barnes-Hut force calculation
+ * @tparam Solver ForceSolver over the particle store
+ *
+ * @param particles Particle store to integrate
+ * @param solver Force solver (accelerations only, refitted after each drift)
  * @param dt Timestep size
  *
  * @note Requires 4 force evaluations per step
  * @note Best for long-term orbital integration
  * @note May struggle with close encounters
  */
-void yoshidaStep(std::vector<std::shared_ptr<Particle>> &, QuadTree<Particle> *, double);
\ No newline at end of file
+template <ForceSolver Solver> void yoshidaStep(ParticleSet &, Solver &, double);
@@ -4,7 +4,6 @@
  */
 
 #include "RK2.h"
-#include "barneshut.h"
 
 /**
  * @brief RK2 integration step (midpoint method)
@@ -15,29 +14,57 @@
  * 3. Evaluate acceleration at predicted position
  * 4. Corrector: update velocity using average of initial and midpoint accelerations
  *
- * @param particles Particle vector
- * @param tree QuadTree for force calculation
+ * The midpoint positions are written to the predictor arrays and used as
+ * force targets while the solver still holds the initial positions, so
+ * every particle's intermediate force sees the same (initial) sources.
+ * The results are swapped in afterwards.
+ *
+ * @param particles Particle store
+ * @param solver Force solver
  * @param dt Timestep
  */
-void RK2step(std::vector<std::shared_ptr<Particle>> &particles, QuadTree<Particle> *tree,
-             double dt) {
-    getAcceleration(particles, tree);
-
-#pragma omp parallel for schedule(dynamic, CHUNK_SIZE)
-    for (int i = 0; i < static_cast<int>(particles.size()); i++) {
-        auto &p = particles[i];
-        Particle temp = *p;
+template <ForceSolver Solver> void RK2step(ParticleSet &particles, Solver &solver, double dt) {
+    const int n = static_cast<int>(particles.size());
+    solver.accelerations(particles);
 
-        // First half RK2 step
-        temp.position += p->velocity * dt + p->acceleration * (0.5 * dt * dt);
+    // First half RK2 step
+#pragma omp parallel for simd schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++) {
+        particles.x_pred[i] =
+            particles.x[i] + particles.vx[i] * dt + particles.ax[i] * (0.5 * dt * dt);
+        particles.y_pred[i] =
+            particles.y[i] + particles.vy[i] * dt + particles.ay[i] * (0.5 * dt * dt);
+        particles.vx_pred[i] = particles.vx[i] + particles.ax[i] * (0.5 * dt);
+        particles.vy_pred[i] = particles.vy[i] + particles.ay[i] * (0.5 * dt);
+    }
 
-        // Get intermediate acceleration
-        temp.acceleration.zero();
-        BarnesHutForceAndJerk(&temp, tree, 0.05);
+    // Get intermediate acceleration at the midpoint positions
+    ForceTargets midpoint = storeTargets(particles, false);
+    midpoint.x = particles.x_pred.data();
+    midpoint.y = particles.y_pred.data();
+    solver.forces(midpoint, n);
 
-        // Second half RK2 step
-        p->position = temp.position;
-        p->velocity += (temp.acceleration + p->acceleration) * (0.5 * dt);
-        p->acceleration = temp.acceleration;
+    // Second half RK2 step
+#pragma omp parallel for simd schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++) {
+        particles.vx_pred[i] += particles.ax[i] * (0.5 * dt);
+        particles.vy_pred[i] += particles.ay[i] * (0.5 * dt);
     }
+
+    std::swap(particles.x, particles.x_pred);
+    std::swap(particles.y, particles.y_pred);
+    std::swap(particles.vx, particles.vx_pred);
+    std::swap(particles.vy, particles.vy_pred);
 }
+
+template void RK2step(ParticleSet &, TreeSolver<QuadTree<ParticleSet>> &, double);
+template void RK2step(ParticleSet &, TreeSolver<LinearQuadTree<ParticleSet>> &, double);
+template void RK2step(ParticleSet &, DirectSolver &, double);
+template void RK2step(ParticleSet &, FmmSolver<QuadTree<ParticleSet>> &, double);
+template void RK2step(ParticleSet &, FmmSolver<LinearQuadTree<ParticleSet>> &, double);
+#ifdef NBODY_OFFLOAD
+template void RK2step(ParticleSet &, DeviceSolver &, double);
+#endif
+#ifdef NBODY_MPI
+template void RK2step(ParticleSet &, DistributedSolver &, double);
+#endif
@@ -0,0 +1,562 @@
+/**
+ * @file accuracy.cpp
+ * @brief Accuracy-versus-cost harness for the force solver settings
+ *
+ * @details For every combination of opening angle and mass-scaling
+ * exponent (Barnes-Hut) or of well-separation parameter and expansion
+ * order (fast multipole method), compares the solver forces against tiled
+ * direct summation on the same initial conditions and then integrates a
+ * short run to measure the conservation errors:
+ * - rms_err, max_err: relative acceleration error |a_tree - a_direct| /
+ *   |a_direct| over all particles (RMS and maximum)
+ * - jerk_rms: relative jerk error (includes the far-field jerk, which
+ *   takes the cell velocity as zero)
+ * - build_ms, force_ms: tree build with moments, and one force evaluation
+ *   (for FMM rows including the multipoles of the upward pass)
+ * - dE/E, dL/L: energy change over the run relative to the total energy,
+ *   and angular momentum change relative to the sum of |m r x v| (an
+ *   isotropic cluster has almost no net angular momentum)
+ * - step_ms: wall time per step of the run
+ *
+ * The run is the bare integrator (transportStep) with the row's solver,
+ * rebuilt every step, without collisions or recentering, so the columns
+ * of different rows only differ by their forces. With --direct, a first
+ * "direct" row integrates the same run with direct-summation forces
+ * (DirectSolver), which separates the drift of the integrator from that
+ * of the tree forces.
+ *
+ * Usage:
+ * ```
+ * nbody_accuracy [--ic NAME|FILE] [--n N] [--seed S] [--thetas LIST]
+ *                [--alphas LIST] [--tree pointer|linear] [--steps N]
+ *                [--dt DT] [--integrator NAME] [--threads N] [--budget E]
+ *                [--multipole monopole|quadrupole|both] [--direct]
+ *                [--far-field double|float|both]
+ *                [--solver barnes-hut|fmm|both] [--orders LIST]
+ * ```
+ * - --ic: initial conditions as for nbody_headless (default plummer; the
+ *   planetary system has too few sources to use the tree)
+ * - --n: number of particles (default 20000)
+ * - --thetas: opening angles (default 0.05,0.1,0.2,0.3,0.5,0.7,1)
+ * - --alphas: mass-scaling exponents (default 0.5,0; 0 disables scaling)
+ * - --steps: steps of the conservation run (default 50, 0 to skip)
+ * - --dt: timestep of the conservation run (default: timestep_eta times
+ *   the shortest |a|/|jerk| of the initial state, or times its dynamical
+ *   time if nothing moves, see resolvingStep())
+ * - --budget: report the cheapest setting with rms_err at most E
+ *   (default 1e-3), or direct summation if no such setting is faster
+ * - --multipole: expansion order of accepted cells; both sweeps every
+ *   setting once per order (default monopole)
+ * - --far-field: precision of the accepted cells' interactions; both
+ *   sweeps every Barnes-Hut setting in double and in float (default
+ *   double); float rows are marked /f in the mp column
+ * - --solver: Barnes-Hut rows, FMM rows or both (default barnes-hut); FMM
+ *   rows use the thetas as SolverConfig::fmm_theta and ignore the alphas
+ *   and --multipole, the mp column shows their order as pN
+ * - --orders: FMM expansion orders (default 4,6,8)
+ */
+
+#include "force_solver.h"
+#include "initial_conditions.h"
+#include "interactions.h"
+#include "simulation.h"
+#include <cstring>
+#include <string>
+
+/**
+ * @brief Print command line usage
+ * @param prog Program name
+ */
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--ic NAME|FILE] [--n N] [--seed S] [--thetas LIST] [--alphas LIST] "
+            "[--tree pointer|linear] [--steps N] [--dt DT] "
+            "[--integrator rk2|yoshida|hermite|block-hermite] [--threads N] [--budget E] "
+            "[--multipole monopole|quadrupole|both] [--direct] [--far-field double|float|both] "
+            "[--solver barnes-hut|fmm|both] [--orders LIST]\n",
+            prog);
+}
+
+/**
+ * @brief Parse a comma-separated list of positive or zero numbers
+ *
+ * @param spec List such as "0.1,0.2"
+ * @param[out] values Parsed numbers (replaced)
+ * @return False if an entry is not a number or negative
+ */
+static bool parseList(const char *spec, std::vector<double> &values) {
+    values.clear();
+    for (const char *p = spec; *p;) {
+        char *end;
+        double v = strtod(p, &end);
+        if (end == p || v < 0 || (*end != ',' && *end != '\0'))
+            return false;
+        values.push_back(v);
+        p = *end ? end + 1 : end;
+    }
+    return !values.empty();
+}
+
+/**
+ * @struct Reference
+ * @brief Direct-summation forces of the initial state
+ */
+struct Reference {
+    std::vector<double> ax, ay, jx, jy; ///< Acceleration and jerk per slot
+    double seconds = 0;                 ///< Wall time of the direct summation
+};
+
+/**
+ * @brief Timestep that resolves the closest encounters of the initial state
+ *
+ * @details The Aarseth-style criterion of the block timesteps,
+ * eta * |a|/|jerk|, taken at its minimum over all particles, so the
+ * conservation columns measure the solver rather than an integrator
+ * that cannot follow the tightest pair. At rest (every jerk zero, as in
+ * the box) the jerk sets no scale, and the dynamical time sqrt(R³/GM) of
+ * the whole system, with R the RMS distance from the center of mass,
+ * stands in for |a|/|jerk|.
+ *
+ * @param particles Initial state
+ * @param reference Direct-summation forces of the initial state
+ * @param eta Accuracy parameter (SolverConfig::timestep_eta)
+ * @return Timestep, or 0 for a store without mass
+ */
+static double resolvingStep(const ParticleSet &particles, const Reference &reference,
+                            double eta) {
+    double shortest = INFINITY;
+    const int n = static_cast<int>(reference.ax.size());
+#pragma omp parallel for reduction(min : shortest) schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++) {
+        const double a = std::hypot(reference.ax[i], reference.ay[i]);
+        const double j = std::hypot(reference.jx[i], reference.jy[i]);
+        if (j > 0)
+            shortest = std::min(shortest, a / j);
+    }
+    if (std::isfinite(shortest))
+        return eta * shortest;
+
+    double mass = 0, mx = 0, my = 0, mr2 = 0;
+    for (int i = 0; i < n; i++) {
+        const double m = particles.mass[i];
+        mass += m;
+        mx += m * particles.x[i];
+        my += m * particles.y[i];
+        mr2 += m * (particles.x[i] * particles.x[i] + particles.y[i] * particles.y[i]);
+    }
+    if (mass <= 0)
+        return 0;
+    const double cx = mx / mass, cy = my / mass;
+    const double r2 = mr2 / mass - (cx * cx + cy * cy);
+    return r2 > 0 ? eta * std::sqrt(r2 * std::sqrt(r2) / (GRAV_G * mass)) : 0;
+}
+
+/**
+ * @struct Conserved
+ * @brief Total energy and angular momentum
+ */
+struct Conserved {
+    double energy = 0;         ///< Kinetic plus potential energy
+    double momentum = 0;       ///< Angular momentum about the origin
+    double momentum_scale = 0; ///< Sum of |m r x v| (the net momentum may be near zero)
+};
+
+/**
+ * @brief Measure the conserved quantities of a particle store
+ *
+ * @param particles Particle store
+ * @param passive_mass Particles lighter than this are passive
+ */
+static Conserved conserved(const ParticleSet &particles, double passive_mass) {
+    Conserved c;
+    double kinetic = 0, momentum = 0, scale = 0;
+    const int n = static_cast<int>(particles.size());
+#pragma omp parallel for reduction(+ : kinetic, momentum, scale) schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++) {
+        const double m = particles.mass[i];
+        const double l = m * (particles.x[i] * particles.vy[i] - particles.y[i] * particles.vx[i]);
+        kinetic += 0.5 * m * (particles.vx[i] * particles.vx[i] + particles.vy[i] * particles.vy[i]);
+        momentum += l;
+        scale += std::abs(l);
+    }
+    c.energy = kinetic + potentialEnergy(particles, passive_mass);
+    c.momentum = momentum;
+    c.momentum_scale = scale;
+    return c;
+}
+
+/**
+ * @struct Row
+ * @brief Results for one solver setting
+ */
+struct Row {
+    double theta = 0, alpha = 0;                   ///< Setting
+    bool quadrupole = false;                       ///< Setting: quadrupole moments
+    bool mixed = false;                            ///< Setting: far field in float
+    int order = 0;                                 ///< Setting: FMM order (0 for Barnes-Hut)
+    double rms_err = 0, max_err = 0, jerk_rms = 0; ///< Force errors
+    double build_ms = 0, force_ms = 0;             ///< Cost of one force evaluation
+    double energy_drift = 0, momentum_drift = 0;   ///< Conservation errors of the run
+    double step_ms = 0;                            ///< Cost per step of the run
+};
+
+/**
+ * @brief Label of a setting's expansion for the mp column
+ *
+ * @param row Setting
+ * @return mono, quad, or pN for an FMM row of order N; /f for a float far field
+ */
+static std::string multipoleName(const Row &row) {
+    if (row.order)
+        return "p" + std::to_string(row.order);
+    return std::string(row.quadrupole ? "quad" : "mono") + (row.mixed ? "/f" : "");
+}
+
+/**
+ * @brief Label of a setting for the budget summary
+ *
+ * @param row Setting
+ * @return Solver and expansion, e.g. "quadrupole, float far field" or "fmm p6"
+ */
+static std::string settingName(const Row &row) {
+    if (row.order)
+        return "fmm " + multipoleName(row);
+    return std::string(row.quadrupole ? "quadrupole" : "monopole") +
+           (row.mixed ? ", float far field" : "");
+}
+
+/**
+ * @brief Integrate the conservation run with one solver
+ *
+ * @details Rebuilds the solver every step and advances the store with
+ * the bare integrator (transportStep): no collisions, no recentering.
+ *
+ * @param solver Solver over work
+ * @param work Store holding the initial state (advanced here)
+ * @param dt Timestep
+ * @param nsteps Number of steps
+ * @param before Conserved quantities of the initial state
+ * @param passive_mass Particles lighter than this are passive
+ * @param[out] row Conservation errors and time per step
+ */
+template <ForceSolver Solver>
+static void conservationRun(Solver &solver, ParticleSet &work, double dt, long nsteps,
+                            const Conserved &before, double passive_mass, Row &row) {
+    const SolverConfig config;
+    const double start = omp_get_wtime();
+    for (long s = 0; s < nsteps; s++) {
+        solver.rebuild();
+        transportStep(work, solver, dt, config);
+    }
+    row.step_ms = 1e3 * (omp_get_wtime() - start) / nsteps;
+    const Conserved after = conserved(work, passive_mass);
+    row.energy_drift = std::abs((after.energy - before.energy) / before.energy);
+    row.momentum_drift = before.momentum_scale > 0
+                             ? std::abs(after.momentum - before.momentum) / before.momentum_scale
+                             : 0;
+}
+
+/**
+ * @brief Build a solver over the particles and compare its forces to the reference
+ *
+ * @param solver Solver over an empty tree of particles (built here)
+ * @param particles Particle store (ax, ay, jx, jy are overwritten)
+ * @param reference Direct-summation forces
+ * @param[out] row Errors and timings
+ */
+template <ForceSolver Solver>
+static void compareForces(Solver &solver, ParticleSet &particles, const Reference &reference,
+                          Row &row) {
+    double start = omp_get_wtime();
+    solver.rebuild();
+    double built = omp_get_wtime();
+    solver.accelerationsAndJerks(particles);
+    double done = omp_get_wtime();
+    const int n = static_cast<int>(particles.size());
+    row.build_ms = 1e3 * (built - start);
+    row.force_ms = 1e3 * (done - built);
+
+    double sum2 = 0, most = 0, jerk2 = 0;
+    int counted = 0, jerk_counted = 0;
+#pragma omp parallel for reduction(+ : sum2, jerk2, counted, jerk_counted) \
+    reduction(max : most) schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++) {
+        double norm = std::hypot(reference.ax[i], reference.ay[i]);
+        if (norm > 0) {
+            double err = std::hypot(particles.ax[i] - reference.ax[i],
+                                    particles.ay[i] - reference.ay[i]) / norm;
+            sum2 += err * err;
+            most = std::max(most, err);
+            counted++;
+        }
+        double jnorm = std::hypot(reference.jx[i], reference.jy[i]);
+        if (jnorm > 0) {
+            double err = std::hypot(particles.jx[i] - reference.jx[i],
+                                    particles.jy[i] - reference.jy[i]) / jnorm;
+            jerk2 += err * err;
+            jerk_counted++;
+        }
+    }
+    row.rms_err = counted ? std::sqrt(sum2 / counted) : 0;
+    row.max_err = most;
+    row.jerk_rms = jerk_counted ? std::sqrt(jerk2 / jerk_counted) : 0;
+}
+
+/**
+ * @brief Entry point of the harness
+ *
+ * @return 0 on success, 1 on bad arguments or unreadable initial conditions
+ */
+int main(int argc, char **argv) {
+    const char *ic = "plummer";
+    int n = 20000;
+    uint64_t seed = 5;
+    std::vector<double> thetas = {0.05, 0.1, 0.2, 0.3, 0.5, 0.7, 1.0};
+    std::vector<double> alphas = {ALPHA, 0};
+    tree_type tree = POINTER_TREE;
+    long nsteps = 50;
+    double dt = 0; // Derived from the initial state unless given
+    int threads = 0;
+    double budget = 1e-3;
+    bool direct_run = false;
+    std::vector<bool> multipoles = {false};
+    std::vector<bool> precisions = {false};
+    std::vector<double> orders = {4, 6, 8};
+    bool barnes_hut = true, fmm = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--direct")) {
+            direct_run = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        bool ok = true;
+        if (!strcmp(argv[i], "--ic"))
+            ic = argv[++i];
+        else if (!strcmp(argv[i], "--n"))
+            n = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed"))
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--thetas"))
+            ok = parseList(argv[++i], thetas);
+        else if (!strcmp(argv[i], "--alphas"))
+            ok = parseList(argv[++i], alphas);
+        else if (!strcmp(argv[i], "--steps"))
+            nsteps = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--dt"))
+            dt = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--threads"))
+            threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--budget"))
+            budget = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--multipole")) {
+            ++i;
+            if (!strcmp(argv[i], "monopole"))
+                multipoles = {false};
+            else if (!strcmp(argv[i], "quadrupole"))
+                multipoles = {true};
+            else if (!strcmp(argv[i], "both"))
+                multipoles = {false, true};
+            else
+                ok = false;
+        }
+        else if (!strcmp(argv[i], "--far-field")) {
+            ++i;
+            if (!strcmp(argv[i], "double"))
+                precisions = {false};
+            else if (!strcmp(argv[i], "float"))
+                precisions = {true};
+            else if (!strcmp(argv[i], "both"))
+                precisions = {false, true};
+            else
+                ok = false;
+        }
+        else if (!strcmp(argv[i], "--orders"))
+            ok = parseList(argv[++i], orders);
+        else if (!strcmp(argv[i], "--solver")) {
+            ++i;
+            barnes_hut = !strcmp(argv[i], "barnes-hut") || !strcmp(argv[i], "both");
+            fmm = !strcmp(argv[i], "fmm") || !strcmp(argv[i], "both");
+            ok = barnes_hut || fmm;
+        }
+        else if (!strcmp(argv[i], "--tree")) {
+            ++i;
+            if (!strcmp(argv[i], "pointer"))
+                tree = POINTER_TREE;
+            else if (!strcmp(argv[i], "linear"))
+                tree = LINEAR_TREE;
+            else
+                ok = false;
+        }
+        else if (!strcmp(argv[i], "--integrator")) {
+            ++i;
+            if (!strcmp(argv[i], "rk2"))
+                TRANSPORT_TYPE = RK2;
+            else if (!strcmp(argv[i], "yoshida"))
+                TRANSPORT_TYPE = YOSHIDA;
+            else if (!strcmp(argv[i], "hermite"))
+                TRANSPORT_TYPE = HERMITE;
+            else if (!strcmp(argv[i], "block-hermite"))
+                TRANSPORT_TYPE = BLOCK_HERMITE;
+            else
+                ok = false;
+        }
+        else
+            ok = false;
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (n < 0 || nsteps < 0 || dt < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threads > 0)
+        omp_set_num_threads(threads);
+
+    // Initial conditions and their direct-summation forces
+    Simulation initial(-250, -250, 500, 500, 1);
+    if (!createInitialConditions(initial, ic, n, seed))
+        return 1;
+    ParticleSet particles = initial.getParticles();
+    const int count = static_cast<int>(particles.size());
+    const Bounds domain = initial.getBounds();
+    const double passive_mass = SolverConfig().passive_mass;
+
+    Reference reference;
+    reference.ax.resize(count);
+    reference.ay.resize(count);
+    reference.jx.resize(count);
+    reference.jy.resize(count);
+    ForceTargets targets = storeTargets(particles, true);
+    targets.ax = reference.ax.data();
+    targets.ay = reference.ay.data();
+    targets.jx = reference.jx.data();
+    targets.jy = reference.jy.data();
+    double start = omp_get_wtime();
+    directForces(particles, targets, count, passive_mass);
+    reference.seconds = omp_get_wtime() - start;
+    const Conserved before = conserved(particles, passive_mass);
+    if (dt == 0)
+        dt = resolvingStep(particles, reference, SolverConfig().timestep_eta);
+    if (dt <= 0 && nsteps > 0) {
+        fprintf(stderr, "No timestep derived from the initial conditions (give --dt)\n");
+        return 1;
+    }
+
+    fprintf(stdout,
+            "nbody_accuracy: %d particles (%s), %s tree, %d threads, direct sum %.1f ms, "
+            "dt %.3g\n",
+            count, ic, tree == LINEAR_TREE ? "linear" : "pointer", omp_get_max_threads(),
+            1e3 * reference.seconds, dt);
+    fprintf(stdout, "%7s %6s %6s %10s %10s %10s %9s %9s %10s %10s %9s\n", "theta", "alpha", "mp",
+            "rms_err", "max_err", "jerk_rms", "build_ms", "force_ms", "dE/E", "dL/L", "step_ms");
+
+    // Integrator-only drift: the same run with direct-summation forces
+    if (direct_run && nsteps > 0) {
+        ParticleSet work = particles;
+        DirectSolver solver(&work, passive_mass);
+        Row row;
+        conservationRun(solver, work, dt, nsteps, before, passive_mass, row);
+        fprintf(stdout, "%7s %6s %6s %10.3e %10.3e %10.3e %9s %9.2f %10.3e %10.3e %9.2f\n",
+                "direct", "-", "-", 0.0, 0.0, 0.0, "-", 1e3 * reference.seconds,
+                row.energy_drift, row.momentum_drift, row.step_ms);
+        fflush(stdout);
+    }
+
+    // Settings to compare, each run as one row
+    std::vector<Row> settings;
+    if (barnes_hut) {
+        for (bool mixed : precisions)
+            for (bool quadrupole : multipoles)
+                for (double alpha : alphas)
+                    for (double theta : thetas)
+                        settings.push_back(Row{theta, alpha, quadrupole, mixed, 0});
+    }
+    if (fmm) {
+        for (double order : orders)
+            for (double theta : thetas)
+                settings.push_back(Row{theta, 0, false, false, static_cast<int>(order)});
+    }
+
+    std::vector<Row> rows;
+    for (Row row : settings) {
+        SolverConfig config;
+        config.theta = row.theta;
+        config.alpha = row.alpha;
+        config.quadrupole = row.quadrupole;
+        config.mixed_precision = row.mixed;
+        if (row.order) {
+            config.method = FAST_MULTIPOLE;
+            config.fmm_order = row.order;
+            config.fmm_theta = row.theta;
+        }
+
+        // Force errors, then the conservation run from the same initial state
+        ParticleSet work = particles;
+        auto evaluate = [&](auto &solver) {
+            compareForces(solver, work, reference, row);
+            if (nsteps > 0) {
+                work = particles;
+                conservationRun(solver, work, dt, nsteps, before, passive_mass, row);
+            }
+        };
+        if (tree == POINTER_TREE) {
+            QuadTree<ParticleSet> quadtree(domain.xmin, domain.ymin, domain.width, domain.height,
+                                           1, nullptr, &work, &config);
+            if (row.order) {
+                FmmSolver<QuadTree<ParticleSet>> solver(&quadtree);
+                evaluate(solver);
+            } else {
+                TreeSolver<QuadTree<ParticleSet>> solver(&quadtree, row.theta);
+                evaluate(solver);
+            }
+        } else {
+            LinearQuadTree<ParticleSet> linear(domain.xmin, domain.ymin, domain.width,
+                                               domain.height, &work, &config);
+            if (row.order) {
+                FmmSolver<LinearQuadTree<ParticleSet>> solver(&linear);
+                evaluate(solver);
+            } else {
+                TreeSolver<LinearQuadTree<ParticleSet>> solver(&linear, row.theta);
+                evaluate(solver);
+            }
+        }
+
+        fprintf(stdout, "%7.3f %6.2f %6s %10.3e %10.3e %10.3e %9.2f %9.2f %10.3e %10.3e %9.2f\n",
+                row.theta, row.alpha, multipoleName(row).c_str(), row.rms_err, row.max_err,
+                row.jerk_rms, row.build_ms, row.force_ms, row.energy_drift, row.momentum_drift,
+                row.step_ms);
+        fflush(stdout);
+        rows.push_back(row);
+    }
+
+    // Cheapest force evaluation that meets the error budget; direct
+    // summation meets any budget, so a setting must also beat it
+    const Row *best = nullptr;
+    for (const Row &row : rows) {
+        if (row.rms_err <= budget && (!best || row.build_ms + row.force_ms <
+                                                   best->build_ms + best->force_ms))
+            best = &row;
+    }
+    const double direct_ms = 1e3 * reference.seconds;
+    if (best && best->build_ms + best->force_ms < direct_ms)
+        fprintf(stdout, "cheapest with rms_err <= %g: theta %.3f alpha %.2f %s (%.2f ms per force "
+                "evaluation, direct sum %.2f ms)\n",
+                budget, best->theta, best->alpha, settingName(*best).c_str(),
+                best->build_ms + best->force_ms, direct_ms);
+    else if (best)
+        fprintf(stdout, "cheapest with rms_err <= %g: direct sum (%.2f ms per force evaluation; "
+                "fastest setting within budget: theta %.3f alpha %.2f %s, %.2f ms)\n",
+                budget, direct_ms, best->theta, best->alpha, settingName(*best).c_str(),
+                best->build_ms + best->force_ms);
+    else
+        fprintf(stdout, "cheapest with rms_err <= %g: direct sum (%.2f ms per force evaluation; "
+                "no setting meets the budget)\n",
+                budget, direct_ms);
+    return 0;
+}
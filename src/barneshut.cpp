@@ -4,15 +4,60 @@
  */
 
 #include "barneshut.h"
+#include "force_kernels.h"
+#include "profiler.h"
 
-void getAcceleration(std::vector<std::shared_ptr<Particle>> &particles, QuadTree<Particle> *tree) {
-#pragma omp parallel for schedule(dynamic, CHUNK_SIZE)
-    for (int i = 0; i < static_cast<int>(particles.size()); i++) {
-        particles[i]->acceleration.zero();
-        BarnesHutForceAndJerk(particles[i].get(), tree, 0.05);
+template <class Tree>
+void getAcceleration(ParticleSet &particles, Tree *tree, const SolverConfig &config) {
+    computeForces(tree, storeTargets(particles, false), static_cast<int>(particles.size()),
+                  config.theta);
+}
+
+template void getAcceleration(ParticleSet &, QuadTree<ParticleSet> *, const SolverConfig &);
+template void getAcceleration(ParticleSet &, LinearQuadTree<ParticleSet> *, const SolverConfig &);
+
+template <class Tree>
+double estimateForceError(const ParticleSet &particles, const Tree *tree, double theta,
+                          int samples) {
+    const int n = static_cast<int>(particles.size());
+    samples = std::min(samples, n);
+    if (samples <= 0)
+        return 0;
+
+    double error_sum = 0;
+    int counted = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : error_sum, counted)
+    for (int k = 0; k < samples; k++) {
+        const int i = static_cast<int>(static_cast<long>(k) * n / samples);
+        Particle p = particles.get(i);
+
+        p.acceleration.zero();
+        p.jerk.zero();
+        BarnesHutForceAndJerk(&p, tree, theta);
+        vector2D a_tree = p.acceleration;
+
+        vector2D a_direct{0, 0};
+        for (int j = 0; j < n; j++) {
+            if (particles.id[j] == p.id || !particles.isSource(j, tree->config->passive_mass))
+                continue;
+            vector2D acc, jerk;
+            forceAndJerk(&p, particles, j, acc, jerk);
+            a_direct += acc;
+        }
+
+        double norm = a_direct.norm();
+        if (norm > 0) {
+            error_sum += (a_tree - a_direct).norm() / norm;
+            counted++;
+        }
     }
+    return counted > 0 ? error_sum / counted : 0;
 }
 
+template double estimateForceError(const ParticleSet &, const QuadTree<ParticleSet> *, double, int);
+template double estimateForceError(const ParticleSet &, const LinearQuadTree<ParticleSet> *, double,
+                                   int);
+
 /**
  * @brief Compute gravitational acceleration and jerk for particle pair
  *
@@ -23,35 +68,83 @@ void getAcceleration(std::vector<std::shared_ptr<Particle>> &particles, QuadTree
  * d/dt[-Gm*r/r³] = -Gm*[v/r³ - 3(r·v)r/r⁵]
  *
  * @param p1 Particle being acted upon
- * @param p2 Source particle
+ * @param particles Particle store holding the source
+ * @param j Source particle slot
  * @param[out] acc_out Acceleration output
  * @param[out] jerk_out Jerk output
  */
-void forceAndJerk(const Particle *p1, const Particle *p2, vector2D &acc_out, vector2D &jerk_out) {
-    vector2D rij = p1->position - p2->position;
-    vector2D vij = p1->velocity - p2->velocity;
+void forceAndJerk(const Particle *p1, const ParticleSet &particles, int j, vector2D &acc_out,
+                  vector2D &jerk_out) {
+    vector2D rij = p1->position - particles.position(j);
+    vector2D vij = p1->velocity - particles.velocity(j);
 
     double r2 = rij.dot(rij);
     double r = std::sqrt(r2);
 
     // Softening to prevent singularities
-    double r_soft = std::max(r, p1->radius + p2->radius);
+    double r_soft = std::max(r, p1->radius + particles.radius[j]);
     double r_soft2 = r_soft * r_soft;
     double r_soft3 = r_soft2 * r_soft;
     double r_soft5 = r_soft3 * r_soft2;
 
     // Acceleration: a = -G*m*r/|r|³
-    double acc_mag = -GRAV_G * p2->mass / r_soft3;
+    double acc_mag = -GRAV_G * particles.mass[j] / r_soft3;
     acc_out = rij * acc_mag;
 
     // Jerk: da/dt = -G*m * [v/r³ - 3*(r·v)*r/r⁵]
     // This is the time derivative of acceleration
     double rv_dot = rij.dot(vij);
-    double jerk_mag = -GRAV_G * p2->mass / r_soft3;
+    double jerk_mag = -GRAV_G * particles.mass[j] / r_soft3;
 
     jerk_out = vij * jerk_mag - rij * (3.0 * jerk_mag * rv_dot / r_soft2);
 }
 
+/**
+ * @brief Far-field interaction with a whole cell
+ *
+ * @param p Target particle (accumulates acceleration and jerk)
+ * @param diff Target position minus cell center of mass
+ * @param velocity Velocity of the cell's center of mass
+ * @param mass Total mass of the cell
+ * @param quadrupole Quadrupole of the cell, or null for a monopole
+ */
+static inline void cellForceAndJerk(Particle *p, const vector2D &diff, const vector2D &velocity,
+                                    double mass, const Quadrupole *quadrupole) {
+    const vector2D dv = p->velocity - velocity;
+    const double min_d2 = 4 * p->radius * p->radius;
+    double ax = 0, ay = 0, jx = 0, jy = 0;
+    if (quadrupole)
+        cellInteraction<true, true>(diff.x, diff.y, dv.x, dv.y, min_d2, mass, quadrupole->xx,
+                                    quadrupole->xy, quadrupole->yy, ax, ay, jx, jy);
+    else
+        cellInteraction<true, false>(diff.x, diff.y, dv.x, dv.y, min_d2, mass, 0, 0, 0, ax, ay,
+                                     jx, jy);
+    p->acceleration += vector2D(ax, ay);
+    p->jerk += vector2D(jx, jy);
+}
+
+/**
+ * @brief Direct interactions with a list of source particles
+ *
+ * @param p Target particle (accumulates acceleration and jerk)
+ * @param particles Particle store holding the sources
+ * @param begin First source slot index
+ * @param end One past the last source slot index
+ * @param passive_mass Sources lighter than this are skipped
+ */
+static inline void leafForceAndJerk(Particle *p, const ParticleSet &particles, const int *begin,
+                                    const int *end, double passive_mass) {
+    for (const int *it = begin; it != end; ++it) {
+        int particle = *it;
+        if (p->id != particles.id[particle] && particles.isSource(particle, passive_mass)) {
+            vector2D acc_contrib, jerk_contrib;
+            forceAndJerk(p, particles, particle, acc_contrib, jerk_contrib);
+            p->acceleration += acc_contrib;
+            p->jerk += jerk_contrib;
+        }
+    }
+}
+
 /**
  * @brief Barnes-Hut tree walk with jerk calculation
  *
@@ -67,26 +160,18 @@ void forceAndJerk(const Particle *p1, const Particle *p2, vector2D &acc_out, vec
  * @param tree Current tree node
  * @param theta Opening angle (accuracy parameter)
  */
-void BarnesHutForceAndJerk(Particle *p, const QuadTree<Particle> *tree, double theta) {
+void BarnesHutForceAndJerk(Particle *p, const QuadTree<ParticleSet> *tree, double theta) {
+    if (tree->totalMass <= 0)
+        return; // no sources below this node
     vector2D diff = p->position - tree->centerOfMass;
     double dist = std::max(diff.norm(), 2 * p->radius);
-    double s = tree->bounds.width; // or max(width, height)
+    double s = tree->extent.size(); // cell size, grown by refit() if particles drifted out
     double dist_eff = dist * theta * tree->thetaScale;
 
     if (s < dist_eff) {
         // Acceptable approximation — treat the whole cell as a distant mass
-        double r2 = dist * dist;
-        double r3 = r2 * dist;
-
-        // Acceleration
-        double acc_mag = -GRAV_G * tree->totalMass / r3;
-        p->acceleration += diff * acc_mag;
-
-        // Jerk (assuming center of mass velocity ≈ 0 for far-field approximation)
-        // For better accuracy, would need to track COM velocity in tree
-        // Simplified: jerk ≈ -G*M * 3*(r·v)*r/r⁵
-        double rv_dot = diff.dot(p->velocity);
-        p->jerk -= diff * (3.0 * acc_mag * rv_dot / r2);
+        cellForceAndJerk(p, diff, tree->comVelocity, tree->totalMass,
+                         tree->config->quadrupole ? &tree->quadrupole : nullptr);
     } else {
         if (tree->is_divided) {
             // Too close — recurse into children
@@ -94,15 +179,593 @@ void BarnesHutForceAndJerk(Particle *p, const QuadTree<Particle> *tree, double t
                 BarnesHutForceAndJerk(p, child, theta);
             }
         } else {
-            for (auto const &particle : tree->particles) {
-                if (p->id != particle->id) {
-                    // p->acceleration += force(p, particle.get());
-                    vector2D acc_contrib, jerk_contrib;
-                    forceAndJerk(p, particle.get(), acc_contrib, jerk_contrib);
-                    p->acceleration += acc_contrib;
-                    p->jerk += jerk_contrib;
+            const int *leaf = tree->particles.data();
+            leafForceAndJerk(p, *tree->store, leaf, leaf + tree->particles.size(),
+                             tree->config->passive_mass);
+        }
+    }
+}
+
+/**
+ * @brief Barnes-Hut walk over a LinearQuadTree
+ *
+ * @details Same three cases as the QuadTree walk, with an explicit stack of
+ * node indices. A leaf's sources are a contiguous range of the Morton order.
+ *
+ * @param p Target particle
+ * @param tree LinearQuadTree to evaluate
+ * @param theta Opening angle (accuracy parameter)
+ */
+void BarnesHutForceAndJerk(Particle *p, const LinearQuadTree<ParticleSet> *tree, double theta) {
+    if (tree->nodes.empty())
+        return;
+
+    int stack[LINEAR_TREE_STACK];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const LinearNode &node = tree->nodes[stack[--top]];
+        if (node.totalMass <= 0)
+            continue;
+        vector2D diff = p->position - node.centerOfMass;
+        double dist = std::max(diff.norm(), 2 * p->radius);
+        double s = node.extent.size();
+        double dist_eff = dist * theta * node.thetaScale;
+
+        if (s < dist_eff) {
+            cellForceAndJerk(p, diff, node.comVelocity, node.totalMass,
+                             tree->config->quadrupole ? &node.quadrupole : nullptr);
+        } else if (node.firstChild >= 0) {
+            for (int c = 0; c < 4; c++) {
+                stack[top++] = node.firstChild + c;
+            }
+        } else {
+            const int *leaf = tree->order.data() + node.first;
+            leafForceAndJerk(p, *tree->store, leaf, leaf + node.count, tree->config->passive_mass);
+        }
+    }
+}
+
+/**
+ * @struct InteractionList
+ * @brief Sources collected by one group walk, in structure-of-arrays form
+ *
+ * @details Accepted cells are reduced to center of mass, its velocity and
+ * mass, plus the quadrupole with SolverConfig::quadrupole. In mixed
+ * precision (SolverConfig::mixed_precision) they go to the float arrays
+ * instead, with the center of mass relative to origin. Opened leaves
+ * contribute their particles, copied out of the store so the evaluation
+ * loop streams through contiguous arrays.
+ */
+struct InteractionList {
+    std::vector<double> cx, cy, cm; ///< Accepted cells: center of mass and mass
+    std::vector<double> cvx, cvy;   ///< Accepted cells: center-of-mass velocity
+    std::vector<double> cqxx, cqxy, cqyy; ///< Accepted cells: quadrupole (if any)
+    std::vector<double> px, py;     ///< Source particle positions
+    std::vector<double> pvx, pvy;   ///< Source particle velocities
+    std::vector<double> pm, pr;     ///< Source particle masses and radii
+    std::vector<int> pid;           ///< Source particle IDs
+    std::vector<float> fx, fy, fm;  ///< Mixed precision cells: center of mass - origin, and mass
+    std::vector<float> fvx, fvy;    ///< Mixed precision cells: center-of-mass velocity
+    std::vector<float> fqxx, fqxy, fqyy; ///< Mixed precision cells: quadrupole (if any)
+    vector2D origin;                ///< Origin of the mixed precision cell positions
+    bool mixed = false;             ///< Store accepted cells in the float arrays
+
+    /// @brief Empty the lists, keeping their capacity
+    void clear() {
+        cx.clear(); cy.clear(); cm.clear(); cvx.clear(); cvy.clear();
+        cqxx.clear(); cqxy.clear(); cqyy.clear();
+        px.clear(); py.clear(); pvx.clear(); pvy.clear();
+        pm.clear(); pr.clear(); pid.clear();
+        fx.clear(); fy.clear(); fm.clear(); fvx.clear(); fvy.clear();
+        fqxx.clear(); fqxy.clear(); fqyy.clear();
+    }
+
+    /// @brief Number of accepted cells, in either precision
+    std::size_t cellCount() const { return cm.size() + fm.size(); }
+
+    /// @brief Append an accepted cell (quadrupole null for a monopole)
+    void addCell(const vector2D &com, const vector2D &velocity, double mass,
+                 const Quadrupole *quadrupole) {
+        if (mixed) {
+            fx.push_back(static_cast<float>(com.x - origin.x));
+            fy.push_back(static_cast<float>(com.y - origin.y));
+            fm.push_back(static_cast<float>(mass));
+            fvx.push_back(static_cast<float>(velocity.x));
+            fvy.push_back(static_cast<float>(velocity.y));
+            if (quadrupole) {
+                fqxx.push_back(static_cast<float>(quadrupole->xx));
+                fqxy.push_back(static_cast<float>(quadrupole->xy));
+                fqyy.push_back(static_cast<float>(quadrupole->yy));
+            }
+            return;
+        }
+        cx.push_back(com.x);
+        cy.push_back(com.y);
+        cm.push_back(mass);
+        cvx.push_back(velocity.x);
+        cvy.push_back(velocity.y);
+        if (quadrupole) {
+            cqxx.push_back(quadrupole->xx);
+            cqxy.push_back(quadrupole->xy);
+            cqyy.push_back(quadrupole->yy);
+        }
+    }
+
+    /// @brief Append the source particles of an opened leaf, skipping passive ones
+    void addParticles(const ParticleSet &store, const int *begin, const int *end,
+                      double passive_mass) {
+        for (const int *it = begin; it != end; ++it) {
+            int j = *it;
+            if (!store.isSource(j, passive_mass))
+                continue;
+            px.push_back(store.x[j]);
+            py.push_back(store.y[j]);
+            pvx.push_back(store.vx[j]);
+            pvy.push_back(store.vy[j]);
+            pm.push_back(store.mass[j]);
+            pr.push_back(store.radius[j]);
+            pid.push_back(store.id[j]);
+        }
+    }
+};
+
+/**
+ * @brief Build the interaction list of a group from a QuadTree
+ *
+ * @param tree Current tree node
+ * @param box Bounding box of the group's target positions
+ * @param theta Opening angle
+ * @param[out] list Interaction list to append to
+ */
+static void walkGroup(const QuadTree<ParticleSet> *tree, const Bounds &box, double theta,
+                      InteractionList &list) {
+    if (tree->totalMass <= 0)
+        return;
+    double d = box.distanceTo(tree->centerOfMass);
+    if (tree->extent.size() < d * theta * tree->thetaScale) {
+        list.addCell(tree->centerOfMass, tree->comVelocity, tree->totalMass,
+                     tree->config->quadrupole ? &tree->quadrupole : nullptr);
+    } else if (tree->is_divided) {
+        for (auto &child : tree->children) {
+            walkGroup(child, box, theta, list);
+        }
+    } else {
+        const int *leaf = tree->particles.data();
+        list.addParticles(*tree->store, leaf, leaf + tree->particles.size(),
+                          tree->config->passive_mass);
+    }
+}
+
+/**
+ * @brief Build the interaction list of a group from a LinearQuadTree
+ *
+ * @param tree LinearQuadTree to walk
+ * @param box Bounding box of the group's target positions
+ * @param theta Opening angle
+ * @param[out] list Interaction list to append to
+ */
+static void walkGroup(const LinearQuadTree<ParticleSet> *tree, const Bounds &box, double theta,
+                      InteractionList &list) {
+    if (tree->nodes.empty())
+        return;
+
+    int stack[LINEAR_TREE_STACK];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const LinearNode &node = tree->nodes[stack[--top]];
+        if (node.totalMass <= 0)
+            continue;
+        double d = box.distanceTo(node.centerOfMass);
+        if (node.extent.size() < d * theta * node.thetaScale) {
+            list.addCell(node.centerOfMass, node.comVelocity, node.totalMass,
+                         tree->config->quadrupole ? &node.quadrupole : nullptr);
+        } else if (node.firstChild >= 0) {
+            for (int c = 0; c < 4; c++) {
+                stack[top++] = node.firstChild + c;
+            }
+        } else {
+            const int *leaf = tree->order.data() + node.first;
+            list.addParticles(*tree->store, leaf, leaf + node.count, tree->config->passive_mass);
+        }
+    }
+}
+
+/**
+ * @brief Evaluate an interaction list for every member of a group
+ *
+ * @details Each target is run against the list's cells and particles
+ * with the batched kernels selected for this CPU (see force_kernels.h).
+ * Cells collected with quadrupoles go to the quadrupole kernel, cells
+ * collected in mixed precision to the float kernels with the target
+ * shifted to the list's origin.
+ *
+ * @param kernels Kernels to use
+ * @param list Interaction list of the group
+ * @param t Target arrays
+ * @param begin First target slot index of the group
+ * @param end One past the last target slot index
+ */
+static void evaluateGroup(const ForceKernels &kernels, const InteractionList &list,
+                          const ForceTargets &t, const int *begin, const int *end) {
+    const bool with_jerk = t.jx != nullptr;
+    const bool with_potential = t.pot != nullptr;
+    const bool quadrupole = !list.cqxx.empty();
+    const CellBlock cells{list.cx.data(),   list.cy.data(),   list.cvx.data(),
+                          list.cvy.data(),  list.cm.data(),   list.cqxx.data(),
+                          list.cqxy.data(), list.cqyy.data(), static_cast<int>(list.cm.size())};
+    const SourceBlock sources{list.px.data(),  list.py.data(), list.pvx.data(),
+                              list.pvy.data(), list.pm.data(), list.pr.data(),
+                              list.pid.data(), static_cast<int>(list.pm.size())};
+    const bool quadrupole_f = !list.fqxx.empty();
+    const CellBlockF cells_f{list.fx.data(),   list.fy.data(),   list.fvx.data(),
+                             list.fvy.data(),  list.fm.data(),   list.fqxx.data(),
+                             list.fqxy.data(), list.fqyy.data(), static_cast<int>(list.fm.size())};
+
+    for (const int *it = begin; it != end; ++it) {
+        const int i = *it;
+        const KernelTarget target{t.x[i], t.y[i], t.vx[i], t.vy[i], t.radius[i], t.id[i]};
+        ForceSum sum;
+        if (quadrupole)
+            kernels.quadrupoles(target, cells, with_jerk, with_potential, sum);
+        else if (cells.count > 0)
+            kernels.cells(target, cells, with_jerk, with_potential, sum);
+        if (cells_f.count > 0) {
+            const KernelTarget shifted{t.x[i] - list.origin.x, t.y[i] - list.origin.y, t.vx[i],
+                                       t.vy[i], t.radius[i], t.id[i]};
+            if (quadrupole_f)
+                kernels.quadrupoles_mixed(shifted, cells_f, with_jerk, with_potential, sum);
+            else
+                kernels.cells_mixed(shifted, cells_f, with_jerk, with_potential, sum);
+        }
+        kernels.particles(target, sources, with_jerk, with_potential, sum);
+
+        t.ax[i] = sum.ax;
+        t.ay[i] = sum.ay;
+        if (with_jerk) {
+            t.jx[i] = sum.jx;
+            t.jy[i] = sum.jy;
+        }
+        if (with_potential)
+            t.pot[i] = sum.pot;
+    }
+}
+
+/**
+ * @brief Split a run of target slots into groups of at most GROUP_SIZE
+ *
+ * @param first Position of the run in the target list
+ * @param count Length of the run
+ * @param[out] groups Group start positions to append to
+ */
+static void addGroups(int first, int count, std::vector<int> &groups) {
+    int ngroups = (count + GROUP_SIZE - 1) / GROUP_SIZE;
+    for (int g = 0; g < ngroups; g++) {
+        groups.push_back(first + static_cast<int>(static_cast<long>(count) * g / ngroups));
+    }
+}
+
+/**
+ * @brief Drop inactive and source-only slots from a grouped target list
+ *
+ * @details Groups keep their spatial grouping; groups left empty are
+ * removed.
+ *
+ * @param active Per-slot evaluation mask (null: every target slot)
+ * @param n Number of target slots; slots at or beyond it are dropped
+ * @param[in,out] order Target slots, group by group
+ * @param[in,out] groups Group start positions in order, plus the end
+ */
+static void keepActive(const uint8_t *active, int n, std::vector<int> &order,
+                       std::vector<int> &groups) {
+    int kept = 0;
+    int ngroups = 0;
+    for (std::size_t g = 0; g + 1 < groups.size(); g++) {
+        const int start = kept;
+        for (int k = groups[g]; k < groups[g + 1]; k++) {
+            if (order[k] < n && (!active || active[order[k]]))
+                order[kept++] = order[k];
+        }
+        if (kept > start)
+            groups[ngroups++] = start;
+    }
+    groups[ngroups++] = kept;
+    groups.resize(ngroups);
+    order.resize(kept);
+}
+
+/**
+ * @brief Cut a grouped target list into contiguous chunks of equal cost
+ *
+ * @details A target's cost is its interaction count from the previous
+ * evaluation (at least one; one for every target if there is no count).
+ * Chunks hold whole groups, so they stay contiguous in tree order.
+ *
+ * @param cost Per-slot interaction counts, or null
+ * @param order Target slots, group by group
+ * @param groups Group start positions in order, plus the end
+ * @param nchunks Number of chunks to aim for
+ * @return First group of every chunk, plus the number of groups
+ */
+static std::vector<int> balanceChunks(const int *cost, const std::vector<int> &order,
+                                      const std::vector<int> &groups, int nchunks) {
+    const int ngroups = static_cast<int>(groups.size()) - 1;
+    std::vector<long> prefix(ngroups + 1, 0);
+    for (int g = 0; g < ngroups; g++) {
+        long work = groups[g + 1] - groups[g];
+        if (cost) {
+            work = 0;
+            for (int k = groups[g]; k < groups[g + 1]; k++)
+                work += std::max(cost[order[k]], 1);
+        }
+        prefix[g + 1] = prefix[g] + work;
+    }
+
+    std::vector<int> chunks;
+    chunks.reserve(nchunks + 1);
+    chunks.push_back(0);
+    for (int c = 1; c < nchunks; c++) {
+        const long target = prefix[ngroups] * c / nchunks;
+        const int g = static_cast<int>(std::lower_bound(prefix.begin(), prefix.end(), target) -
+                                       prefix.begin());
+        if (g > chunks.back() && g < ngroups)
+            chunks.push_back(g);
+    }
+    chunks.push_back(ngroups);
+    return chunks;
+}
+
+/**
+ * @brief Collect the particles of every QuadTree node, leaf by leaf
+ *
+ * @param tree Current tree node
+ * @param[out] order Target slot indices, grouped by leaf
+ * @param[out] groups Group start positions in order
+ */
+static void collectGroups(const QuadTree<ParticleSet> *tree, std::vector<int> &order,
+                          std::vector<int> &groups) {
+    if (!tree->particles.empty()) {
+        addGroups(static_cast<int>(order.size()), static_cast<int>(tree->particles.size()), groups);
+        order.insert(order.end(), tree->particles.begin(), tree->particles.end());
+    }
+    if (tree->is_divided) {
+        for (auto &child : tree->children) {
+            collectGroups(child, order, groups);
+        }
+    }
+}
+
+/**
+ * @brief Collect the leaves of a LinearQuadTree, which are contiguous
+ * ranges of its Morton order
+ *
+ * @param tree LinearQuadTree
+ * @param[out] order Target slot indices, grouped by leaf
+ * @param[out] groups Group start positions in order
+ */
+static void collectGroups(const LinearQuadTree<ParticleSet> *tree, std::vector<int> &order,
+                          std::vector<int> &groups) {
+    order = tree->order;
+    for (const LinearNode &node : tree->nodes) {
+        if (node.firstChild < 0 && node.count > 0)
+            addGroups(node.first, node.count, groups);
+    }
+    // Nodes are stored level by level; the leaves tile the order, so
+    // sorting their starts gives consecutive group boundaries
+    std::sort(groups.begin(), groups.end());
+}
+
+/**
+ * @brief Slots of the sources inside the tree, if there are few of them
+ *
+ * @param tree Tree whose store and bounds to scan
+ * @param[out] sources Source slot indices
+ * @return True if there are at most SolverConfig::direct_sum_max sources
+ */
+template <class Tree> static bool fewSources(const Tree *tree, std::vector<int> &sources) {
+    const ParticleSet &store = *tree->store;
+    const SolverConfig &config = *tree->config;
+    for (int j = 0; j < static_cast<int>(store.size()); j++) {
+        if (store.isSource(j, config.passive_mass) && tree->bounds.contains(store.position(j))) {
+            if (static_cast<int>(sources.size()) == config.direct_sum_max)
+                return false;
+            sources.push_back(j);
+        }
+    }
+    return true;
+}
+
+template <class Tree>
+void computeForces(const Tree *tree, const ForceTargets &targets, int n, double theta) {
+    NBODY_PROFILE_PHASE(PHASE_FORCES);
+    NBODY_PROFILE_ONLY(std::vector<double> busy(omp_get_max_threads(), 0.0);)
+    const ForceKernels &kernels = forceKernels();
+
+    // Few sources (e.g. a star and planets among test particles): every
+    // target sums over all of them directly, with no tree walk
+    std::vector<int> sources;
+    if (fewSources(tree, sources)) {
+        InteractionList direct;
+        direct.addParticles(*tree->store, sources.data(), sources.data() + sources.size(),
+                            tree->config->passive_mass);
+        std::vector<int> all;
+        all.reserve(n);
+        for (int i = 0; i < n; i++) {
+            if (!targets.active || targets.active[i])
+                all.push_back(i);
+        }
+        const int count = static_cast<int>(all.size());
+
+#pragma omp parallel
+        {
+            NBODY_PROFILE_ONLY(const double start = omp_get_wtime();)
+#pragma omp for schedule(dynamic, 8) nowait
+            for (int first = 0; first < count; first += GROUP_SIZE) {
+                evaluateGroup(kernels, direct, targets, all.data() + first,
+                              all.data() + std::min(first + GROUP_SIZE, count));
+            }
+            NBODY_PROFILE_ONLY(busy[omp_get_thread_num()] = omp_get_wtime() - start;)
+        }
+        NBODY_PROFILE_COUNT(COUNTER_TARGETS, count);
+        NBODY_PROFILE_COUNT(COUNTER_PARTICLES, static_cast<long>(count) * direct.pm.size());
+        NBODY_PROFILE_ONLY(profiler().addBusy(busy);)
+        return;
+    }
+
+    std::vector<int> order;
+    std::vector<int> groups;
+    order.reserve(n);
+    groups.reserve(n / (GROUP_SIZE / 2) + 1);
+    collectGroups(tree, order, groups);
+
+    // Source-only slots (beyond n) are never targets
+    const bool source_only = static_cast<int>(tree->store->size()) > n;
+    if (source_only) {
+        groups.push_back(static_cast<int>(order.size()));
+        keepActive(nullptr, n, order, groups);
+        groups.pop_back();
+    }
+
+    // Particles outside the tree become groups of one
+    if (static_cast<int>(order.size()) < n) {
+        std::vector<uint8_t> in_tree(n, 0);
+        for (int i : order)
+            in_tree[i] = 1;
+        for (int i = 0; i < n; i++) {
+            if (!in_tree[i]) {
+                groups.push_back(static_cast<int>(order.size()));
+                order.push_back(i);
+            }
+        }
+    }
+    groups.push_back(static_cast<int>(order.size()));
+    if (targets.active)
+        keepActive(targets.active, n, order, groups);
+
+    // Contiguous runs of groups with equal estimated work; dynamic over
+    // the runs so a thread that finishes early takes the next one
+    const std::vector<int> chunks =
+        balanceChunks(targets.cost, order, groups, omp_get_max_threads() * FORCE_CHUNKS_PER_THREAD);
+    const int nchunks = static_cast<int>(chunks.size()) - 1;
+
+#pragma omp parallel
+    {
+        static thread_local InteractionList list;
+        NBODY_PROFILE_ONLY(const double start = omp_get_wtime(); long cells = 0, sources = 0;)
+
+#pragma omp for schedule(dynamic, 1) nowait
+        for (int c = 0; c < nchunks; c++) {
+            for (int g = chunks[c]; g < chunks[c + 1]; g++) {
+                const int *begin = order.data() + groups[g];
+                const int *end = order.data() + groups[g + 1];
+
+                Bounds box;
+                box.set_bounds(targets.x[*begin], targets.y[*begin], 0, 0);
+                for (const int *it = begin + 1; it != end; ++it) {
+                    box.expand(vector2D(targets.x[*it], targets.y[*it]));
+                }
+
+                list.clear();
+                list.mixed = tree->config->mixed_precision;
+                list.origin = vector2D(box.xmin + 0.5 * box.width, box.ymin + 0.5 * box.height);
+                walkGroup(tree, box, theta, list);
+                evaluateGroup(kernels, list, targets, begin, end);
+                if (targets.cost) {
+                    const int work = static_cast<int>(list.cellCount() + list.pm.size());
+                    for (const int *it = begin; it != end; ++it)
+                        targets.cost[*it] = work;
                 }
+                NBODY_PROFILE_ONLY(cells += static_cast<long>(end - begin) * list.cellCount();
+                                   sources += static_cast<long>(end - begin) * list.pm.size();)
             }
         }
+        NBODY_PROFILE_ONLY(busy[omp_get_thread_num()] = omp_get_wtime() - start;)
+        NBODY_PROFILE_COUNT(COUNTER_CELLS, cells);
+        NBODY_PROFILE_COUNT(COUNTER_PARTICLES, sources);
+    }
+    NBODY_PROFILE_COUNT(COUNTER_TARGETS, static_cast<long>(order.size()));
+    NBODY_PROFILE_ONLY(profiler().addBusy(busy);)
+}
+
+template void computeForces(const QuadTree<ParticleSet> *, const ForceTargets &, int, double);
+template void computeForces(const LinearQuadTree<ParticleSet> *, const ForceTargets &, int, double);
+
+/**
+ * @brief Point masses with the mass, center of mass and quadrupole of a cell
+ *
+ * @details The second moment S = Σ m d dᵀ follows from the traceless
+ * quadrupole (Sxx = (2Qxx + Qyy)/3, Syy = (Qxx + 2Qyy)/3, Sxy = Qxy/3).
+ * Masses M/4 at ±a_k e_k along its eigenvectors e_k, with
+ * a_k = sqrt(2λ_k / M), have the same second moment and no dipole.
+ *
+ * @param list Interaction list holding the cell
+ * @param k Cell index in list
+ * @param[out] out Store to write the points to
+ * @param i First of the CELL_POINTS slots to write
+ */
+static void cellPoints(const InteractionList &list, std::size_t k, ParticleSet &out,
+                       std::size_t i) {
+    const double m = list.cm[k];
+    const double sxx = (2 * list.cqxx[k] + list.cqyy[k]) / 3;
+    const double syy = (list.cqxx[k] + 2 * list.cqyy[k]) / 3;
+    const double sxy = list.cqxy[k] / 3;
+    const double mean = 0.5 * (sxx + syy);
+    const double radius = std::sqrt(0.25 * (sxx - syy) * (sxx - syy) + sxy * sxy);
+    const double angle = 0.5 * std::atan2(2 * sxy, sxx - syy);
+    const double a1 = m > 0 ? std::sqrt(std::max(2 * (mean + radius) / m, 0.0)) : 0;
+    const double a2 = m > 0 ? std::sqrt(std::max(2 * (mean - radius) / m, 0.0)) : 0;
+    const double c = std::cos(angle), s = std::sin(angle);
+    const double dx[CELL_POINTS] = {a1 * c, -a1 * c, -a2 * s, a2 * s};
+    const double dy[CELL_POINTS] = {a1 * s, -a1 * s, a2 * c, -a2 * c};
+    for (int p = 0; p < CELL_POINTS; p++, i++) {
+        out.x[i] = list.cx[k] + dx[p];
+        out.y[i] = list.cy[k] + dy[p];
+        out.vx[i] = list.cvx[k];
+        out.vy[i] = list.cvy[k];
+        out.mass[i] = 0.25 * m;
+        out.radius[i] = 0;
+        out.id[i] = -1;
+    }
+}
+
+template <class Tree>
+void exportSources(const Tree *tree, const Bounds &box, double theta, ParticleSet &out) {
+    InteractionList list;
+    walkGroup(tree, box, theta, list);
+
+    const std::size_t first = out.size();
+    const bool quadrupole = !list.cqxx.empty();
+    const std::size_t ncells = list.cm.size() * (quadrupole ? CELL_POINTS : 1);
+    out.resize(first + ncells + list.pm.size());
+    for (std::size_t k = 0; k < list.cm.size(); k++) {
+        if (quadrupole) {
+            cellPoints(list, k, out, first + CELL_POINTS * k);
+            continue;
+        }
+        const std::size_t i = first + k;
+        out.x[i] = list.cx[k];
+        out.y[i] = list.cy[k];
+        out.vx[i] = list.cvx[k];
+        out.vy[i] = list.cvy[k];
+        out.mass[i] = list.cm[k];
+        out.radius[i] = 0;
+        out.id[i] = -1;
+    }
+    for (std::size_t k = 0; k < list.pm.size(); k++) {
+        const std::size_t i = first + ncells + k;
+        out.x[i] = list.px[k];
+        out.y[i] = list.py[k];
+        out.vx[i] = list.pvx[k];
+        out.vy[i] = list.pvy[k];
+        out.mass[i] = list.pm[k];
+        out.radius[i] = list.pr[k];
+        out.id[i] = list.pid[k];
     }
 }
+
+template void exportSources(const QuadTree<ParticleSet> *, const Bounds &, double, ParticleSet &);
+template void exportSources(const LinearQuadTree<ParticleSet> *, const Bounds &, double,
+                            ParticleSet &);
@@ -0,0 +1,152 @@
+/**
+ * @file collision_grid.cpp
+ * @brief Implementation of the collision broad phase
+ */
+
+#include "collision_grid.h"
+#include "morton.h"
+
+/// @brief Most cells per axis (keeps keys compact when one particle is far out)
+#define COLLISION_GRID_MAX_CELLS (1 << 20)
+
+/// @brief Fraction of particles whose reach fits in one cell
+#define COLLISION_GRID_QUANTILE 0.99
+
+void CollisionGrid::build(const ParticleSet &particles, const Bounds &domain, double dt)
+{
+    const int n = static_cast<int>(particles.size());
+    reach.resize(n);
+    keys.clear();
+    order.clear();
+    candidates.clear();
+    cell = 0;
+
+    // Reach of every particle, and the box of those taking part
+    double xmin = domain.xmax, ymin = domain.ymax, xmax = domain.xmin, ymax = domain.ymin;
+    int inside = 0;
+#pragma omp parallel for schedule(static, CHUNK_SIZE) \
+    reduction(max : xmax, ymax) reduction(min : xmin, ymin) reduction(+ : inside)
+    for (int i = 0; i < n; i++) {
+        reach[i] = 2.0 * particles.radius[i] + std::hypot(particles.vx[i], particles.vy[i]) * dt;
+        if (particles.isMarkedForDeletion(i) || !domain.contains(particles.position(i))) {
+            reach[i] = -1;
+            continue;
+        }
+        xmin = std::min(xmin, particles.x[i]);
+        ymin = std::min(ymin, particles.y[i]);
+        xmax = std::max(xmax, particles.x[i]);
+        ymax = std::max(ymax, particles.y[i]);
+        inside++;
+    }
+    if (inside < 2)
+        return;
+
+    // Cells fit the reach of all but the fastest particles; a few ejected
+    // particles would otherwise make every cell crowded
+    std::vector<double> sorted_reach;
+    sorted_reach.reserve(inside);
+    for (int i = 0; i < n; i++) {
+        if (reach[i] >= 0)
+            sorted_reach.push_back(reach[i]);
+    }
+    auto quantile = sorted_reach.begin() + static_cast<long>(COLLISION_GRID_QUANTILE * (inside - 1));
+    std::nth_element(sorted_reach.begin(), quantile, sorted_reach.end());
+
+    cell = std::max({*quantile, (xmax - xmin) / COLLISION_GRID_MAX_CELLS,
+                     (ymax - ymin) / COLLISION_GRID_MAX_CELLS, 1e-300});
+    const double inv_cell = 1.0 / cell;
+
+    // One empty column on each side, so the neighbours of a cell never wrap
+    // into another row
+    const uint64_t cols = static_cast<uint64_t>((xmax - xmin) * inv_cell) + 3;
+    const uint64_t rows = static_cast<uint64_t>((ymax - ymin) * inv_cell) + 2;
+
+    keys.reserve(inside);
+    order.reserve(inside);
+    for (int i = 0; i < n; i++) {
+        if (reach[i] < 0)
+            continue;
+        uint64_t ix = static_cast<uint64_t>((particles.x[i] - xmin) * inv_cell);
+        uint64_t iy = static_cast<uint64_t>((particles.y[i] - ymin) * inv_cell);
+        ix = std::min(ix, cols - 3) + 1;
+        iy = std::min(iy, rows - 2);
+        keys.push_back(iy * cols + ix);
+        order.push_back(i);
+    }
+    int key_bits = 1;
+    while (key_bits < 64 && (rows * cols) >> key_bits)
+        key_bits++;
+    radixSortByKey(keys, order, key_bits);
+
+    // Slow particles (reach within one cell) pair with their forward
+    // half-neighbourhood: the rest of their own cell and the next cell in
+    // the row, then cells (ix-1..ix+1, iy+1). Fast particles scan every cell
+    // their reach covers and own their pairs with slow particles, and with
+    // fast particles of smaller reach.
+    const int count = static_cast<int>(keys.size());
+#pragma omp parallel
+    {
+        std::vector<std::pair<int, int>> found;
+
+        auto test = [&](int i, int j) {
+            const double r = std::max(reach[i], reach[j]);
+            if (std::abs(particles.x[i] - particles.x[j]) <= r &&
+                std::abs(particles.y[i] - particles.y[j]) <= r) {
+                if (particles.id[i] < particles.id[j])
+                    found.emplace_back(i, j);
+                else
+                    found.emplace_back(j, i);
+            }
+        };
+
+#pragma omp for schedule(dynamic, CHUNK_SIZE) nowait
+        for (int p = 0; p < count; p++) {
+            const int i = order[p];
+            const uint64_t key = keys[p];
+
+            if (reach[i] <= cell) {
+                const int row_end = static_cast<int>(
+                    std::upper_bound(keys.begin() + p, keys.end(), key + 1) - keys.begin());
+                for (int q = p + 1; q < row_end; q++) {
+                    if (reach[order[q]] <= cell)
+                        test(i, order[q]);
+                }
+
+                auto above = std::lower_bound(keys.begin() + row_end, keys.end(), key + cols - 1);
+                const int above_end = static_cast<int>(
+                    std::upper_bound(above, keys.end(), key + cols + 1) - keys.begin());
+                for (int q = static_cast<int>(above - keys.begin()); q < above_end; q++) {
+                    if (reach[order[q]] <= cell)
+                        test(i, order[q]);
+                }
+                continue;
+            }
+
+            const int64_t ix = static_cast<int64_t>(key % cols);
+            const int64_t iy = static_cast<int64_t>(key / cols);
+            const int64_t k = static_cast<int64_t>(std::ceil(reach[i] * inv_cell));
+            const uint64_t x0 = static_cast<uint64_t>(std::max<int64_t>(ix - k, 1));
+            const uint64_t x1 = static_cast<uint64_t>(std::min<int64_t>(ix + k, cols - 2));
+            const int64_t y1 = std::min<int64_t>(iy + k, rows - 1);
+            for (int64_t y = std::max<int64_t>(iy - k, 0); y <= y1; y++) {
+                const uint64_t row = static_cast<uint64_t>(y) * cols;
+                auto lo = std::lower_bound(keys.begin(), keys.end(), row + x0);
+                auto hi = std::upper_bound(lo, keys.end(), row + x1);
+                for (int q = static_cast<int>(lo - keys.begin()); q < hi - keys.begin(); q++) {
+                    const int j = order[q];
+                    const bool j_owns = reach[j] > cell &&
+                                        (reach[j] > reach[i] || (reach[j] == reach[i] && j < i));
+                    if (j == i || j_owns)
+                        continue;
+                    test(i, j);
+                }
+            }
+        }
+
+#pragma omp critical
+        candidates.insert(candidates.end(), found.begin(), found.end());
+    }
+
+    // Thread-count independent order for the narrow phase
+    std::sort(candidates.begin(), candidates.end());
+}
@@ -0,0 +1,177 @@
+/**
+ * @file device_solver.cpp
+ * @brief Implementation of the offloaded direct summation
+ */
+
+#include "device_solver.h"
+
+#pragma omp declare target
+/**
+ * @brief Acceleration (and jerk and potential) of one target from every source
+ *
+ * @details Same softened pair formula as the particle kernels
+ * (force_kernels.cpp): r_s = max(|r|, r_i + r_j), sources with the
+ * target's ID are skipped.
+ */
+static void sumSources(double tx, double ty, double tvx, double tvy, double tradius, int tid,
+                       const double *sx, const double *sy, const double *svx, const double *svy,
+                       const double *smass, const double *sradius, const int *sid, int count,
+                       bool with_jerk, bool with_potential, double &ax, double &ay, double &jx,
+                       double &jy, double &pot) {
+    ax = ay = jx = jy = pot = 0;
+    for (int k = 0; k < count; k++) {
+        const double dx = tx - sx[k];
+        const double dy = ty - sy[k];
+        const double r_soft = std::max(std::sqrt(dx * dx + dy * dy), tradius + sradius[k]);
+        const double r_soft2 = r_soft * r_soft;
+        const double mag = sid[k] == tid ? 0.0 : -GRAV_G * smass[k] / (r_soft2 * r_soft);
+        ax += dx * mag;
+        ay += dy * mag;
+        if (with_potential)
+            pot += mag * r_soft2;
+        if (with_jerk) {
+            const double dvx = tvx - svx[k];
+            const double dvy = tvy - svy[k];
+            const double f = 3.0 * mag * (dx * dvx + dy * dvy) / r_soft2;
+            jx += dvx * mag - dx * f;
+            jy += dvy * mag - dy * f;
+        }
+    }
+}
+#pragma omp end declare target
+
+DeviceSolver::DeviceSolver(const ParticleSet *_sources, double _passive_mass)
+    : sources(_sources), passive_mass(_passive_mass) {
+    rebuild();
+}
+
+DeviceSolver::~DeviceSolver() { unmap(); }
+
+bool DeviceSolver::hasDevice() { return omp_get_num_devices() > 0; }
+
+void DeviceSolver::unmap() {
+    if (!mapped)
+        return;
+    // Named only in the data clauses, which GCC does not count as uses
+    [[maybe_unused]] double *px = x.data(), *py = y.data(), *pvx = vx.data(), *pvy = vy.data();
+    [[maybe_unused]] double *pmass = mass.data(), *pradius = radius.data();
+    [[maybe_unused]] int *pid = id.data();
+    const int ns = count;
+#pragma omp target exit data map(release : px[0:ns], py[0:ns], pvx[0:ns], pvy[0:ns],          \
+                                     pmass[0:ns], pradius[0:ns], pid[0:ns])
+    mapped = false;
+}
+
+void DeviceSolver::rebuild() {
+    unmap();
+    const ParticleSet &store = *sources;
+    slots.clear();
+    for (int j = 0; j < static_cast<int>(store.size()); j++)
+        if (store.isSource(j, passive_mass))
+            slots.push_back(j);
+    count = static_cast<int>(slots.size());
+    x.resize(count);
+    y.resize(count);
+    vx.resize(count);
+    vy.resize(count);
+    mass.resize(count);
+    radius.resize(count);
+    id.resize(count);
+#pragma omp parallel for schedule(static, CHUNK_SIZE)
+    for (int k = 0; k < count; k++) {
+        const int j = slots[k];
+        x[k] = store.x[j];
+        y[k] = store.y[j];
+        vx[k] = store.vx[j];
+        vy[k] = store.vy[j];
+        mass[k] = store.mass[j];
+        radius[k] = store.radius[j];
+        id[k] = store.id[j];
+    }
+
+    // Named only in the data clauses, which GCC does not count as uses
+    [[maybe_unused]] double *px = x.data(), *py = y.data(), *pvx = vx.data(), *pvy = vy.data();
+    [[maybe_unused]] double *pmass = mass.data(), *pradius = radius.data();
+    [[maybe_unused]] int *pid = id.data();
+    const int ns = count;
+#pragma omp target enter data map(to : px[0:ns], py[0:ns], pvx[0:ns], pvy[0:ns], pmass[0:ns],  \
+                                      pradius[0:ns], pid[0:ns])
+    mapped = true;
+}
+
+void DeviceSolver::refit() {
+    const ParticleSet &store = *sources;
+#pragma omp parallel for schedule(static, CHUNK_SIZE)
+    for (int k = 0; k < count; k++) {
+        const int j = slots[k];
+        x[k] = store.x[j];
+        y[k] = store.y[j];
+        vx[k] = store.vx[j];
+        vy[k] = store.vy[j];
+    }
+
+    [[maybe_unused]] double *px = x.data(), *py = y.data(), *pvx = vx.data(), *pvy = vy.data();
+    const int ns = count;
+#pragma omp target update to(px[0:ns], py[0:ns], pvx[0:ns], pvy[0:ns])
+}
+
+void DeviceSolver::forces(const ForceTargets &targets, int n) {
+    const double *tx = targets.x, *ty = targets.y, *tvx = targets.vx, *tvy = targets.vy;
+    const double *tradius = targets.radius;
+    const int *tid = targets.id;
+    const uint8_t *active = targets.active;
+    double *ax = targets.ax, *ay = targets.ay, *jx = targets.jx, *jy = targets.jy;
+    double *pot = targets.pot;
+    const bool with_jerk = jx != nullptr;
+    const bool with_potential = pot != nullptr;
+    const int nj = with_jerk ? n : 0;
+    const int np = with_potential ? n : 0;
+
+    const double *sx = x.data(), *sy = y.data(), *svx = vx.data(), *svy = vy.data();
+    const double *smass = mass.data(), *sradius = radius.data();
+    const int *sid = id.data();
+    const int ns = count;
+
+    if (!active) {
+        // Every target is written: the outputs only travel back
+#pragma omp target teams distribute parallel for                                               \
+    map(to : tx[0:n], ty[0:n], tvx[0:n], tvy[0:n], tradius[0:n], tid[0:n])                     \
+    map(from : ax[0:n], ay[0:n], jx[0:nj], jy[0:nj], pot[0:np])                                \
+    map(to : sx[0:ns], sy[0:ns], svx[0:ns], svy[0:ns], smass[0:ns], sradius[0:ns], sid[0:ns])
+        for (int i = 0; i < n; i++) {
+            double sax, say, sjx, sjy, spot;
+            sumSources(tx[i], ty[i], tvx[i], tvy[i], tradius[i], tid[i], sx, sy, svx, svy, smass,
+                       sradius, sid, ns, with_jerk, with_potential, sax, say, sjx, sjy, spot);
+            ax[i] = sax;
+            ay[i] = say;
+            if (with_jerk) {
+                jx[i] = sjx;
+                jy[i] = sjy;
+            }
+            if (with_potential)
+                pot[i] = spot;
+        }
+        return;
+    }
+
+    // Inactive targets keep their outputs, so those make the round trip
+#pragma omp target teams distribute parallel for                                               \
+    map(to : tx[0:n], ty[0:n], tvx[0:n], tvy[0:n], tradius[0:n], tid[0:n], active[0:n])        \
+    map(tofrom : ax[0:n], ay[0:n], jx[0:nj], jy[0:nj], pot[0:np])                              \
+    map(to : sx[0:ns], sy[0:ns], svx[0:ns], svy[0:ns], smass[0:ns], sradius[0:ns], sid[0:ns])
+    for (int i = 0; i < n; i++) {
+        if (!active[i])
+            continue;
+        double sax, say, sjx, sjy, spot;
+        sumSources(tx[i], ty[i], tvx[i], tvy[i], tradius[i], tid[i], sx, sy, svx, svy, smass,
+                   sradius, sid, ns, with_jerk, with_potential, sax, say, sjx, sjy, spot);
+        ax[i] = sax;
+        ay[i] = say;
+        if (with_jerk) {
+            jx[i] = sjx;
+            jy[i] = sjy;
+        }
+        if (with_potential)
+            pot[i] = spot;
+    }
+}
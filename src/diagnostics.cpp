@@ -0,0 +1,72 @@
+/**
+ * @file diagnostics.cpp
+ * @brief Implementation of the fused conserved-quantity reduction
+ */
+
+#include "diagnostics.h"
+
+/// @brief Partial sums of one CHUNK_SIZE block of the store
+struct BlockSums {
+    double kinetic = 0, potential = 0, px = 0, py = 0, angular = 0, mass = 0, mx = 0, my = 0;
+    long count = 0;
+};
+
+Diagnostics measureDiagnostics(const ParticleSet &particles, const Bounds &bounds,
+                               double passive_mass, bool with_potential) {
+    // Fixed per-block partial sums combined in block order, so the center
+    // the store is recentered on does not depend on the thread count or
+    // on the order the threads finish
+    const int n = static_cast<int>(particles.size());
+    const int nblocks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<BlockSums> blocks(nblocks);
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < nblocks; b++) {
+        BlockSums &s = blocks[b];
+        for (int i = b * CHUNK_SIZE; i < std::min(n, (b + 1) * CHUNK_SIZE); i++) {
+            if (!bounds.contains(particles.position(i)))
+                continue;
+            const double m = particles.mass[i];
+            const double vx = particles.vx[i], vy = particles.vy[i];
+            s.kinetic += 0.5 * m * (vx * vx + vy * vy);
+            s.px += m * vx;
+            s.py += m * vy;
+            s.angular += m * (particles.x[i] * vy - particles.y[i] * vx);
+            s.mass += m;
+            s.mx += m * particles.x[i];
+            s.my += m * particles.y[i];
+            s.count++;
+            if (with_potential)
+                s.potential +=
+                    (particles.isSource(i, passive_mass) ? 0.5 : 1.0) * m * particles.pot[i];
+        }
+    }
+
+    BlockSums total;
+    for (const BlockSums &s : blocks) {
+        total.kinetic += s.kinetic;
+        total.potential += s.potential;
+        total.px += s.px;
+        total.py += s.py;
+        total.angular += s.angular;
+        total.mass += s.mass;
+        total.mx += s.mx;
+        total.my += s.my;
+        total.count += s.count;
+    }
+
+    Diagnostics d;
+    d.kinetic = total.kinetic;
+    d.potential = total.potential;
+    d.px = total.px;
+    d.py = total.py;
+    d.mass = total.mass;
+    d.count = total.count;
+    d.with_potential = with_potential;
+    if (total.mass > 0) {
+        d.com_x = total.mx / total.mass;
+        d.com_y = total.my / total.mass;
+    }
+    // About the center of mass: L - R x P
+    d.angular = total.angular - (d.com_x * total.py - d.com_y * total.px);
+    return d;
+}
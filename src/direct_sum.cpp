@@ -0,0 +1,112 @@
+/**
+ * @file direct_sum.cpp
+ * @brief Implementation of the tiled direct summation
+ */
+
+#include "direct_sum.h"
+#include "force_kernels.h"
+
+/**
+ * @struct SourceArrays
+ * @brief Sources of a particle store packed into contiguous arrays
+ */
+struct SourceArrays {
+    std::vector<double> x, y, vx, vy, mass, radius; ///< Source state
+    std::vector<int> id;                            ///< Source IDs
+
+    /**
+     * @brief Pack the sources of a store
+     *
+     * @param store Particle store
+     * @param passive_mass Particles lighter than this are skipped
+     */
+    SourceArrays(const ParticleSet &store, double passive_mass) {
+        for (int j = 0; j < static_cast<int>(store.size()); j++) {
+            if (!store.isSource(j, passive_mass))
+                continue;
+            x.push_back(store.x[j]);
+            y.push_back(store.y[j]);
+            vx.push_back(store.vx[j]);
+            vy.push_back(store.vy[j]);
+            mass.push_back(store.mass[j]);
+            radius.push_back(store.radius[j]);
+            id.push_back(store.id[j]);
+        }
+    }
+
+    /**
+     * @brief Block view of the sources [first, first + count)
+     *
+     * @param first First source
+     * @param count Number of sources
+     */
+    SourceBlock tile(int first, int count) const {
+        return {x.data() + first,    y.data() + first,      vx.data() + first, vy.data() + first,
+                mass.data() + first, radius.data() + first, id.data() + first, count};
+    }
+};
+
+void directForces(const ParticleSet &sources, const ForceTargets &targets, int n,
+                  double passive_mass) {
+    const ForceKernels &kernels = forceKernels();
+    const SourceArrays packed(sources, passive_mass);
+    const int nsources = static_cast<int>(packed.mass.size());
+    const bool with_jerk = targets.jx != nullptr;
+    const bool with_potential = targets.pot != nullptr;
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int first = 0; first < n; first += GROUP_SIZE) {
+        const int end = std::min(first + GROUP_SIZE, n);
+        ForceSum sums[GROUP_SIZE];
+
+        // Every target of the group runs over a tile while it is in cache
+        for (int tile = 0; tile < nsources; tile += DIRECT_TILE) {
+            const SourceBlock block = packed.tile(tile, std::min(DIRECT_TILE, nsources - tile));
+            for (int i = first; i < end; i++) {
+                if (targets.active && !targets.active[i])
+                    continue;
+                const KernelTarget target{targets.x[i],  targets.y[i],      targets.vx[i],
+                                          targets.vy[i], targets.radius[i], targets.id[i]};
+                kernels.particles(target, block, with_jerk, with_potential, sums[i - first]);
+            }
+        }
+
+        for (int i = first; i < end; i++) {
+            if (targets.active && !targets.active[i])
+                continue;
+            targets.ax[i] = sums[i - first].ax;
+            targets.ay[i] = sums[i - first].ay;
+            if (with_jerk) {
+                targets.jx[i] = sums[i - first].jx;
+                targets.jy[i] = sums[i - first].jy;
+            }
+            if (with_potential)
+                targets.pot[i] = sums[i - first].pot;
+        }
+    }
+}
+
+double potentialEnergy(const ParticleSet &particles, double passive_mass) {
+    const SourceArrays packed(particles, passive_mass);
+    const int n = static_cast<int>(particles.size());
+    const int nsources = static_cast<int>(packed.mass.size());
+    double energy = 0;
+
+    // Source-source pairs are counted from the lower ID, pairs with a
+    // passive particle from the passive side
+#pragma omp parallel for reduction(+ : energy) schedule(dynamic, CHUNK_SIZE)
+    for (int i = 0; i < n; i++) {
+        const bool source = particles.isSource(i, passive_mass);
+        double sum = 0;
+        for (int j = 0; j < nsources; j++) {
+            if (source && packed.id[j] <= particles.id[i])
+                continue;
+            double dx = particles.x[i] - packed.x[j];
+            double dy = particles.y[i] - packed.y[j];
+            double r = std::max(std::sqrt(dx * dx + dy * dy), particles.radius[i] + packed.radius[j]);
+            sum += packed.mass[j] / r;
+        }
+        energy -= GRAV_G * particles.mass[i] * sum;
+    }
+    return energy;
+}
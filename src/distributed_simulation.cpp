@@ -0,0 +1,131 @@
+/**
+ * @file distributed_simulation.cpp
+ * @brief Implementation of the MPI stepping engine
+ */
+
+#include "distributed_simulation.h"
+#include "interactions.h"
+#include "profiler.h"
+
+DistributedSimulation::DistributedSimulation(MPI_Comm comm, double xmin, double ymin,
+                                             double width, double height, double _dt,
+                                             const SolverConfig &_config)
+    : config(_config), domain(comm, xmin, ymin, width, height),
+      solver(&domain, &particles, &config), dt(_dt) {}
+
+void DistributedSimulation::distribute() {
+    imbalance = domain.balance(particles, 0);
+    domain.migrate(particles);
+    solver.takeWork();
+}
+
+void DistributedSimulation::step() {
+    NBODY_PROFILE_ONLY(profiler().beginStep();)
+    {
+        NBODY_PROFILE_PHASE(PHASE_STEP);
+        {
+            NBODY_PROFILE_PHASE(PHASE_TRANSPORT);
+            solver.rebuild();
+            transportStep(particles, solver, dt, config);
+        }
+        {
+            NBODY_PROFILE_PHASE(PHASE_COLLISIONS);
+            collide();
+        }
+        {
+            NBODY_PROFILE_PHASE(PHASE_RECENTER);
+            recenter();
+        }
+        {
+            NBODY_PROFILE_PHASE(PHASE_TREE);
+            if (rebalance_interval > 0 && (step_count + 1) % rebalance_interval == 0)
+                imbalance = domain.balance(particles, solver.takeWork());
+            domain.migrate(particles);
+        }
+    }
+    time += dt;
+    step_count++;
+    NBODY_PROFILE_ONLY(profiler().endStep(step_count, particles.size(), 0, 0);)
+}
+
+void DistributedSimulation::run(long nsteps) {
+    for (long s = 0; s < nsteps; s++)
+        step();
+}
+
+long DistributedSimulation::globalCount() const {
+    return static_cast<long>(domain.sum(static_cast<double>(particles.size())));
+}
+
+void DistributedSimulation::collide() {
+    const int n = static_cast<int>(particles.size());
+
+    // Halo: every particle a local one could reach this step (the reach
+    // of the collision grid, 2 * radius + |v| * dt)
+    double reach = 0, xmin = INFINITY, ymin = INFINITY, xmax = -INFINITY, ymax = -INFINITY;
+#pragma omp parallel for reduction(max : reach, xmax, ymax) reduction(min : xmin, ymin)         \
+    schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++) {
+        const double speed = std::sqrt(particles.vx[i] * particles.vx[i] +
+                                       particles.vy[i] * particles.vy[i]);
+        reach = std::max(reach, 2 * particles.radius[i] + speed * dt);
+        xmin = std::min(xmin, particles.x[i]);
+        ymin = std::min(ymin, particles.y[i]);
+        xmax = std::max(xmax, particles.x[i]);
+        ymax = std::max(ymax, particles.y[i]);
+    }
+    Bounds box = emptyBox();
+    if (n > 0)
+        box.set_bounds(xmin, ymin, xmax - xmin, ymax - ymin);
+    const std::vector<Bounds> boxes = domain.gatherBoxes(box);
+
+    ParticleSet combined = particles;
+    domain.exchangeHalo(particles, boxes, domain.max(reach), combined);
+    const std::vector<int> remap = collideParticles(combined, domain.getDomain(), dt);
+    if (remap.empty())
+        return;
+
+    // Keep the outcome for the local slots, which come first in combined
+#pragma omp parallel for schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++) {
+        const int k = remap[i];
+        if (k < 0) {
+            particles.markForDeletion(i);
+            continue;
+        }
+        particles.vx[i] = combined.vx[k];
+        particles.vy[i] = combined.vy[k];
+        particles.mass[i] = combined.mass[k];
+        particles.radius[i] = combined.radius[k];
+        particles.flags[i] = combined.flags[k];
+    }
+    particles.compact();
+}
+
+void DistributedSimulation::recenter() {
+    const Bounds &bounds = domain.getDomain();
+    double total_mass = 0, com_x = 0, com_y = 0;
+#pragma omp parallel for reduction(+ : com_x, com_y, total_mass) schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < static_cast<int>(particles.size()); i++) {
+        if (bounds.contains(particles.position(i))) {
+            com_x += particles.x[i] * particles.mass[i];
+            com_y += particles.y[i] * particles.mass[i];
+            total_mass += particles.mass[i];
+        }
+    }
+
+    // Every rank sees the same total, so all return together
+    total_mass = domain.sum(total_mass);
+    com_x = domain.sum(com_x);
+    com_y = domain.sum(com_y);
+    if (total_mass <= 0)
+        return;
+    com_x /= total_mass;
+    com_y /= total_mass;
+
+#pragma omp parallel for simd schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < static_cast<int>(particles.size()); i++) {
+        particles.x[i] -= com_x;
+        particles.y[i] -= com_y;
+    }
+}
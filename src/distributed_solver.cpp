@@ -0,0 +1,94 @@
+/**
+ * @file distributed_solver.cpp
+ * @brief Implementation of the distributed Barnes-Hut solver
+ */
+
+#include "distributed_solver.h"
+
+/// @brief True if box outer holds box inner (an empty inner is always held)
+static bool covers(const Bounds &outer, const Bounds &inner) {
+    if (isEmptyBox(inner))
+        return true;
+    return !isEmptyBox(outer) && outer.xmin <= inner.xmin && outer.ymin <= inner.ymin &&
+           outer.xmax >= inner.xmax && outer.ymax >= inner.ymax;
+}
+
+/**
+ * @brief Bounding box of the active targets
+ *
+ * @param targets Target arrays
+ * @param n Number of target slots
+ * @return Box of the active targets (emptyBox() if none)
+ */
+static Bounds targetBox(const ForceTargets &targets, int n) {
+    double xmin = INFINITY, ymin = INFINITY, xmax = -INFINITY, ymax = -INFINITY;
+#pragma omp parallel for reduction(min : xmin, ymin) reduction(max : xmax, ymax)                \
+    schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++) {
+        if (targets.active && !targets.active[i])
+            continue;
+        xmin = std::min(xmin, targets.x[i]);
+        ymin = std::min(ymin, targets.y[i]);
+        xmax = std::max(xmax, targets.x[i]);
+        ymax = std::max(ymax, targets.y[i]);
+    }
+    if (xmin > xmax)
+        return emptyBox();
+    Bounds box;
+    box.set_bounds(xmin, ymin, xmax - xmin, ymax - ymin);
+    return box;
+}
+
+DistributedSolver::DistributedSolver(DomainDecomposition *_domain, const ParticleSet *_particles,
+                                     const SolverConfig *_config)
+    : domain(_domain), particles(_particles), config(_config),
+      local_tree(_domain->getDomain().xmin, _domain->getDomain().ymin,
+                 _domain->getDomain().width, _domain->getDomain().height, _particles, _config),
+      source_tree(_domain->getDomain().xmin, _domain->getDomain().ymin,
+                  _domain->getDomain().width, _domain->getDomain().height, &sources, _config) {}
+
+void DistributedSolver::forces(const ForceTargets &targets, int n) {
+    const std::vector<Bounds> boxes = domain->gatherBoxes(targetBox(targets, n));
+    // Every rank sees the same boxes, so all take the same branch
+    bool covered = !stale && exported.size() == boxes.size();
+    for (std::size_t r = 0; covered && r < boxes.size(); r++)
+        covered = covers(exported[r], boxes[r]);
+    if (!covered)
+        exchange(boxes);
+
+    const double start = omp_get_wtime();
+    computeForces(&source_tree, targets, n, config->theta);
+    work += omp_get_wtime() - start;
+}
+
+void DistributedSolver::exchange(const std::vector<Bounds> &boxes) {
+    local_tree.build();
+    local_tree.calculateCOM();
+
+    // Local particles keep their slots; imports follow as sources only
+    const int n = static_cast<int>(particles->size());
+    sources.resize(n);
+#pragma omp parallel for schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++) {
+        sources.x[i] = particles->x[i];
+        sources.y[i] = particles->y[i];
+        sources.vx[i] = particles->vx[i];
+        sources.vy[i] = particles->vy[i];
+        sources.mass[i] = particles->mass[i];
+        sources.radius[i] = particles->radius[i];
+        sources.id[i] = particles->id[i];
+        sources.flags[i] = particles->flags[i];
+    }
+    domain->exchangeSources(local_tree, boxes, config->theta, sources);
+
+    source_tree.build();
+    source_tree.calculateCOM();
+    exported = boxes;
+    stale = false;
+}
+
+double DistributedSolver::takeWork() {
+    const double taken = work;
+    work = 0;
+    return taken;
+}
@@ -0,0 +1,276 @@
+/**
+ * @file domain_decomposition.cpp
+ * @brief Implementation of the MPI partition and exchanges
+ */
+
+#include "domain_decomposition.h"
+#include "barneshut.h"
+
+/**
+ * @struct ParticleRecord
+ * @brief Complete state of a migrating or halo particle
+ */
+struct ParticleRecord {
+    double x, y, vx, vy, ax, ay, jx, jy; ///< Phase space, acceleration and jerk
+    double mass, radius;                 ///< Mass and radius
+    int id;                              ///< Particle ID
+    int cost;                            ///< Interactions of the last force evaluation
+    uint8_t flags;                       ///< PARTICLE_* flag bits
+    uint8_t level;                       ///< Block timestep level
+};
+
+/**
+ * @struct SourceRecord
+ * @brief One exported source (particle or cell pseudo-particle)
+ */
+struct SourceRecord {
+    double x, y, vx, vy; ///< Position and velocity
+    double mass, radius; ///< Mass and softening radius
+    int id;              ///< Particle ID (-1 for a cell)
+};
+
+/// @brief Record of slot i of a store
+static ParticleRecord packParticle(const ParticleSet &p, int i) {
+    return {p.x[i],    p.y[i],      p.vx[i], p.vy[i],   p.ax[i],    p.ay[i],    p.jx[i],
+            p.jy[i],   p.mass[i],   p.radius[i], p.id[i], p.cost[i], p.flags[i], p.level[i]};
+}
+
+/// @brief Write a record into slot i of a store
+static void unpackParticle(const ParticleRecord &r, ParticleSet &p, int i) {
+    p.x[i] = r.x;
+    p.y[i] = r.y;
+    p.vx[i] = r.vx;
+    p.vy[i] = r.vy;
+    p.ax[i] = r.ax;
+    p.ay[i] = r.ay;
+    p.jx[i] = r.jx;
+    p.jy[i] = r.jy;
+    p.mass[i] = r.mass;
+    p.radius[i] = r.radius;
+    p.id[i] = r.id;
+    p.cost[i] = r.cost;
+    p.flags[i] = r.flags;
+    p.level[i] = r.level;
+}
+
+/**
+ * @brief All-to-all exchange of variable-length record lists
+ *
+ * @details Counts and offsets are in records, with a contiguous MPI type
+ * of one record, so they stay within int range far beyond the point
+ * where byte counts would overflow.
+ *
+ * @param comm Communicator
+ * @param send Records for every rank (the own entry is ignored)
+ * @param[out] recv Records received, rank by rank
+ */
+template <class Record>
+static void exchangeRecords(MPI_Comm comm, std::vector<std::vector<Record>> &send,
+                            std::vector<Record> &recv) {
+    const int nranks = static_cast<int>(send.size());
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    send[rank].clear();
+
+    std::vector<int> send_counts(nranks), recv_counts(nranks);
+    for (int r = 0; r < nranks; r++)
+        send_counts[r] = static_cast<int>(send[r].size());
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+
+    std::vector<int> send_offsets(nranks + 1, 0), recv_offsets(nranks + 1, 0);
+    for (int r = 0; r < nranks; r++) {
+        send_offsets[r + 1] = send_offsets[r] + send_counts[r];
+        recv_offsets[r + 1] = recv_offsets[r] + recv_counts[r];
+    }
+    std::vector<Record> packed(send_offsets[nranks]);
+    for (int r = 0; r < nranks; r++)
+        std::copy(send[r].begin(), send[r].end(), packed.begin() + send_offsets[r]);
+    recv.resize(recv_offsets[nranks]);
+
+    MPI_Datatype record;
+    MPI_Type_contiguous(static_cast<int>(sizeof(Record)), MPI_BYTE, &record);
+    MPI_Type_commit(&record);
+    MPI_Alltoallv(packed.data(), send_counts.data(), send_offsets.data(), record, recv.data(),
+                  recv_counts.data(), recv_offsets.data(), record, comm);
+    MPI_Type_free(&record);
+}
+
+DomainDecomposition::DomainDecomposition(MPI_Comm _comm, double xmin, double ymin, double width,
+                                         double height)
+    : comm(_comm) {
+    domain.set_bounds(xmin, ymin, width, height);
+    MPI_Comm_rank(comm, &rank_index);
+    MPI_Comm_size(comm, &rank_count);
+    const uint64_t keys = 1ULL << (2 * DOMAIN_KEY_LEVELS);
+    splitters.resize(rank_count + 1);
+    for (int r = 0; r <= rank_count; r++)
+        splitters[r] = keys / rank_count * r;
+    splitters[rank_count] = keys;
+}
+
+int DomainDecomposition::owner(double x, double y) const {
+    const uint64_t k = key(x, y);
+    return static_cast<int>(std::upper_bound(splitters.begin(), splitters.end(), k) -
+                            splitters.begin()) - 1;
+}
+
+double DomainDecomposition::balance(const ParticleSet &particles, double work) {
+    const int n = static_cast<int>(particles.size());
+    std::vector<std::pair<uint64_t, int>> keyed(n);
+#pragma omp parallel for schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++)
+        keyed[i] = {key(particles.x[i], particles.y[i]), i};
+    std::sort(keyed.begin(), keyed.end());
+
+    // Unit weights until every rank has measured its work
+    double imbalance = 1;
+    const bool measured = max(work <= 0 || n == 0 ? 1.0 : 0.0) == 0;
+    if (measured) {
+        const double mean = sum(work) / rank_count;
+        imbalance = max(work) / mean;
+    }
+
+    // The rank's work shared out by the particles' interaction counts (at
+    // least one, as in the force chunking), summed along the key order
+    double interactions = 0;
+    for (int i = 0; i < n; i++)
+        interactions += std::max(particles.cost[i], 1);
+    const double scale = measured ? work / interactions : 1;
+    std::vector<uint64_t> keys(n);
+    std::vector<double> prefix(n + 1, 0);
+    for (int k = 0; k < n; k++) {
+        const int i = keyed[k].second;
+        keys[k] = keyed[k].first;
+        prefix[k + 1] = prefix[k] + (measured ? scale * std::max(particles.cost[i], 1) : 1);
+    }
+    const double total = sum(prefix[n]);
+
+    // Bisection of every splitter at once: lo is the smallest key whose
+    // weight below may still reach the target, hi the largest
+    const int nsplit = rank_count - 1;
+    std::vector<uint64_t> lo(nsplit, 0), hi(nsplit, splitters[rank_count]);
+    std::vector<double> below(nsplit), global_below(nsplit);
+    for (int iter = 0; iter <= 2 * DOMAIN_KEY_LEVELS; iter++) {
+        for (int s = 0; s < nsplit; s++) {
+            const uint64_t mid = lo[s] + (hi[s] - lo[s]) / 2;
+            below[s] = prefix[std::lower_bound(keys.begin(), keys.end(), mid) - keys.begin()];
+        }
+        MPI_Allreduce(below.data(), global_below.data(), nsplit, MPI_DOUBLE, MPI_SUM, comm);
+        for (int s = 0; s < nsplit; s++) {
+            const uint64_t mid = lo[s] + (hi[s] - lo[s]) / 2;
+            if (global_below[s] < total * (s + 1) / rank_count)
+                lo[s] = mid + 1;
+            else
+                hi[s] = mid;
+        }
+    }
+    for (int s = 0; s < nsplit; s++)
+        splitters[s + 1] = std::max(lo[s], splitters[s]);
+    return imbalance;
+}
+
+void DomainDecomposition::migrate(ParticleSet &particles) {
+    const int n = static_cast<int>(particles.size());
+    std::vector<int> owners(n);
+#pragma omp parallel for schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++)
+        owners[i] = owner(particles.x[i], particles.y[i]);
+
+    std::vector<std::vector<ParticleRecord>> send(rank_count);
+    for (int i = 0; i < n; i++) {
+        if (owners[i] != rank_index) {
+            send[owners[i]].push_back(packParticle(particles, i));
+            particles.markForDeletion(i);
+        }
+    }
+    std::vector<ParticleRecord> recv;
+    exchangeRecords(comm, send, recv);
+
+    particles.compact();
+    const int first = static_cast<int>(particles.size());
+    particles.resize(first + recv.size());
+    for (std::size_t k = 0; k < recv.size(); k++)
+        unpackParticle(recv[k], particles, first + static_cast<int>(k));
+}
+
+std::vector<Bounds> DomainDecomposition::gatherBoxes(const Bounds &box) const {
+    const double mine[4] = {box.xmin, box.ymin, box.width, box.height};
+    std::vector<double> all(4 * rank_count);
+    MPI_Allgather(mine, 4, MPI_DOUBLE, all.data(), 4, MPI_DOUBLE, comm);
+    std::vector<Bounds> boxes(rank_count);
+    for (int r = 0; r < rank_count; r++)
+        boxes[r].set_bounds(all[4 * r], all[4 * r + 1], all[4 * r + 2], all[4 * r + 3]);
+    return boxes;
+}
+
+void DomainDecomposition::exchangeSources(const LinearQuadTree<ParticleSet> &tree,
+                                          const std::vector<Bounds> &boxes, double theta,
+                                          ParticleSet &imported) const {
+    std::vector<std::vector<SourceRecord>> send(rank_count);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int r = 0; r < rank_count; r++) {
+        if (r == rank_index || isEmptyBox(boxes[r]))
+            continue;
+        ParticleSet essential;
+        exportSources(&tree, boxes[r], theta, essential);
+        send[r].resize(essential.size());
+        for (std::size_t k = 0; k < essential.size(); k++) {
+            send[r][k] = {essential.x[k],    essential.y[k],      essential.vx[k], essential.vy[k],
+                          essential.mass[k], essential.radius[k], essential.id[k]};
+        }
+    }
+    std::vector<SourceRecord> recv;
+    exchangeRecords(comm, send, recv);
+
+    const std::size_t first = imported.size();
+    imported.resize(first + recv.size());
+    for (std::size_t k = 0; k < recv.size(); k++) {
+        const std::size_t i = first + k;
+        imported.x[i] = recv[k].x;
+        imported.y[i] = recv[k].y;
+        imported.vx[i] = recv[k].vx;
+        imported.vy[i] = recv[k].vy;
+        imported.mass[i] = recv[k].mass;
+        imported.radius[i] = recv[k].radius;
+        imported.id[i] = recv[k].id;
+    }
+}
+
+void DomainDecomposition::exchangeHalo(const ParticleSet &particles,
+                                       const std::vector<Bounds> &boxes, double margin,
+                                       ParticleSet &halo) const {
+    const int n = static_cast<int>(particles.size());
+    std::vector<std::vector<ParticleRecord>> send(rank_count);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int r = 0; r < rank_count; r++) {
+        if (r == rank_index || isEmptyBox(boxes[r]))
+            continue;
+        Bounds reach;
+        reach.set_bounds(boxes[r].xmin - margin, boxes[r].ymin - margin,
+                         boxes[r].width + 2 * margin, boxes[r].height + 2 * margin);
+        for (int i = 0; i < n; i++) {
+            if (particles.x[i] >= reach.xmin && particles.x[i] <= reach.xmax &&
+                particles.y[i] >= reach.ymin && particles.y[i] <= reach.ymax)
+                send[r].push_back(packParticle(particles, i));
+        }
+    }
+    std::vector<ParticleRecord> recv;
+    exchangeRecords(comm, send, recv);
+
+    const int first = static_cast<int>(halo.size());
+    halo.resize(first + recv.size());
+    for (std::size_t k = 0; k < recv.size(); k++)
+        unpackParticle(recv[k], halo, first + static_cast<int>(k));
+}
+
+double DomainDecomposition::sum(double value) const {
+    double total;
+    MPI_Allreduce(&value, &total, 1, MPI_DOUBLE, MPI_SUM, comm);
+    return total;
+}
+
+double DomainDecomposition::max(double value) const {
+    double largest;
+    MPI_Allreduce(&value, &largest, 1, MPI_DOUBLE, MPI_MAX, comm);
+    return largest;
+}
@@ -0,0 +1,617 @@
+/**
+ * @file fmm.cpp
+ * @brief Cartesian fast multipole method (see fmm.h)
+ *
+ * Expansion coefficients of total order n are stored in blocks of n + 1,
+ * coefficient (a, b) of ∂x^a ∂y^b at index (a + b)(a + b + 1)/2 + b.
+ * Every cell owns three multipole and three local expansions of that
+ * layout, for the mass and the two velocity-weighted masses.
+ */
+
+#include "fmm.h"
+#include "force_kernels.h"
+#include "profiler.h"
+
+/// @brief Coefficients of an expansion of order FMM_MAX_ORDER
+#define FMM_MAX_TERMS ((FMM_MAX_ORDER + 1) * (FMM_MAX_ORDER + 2) / 2)
+
+/// @brief Index of coefficient (a, b) in an expansion
+static inline int termIndex(int a, int b) {
+    const int n = a + b;
+    return n * (n + 1) / 2 + b;
+}
+
+/**
+ * @brief Scaled powers of an offset
+ *
+ * @param dx Offset x
+ * @param dy Offset y
+ * @param p Highest power
+ * @param[out] px dx^a / a! for a <= p
+ * @param[out] py dy^b / b! for b <= p
+ */
+static inline void scaledPowers(double dx, double dy, int p, double *px, double *py) {
+    px[0] = py[0] = 1;
+    for (int k = 1; k <= p; k++) {
+        px[k] = px[k - 1] * dx / k;
+        py[k] = py[k - 1] * dy / k;
+    }
+}
+
+/**
+ * @brief Scaled monomials of an offset
+ *
+ * @param dx Offset x
+ * @param dy Offset y
+ * @param p Highest total order
+ * @param[out] w dx^a dy^b / (a! b!) in expansion layout
+ */
+static inline void shiftMonomials(double dx, double dy, int p, double *w) {
+    double px[FMM_MAX_ORDER + 1], py[FMM_MAX_ORDER + 1];
+    scaledPowers(dx, dy, p, px, py);
+    for (int n = 0, idx = 0; n <= p; n++) {
+        for (int b = 0; b <= n; b++, idx++) {
+            w[idx] = px[n - b] * py[b];
+        }
+    }
+}
+
+/**
+ * @brief Derivatives of 1/r up to order p
+ *
+ * @details Uses the auxiliary functions R^(m)_{a,b} with
+ * R^(m)_{0,0} = (-1)^m (2m-1)!! / r^(2m+1) and
+ * R^(m)_{a+1,b} = x R^(m+1)_{a,b} + a R^(m+1)_{a-1,b} (likewise in y), so
+ * that ∂x^a ∂y^b (1/r) = R^(0)_{a,b}.
+ *
+ * @param x Offset x (nonzero offset)
+ * @param y Offset y
+ * @param p Highest total order
+ * @param[out] D Derivatives in expansion layout
+ */
+static void inverseDistanceDerivatives(double x, double y, int p, double *D) {
+    double R[FMM_MAX_ORDER + 1][FMM_MAX_TERMS];
+    const double inv2 = 1.0 / (x * x + y * y);
+    double base = std::sqrt(inv2);
+    for (int m = 0; m <= p; m++) {
+        R[m][0] = base;
+        base *= -(2 * m + 1) * inv2;
+    }
+    for (int n = 1; n <= p; n++) {
+        for (int m = 0; m <= p - n; m++) {
+            const double *up = R[m + 1];
+            for (int b = 0; b <= n; b++) {
+                const int a = n - b;
+                double value;
+                if (a > 0) {
+                    value = x * up[termIndex(a - 1, b)];
+                    if (a > 1)
+                        value += (a - 1) * up[termIndex(a - 2, b)];
+                } else {
+                    value = y * up[termIndex(0, b - 1)];
+                    if (b > 1)
+                        value += (b - 1) * up[termIndex(0, b - 2)];
+                }
+                R[m][termIndex(a, b)] = value;
+            }
+        }
+    }
+    std::copy(R[0], R[0] + (p + 1) * (p + 2) / 2, D);
+}
+
+/**
+ * @brief Cell with no sources covering a box
+ *
+ * @param bounds Box of the tree node
+ * @param depth Depth of the tree node
+ */
+static FmmCell emptyCell(const Bounds &bounds, int depth) {
+    FmmCell cell{};
+    cell.center = {bounds.xmin + 0.5 * bounds.width, bounds.ymin + 0.5 * bounds.height};
+    cell.first_child = -1;
+    cell.depth = depth;
+    return cell;
+}
+
+void FastMultipole::configure(const SolverConfig &config, std::size_t node_count) {
+    theta = config.fmm_theta;
+    const int order_p = std::clamp(config.fmm_order, 2, FMM_MAX_ORDER);
+    if (order_p != p) {
+        p = order_p;
+        terms = (p + 1) * (p + 2) / 2;
+        m2m_terms.clear();
+        m2l_terms.clear();
+        m2l_ends.clear();
+        l2l_terms.clear();
+        for (int n = 0; n <= p; n++) {
+            for (int b = 0; b <= n; b++) {
+                const int a = n - b;
+                const int out = termIndex(a, b);
+                // M2M: M'_α += M_γ s^(α-γ)/(α-γ)! for γ <= α, s = Z' - Z
+                for (int ga = 0; ga <= a; ga++)
+                    for (int gb = 0; gb <= b; gb++)
+                        m2m_terms.push_back({out, termIndex(ga, gb), termIndex(a - ga, b - gb)});
+                // M2L: L_β += M_α D_(α+β) and L2L: L'_β += L_(β+γ) s^γ/γ!
+                for (int m = 0; m <= p - n; m++) {
+                    for (int gb = 0; gb <= m; gb++) {
+                        const int ga = m - gb;
+                        m2l_terms.push_back({out, termIndex(ga, gb), termIndex(a + ga, b + gb)});
+                        l2l_terms.push_back({out, termIndex(a + ga, b + gb), termIndex(ga, gb)});
+                    }
+                }
+                m2l_ends.push_back(static_cast<int>(m2l_terms.size()));
+            }
+        }
+    }
+    cells.clear();
+    cells.reserve(node_count);
+    order.clear();
+    source_x.clear();
+    source_y.clear();
+    source_vx.clear();
+    source_vy.clear();
+    source_mass.clear();
+    source_radius.clear();
+    source_id.clear();
+}
+
+void FastMultipole::appendLeaf(FmmCell &cell, const ParticleSet &store, const int *slots,
+                               int count, double passive_mass) {
+    cell.first = static_cast<int>(order.size());
+    cell.count = count;
+    order.insert(order.end(), slots, slots + count);
+    cell.source_first = static_cast<int>(source_x.size());
+    for (int k = 0; k < count; k++) {
+        const int slot = slots[k];
+        if (!store.isSource(slot, passive_mass))
+            continue;
+        source_x.push_back(store.x[slot]);
+        source_y.push_back(store.y[slot]);
+        source_vx.push_back(store.vx[slot]);
+        source_vy.push_back(store.vy[slot]);
+        source_mass.push_back(store.mass[slot]);
+        source_radius.push_back(store.radius[slot]);
+        source_id.push_back(store.id[slot]);
+    }
+    cell.source_count = static_cast<int>(source_x.size()) - cell.source_first;
+}
+
+void FastMultipole::build(const QuadTree<ParticleSet> &tree) {
+    NBODY_PROFILE_PHASE(PHASE_MOMENTS);
+    configure(*tree.config, cells.capacity());
+
+    // Breadth first, so the four children of a node are contiguous
+    std::vector<const QuadTree<ParticleSet> *> nodes{&tree};
+    cells.push_back(emptyCell(tree.bounds, tree.depth));
+    for (std::size_t k = 0; k < nodes.size(); k++) {
+        const QuadTree<ParticleSet> *node = nodes[k];
+        if (node->is_divided) {
+            cells[k].first_child = static_cast<int>(cells.size());
+            for (const auto *child : node->children) {
+                nodes.push_back(child);
+                cells.push_back(emptyCell(child->bounds, child->depth));
+            }
+        } else {
+            appendLeaf(cells[k], *node->store, node->particles.data(),
+                       static_cast<int>(node->particles.size()), node->config->passive_mass);
+        }
+    }
+
+    multipoles.resize(3 * terms * cells.size());
+    locals.resize(3 * terms * cells.size());
+    near.resize(cells.size());
+    if (omp_in_parallel()) {
+        upward(0);
+    } else {
+#pragma omp parallel
+#pragma omp single
+        upward(0);
+    }
+}
+
+void FastMultipole::build(const LinearQuadTree<ParticleSet> &tree) {
+    NBODY_PROFILE_PHASE(PHASE_MOMENTS);
+    configure(*tree.config, tree.nodes.size());
+
+    // The node array is already level ordered with contiguous children
+    for (const LinearNode &node : tree.nodes) {
+        cells.push_back(emptyCell(node.bounds, node.depth));
+        if (node.firstChild >= 0)
+            cells.back().first_child = node.firstChild;
+        else
+            appendLeaf(cells.back(), *tree.store, tree.order.data() + node.first, node.count,
+                       tree.config->passive_mass);
+    }
+
+    multipoles.resize(3 * terms * cells.size());
+    locals.resize(3 * terms * cells.size());
+    near.resize(cells.size());
+    if (cells.empty())
+        return;
+    if (omp_in_parallel()) {
+        upward(0);
+    } else {
+#pragma omp parallel
+#pragma omp single
+        upward(0);
+    }
+}
+
+void FastMultipole::upward(int c) {
+    FmmCell &cell = cells[c];
+    double *M = &multipoles[3 * terms * c];
+    std::fill(M, M + 3 * terms, 0.0);
+    double px[FMM_MAX_ORDER + 1], py[FMM_MAX_ORDER + 1];
+
+    if (cell.first_child < 0) {
+        const int begin = cell.source_first, end = begin + cell.source_count;
+        double mass = 0, soft = 0;
+        vector2D com(0, 0);
+        for (int s = begin; s < end; s++) {
+            mass += source_mass[s];
+            com += vector2D(source_x[s], source_y[s]) * source_mass[s];
+            soft = std::max(soft, source_radius[s]);
+        }
+        cell.mass = mass;
+        cell.source_soft = soft;
+        if (mass > 0)
+            cell.center = com / mass;
+
+        double radius2 = 0;
+        for (int s = begin; s < end; s++) {
+            const double dx = cell.center.x - source_x[s];
+            const double dy = cell.center.y - source_y[s];
+            radius2 = std::max(radius2, dx * dx + dy * dy);
+            scaledPowers(dx, dy, p, px, py);
+            const double m = source_mass[s];
+            const double mvx = m * source_vx[s];
+            const double mvy = m * source_vy[s];
+            for (int n = 0, idx = 0; n <= p; n++) {
+                for (int b = 0; b <= n; b++, idx++) {
+                    const double w = px[n - b] * py[b];
+                    M[idx] += m * w;
+                    M[terms + idx] += mvx * w;
+                    M[2 * terms + idx] += mvy * w;
+                }
+            }
+        }
+        cell.source_radius = std::sqrt(radius2);
+        return;
+    }
+
+    double w[FMM_MAX_TERMS];
+    const int first = cell.first_child;
+    if (cell.depth < TREE_TASK_DEPTH) {
+        for (int k = 0; k < 4; k++) {
+#pragma omp task firstprivate(k)
+            upward(first + k);
+        }
+#pragma omp taskwait
+    } else {
+        for (int k = 0; k < 4; k++) {
+            upward(first + k);
+        }
+    }
+
+    double mass = 0, soft = 0;
+    vector2D com(0, 0);
+    for (int k = first; k < first + 4; k++) {
+        mass += cells[k].mass;
+        com += cells[k].center * cells[k].mass;
+        if (cells[k].mass > 0)
+            soft = std::max(soft, cells[k].source_soft);
+    }
+    cell.mass = mass;
+    cell.source_soft = soft;
+    cell.source_radius = 0;
+    if (mass <= 0)
+        return;
+    cell.center = com / mass;
+
+    for (int k = first; k < first + 4; k++) {
+        const FmmCell &child = cells[k];
+        if (child.mass <= 0)
+            continue;
+        const vector2D shift = cell.center - child.center;
+        cell.source_radius = std::max(cell.source_radius, shift.norm() + child.source_radius);
+        shiftMonomials(shift.x, shift.y, p, w);
+        const double *C = &multipoles[3 * terms * k];
+        for (const FmmTerm &term : m2m_terms) {
+            const double f = w[term.aux];
+            M[term.out] += C[term.in] * f;
+            M[terms + term.out] += C[terms + term.in] * f;
+            M[2 * terms + term.out] += C[2 * terms + term.in] * f;
+        }
+    }
+}
+
+bool FastMultipole::evaluate(const ForceTargets &_targets, int n, std::vector<uint8_t> &outside) {
+    {
+        NBODY_PROFILE_PHASE(PHASE_FORCES);
+        targets = &_targets;
+        target_count = n;
+        with_jerk = _targets.jx && _targets.jy;
+        in_tree.assign(n, 0);
+
+        if (!cells.empty()) {
+            if (omp_in_parallel()) {
+                prepareTargets(0);
+                interact(0, 0);
+                downward(0);
+            } else {
+#pragma omp parallel
+#pragma omp single
+                {
+                    prepareTargets(0);
+                    interact(0, 0);
+                    downward(0);
+                }
+            }
+            NBODY_PROFILE_COUNT(COUNTER_TARGETS, cells[0].targets);
+        }
+        targets = nullptr;
+    }
+
+    outside.clear();
+    for (int i = 0; i < n; i++) {
+        if (in_tree[i] || (_targets.active && !_targets.active[i]))
+            continue;
+        if (outside.empty())
+            outside.assign(n, 0);
+        outside[i] = 1;
+    }
+    return !outside.empty();
+}
+
+void FastMultipole::prepareTargets(int c) {
+    FmmCell &cell = cells[c];
+    std::fill_n(&locals[3 * terms * c], with_jerk ? 3 * terms : terms, 0.0);
+    cell.targets = 0;
+    cell.target_radius = 0;
+    cell.target_soft = 0;
+
+    if (cell.first_child < 0) {
+        near[c].clear();
+        const ForceTargets &t = *targets;
+        double radius2 = 0;
+        for (int k = cell.first; k < cell.first + cell.count; k++) {
+            const int i = order[k];
+            if (i >= target_count || (t.active && !t.active[i]))
+                continue;
+            in_tree[i] = 1;
+            const double dx = t.x[i] - cell.center.x;
+            const double dy = t.y[i] - cell.center.y;
+            radius2 = std::max(radius2, dx * dx + dy * dy);
+            cell.target_soft = std::max(cell.target_soft, t.radius[i]);
+            cell.targets++;
+        }
+        cell.target_radius = std::sqrt(radius2);
+        return;
+    }
+
+    const int first = cell.first_child;
+    if (cell.depth < TREE_TASK_DEPTH) {
+        for (int k = 0; k < 4; k++) {
+#pragma omp task firstprivate(k)
+            prepareTargets(first + k);
+        }
+#pragma omp taskwait
+    } else {
+        for (int k = 0; k < 4; k++) {
+            prepareTargets(first + k);
+        }
+    }
+
+    for (int k = first; k < first + 4; k++) {
+        const FmmCell &child = cells[k];
+        if (!child.targets)
+            continue;
+        cell.targets += child.targets;
+        cell.target_radius = std::max(cell.target_radius,
+                                      (child.center - cell.center).norm() + child.target_radius);
+        cell.target_soft = std::max(cell.target_soft, child.target_soft);
+    }
+}
+
+void FastMultipole::interact(int a, int b) {
+    const FmmCell &A = cells[a];
+    const FmmCell &B = cells[b];
+    if (!A.targets || B.mass <= 0)
+        return;
+
+    // Well separated, and no target-source pair close enough to be softened
+    const double d = (A.center - B.center).norm();
+    const double reach = A.target_radius + B.source_radius;
+    if (reach < theta * d && reach + A.target_soft + B.source_soft <= d) {
+        multipoleToLocal(a, b);
+        return;
+    }
+
+    const bool a_leaf = A.first_child < 0;
+    const bool b_leaf = B.first_child < 0;
+    if (a_leaf && b_leaf) {
+        near[a].push_back(b);
+    } else if (!a_leaf && (b_leaf || A.target_radius >= B.source_radius)) {
+        // Tasks only split the target cell, so each writes its own subtree
+        const int first = A.first_child;
+        if (A.depth < TREE_TASK_DEPTH) {
+            for (int k = 0; k < 4; k++) {
+#pragma omp task firstprivate(k)
+                interact(first + k, b);
+            }
+#pragma omp taskwait
+        } else {
+            for (int k = 0; k < 4; k++) {
+                interact(first + k, b);
+            }
+        }
+    } else {
+        for (int k = 0; k < 4; k++) {
+            interact(a, B.first_child + k);
+        }
+    }
+}
+
+void FastMultipole::multipoleToLocal(int a, int b) {
+    double D[FMM_MAX_TERMS];
+    const vector2D r = cells[a].center - cells[b].center;
+    inverseDistanceDerivatives(r.x, r.y, p, D);
+
+    const double *M = &multipoles[3 * terms * b];
+    double *L = &locals[3 * terms * a];
+    // Terms are grouped by output coefficient, summed in registers
+    const FmmTerm *term = m2l_terms.data();
+    for (int out = 0; out < terms; out++) {
+        const FmmTerm *end = m2l_terms.data() + m2l_ends[out];
+        double sum = 0, sum_vx = 0, sum_vy = 0;
+        if (with_jerk) {
+            for (; term < end; term++) {
+                const double g = D[term->aux];
+                sum += M[term->in] * g;
+                sum_vx += M[terms + term->in] * g;
+                sum_vy += M[2 * terms + term->in] * g;
+            }
+            L[terms + out] += sum_vx;
+            L[2 * terms + out] += sum_vy;
+        } else {
+            for (; term < end; term++) {
+                sum += M[term->in] * D[term->aux];
+            }
+        }
+        L[out] += sum;
+    }
+}
+
+void FastMultipole::downward(int c) {
+    const FmmCell &cell = cells[c];
+    if (!cell.targets)
+        return;
+    if (cell.first_child < 0) {
+        localToParticles(c);
+        return;
+    }
+
+    // L2L: shift the parent's locals to every child holding targets
+    const int expansions = with_jerk ? 3 : 1;
+    const double *L = &locals[3 * terms * c];
+    double w[FMM_MAX_TERMS];
+    const int first = cell.first_child;
+    for (int k = first; k < first + 4; k++) {
+        if (!cells[k].targets)
+            continue;
+        const vector2D shift = cells[k].center - cell.center;
+        shiftMonomials(shift.x, shift.y, p, w);
+        double *C = &locals[3 * terms * k];
+        for (int e = 0; e < expansions; e++) {
+            const double *Le = L + e * terms;
+            double *Ce = C + e * terms;
+            for (const FmmTerm &term : l2l_terms) {
+                Ce[term.out] += Le[term.in] * w[term.aux];
+            }
+        }
+    }
+
+    if (cell.depth < TREE_TASK_DEPTH) {
+        for (int k = 0; k < 4; k++) {
+#pragma omp task firstprivate(k)
+            downward(first + k);
+        }
+#pragma omp taskwait
+    } else {
+        for (int k = 0; k < 4; k++) {
+            downward(first + k);
+        }
+    }
+}
+
+void FastMultipole::localToParticles(int c) {
+    const FmmCell &cell = cells[c];
+    const double *L = &locals[3 * terms * c];
+    const double *Lvx = L + terms;
+    const double *Lvy = L + 2 * terms;
+    const ForceTargets &t = *targets;
+    double px[FMM_MAX_ORDER + 1], py[FMM_MAX_ORDER + 1];
+
+    // Sources of the near leaves, gathered into one block
+    static thread_local std::vector<double> nx, ny, nvx, nvy, nm, nr;
+    static thread_local std::vector<int> nid;
+    nx.clear();
+    ny.clear();
+    nvx.clear();
+    nvy.clear();
+    nm.clear();
+    nr.clear();
+    nid.clear();
+    for (int b : near[c]) {
+        const int begin = cells[b].source_first, end = begin + cells[b].source_count;
+        nx.insert(nx.end(), source_x.begin() + begin, source_x.begin() + end);
+        ny.insert(ny.end(), source_y.begin() + begin, source_y.begin() + end);
+        nvx.insert(nvx.end(), source_vx.begin() + begin, source_vx.begin() + end);
+        nvy.insert(nvy.end(), source_vy.begin() + begin, source_vy.begin() + end);
+        nm.insert(nm.end(), source_mass.begin() + begin, source_mass.begin() + end);
+        nr.insert(nr.end(), source_radius.begin() + begin, source_radius.begin() + end);
+        nid.insert(nid.end(), source_id.begin() + begin, source_id.begin() + end);
+    }
+    const SourceBlock sources{nx.data(),  ny.data(), nvx.data(),
+                              nvy.data(), nm.data(), nr.data(),
+                              nid.data(), static_cast<int>(nx.size())};
+    const ForceKernels &kernels = forceKernels();
+
+    for (int k = cell.first; k < cell.first + cell.count; k++) {
+        const int i = order[k];
+        if (i >= target_count || (t.active && !t.active[i]))
+            continue;
+
+        ForceSum sum;
+        if (sources.count) {
+            const KernelTarget target{t.x[i], t.y[i], t.vx[i], t.vy[i], t.radius[i], t.id[i]};
+            kernels.particles(target, sources, with_jerk, t.pot != nullptr, sum);
+        }
+        scaledPowers(t.x[i] - cell.center.x, t.y[i] - cell.center.y, p, px, py);
+
+        // Gradient of the local expansion (orders up to p - 1 of the offset)
+        double gx = 0, gy = 0;
+        for (int n = 0; n < p; n++) {
+            for (int b = 0; b <= n; b++) {
+                const int a = n - b;
+                const double w = px[a] * py[b];
+                gx += L[termIndex(a + 1, b)] * w;
+                gy += L[termIndex(a, b + 1)] * w;
+            }
+        }
+        t.ax[i] = sum.ax + GRAV_G * gx;
+        t.ay[i] = sum.ay + GRAV_G * gy;
+        if (t.pot) {
+            // The local expansion itself, to order p
+            double phi = 0;
+            for (int n = 0; n <= p; n++) {
+                for (int b = 0; b <= n; b++)
+                    phi += L[termIndex(n - b, b)] * px[n - b] * py[b];
+            }
+            t.pot[i] = sum.pot - GRAV_G * phi;
+        }
+        if (!with_jerk)
+            continue;
+
+        // Second derivatives of the mass and velocity-weighted locals
+        double hxx = 0, hxy = 0, hyy = 0, vxx = 0, vxy = 0, vyx = 0, vyy = 0;
+        for (int n = 0; n < p - 1; n++) {
+            for (int b = 0; b <= n; b++) {
+                const int a = n - b;
+                const double w = px[a] * py[b];
+                const int ixx = termIndex(a + 2, b);
+                const int ixy = termIndex(a + 1, b + 1);
+                const int iyy = termIndex(a, b + 2);
+                hxx += L[ixx] * w;
+                hxy += L[ixy] * w;
+                hyy += L[iyy] * w;
+                vxx += Lvx[ixx] * w;
+                vxy += Lvx[ixy] * w;
+                vyx += Lvy[ixy] * w;
+                vyy += Lvy[iyy] * w;
+            }
+        }
+        t.jx[i] = sum.jx + GRAV_G * (t.vx[i] * hxx + t.vy[i] * hxy - vxx - vyx);
+        t.jy[i] = sum.jy + GRAV_G * (t.vx[i] * hxy + t.vy[i] * hyy - vxy - vyy);
+    }
+}
@@ -0,0 +1,1211 @@
+/**
+ * @file force_kernels.cpp
+ * @brief Scalar and SIMD implementations of the batched gravity kernels
+ *
+ * The x86 kernels are compiled with per-function target attributes, so the
+ * rest of the library needs no -mavx flags and runs on any x86-64 CPU.
+ */
+
+#include "force_kernels.h"
+#include <cstring>
+#include <type_traits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NBODY_KERNELS_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define NBODY_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * @brief Call a generic kernel with the jerk and potential flags as constants
+ *
+ * @param with_jerk Also accumulate the jerk
+ * @param with_potential Also accumulate the potential
+ * @param kernel Callable taking two std::bool_constant arguments, jerk and potential
+ */
+template <class Kernel>
+static inline void withTerms(bool with_jerk, bool with_potential, Kernel &&kernel) {
+    if (with_jerk) {
+        if (with_potential)
+            kernel(std::true_type(), std::true_type());
+        else
+            kernel(std::true_type(), std::false_type());
+    } else {
+        if (with_potential)
+            kernel(std::false_type(), std::true_type());
+        else
+            kernel(std::false_type(), std::false_type());
+    }
+}
+
+//
+// Scalar reference kernels
+//
+
+template <bool WithJerk, bool WithQuad, bool WithPotential, class Real>
+static void cellsScalarImpl(const KernelTarget &t, const CellBlockOf<Real> &c, ForceSum &sum) {
+    const Real x = static_cast<Real>(t.x), y = static_cast<Real>(t.y);
+    const Real vx = static_cast<Real>(t.vx), vy = static_cast<Real>(t.vy);
+    const Real min_d2 = static_cast<Real>(4 * t.radius * t.radius);
+    Real ax = 0, ay = 0, jx = 0, jy = 0, pot = 0;
+#pragma omp simd reduction(+ : ax, ay, jx, jy, pot)
+    for (int k = 0; k < c.count; k++) {
+        // Per-cell terms in locals: the reduction variables must not escape by reference
+        Real cax = 0, cay = 0, cjx = 0, cjy = 0;
+        cellInteraction<WithJerk, WithQuad, Real>(
+            x - c.x[k], y - c.y[k], vx - c.vx[k], vy - c.vy[k], min_d2, c.mass[k],
+            WithQuad ? c.qxx[k] : Real(0), WithQuad ? c.qxy[k] : Real(0),
+            WithQuad ? c.qyy[k] : Real(0), cax, cay, cjx, cjy);
+        ax += cax;
+        ay += cay;
+        jx += cjx;
+        jy += cjy;
+        if constexpr (WithPotential) {
+            pot += cellPotential<WithQuad, Real>(
+                x - c.x[k], y - c.y[k], min_d2, c.mass[k], WithQuad ? c.qxx[k] : Real(0),
+                WithQuad ? c.qxy[k] : Real(0), WithQuad ? c.qyy[k] : Real(0));
+        }
+    }
+    sum.ax += ax;
+    sum.ay += ay;
+    sum.jx += jx;
+    sum.jy += jy;
+    if constexpr (WithPotential)
+        sum.pot += pot;
+}
+
+template <bool WithJerk, bool WithPotential>
+static void particlesScalarImpl(const KernelTarget &t, const SourceBlock &s, ForceSum &sum) {
+    double ax = 0, ay = 0, jx = 0, jy = 0, pot = 0;
+#pragma omp simd reduction(+ : ax, ay, jx, jy, pot)
+    for (int k = 0; k < s.count; k++) {
+        double dx = t.x - s.x[k];
+        double dy = t.y - s.y[k];
+        double r_soft = std::max(std::sqrt(dx * dx + dy * dy), t.radius + s.radius[k]);
+        double r_soft2 = r_soft * r_soft;
+        double mag = s.id[k] == t.id ? 0.0 : -GRAV_G * s.mass[k] / (r_soft2 * r_soft);
+        ax += dx * mag;
+        ay += dy * mag;
+        if constexpr (WithPotential)
+            pot += mag * r_soft2;
+        if constexpr (WithJerk) {
+            double dvx = t.vx - s.vx[k];
+            double dvy = t.vy - s.vy[k];
+            double f = 3.0 * mag * (dx * dvx + dy * dvy) / r_soft2;
+            jx += dvx * mag - dx * f;
+            jy += dvy * mag - dy * f;
+        }
+    }
+    sum.ax += ax;
+    sum.ay += ay;
+    sum.jx += jx;
+    sum.jy += jy;
+    if constexpr (WithPotential)
+        sum.pot += pot;
+}
+
+static void cellsScalar(const KernelTarget &t, const CellBlock &c, bool with_jerk,
+                        bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        cellsScalarImpl<jerk, false, potential>(t, c, sum);
+    });
+}
+
+static void quadrupolesScalar(const KernelTarget &t, const CellBlock &c, bool with_jerk,
+                              bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        cellsScalarImpl<jerk, true, potential>(t, c, sum);
+    });
+}
+
+static void particlesScalar(const KernelTarget &t, const SourceBlock &s, bool with_jerk,
+                            bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        particlesScalarImpl<jerk, potential>(t, s, sum);
+    });
+}
+
+static void cellsMixedScalar(const KernelTarget &t, const CellBlockF &c, bool with_jerk,
+                             bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        cellsScalarImpl<jerk, false, potential>(t, c, sum);
+    });
+}
+
+static void quadrupolesMixedScalar(const KernelTarget &t, const CellBlockF &c, bool with_jerk,
+                                   bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        cellsScalarImpl<jerk, true, potential>(t, c, sum);
+    });
+}
+
+static const ForceKernels scalar_kernels = {"scalar",         cellsScalar,
+                                            quadrupolesScalar, particlesScalar,
+                                            cellsMixedScalar, quadrupolesMixedScalar};
+
+#ifdef NBODY_KERNELS_X86
+
+//
+// AVX2 + FMA: 4 lanes. There is no double-precision rsqrt before AVX-512,
+// so the seed is the 12-bit single-precision estimate and three Newton
+// steps bring it to full double precision.
+//
+
+#define NBODY_AVX2 __attribute__((target("avx2,fma")))
+
+/// @brief 1/sqrt(x) to double precision
+NBODY_AVX2 static inline __m256d rsqrtAvx2(__m256d x) {
+    const __m256d half_x = _mm256_mul_pd(x, _mm256_set1_pd(0.5));
+    const __m256d three_halves = _mm256_set1_pd(1.5);
+    __m256d y = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(x)));
+    for (int i = 0; i < 3; i++) {
+        __m256d yy = _mm256_mul_pd(y, y);
+        y = _mm256_mul_pd(y, _mm256_fnmadd_pd(half_x, yy, three_halves));
+    }
+    return y;
+}
+
+/// @brief Sum of the four lanes
+NBODY_AVX2 static inline double hsumAvx2(__m256d v) {
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+/// @brief Lane mask for the first n of 4 lanes (n in [0, 4])
+NBODY_AVX2 static inline __m256i tailMaskAvx2(int n) {
+    return _mm256_cmpgt_epi64(_mm256_set1_epi64x(n), _mm256_setr_epi64x(0, 1, 2, 3));
+}
+
+template <bool WithJerk, bool WithPotential>
+NBODY_AVX2 static void cellsAvx2Impl(const KernelTarget &t, const CellBlock &c, ForceSum &sum) {
+    const __m256d xi = _mm256_set1_pd(t.x), yi = _mm256_set1_pd(t.y);
+    const __m256d vxi = _mm256_set1_pd(t.vx), vyi = _mm256_set1_pd(t.vy);
+    const __m256d min_d2 = _mm256_set1_pd(4 * t.radius * t.radius);
+    const __m256d neg_g = _mm256_set1_pd(-GRAV_G), three = _mm256_set1_pd(3.0);
+    __m256d ax = _mm256_setzero_pd(), ay = _mm256_setzero_pd();
+    __m256d jx = _mm256_setzero_pd(), jy = _mm256_setzero_pd();
+    __m256d pot = _mm256_setzero_pd();
+
+    for (int k = 0; k < c.count; k += 4) {
+        const __m256i mask = tailMaskAvx2(std::min(c.count - k, 4));
+        __m256d dx = _mm256_sub_pd(xi, _mm256_maskload_pd(c.x + k, mask));
+        __m256d dy = _mm256_sub_pd(yi, _mm256_maskload_pd(c.y + k, mask));
+        __m256d m = _mm256_maskload_pd(c.mass + k, mask);
+
+        __m256d r2 = _mm256_max_pd(_mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy)), min_d2);
+        __m256d inv = rsqrtAvx2(r2);
+        __m256d inv2 = _mm256_mul_pd(inv, inv);
+        __m256d acc_mag = _mm256_mul_pd(_mm256_mul_pd(neg_g, m), _mm256_mul_pd(inv2, inv));
+        acc_mag = _mm256_and_pd(acc_mag, _mm256_castsi256_pd(mask));
+
+        ax = _mm256_fmadd_pd(dx, acc_mag, ax);
+        ay = _mm256_fmadd_pd(dy, acc_mag, ay);
+        if constexpr (WithPotential) {
+            pot = _mm256_fmadd_pd(acc_mag, r2, pot);
+        }
+        if constexpr (WithJerk) {
+            __m256d dvx = _mm256_sub_pd(vxi, _mm256_maskload_pd(c.vx + k, mask));
+            __m256d dvy = _mm256_sub_pd(vyi, _mm256_maskload_pd(c.vy + k, mask));
+            __m256d rv = _mm256_fmadd_pd(dx, dvx, _mm256_mul_pd(dy, dvy));
+            __m256d f = _mm256_mul_pd(_mm256_mul_pd(three, acc_mag), _mm256_mul_pd(rv, inv2));
+            jx = _mm256_add_pd(jx, _mm256_fnmadd_pd(dx, f, _mm256_mul_pd(dvx, acc_mag)));
+            jy = _mm256_add_pd(jy, _mm256_fnmadd_pd(dy, f, _mm256_mul_pd(dvy, acc_mag)));
+        }
+    }
+    sum.ax += hsumAvx2(ax);
+    sum.ay += hsumAvx2(ay);
+    sum.jx += hsumAvx2(jx);
+    sum.jy += hsumAvx2(jy);
+    if constexpr (WithPotential)
+        sum.pot += hsumAvx2(pot);
+}
+
+template <bool WithJerk, bool WithPotential>
+NBODY_AVX2 static void particlesAvx2Impl(const KernelTarget &t, const SourceBlock &s,
+                                         ForceSum &sum) {
+    const __m256d xi = _mm256_set1_pd(t.x), yi = _mm256_set1_pd(t.y);
+    const __m256d vxi = _mm256_set1_pd(t.vx), vyi = _mm256_set1_pd(t.vy);
+    const __m256d ri = _mm256_set1_pd(t.radius);
+    const __m256i idi = _mm256_set1_epi64x(t.id);
+    const __m256d neg_g = _mm256_set1_pd(-GRAV_G), three = _mm256_set1_pd(3.0);
+    __m256d ax = _mm256_setzero_pd(), ay = _mm256_setzero_pd();
+    __m256d jx = _mm256_setzero_pd(), jy = _mm256_setzero_pd();
+    __m256d pot = _mm256_setzero_pd();
+
+    for (int k = 0; k < s.count; k += 4) {
+        const int lanes = std::min(s.count - k, 4);
+        const __m256i mask = tailMaskAvx2(lanes);
+        __m256d dx = _mm256_sub_pd(xi, _mm256_maskload_pd(s.x + k, mask));
+        __m256d dy = _mm256_sub_pd(yi, _mm256_maskload_pd(s.y + k, mask));
+        __m256d m = _mm256_maskload_pd(s.mass + k, mask);
+        __m256d rsum = _mm256_add_pd(ri, _mm256_maskload_pd(s.radius + k, mask));
+
+        // Self-interaction mask: compare IDs widened to 64-bit lanes
+        __m128i id_mask = _mm_cmpgt_epi32(_mm_set1_epi32(lanes), _mm_setr_epi32(0, 1, 2, 3));
+        __m128i id32 = _mm_maskload_epi32(s.id + k, id_mask);
+        __m256i same = _mm256_cmpeq_epi64(_mm256_cvtepi32_epi64(id32), idi);
+        __m256i keep = _mm256_andnot_si256(same, mask);
+
+        // r_soft² = max(r², (r_i + r_j)²) avoids the square root
+        __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy));
+        r2 = _mm256_max_pd(r2, _mm256_mul_pd(rsum, rsum));
+        __m256d inv = rsqrtAvx2(r2);
+        __m256d inv2 = _mm256_mul_pd(inv, inv);
+        __m256d mag = _mm256_mul_pd(_mm256_mul_pd(neg_g, m), _mm256_mul_pd(inv2, inv));
+        mag = _mm256_and_pd(mag, _mm256_castsi256_pd(keep));
+
+        ax = _mm256_fmadd_pd(dx, mag, ax);
+        ay = _mm256_fmadd_pd(dy, mag, ay);
+        if constexpr (WithPotential) {
+            pot = _mm256_fmadd_pd(mag, r2, pot);
+        }
+        if constexpr (WithJerk) {
+            __m256d dvx = _mm256_sub_pd(vxi, _mm256_maskload_pd(s.vx + k, mask));
+            __m256d dvy = _mm256_sub_pd(vyi, _mm256_maskload_pd(s.vy + k, mask));
+            __m256d rv = _mm256_fmadd_pd(dx, dvx, _mm256_mul_pd(dy, dvy));
+            __m256d f = _mm256_mul_pd(_mm256_mul_pd(three, mag), _mm256_mul_pd(rv, inv2));
+            jx = _mm256_add_pd(jx, _mm256_fnmadd_pd(dx, f, _mm256_mul_pd(dvx, mag)));
+            jy = _mm256_add_pd(jy, _mm256_fnmadd_pd(dy, f, _mm256_mul_pd(dvy, mag)));
+        }
+    }
+    sum.ax += hsumAvx2(ax);
+    sum.ay += hsumAvx2(ay);
+    sum.jx += hsumAvx2(jx);
+    sum.jy += hsumAvx2(jy);
+    if constexpr (WithPotential)
+        sum.pot += hsumAvx2(pot);
+}
+
+template <bool WithJerk, bool WithPotential>
+NBODY_AVX2 static void quadrupolesAvx2Impl(const KernelTarget &t, const CellBlock &c,
+                                           ForceSum &sum) {
+    const __m256d xi = _mm256_set1_pd(t.x), yi = _mm256_set1_pd(t.y);
+    const __m256d vxi = _mm256_set1_pd(t.vx), vyi = _mm256_set1_pd(t.vy);
+    const __m256d min_d2 = _mm256_set1_pd(4 * t.radius * t.radius);
+    const __m256d g = _mm256_set1_pd(GRAV_G), neg_g = _mm256_set1_pd(-GRAV_G);
+    const __m256d three = _mm256_set1_pd(3.0), five = _mm256_set1_pd(5.0);
+    const __m256d five_halves = _mm256_set1_pd(2.5), c35_2 = _mm256_set1_pd(17.5);
+    __m256d ax = _mm256_setzero_pd(), ay = _mm256_setzero_pd();
+    __m256d jx = _mm256_setzero_pd(), jy = _mm256_setzero_pd();
+    __m256d pot = _mm256_setzero_pd();
+
+    for (int k = 0; k < c.count; k += 4) {
+        const __m256i mask = tailMaskAvx2(std::min(c.count - k, 4));
+        __m256d dx = _mm256_sub_pd(xi, _mm256_maskload_pd(c.x + k, mask));
+        __m256d dy = _mm256_sub_pd(yi, _mm256_maskload_pd(c.y + k, mask));
+        __m256d m = _mm256_maskload_pd(c.mass + k, mask);
+        // Lanes past the end load a zero quadrupole, so only the monopole needs masking
+        __m256d qxx = _mm256_maskload_pd(c.qxx + k, mask);
+        __m256d qxy = _mm256_maskload_pd(c.qxy + k, mask);
+        __m256d qyy = _mm256_maskload_pd(c.qyy + k, mask);
+
+        __m256d r2 = _mm256_max_pd(_mm256_fmadd_pd(dx, dx, _mm256_mul_pd(dy, dy)), min_d2);
+        __m256d inv = rsqrtAvx2(r2);
+        __m256d inv2 = _mm256_mul_pd(inv, inv);
+        __m256d inv3 = _mm256_mul_pd(inv2, inv);
+        __m256d mono = _mm256_mul_pd(_mm256_mul_pd(neg_g, m), inv3);
+        mono = _mm256_and_pd(mono, _mm256_castsi256_pd(mask));
+
+        // Qr, rᵀQr and the G/d⁵, G/d⁷ factors
+        __m256d qrx = _mm256_fmadd_pd(qxx, dx, _mm256_mul_pd(qxy, dy));
+        __m256d qry = _mm256_fmadd_pd(qxy, dx, _mm256_mul_pd(qyy, dy));
+        __m256d s = _mm256_fmadd_pd(dx, qrx, _mm256_mul_pd(dy, qry));
+        __m256d g5 = _mm256_mul_pd(_mm256_mul_pd(g, inv3), inv2);
+        __m256d g7 = _mm256_mul_pd(g5, inv2);
+
+        // a = (mono - 5/2 g7 s) r + g5 Qr
+        __m256d radial = _mm256_fnmadd_pd(_mm256_mul_pd(five_halves, g7), s, mono);
+        ax = _mm256_fmadd_pd(dx, radial, _mm256_fmadd_pd(g5, qrx, ax));
+        ay = _mm256_fmadd_pd(dy, radial, _mm256_fmadd_pd(g5, qry, ay));
+        if constexpr (WithPotential) {
+            pot = _mm256_fmadd_pd(mono, r2, pot);
+            pot = _mm256_fnmadd_pd(_mm256_mul_pd(_mm256_set1_pd(0.5), g5), s, pot);
+        }
+        if constexpr (WithJerk) {
+            __m256d dvx = _mm256_sub_pd(vxi, _mm256_maskload_pd(c.vx + k, mask));
+            __m256d dvy = _mm256_sub_pd(vyi, _mm256_maskload_pd(c.vy + k, mask));
+            __m256d rv = _mm256_fmadd_pd(dx, dvx, _mm256_mul_pd(dy, dvy));
+            __m256d qvx = _mm256_fmadd_pd(qxx, dvx, _mm256_mul_pd(qxy, dvy));
+            __m256d qvy = _mm256_fmadd_pd(qxy, dvx, _mm256_mul_pd(qyy, dvy));
+            __m256d vq = _mm256_fmadd_pd(dvx, qrx, _mm256_mul_pd(dvy, qry));
+
+            // j = radial v + g5 Qv + jr r - 5 g7 (r·v) Qr, with
+            // jr = g7 (35/2 s (r·v)/d² - 5 v·Qr) - 3 mono (r·v)/d²
+            __m256d rv_inv2 = _mm256_mul_pd(rv, inv2);
+            __m256d jr = _mm256_mul_pd(
+                g7, _mm256_fmsub_pd(_mm256_mul_pd(c35_2, s), rv_inv2, _mm256_mul_pd(five, vq)));
+            jr = _mm256_fnmadd_pd(_mm256_mul_pd(three, mono), rv_inv2, jr);
+            __m256d qr_coef = _mm256_mul_pd(_mm256_mul_pd(five, g7), rv);
+            jx = _mm256_add_pd(jx, _mm256_fnmadd_pd(qr_coef, qrx,
+                               _mm256_fmadd_pd(dx, jr, _mm256_fmadd_pd(g5, qvx,
+                                                                       _mm256_mul_pd(dvx, radial)))));
+            jy = _mm256_add_pd(jy, _mm256_fnmadd_pd(qr_coef, qry,
+                               _mm256_fmadd_pd(dy, jr, _mm256_fmadd_pd(g5, qvy,
+                                                                       _mm256_mul_pd(dvy, radial)))));
+        }
+    }
+    sum.ax += hsumAvx2(ax);
+    sum.ay += hsumAvx2(ay);
+    sum.jx += hsumAvx2(jx);
+    sum.jy += hsumAvx2(jy);
+    if constexpr (WithPotential)
+        sum.pot += hsumAvx2(pot);
+}
+
+NBODY_AVX2 static void cellsAvx2(const KernelTarget &t, const CellBlock &c, bool with_jerk,
+                                 bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        cellsAvx2Impl<jerk, potential>(t, c, sum);
+    });
+}
+
+NBODY_AVX2 static void quadrupolesAvx2(const KernelTarget &t, const CellBlock &c, bool with_jerk,
+                                       bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        quadrupolesAvx2Impl<jerk, potential>(t, c, sum);
+    });
+}
+
+NBODY_AVX2 static void particlesAvx2(const KernelTarget &t, const SourceBlock &s, bool with_jerk,
+                                     bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        particlesAvx2Impl<jerk, potential>(t, s, sum);
+    });
+}
+
+//
+// AVX2 + FMA in single precision (mixed-precision far field): 8 lanes.
+// The 12-bit rsqrt estimate needs one Newton step.
+//
+
+/// @brief 1/sqrt(x) to single precision
+NBODY_AVX2 static inline __m256 rsqrtAvx2F(__m256 x) {
+    const __m256 y = _mm256_rsqrt_ps(x);
+    const __m256 yy = _mm256_mul_ps(y, y);
+    return _mm256_mul_ps(y, _mm256_fnmadd_ps(_mm256_mul_ps(x, _mm256_set1_ps(0.5f)), yy,
+                                             _mm256_set1_ps(1.5f)));
+}
+
+/// @brief Sum of the eight lanes, in double
+NBODY_AVX2 static inline double hsumAvx2F(__m256 v) {
+    return hsumAvx2(_mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)),
+                                  _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1))));
+}
+
+/// @brief Lane mask for the first n of 8 lanes (n in [0, 8])
+NBODY_AVX2 static inline __m256i tailMaskAvx2F(int n) {
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+template <bool WithJerk, bool WithPotential>
+NBODY_AVX2 static void cellsMixedAvx2Impl(const KernelTarget &t, const CellBlockF &c,
+                                          ForceSum &sum) {
+    const __m256 xi = _mm256_set1_ps(static_cast<float>(t.x));
+    const __m256 yi = _mm256_set1_ps(static_cast<float>(t.y));
+    const __m256 vxi = _mm256_set1_ps(static_cast<float>(t.vx));
+    const __m256 vyi = _mm256_set1_ps(static_cast<float>(t.vy));
+    const __m256 min_d2 = _mm256_set1_ps(static_cast<float>(4 * t.radius * t.radius));
+    const __m256 neg_g = _mm256_set1_ps(static_cast<float>(-GRAV_G));
+    const __m256 three = _mm256_set1_ps(3.0f);
+    __m256 ax = _mm256_setzero_ps(), ay = _mm256_setzero_ps();
+    __m256 jx = _mm256_setzero_ps(), jy = _mm256_setzero_ps();
+    __m256 pot = _mm256_setzero_ps();
+
+    for (int k = 0; k < c.count; k += 8) {
+        const __m256i mask = tailMaskAvx2F(std::min(c.count - k, 8));
+        __m256 dx = _mm256_sub_ps(xi, _mm256_maskload_ps(c.x + k, mask));
+        __m256 dy = _mm256_sub_ps(yi, _mm256_maskload_ps(c.y + k, mask));
+        __m256 m = _mm256_maskload_ps(c.mass + k, mask);
+
+        __m256 r2 = _mm256_max_ps(_mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy)), min_d2);
+        __m256 inv = rsqrtAvx2F(r2);
+        __m256 inv2 = _mm256_mul_ps(inv, inv);
+        __m256 acc_mag = _mm256_mul_ps(_mm256_mul_ps(neg_g, m), _mm256_mul_ps(inv2, inv));
+        acc_mag = _mm256_and_ps(acc_mag, _mm256_castsi256_ps(mask));
+
+        ax = _mm256_fmadd_ps(dx, acc_mag, ax);
+        ay = _mm256_fmadd_ps(dy, acc_mag, ay);
+        if constexpr (WithPotential) {
+            pot = _mm256_fmadd_ps(acc_mag, r2, pot);
+        }
+        if constexpr (WithJerk) {
+            __m256 dvx = _mm256_sub_ps(vxi, _mm256_maskload_ps(c.vx + k, mask));
+            __m256 dvy = _mm256_sub_ps(vyi, _mm256_maskload_ps(c.vy + k, mask));
+            __m256 rv = _mm256_fmadd_ps(dx, dvx, _mm256_mul_ps(dy, dvy));
+            __m256 f = _mm256_mul_ps(_mm256_mul_ps(three, acc_mag), _mm256_mul_ps(rv, inv2));
+            jx = _mm256_add_ps(jx, _mm256_fnmadd_ps(dx, f, _mm256_mul_ps(dvx, acc_mag)));
+            jy = _mm256_add_ps(jy, _mm256_fnmadd_ps(dy, f, _mm256_mul_ps(dvy, acc_mag)));
+        }
+    }
+    sum.ax += hsumAvx2F(ax);
+    sum.ay += hsumAvx2F(ay);
+    sum.jx += hsumAvx2F(jx);
+    sum.jy += hsumAvx2F(jy);
+    if constexpr (WithPotential)
+        sum.pot += hsumAvx2F(pot);
+}
+
+template <bool WithJerk, bool WithPotential>
+NBODY_AVX2 static void quadrupolesMixedAvx2Impl(const KernelTarget &t, const CellBlockF &c,
+                                                ForceSum &sum) {
+    const __m256 xi = _mm256_set1_ps(static_cast<float>(t.x));
+    const __m256 yi = _mm256_set1_ps(static_cast<float>(t.y));
+    const __m256 vxi = _mm256_set1_ps(static_cast<float>(t.vx));
+    const __m256 vyi = _mm256_set1_ps(static_cast<float>(t.vy));
+    const __m256 min_d2 = _mm256_set1_ps(static_cast<float>(4 * t.radius * t.radius));
+    const __m256 g = _mm256_set1_ps(static_cast<float>(GRAV_G));
+    const __m256 neg_g = _mm256_set1_ps(static_cast<float>(-GRAV_G));
+    const __m256 three = _mm256_set1_ps(3.0f), five = _mm256_set1_ps(5.0f);
+    const __m256 five_halves = _mm256_set1_ps(2.5f), c35_2 = _mm256_set1_ps(17.5f);
+    __m256 ax = _mm256_setzero_ps(), ay = _mm256_setzero_ps();
+    __m256 jx = _mm256_setzero_ps(), jy = _mm256_setzero_ps();
+    __m256 pot = _mm256_setzero_ps();
+
+    for (int k = 0; k < c.count; k += 8) {
+        const __m256i mask = tailMaskAvx2F(std::min(c.count - k, 8));
+        __m256 dx = _mm256_sub_ps(xi, _mm256_maskload_ps(c.x + k, mask));
+        __m256 dy = _mm256_sub_ps(yi, _mm256_maskload_ps(c.y + k, mask));
+        __m256 m = _mm256_maskload_ps(c.mass + k, mask);
+        // Lanes past the end load a zero quadrupole, so only the monopole needs masking
+        __m256 qxx = _mm256_maskload_ps(c.qxx + k, mask);
+        __m256 qxy = _mm256_maskload_ps(c.qxy + k, mask);
+        __m256 qyy = _mm256_maskload_ps(c.qyy + k, mask);
+
+        __m256 r2 = _mm256_max_ps(_mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy)), min_d2);
+        __m256 inv = rsqrtAvx2F(r2);
+        __m256 inv2 = _mm256_mul_ps(inv, inv);
+        __m256 inv3 = _mm256_mul_ps(inv2, inv);
+        __m256 mono = _mm256_mul_ps(_mm256_mul_ps(neg_g, m), inv3);
+        mono = _mm256_and_ps(mono, _mm256_castsi256_ps(mask));
+
+        // Qr, rᵀQr and the G/d⁵, G/d⁷ factors
+        __m256 qrx = _mm256_fmadd_ps(qxx, dx, _mm256_mul_ps(qxy, dy));
+        __m256 qry = _mm256_fmadd_ps(qxy, dx, _mm256_mul_ps(qyy, dy));
+        __m256 s = _mm256_fmadd_ps(dx, qrx, _mm256_mul_ps(dy, qry));
+        __m256 g5 = _mm256_mul_ps(_mm256_mul_ps(g, inv3), inv2);
+        __m256 g7 = _mm256_mul_ps(g5, inv2);
+
+        // a = (mono - 5/2 g7 s) r + g5 Qr
+        __m256 radial = _mm256_fnmadd_ps(_mm256_mul_ps(five_halves, g7), s, mono);
+        ax = _mm256_fmadd_ps(dx, radial, _mm256_fmadd_ps(g5, qrx, ax));
+        ay = _mm256_fmadd_ps(dy, radial, _mm256_fmadd_ps(g5, qry, ay));
+        if constexpr (WithPotential) {
+            pot = _mm256_fmadd_ps(mono, r2, pot);
+            pot = _mm256_fnmadd_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), g5), s, pot);
+        }
+        if constexpr (WithJerk) {
+            __m256 dvx = _mm256_sub_ps(vxi, _mm256_maskload_ps(c.vx + k, mask));
+            __m256 dvy = _mm256_sub_ps(vyi, _mm256_maskload_ps(c.vy + k, mask));
+            __m256 rv = _mm256_fmadd_ps(dx, dvx, _mm256_mul_ps(dy, dvy));
+            __m256 qvx = _mm256_fmadd_ps(qxx, dvx, _mm256_mul_ps(qxy, dvy));
+            __m256 qvy = _mm256_fmadd_ps(qxy, dvx, _mm256_mul_ps(qyy, dvy));
+            __m256 vq = _mm256_fmadd_ps(dvx, qrx, _mm256_mul_ps(dvy, qry));
+
+            // j = radial v + g5 Qv + jr r - 5 g7 (r·v) Qr (see quadrupolesAvx512Impl)
+            __m256 rv_inv2 = _mm256_mul_ps(rv, inv2);
+            __m256 jr = _mm256_mul_ps(
+                g7, _mm256_fmsub_ps(_mm256_mul_ps(c35_2, s), rv_inv2, _mm256_mul_ps(five, vq)));
+            jr = _mm256_fnmadd_ps(_mm256_mul_ps(three, mono), rv_inv2, jr);
+            __m256 qr_coef = _mm256_mul_ps(_mm256_mul_ps(five, g7), rv);
+            jx = _mm256_add_ps(jx, _mm256_fnmadd_ps(qr_coef, qrx,
+                               _mm256_fmadd_ps(dx, jr, _mm256_fmadd_ps(g5, qvx,
+                                                                       _mm256_mul_ps(dvx, radial)))));
+            jy = _mm256_add_ps(jy, _mm256_fnmadd_ps(qr_coef, qry,
+                               _mm256_fmadd_ps(dy, jr, _mm256_fmadd_ps(g5, qvy,
+                                                                       _mm256_mul_ps(dvy, radial)))));
+        }
+    }
+    sum.ax += hsumAvx2F(ax);
+    sum.ay += hsumAvx2F(ay);
+    sum.jx += hsumAvx2F(jx);
+    sum.jy += hsumAvx2F(jy);
+    if constexpr (WithPotential)
+        sum.pot += hsumAvx2F(pot);
+}
+
+NBODY_AVX2 static void cellsMixedAvx2(const KernelTarget &t, const CellBlockF &c, bool with_jerk,
+                                      bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        cellsMixedAvx2Impl<jerk, potential>(t, c, sum);
+    });
+}
+
+NBODY_AVX2 static void quadrupolesMixedAvx2(const KernelTarget &t, const CellBlockF &c,
+                                            bool with_jerk, bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        quadrupolesMixedAvx2Impl<jerk, potential>(t, c, sum);
+    });
+}
+
+static const ForceKernels avx2_kernels = {"avx2",         cellsAvx2,
+                                          quadrupolesAvx2, particlesAvx2,
+                                          cellsMixedAvx2, quadrupolesMixedAvx2};
+
+//
+// AVX-512F: 8 lanes with native mask registers. The 14-bit
+// double-precision rsqrt estimate needs two Newton steps.
+//
+
+#define NBODY_AVX512 __attribute__((target("avx512f")))
+
+// GCC 12's AVX-512 intrinsics (_mm512_extractf64x4_pd, _mm512_cvtps_pd,
+// ...) pass _mm512_undefined_*() placeholders that trip -Wuninitialized
+// and -Wmaybe-uninitialized once inlined
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+/// @brief 1/sqrt(x) to double precision
+NBODY_AVX512 static inline __m512d rsqrtAvx512(__m512d x) {
+    const __m512d half_x = _mm512_mul_pd(x, _mm512_set1_pd(0.5));
+    const __m512d three_halves = _mm512_set1_pd(1.5);
+    __m512d y = _mm512_rsqrt14_pd(x);
+    for (int i = 0; i < 2; i++) {
+        __m512d yy = _mm512_mul_pd(y, y);
+        y = _mm512_mul_pd(y, _mm512_fnmadd_pd(half_x, yy, three_halves));
+    }
+    return y;
+}
+
+/// @brief Lane mask for the first n of 8 lanes (n in [0, 8])
+static inline __mmask8 tailMaskAvx512(int n) {
+    return static_cast<__mmask8>((1u << n) - 1);
+}
+
+template <bool WithJerk, bool WithPotential>
+NBODY_AVX512 static void cellsAvx512Impl(const KernelTarget &t, const CellBlock &c,
+                                         ForceSum &sum) {
+    const __m512d xi = _mm512_set1_pd(t.x), yi = _mm512_set1_pd(t.y);
+    const __m512d vxi = _mm512_set1_pd(t.vx), vyi = _mm512_set1_pd(t.vy);
+    const __m512d min_d2 = _mm512_set1_pd(4 * t.radius * t.radius);
+    const __m512d neg_g = _mm512_set1_pd(-GRAV_G), three = _mm512_set1_pd(3.0);
+    __m512d ax = _mm512_setzero_pd(), ay = _mm512_setzero_pd();
+    __m512d jx = _mm512_setzero_pd(), jy = _mm512_setzero_pd();
+    __m512d pot = _mm512_setzero_pd();
+
+    for (int k = 0; k < c.count; k += 8) {
+        const __mmask8 mask = tailMaskAvx512(std::min(c.count - k, 8));
+        __m512d dx = _mm512_sub_pd(xi, _mm512_maskz_loadu_pd(mask, c.x + k));
+        __m512d dy = _mm512_sub_pd(yi, _mm512_maskz_loadu_pd(mask, c.y + k));
+        __m512d m = _mm512_maskz_loadu_pd(mask, c.mass + k);
+
+        __m512d r2 = _mm512_max_pd(_mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy)), min_d2);
+        __m512d inv = rsqrtAvx512(r2);
+        __m512d inv2 = _mm512_mul_pd(inv, inv);
+        __m512d acc_mag =
+            _mm512_maskz_mul_pd(mask, _mm512_mul_pd(neg_g, m), _mm512_mul_pd(inv2, inv));
+
+        ax = _mm512_fmadd_pd(dx, acc_mag, ax);
+        ay = _mm512_fmadd_pd(dy, acc_mag, ay);
+        if constexpr (WithPotential) {
+            pot = _mm512_fmadd_pd(acc_mag, r2, pot);
+        }
+        if constexpr (WithJerk) {
+            __m512d dvx = _mm512_sub_pd(vxi, _mm512_maskz_loadu_pd(mask, c.vx + k));
+            __m512d dvy = _mm512_sub_pd(vyi, _mm512_maskz_loadu_pd(mask, c.vy + k));
+            __m512d rv = _mm512_fmadd_pd(dx, dvx, _mm512_mul_pd(dy, dvy));
+            __m512d f = _mm512_mul_pd(_mm512_mul_pd(three, acc_mag), _mm512_mul_pd(rv, inv2));
+            jx = _mm512_add_pd(jx, _mm512_fnmadd_pd(dx, f, _mm512_mul_pd(dvx, acc_mag)));
+            jy = _mm512_add_pd(jy, _mm512_fnmadd_pd(dy, f, _mm512_mul_pd(dvy, acc_mag)));
+        }
+    }
+    sum.ax += _mm512_reduce_add_pd(ax);
+    sum.ay += _mm512_reduce_add_pd(ay);
+    sum.jx += _mm512_reduce_add_pd(jx);
+    sum.jy += _mm512_reduce_add_pd(jy);
+    if constexpr (WithPotential)
+        sum.pot += _mm512_reduce_add_pd(pot);
+}
+
+template <bool WithJerk, bool WithPotential>
+NBODY_AVX512 static void particlesAvx512Impl(const KernelTarget &t, const SourceBlock &s,
+                                             ForceSum &sum) {
+    const __m512d xi = _mm512_set1_pd(t.x), yi = _mm512_set1_pd(t.y);
+    const __m512d vxi = _mm512_set1_pd(t.vx), vyi = _mm512_set1_pd(t.vy);
+    const __m512d ri = _mm512_set1_pd(t.radius);
+    const __m512i idi = _mm512_set1_epi32(t.id);
+    const __m512d neg_g = _mm512_set1_pd(-GRAV_G), three = _mm512_set1_pd(3.0);
+    __m512d ax = _mm512_setzero_pd(), ay = _mm512_setzero_pd();
+    __m512d jx = _mm512_setzero_pd(), jy = _mm512_setzero_pd();
+    __m512d pot = _mm512_setzero_pd();
+
+    for (int k = 0; k < s.count; k += 8) {
+        const __mmask8 mask = tailMaskAvx512(std::min(s.count - k, 8));
+        __m512d dx = _mm512_sub_pd(xi, _mm512_maskz_loadu_pd(mask, s.x + k));
+        __m512d dy = _mm512_sub_pd(yi, _mm512_maskz_loadu_pd(mask, s.y + k));
+        __m512d m = _mm512_maskz_loadu_pd(mask, s.mass + k);
+        __m512d rsum = _mm512_add_pd(ri, _mm512_maskz_loadu_pd(mask, s.radius + k));
+
+        // Self-interaction mask: compare 8 IDs in the low half of a 16-lane register
+        __m512i ids = _mm512_maskz_loadu_epi32(mask, s.id + k);
+        __mmask8 keep = static_cast<__mmask8>(_mm512_mask_cmpneq_epi32_mask(mask, ids, idi));
+
+        // r_soft² = max(r², (r_i + r_j)²) avoids the square root
+        __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy));
+        r2 = _mm512_max_pd(r2, _mm512_mul_pd(rsum, rsum));
+        __m512d inv = rsqrtAvx512(r2);
+        __m512d inv2 = _mm512_mul_pd(inv, inv);
+        __m512d mag = _mm512_maskz_mul_pd(keep, _mm512_mul_pd(neg_g, m), _mm512_mul_pd(inv2, inv));
+
+        ax = _mm512_fmadd_pd(dx, mag, ax);
+        ay = _mm512_fmadd_pd(dy, mag, ay);
+        if constexpr (WithPotential) {
+            pot = _mm512_fmadd_pd(mag, r2, pot);
+        }
+        if constexpr (WithJerk) {
+            __m512d dvx = _mm512_sub_pd(vxi, _mm512_maskz_loadu_pd(mask, s.vx + k));
+            __m512d dvy = _mm512_sub_pd(vyi, _mm512_maskz_loadu_pd(mask, s.vy + k));
+            __m512d rv = _mm512_fmadd_pd(dx, dvx, _mm512_mul_pd(dy, dvy));
+            __m512d f = _mm512_mul_pd(_mm512_mul_pd(three, mag), _mm512_mul_pd(rv, inv2));
+            jx = _mm512_add_pd(jx, _mm512_fnmadd_pd(dx, f, _mm512_mul_pd(dvx, mag)));
+            jy = _mm512_add_pd(jy, _mm512_fnmadd_pd(dy, f, _mm512_mul_pd(dvy, mag)));
+        }
+    }
+    sum.ax += _mm512_reduce_add_pd(ax);
+    sum.ay += _mm512_reduce_add_pd(ay);
+    sum.jx += _mm512_reduce_add_pd(jx);
+    sum.jy += _mm512_reduce_add_pd(jy);
+    if constexpr (WithPotential)
+        sum.pot += _mm512_reduce_add_pd(pot);
+}
+
+template <bool WithJerk, bool WithPotential>
+NBODY_AVX512 static void quadrupolesAvx512Impl(const KernelTarget &t, const CellBlock &c,
+                                               ForceSum &sum) {
+    const __m512d xi = _mm512_set1_pd(t.x), yi = _mm512_set1_pd(t.y);
+    const __m512d vxi = _mm512_set1_pd(t.vx), vyi = _mm512_set1_pd(t.vy);
+    const __m512d min_d2 = _mm512_set1_pd(4 * t.radius * t.radius);
+    const __m512d g = _mm512_set1_pd(GRAV_G), neg_g = _mm512_set1_pd(-GRAV_G);
+    const __m512d three = _mm512_set1_pd(3.0), five = _mm512_set1_pd(5.0);
+    const __m512d five_halves = _mm512_set1_pd(2.5), c35_2 = _mm512_set1_pd(17.5);
+    __m512d ax = _mm512_setzero_pd(), ay = _mm512_setzero_pd();
+    __m512d jx = _mm512_setzero_pd(), jy = _mm512_setzero_pd();
+    __m512d pot = _mm512_setzero_pd();
+
+    for (int k = 0; k < c.count; k += 8) {
+        const __mmask8 mask = tailMaskAvx512(std::min(c.count - k, 8));
+        __m512d dx = _mm512_sub_pd(xi, _mm512_maskz_loadu_pd(mask, c.x + k));
+        __m512d dy = _mm512_sub_pd(yi, _mm512_maskz_loadu_pd(mask, c.y + k));
+        __m512d m = _mm512_maskz_loadu_pd(mask, c.mass + k);
+        // Lanes past the end load a zero quadrupole, so only the monopole needs masking
+        __m512d qxx = _mm512_maskz_loadu_pd(mask, c.qxx + k);
+        __m512d qxy = _mm512_maskz_loadu_pd(mask, c.qxy + k);
+        __m512d qyy = _mm512_maskz_loadu_pd(mask, c.qyy + k);
+
+        __m512d r2 = _mm512_max_pd(_mm512_fmadd_pd(dx, dx, _mm512_mul_pd(dy, dy)), min_d2);
+        __m512d inv = rsqrtAvx512(r2);
+        __m512d inv2 = _mm512_mul_pd(inv, inv);
+        __m512d inv3 = _mm512_mul_pd(inv2, inv);
+        __m512d mono = _mm512_maskz_mul_pd(mask, _mm512_mul_pd(neg_g, m), inv3);
+
+        // Qr, rᵀQr and the G/d⁵, G/d⁷ factors
+        __m512d qrx = _mm512_fmadd_pd(qxx, dx, _mm512_mul_pd(qxy, dy));
+        __m512d qry = _mm512_fmadd_pd(qxy, dx, _mm512_mul_pd(qyy, dy));
+        __m512d s = _mm512_fmadd_pd(dx, qrx, _mm512_mul_pd(dy, qry));
+        __m512d g5 = _mm512_mul_pd(_mm512_mul_pd(g, inv3), inv2);
+        __m512d g7 = _mm512_mul_pd(g5, inv2);
+
+        // a = (mono - 5/2 g7 s) r + g5 Qr
+        __m512d radial = _mm512_fnmadd_pd(_mm512_mul_pd(five_halves, g7), s, mono);
+        ax = _mm512_fmadd_pd(dx, radial, _mm512_fmadd_pd(g5, qrx, ax));
+        ay = _mm512_fmadd_pd(dy, radial, _mm512_fmadd_pd(g5, qry, ay));
+        if constexpr (WithPotential) {
+            pot = _mm512_fmadd_pd(mono, r2, pot);
+            pot = _mm512_fnmadd_pd(_mm512_mul_pd(_mm512_set1_pd(0.5), g5), s, pot);
+        }
+        if constexpr (WithJerk) {
+            __m512d dvx = _mm512_sub_pd(vxi, _mm512_maskz_loadu_pd(mask, c.vx + k));
+            __m512d dvy = _mm512_sub_pd(vyi, _mm512_maskz_loadu_pd(mask, c.vy + k));
+            __m512d rv = _mm512_fmadd_pd(dx, dvx, _mm512_mul_pd(dy, dvy));
+            __m512d qvx = _mm512_fmadd_pd(qxx, dvx, _mm512_mul_pd(qxy, dvy));
+            __m512d qvy = _mm512_fmadd_pd(qxy, dvx, _mm512_mul_pd(qyy, dvy));
+            __m512d vq = _mm512_fmadd_pd(dvx, qrx, _mm512_mul_pd(dvy, qry));
+
+            // j = radial v + g5 Qv + jr r - 5 g7 (r·v) Qr, with
+            // jr = g7 (35/2 s (r·v)/d² - 5 v·Qr) - 3 mono (r·v)/d²
+            __m512d rv_inv2 = _mm512_mul_pd(rv, inv2);
+            __m512d jr = _mm512_mul_pd(
+                g7, _mm512_fmsub_pd(_mm512_mul_pd(c35_2, s), rv_inv2, _mm512_mul_pd(five, vq)));
+            jr = _mm512_fnmadd_pd(_mm512_mul_pd(three, mono), rv_inv2, jr);
+            __m512d qr_coef = _mm512_mul_pd(_mm512_mul_pd(five, g7), rv);
+            jx = _mm512_add_pd(jx, _mm512_fnmadd_pd(qr_coef, qrx,
+                               _mm512_fmadd_pd(dx, jr, _mm512_fmadd_pd(g5, qvx,
+                                                                       _mm512_mul_pd(dvx, radial)))));
+            jy = _mm512_add_pd(jy, _mm512_fnmadd_pd(qr_coef, qry,
+                               _mm512_fmadd_pd(dy, jr, _mm512_fmadd_pd(g5, qvy,
+                                                                       _mm512_mul_pd(dvy, radial)))));
+        }
+    }
+    sum.ax += _mm512_reduce_add_pd(ax);
+    sum.ay += _mm512_reduce_add_pd(ay);
+    sum.jx += _mm512_reduce_add_pd(jx);
+    sum.jy += _mm512_reduce_add_pd(jy);
+    if constexpr (WithPotential)
+        sum.pot += _mm512_reduce_add_pd(pot);
+}
+
+NBODY_AVX512 static void cellsAvx512(const KernelTarget &t, const CellBlock &c, bool with_jerk,
+                                     bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        cellsAvx512Impl<jerk, potential>(t, c, sum);
+    });
+}
+
+NBODY_AVX512 static void quadrupolesAvx512(const KernelTarget &t, const CellBlock &c,
+                                           bool with_jerk, bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        quadrupolesAvx512Impl<jerk, potential>(t, c, sum);
+    });
+}
+
+NBODY_AVX512 static void particlesAvx512(const KernelTarget &t, const SourceBlock &s,
+                                         bool with_jerk, bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        particlesAvx512Impl<jerk, potential>(t, s, sum);
+    });
+}
+
+//
+// AVX-512F in single precision (mixed-precision far field): 16 lanes.
+// The 14-bit rsqrt estimate needs one Newton step.
+//
+
+/// @brief 1/sqrt(x) to single precision
+NBODY_AVX512 static inline __m512 rsqrtAvx512F(__m512 x) {
+    const __m512 y = _mm512_rsqrt14_ps(x);
+    const __m512 yy = _mm512_mul_ps(y, y);
+    return _mm512_mul_ps(y, _mm512_fnmadd_ps(_mm512_mul_ps(x, _mm512_set1_ps(0.5f)), yy,
+                                             _mm512_set1_ps(1.5f)));
+}
+
+/// @brief Sum of the sixteen lanes, in double
+NBODY_AVX512 static inline double hsumAvx512F(__m512 v) {
+    const __m256 high = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1));
+    return _mm512_reduce_add_pd(
+        _mm512_add_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(v)), _mm512_cvtps_pd(high)));
+}
+
+/// @brief Lane mask for the first n of 16 lanes (n in [0, 16])
+static inline __mmask16 tailMaskAvx512F(int n) {
+    return static_cast<__mmask16>((1u << n) - 1);
+}
+
+template <bool WithJerk, bool WithPotential>
+NBODY_AVX512 static void cellsMixedAvx512Impl(const KernelTarget &t, const CellBlockF &c,
+                                              ForceSum &sum) {
+    const __m512 xi = _mm512_set1_ps(static_cast<float>(t.x));
+    const __m512 yi = _mm512_set1_ps(static_cast<float>(t.y));
+    const __m512 vxi = _mm512_set1_ps(static_cast<float>(t.vx));
+    const __m512 vyi = _mm512_set1_ps(static_cast<float>(t.vy));
+    const __m512 min_d2 = _mm512_set1_ps(static_cast<float>(4 * t.radius * t.radius));
+    const __m512 neg_g = _mm512_set1_ps(static_cast<float>(-GRAV_G));
+    const __m512 three = _mm512_set1_ps(3.0f);
+    __m512 ax = _mm512_setzero_ps(), ay = _mm512_setzero_ps();
+    __m512 jx = _mm512_setzero_ps(), jy = _mm512_setzero_ps();
+    __m512 pot = _mm512_setzero_ps();
+
+    for (int k = 0; k < c.count; k += 16) {
+        const __mmask16 mask = tailMaskAvx512F(std::min(c.count - k, 16));
+        __m512 dx = _mm512_sub_ps(xi, _mm512_maskz_loadu_ps(mask, c.x + k));
+        __m512 dy = _mm512_sub_ps(yi, _mm512_maskz_loadu_ps(mask, c.y + k));
+        __m512 m = _mm512_maskz_loadu_ps(mask, c.mass + k);
+
+        __m512 r2 = _mm512_max_ps(_mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy)), min_d2);
+        __m512 inv = rsqrtAvx512F(r2);
+        __m512 inv2 = _mm512_mul_ps(inv, inv);
+        __m512 acc_mag =
+            _mm512_maskz_mul_ps(mask, _mm512_mul_ps(neg_g, m), _mm512_mul_ps(inv2, inv));
+
+        ax = _mm512_fmadd_ps(dx, acc_mag, ax);
+        ay = _mm512_fmadd_ps(dy, acc_mag, ay);
+        if constexpr (WithPotential) {
+            pot = _mm512_fmadd_ps(acc_mag, r2, pot);
+        }
+        if constexpr (WithJerk) {
+            __m512 dvx = _mm512_sub_ps(vxi, _mm512_maskz_loadu_ps(mask, c.vx + k));
+            __m512 dvy = _mm512_sub_ps(vyi, _mm512_maskz_loadu_ps(mask, c.vy + k));
+            __m512 rv = _mm512_fmadd_ps(dx, dvx, _mm512_mul_ps(dy, dvy));
+            __m512 f = _mm512_mul_ps(_mm512_mul_ps(three, acc_mag), _mm512_mul_ps(rv, inv2));
+            jx = _mm512_add_ps(jx, _mm512_fnmadd_ps(dx, f, _mm512_mul_ps(dvx, acc_mag)));
+            jy = _mm512_add_ps(jy, _mm512_fnmadd_ps(dy, f, _mm512_mul_ps(dvy, acc_mag)));
+        }
+    }
+    sum.ax += hsumAvx512F(ax);
+    sum.ay += hsumAvx512F(ay);
+    sum.jx += hsumAvx512F(jx);
+    sum.jy += hsumAvx512F(jy);
+    if constexpr (WithPotential)
+        sum.pot += hsumAvx512F(pot);
+}
+
+template <bool WithJerk, bool WithPotential>
+NBODY_AVX512 static void quadrupolesMixedAvx512Impl(const KernelTarget &t, const CellBlockF &c,
+                                                    ForceSum &sum) {
+    const __m512 xi = _mm512_set1_ps(static_cast<float>(t.x));
+    const __m512 yi = _mm512_set1_ps(static_cast<float>(t.y));
+    const __m512 vxi = _mm512_set1_ps(static_cast<float>(t.vx));
+    const __m512 vyi = _mm512_set1_ps(static_cast<float>(t.vy));
+    const __m512 min_d2 = _mm512_set1_ps(static_cast<float>(4 * t.radius * t.radius));
+    const __m512 g = _mm512_set1_ps(static_cast<float>(GRAV_G));
+    const __m512 neg_g = _mm512_set1_ps(static_cast<float>(-GRAV_G));
+    const __m512 three = _mm512_set1_ps(3.0f), five = _mm512_set1_ps(5.0f);
+    const __m512 five_halves = _mm512_set1_ps(2.5f), c35_2 = _mm512_set1_ps(17.5f);
+    __m512 ax = _mm512_setzero_ps(), ay = _mm512_setzero_ps();
+    __m512 jx = _mm512_setzero_ps(), jy = _mm512_setzero_ps();
+    __m512 pot = _mm512_setzero_ps();
+
+    for (int k = 0; k < c.count; k += 16) {
+        const __mmask16 mask = tailMaskAvx512F(std::min(c.count - k, 16));
+        __m512 dx = _mm512_sub_ps(xi, _mm512_maskz_loadu_ps(mask, c.x + k));
+        __m512 dy = _mm512_sub_ps(yi, _mm512_maskz_loadu_ps(mask, c.y + k));
+        __m512 m = _mm512_maskz_loadu_ps(mask, c.mass + k);
+        // Lanes past the end load a zero quadrupole, so only the monopole needs masking
+        __m512 qxx = _mm512_maskz_loadu_ps(mask, c.qxx + k);
+        __m512 qxy = _mm512_maskz_loadu_ps(mask, c.qxy + k);
+        __m512 qyy = _mm512_maskz_loadu_ps(mask, c.qyy + k);
+
+        __m512 r2 = _mm512_max_ps(_mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy)), min_d2);
+        __m512 inv = rsqrtAvx512F(r2);
+        __m512 inv2 = _mm512_mul_ps(inv, inv);
+        __m512 inv3 = _mm512_mul_ps(inv2, inv);
+        __m512 mono = _mm512_maskz_mul_ps(mask, _mm512_mul_ps(neg_g, m), inv3);
+
+        // Qr, rᵀQr and the G/d⁵, G/d⁷ factors
+        __m512 qrx = _mm512_fmadd_ps(qxx, dx, _mm512_mul_ps(qxy, dy));
+        __m512 qry = _mm512_fmadd_ps(qxy, dx, _mm512_mul_ps(qyy, dy));
+        __m512 s = _mm512_fmadd_ps(dx, qrx, _mm512_mul_ps(dy, qry));
+        __m512 g5 = _mm512_mul_ps(_mm512_mul_ps(g, inv3), inv2);
+        __m512 g7 = _mm512_mul_ps(g5, inv2);
+
+        // a = (mono - 5/2 g7 s) r + g5 Qr
+        __m512 radial = _mm512_fnmadd_ps(_mm512_mul_ps(five_halves, g7), s, mono);
+        ax = _mm512_fmadd_ps(dx, radial, _mm512_fmadd_ps(g5, qrx, ax));
+        ay = _mm512_fmadd_ps(dy, radial, _mm512_fmadd_ps(g5, qry, ay));
+        if constexpr (WithPotential) {
+            pot = _mm512_fmadd_ps(mono, r2, pot);
+            pot = _mm512_fnmadd_ps(_mm512_mul_ps(_mm512_set1_ps(0.5f), g5), s, pot);
+        }
+        if constexpr (WithJerk) {
+            __m512 dvx = _mm512_sub_ps(vxi, _mm512_maskz_loadu_ps(mask, c.vx + k));
+            __m512 dvy = _mm512_sub_ps(vyi, _mm512_maskz_loadu_ps(mask, c.vy + k));
+            __m512 rv = _mm512_fmadd_ps(dx, dvx, _mm512_mul_ps(dy, dvy));
+            __m512 qvx = _mm512_fmadd_ps(qxx, dvx, _mm512_mul_ps(qxy, dvy));
+            __m512 qvy = _mm512_fmadd_ps(qxy, dvx, _mm512_mul_ps(qyy, dvy));
+            __m512 vq = _mm512_fmadd_ps(dvx, qrx, _mm512_mul_ps(dvy, qry));
+
+            // j = radial v + g5 Qv + jr r - 5 g7 (r·v) Qr (see quadrupolesAvx512Impl)
+            __m512 rv_inv2 = _mm512_mul_ps(rv, inv2);
+            __m512 jr = _mm512_mul_ps(
+                g7, _mm512_fmsub_ps(_mm512_mul_ps(c35_2, s), rv_inv2, _mm512_mul_ps(five, vq)));
+            jr = _mm512_fnmadd_ps(_mm512_mul_ps(three, mono), rv_inv2, jr);
+            __m512 qr_coef = _mm512_mul_ps(_mm512_mul_ps(five, g7), rv);
+            jx = _mm512_add_ps(jx, _mm512_fnmadd_ps(qr_coef, qrx,
+                               _mm512_fmadd_ps(dx, jr, _mm512_fmadd_ps(g5, qvx,
+                                                                       _mm512_mul_ps(dvx, radial)))));
+            jy = _mm512_add_ps(jy, _mm512_fnmadd_ps(qr_coef, qry,
+                               _mm512_fmadd_ps(dy, jr, _mm512_fmadd_ps(g5, qvy,
+                                                                       _mm512_mul_ps(dvy, radial)))));
+        }
+    }
+    sum.ax += hsumAvx512F(ax);
+    sum.ay += hsumAvx512F(ay);
+    sum.jx += hsumAvx512F(jx);
+    sum.jy += hsumAvx512F(jy);
+    if constexpr (WithPotential)
+        sum.pot += hsumAvx512F(pot);
+}
+
+NBODY_AVX512 static void cellsMixedAvx512(const KernelTarget &t, const CellBlockF &c,
+                                          bool with_jerk, bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        cellsMixedAvx512Impl<jerk, potential>(t, c, sum);
+    });
+}
+
+NBODY_AVX512 static void quadrupolesMixedAvx512(const KernelTarget &t, const CellBlockF &c,
+                                                bool with_jerk, bool with_potential,
+                                                ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        quadrupolesMixedAvx512Impl<jerk, potential>(t, c, sum);
+    });
+}
+
+static const ForceKernels avx512_kernels = {"avx512",          cellsAvx512,
+                                            quadrupolesAvx512, particlesAvx512,
+                                            cellsMixedAvx512,  quadrupolesMixedAvx512};
+
+#pragma GCC diagnostic pop
+
+#endif // NBODY_KERNELS_X86
+
+#ifdef NBODY_KERNELS_NEON
+
+//
+// NEON (AArch64): 2 lanes. The 8-bit rsqrt estimate needs three
+// vrsqrts Newton steps. Tails are handled by padding a local copy.
+//
+
+/// @brief 1/sqrt(x) to double precision
+static inline float64x2_t rsqrtNeon(float64x2_t x) {
+    float64x2_t y = vrsqrteq_f64(x);
+    for (int i = 0; i < 3; i++) {
+        y = vmulq_f64(y, vrsqrtsq_f64(vmulq_f64(x, y), y));
+    }
+    return y;
+}
+
+/// @brief Lane mask for the first n of 2 lanes (n in [0, 2])
+static inline uint64x2_t tailMaskNeon(int n) {
+    const int64x2_t lane = {0, 1};
+    return vcltq_s64(lane, vdupq_n_s64(n));
+}
+
+/// @brief Load up to two doubles, zero-filling past the end
+static inline float64x2_t loadNeon(const double *p, int lanes) {
+    return lanes == 2 ? vld1q_f64(p) : vsetq_lane_f64(p[0], vdupq_n_f64(0), 0);
+}
+
+template <bool WithJerk, bool WithPotential>
+static void cellsNeonImpl(const KernelTarget &t, const CellBlock &c, ForceSum &sum) {
+    const float64x2_t xi = vdupq_n_f64(t.x), yi = vdupq_n_f64(t.y);
+    const float64x2_t vxi = vdupq_n_f64(t.vx), vyi = vdupq_n_f64(t.vy);
+    const float64x2_t min_d2 = vdupq_n_f64(4 * t.radius * t.radius);
+    const float64x2_t neg_g = vdupq_n_f64(-GRAV_G), three = vdupq_n_f64(3.0);
+    float64x2_t ax = vdupq_n_f64(0), ay = vdupq_n_f64(0);
+    float64x2_t jx = vdupq_n_f64(0), jy = vdupq_n_f64(0);
+    float64x2_t pot = vdupq_n_f64(0);
+
+    for (int k = 0; k < c.count; k += 2) {
+        const int lanes = std::min(c.count - k, 2);
+        const uint64x2_t mask = tailMaskNeon(lanes);
+        float64x2_t dx = vsubq_f64(xi, loadNeon(c.x + k, lanes));
+        float64x2_t dy = vsubq_f64(yi, loadNeon(c.y + k, lanes));
+        float64x2_t m = loadNeon(c.mass + k, lanes);
+
+        float64x2_t r2 = vmaxq_f64(vfmaq_f64(vmulq_f64(dy, dy), dx, dx), min_d2);
+        float64x2_t inv = rsqrtNeon(r2);
+        float64x2_t inv2 = vmulq_f64(inv, inv);
+        float64x2_t acc_mag = vmulq_f64(vmulq_f64(neg_g, m), vmulq_f64(inv2, inv));
+        acc_mag = vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(acc_mag), mask));
+
+        ax = vfmaq_f64(ax, dx, acc_mag);
+        ay = vfmaq_f64(ay, dy, acc_mag);
+        if constexpr (WithPotential) {
+            pot = vfmaq_f64(pot, acc_mag, r2);
+        }
+        if constexpr (WithJerk) {
+            float64x2_t dvx = vsubq_f64(vxi, loadNeon(c.vx + k, lanes));
+            float64x2_t dvy = vsubq_f64(vyi, loadNeon(c.vy + k, lanes));
+            float64x2_t rv = vfmaq_f64(vmulq_f64(dy, dvy), dx, dvx);
+            float64x2_t f = vmulq_f64(vmulq_f64(three, acc_mag), vmulq_f64(rv, inv2));
+            jx = vaddq_f64(jx, vfmsq_f64(vmulq_f64(dvx, acc_mag), dx, f));
+            jy = vaddq_f64(jy, vfmsq_f64(vmulq_f64(dvy, acc_mag), dy, f));
+        }
+    }
+    sum.ax += vaddvq_f64(ax);
+    sum.ay += vaddvq_f64(ay);
+    sum.jx += vaddvq_f64(jx);
+    sum.jy += vaddvq_f64(jy);
+    if constexpr (WithPotential)
+        sum.pot += vaddvq_f64(pot);
+}
+
+template <bool WithJerk, bool WithPotential>
+static void particlesNeonImpl(const KernelTarget &t, const SourceBlock &s, ForceSum &sum) {
+    const float64x2_t xi = vdupq_n_f64(t.x), yi = vdupq_n_f64(t.y);
+    const float64x2_t vxi = vdupq_n_f64(t.vx), vyi = vdupq_n_f64(t.vy);
+    const float64x2_t ri = vdupq_n_f64(t.radius);
+    const float64x2_t neg_g = vdupq_n_f64(-GRAV_G), three = vdupq_n_f64(3.0);
+    float64x2_t ax = vdupq_n_f64(0), ay = vdupq_n_f64(0);
+    float64x2_t jx = vdupq_n_f64(0), jy = vdupq_n_f64(0);
+    float64x2_t pot = vdupq_n_f64(0);
+
+    for (int k = 0; k < s.count; k += 2) {
+        const int lanes = std::min(s.count - k, 2);
+        float64x2_t dx = vsubq_f64(xi, loadNeon(s.x + k, lanes));
+        float64x2_t dy = vsubq_f64(yi, loadNeon(s.y + k, lanes));
+        float64x2_t m = loadNeon(s.mass + k, lanes);
+        float64x2_t rsum = vaddq_f64(ri, loadNeon(s.radius + k, lanes));
+
+        // Keep lanes inside the block whose ID differs from the target's
+        const int64x2_t ids = {s.id[k], lanes == 2 ? s.id[k + 1] : t.id};
+        uint64x2_t keep = vbicq_u64(tailMaskNeon(lanes), vceqq_s64(ids, vdupq_n_s64(t.id)));
+
+        // r_soft² = max(r², (r_i + r_j)²) avoids the square root
+        float64x2_t r2 = vfmaq_f64(vmulq_f64(dy, dy), dx, dx);
+        r2 = vmaxq_f64(r2, vmulq_f64(rsum, rsum));
+        float64x2_t inv = rsqrtNeon(r2);
+        float64x2_t inv2 = vmulq_f64(inv, inv);
+        float64x2_t mag = vmulq_f64(vmulq_f64(neg_g, m), vmulq_f64(inv2, inv));
+        mag = vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(mag), keep));
+
+        ax = vfmaq_f64(ax, dx, mag);
+        ay = vfmaq_f64(ay, dy, mag);
+        if constexpr (WithPotential) {
+            pot = vfmaq_f64(pot, mag, r2);
+        }
+        if constexpr (WithJerk) {
+            float64x2_t dvx = vsubq_f64(vxi, loadNeon(s.vx + k, lanes));
+            float64x2_t dvy = vsubq_f64(vyi, loadNeon(s.vy + k, lanes));
+            float64x2_t rv = vfmaq_f64(vmulq_f64(dy, dvy), dx, dvx);
+            float64x2_t f = vmulq_f64(vmulq_f64(three, mag), vmulq_f64(rv, inv2));
+            jx = vaddq_f64(jx, vfmsq_f64(vmulq_f64(dvx, mag), dx, f));
+            jy = vaddq_f64(jy, vfmsq_f64(vmulq_f64(dvy, mag), dy, f));
+        }
+    }
+    sum.ax += vaddvq_f64(ax);
+    sum.ay += vaddvq_f64(ay);
+    sum.jx += vaddvq_f64(jx);
+    sum.jy += vaddvq_f64(jy);
+    if constexpr (WithPotential)
+        sum.pot += vaddvq_f64(pot);
+}
+
+template <bool WithJerk, bool WithPotential>
+static void quadrupolesNeonImpl(const KernelTarget &t, const CellBlock &c, ForceSum &sum) {
+    const float64x2_t xi = vdupq_n_f64(t.x), yi = vdupq_n_f64(t.y);
+    const float64x2_t vxi = vdupq_n_f64(t.vx), vyi = vdupq_n_f64(t.vy);
+    const float64x2_t min_d2 = vdupq_n_f64(4 * t.radius * t.radius);
+    const float64x2_t g = vdupq_n_f64(GRAV_G), neg_g = vdupq_n_f64(-GRAV_G);
+    const float64x2_t three = vdupq_n_f64(3.0), five = vdupq_n_f64(5.0);
+    const float64x2_t five_halves = vdupq_n_f64(2.5), c35_2 = vdupq_n_f64(17.5);
+    float64x2_t ax = vdupq_n_f64(0), ay = vdupq_n_f64(0);
+    float64x2_t jx = vdupq_n_f64(0), jy = vdupq_n_f64(0);
+    float64x2_t pot = vdupq_n_f64(0);
+
+    for (int k = 0; k < c.count; k += 2) {
+        const int lanes = std::min(c.count - k, 2);
+        const uint64x2_t mask = tailMaskNeon(lanes);
+        float64x2_t dx = vsubq_f64(xi, loadNeon(c.x + k, lanes));
+        float64x2_t dy = vsubq_f64(yi, loadNeon(c.y + k, lanes));
+        float64x2_t m = loadNeon(c.mass + k, lanes);
+        // Lanes past the end load a zero quadrupole, so only the monopole needs masking
+        float64x2_t qxx = loadNeon(c.qxx + k, lanes);
+        float64x2_t qxy = loadNeon(c.qxy + k, lanes);
+        float64x2_t qyy = loadNeon(c.qyy + k, lanes);
+
+        float64x2_t r2 = vmaxq_f64(vfmaq_f64(vmulq_f64(dy, dy), dx, dx), min_d2);
+        float64x2_t inv = rsqrtNeon(r2);
+        float64x2_t inv2 = vmulq_f64(inv, inv);
+        float64x2_t inv3 = vmulq_f64(inv2, inv);
+        float64x2_t mono = vmulq_f64(vmulq_f64(neg_g, m), inv3);
+        mono = vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(mono), mask));
+
+        // Qr, rᵀQr and the G/d⁵, G/d⁷ factors
+        float64x2_t qrx = vfmaq_f64(vmulq_f64(qxy, dy), qxx, dx);
+        float64x2_t qry = vfmaq_f64(vmulq_f64(qyy, dy), qxy, dx);
+        float64x2_t s = vfmaq_f64(vmulq_f64(dy, qry), dx, qrx);
+        float64x2_t g5 = vmulq_f64(vmulq_f64(g, inv3), inv2);
+        float64x2_t g7 = vmulq_f64(g5, inv2);
+
+        // a = (mono - 5/2 g7 s) r + g5 Qr
+        float64x2_t radial = vfmsq_f64(mono, vmulq_f64(five_halves, g7), s);
+        ax = vfmaq_f64(vfmaq_f64(ax, g5, qrx), dx, radial);
+        ay = vfmaq_f64(vfmaq_f64(ay, g5, qry), dy, radial);
+        if constexpr (WithPotential) {
+            pot = vfmaq_f64(pot, mono, r2);
+            pot = vfmsq_f64(pot, vmulq_f64(vdupq_n_f64(0.5), g5), s);
+        }
+        if constexpr (WithJerk) {
+            float64x2_t dvx = vsubq_f64(vxi, loadNeon(c.vx + k, lanes));
+            float64x2_t dvy = vsubq_f64(vyi, loadNeon(c.vy + k, lanes));
+            float64x2_t rv = vfmaq_f64(vmulq_f64(dy, dvy), dx, dvx);
+            float64x2_t qvx = vfmaq_f64(vmulq_f64(qxy, dvy), qxx, dvx);
+            float64x2_t qvy = vfmaq_f64(vmulq_f64(qyy, dvy), qxy, dvx);
+            float64x2_t vq = vfmaq_f64(vmulq_f64(dvy, qry), dvx, qrx);
+
+            // j = radial v + g5 Qv + jr r - 5 g7 (r·v) Qr, with
+            // jr = g7 (35/2 s (r·v)/d² - 5 v·Qr) - 3 mono (r·v)/d²
+            float64x2_t rv_inv2 = vmulq_f64(rv, inv2);
+            float64x2_t jr = vmulq_f64(
+                g7, vfmsq_f64(vmulq_f64(vmulq_f64(c35_2, s), rv_inv2), five, vq));
+            jr = vfmsq_f64(jr, vmulq_f64(three, mono), rv_inv2);
+            float64x2_t qr_coef = vmulq_f64(vmulq_f64(five, g7), rv);
+            jx = vaddq_f64(jx, vfmsq_f64(vfmaq_f64(vfmaq_f64(vmulq_f64(dvx, radial), g5, qvx),
+                                                   dx, jr),
+                                         qr_coef, qrx));
+            jy = vaddq_f64(jy, vfmsq_f64(vfmaq_f64(vfmaq_f64(vmulq_f64(dvy, radial), g5, qvy),
+                                                   dy, jr),
+                                         qr_coef, qry));
+        }
+    }
+    sum.ax += vaddvq_f64(ax);
+    sum.ay += vaddvq_f64(ay);
+    sum.jx += vaddvq_f64(jx);
+    sum.jy += vaddvq_f64(jy);
+    if constexpr (WithPotential)
+        sum.pot += vaddvq_f64(pot);
+}
+
+static void cellsNeon(const KernelTarget &t, const CellBlock &c, bool with_jerk,
+                      bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        cellsNeonImpl<jerk, potential>(t, c, sum);
+    });
+}
+
+static void particlesNeon(const KernelTarget &t, const SourceBlock &s, bool with_jerk,
+                          bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        particlesNeonImpl<jerk, potential>(t, s, sum);
+    });
+}
+
+static void quadrupolesNeon(const KernelTarget &t, const CellBlock &c, bool with_jerk,
+                            bool with_potential, ForceSum &sum) {
+    withTerms(with_jerk, with_potential, [&](auto jerk, auto potential) {
+        quadrupolesNeonImpl<jerk, potential>(t, c, sum);
+    });
+}
+
+// The float cell kernels are the scalar ones, vectorized by OpenMP simd
+static const ForceKernels neon_kernels = {"neon",          cellsNeon,
+                                          quadrupolesNeon, particlesNeon,
+                                          cellsMixedScalar, quadrupolesMixedScalar};
+
+#endif // NBODY_KERNELS_NEON
+
+/**
+ * @brief Look up kernels by name, if this CPU supports them
+ *
+ * @param name Kernel name, or "auto" for the widest supported
+ * @return Kernels, or nullptr if unknown or unsupported
+ */
+static const ForceKernels *findKernels(const char *name) {
+    const bool any = !strcmp(name, "auto");
+#ifdef NBODY_KERNELS_X86
+    __builtin_cpu_init();
+    if ((any || !strcmp(name, "avx512")) && __builtin_cpu_supports("avx512f"))
+        return &avx512_kernels;
+    if ((any || !strcmp(name, "avx2")) && __builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("fma"))
+        return &avx2_kernels;
+#endif
+#ifdef NBODY_KERNELS_NEON
+    if (any || !strcmp(name, "neon"))
+        return &neon_kernels;
+#endif
+    if (any || !strcmp(name, "scalar"))
+        return &scalar_kernels;
+    return nullptr;
+}
+
+/// @brief Kernels in use (chosen on first call to forceKernels())
+static const ForceKernels *active_kernels = nullptr;
+
+const ForceKernels &forceKernels() {
+    static const ForceKernels *detected = findKernels("auto");
+    return active_kernels ? *active_kernels : *detected;
+}
+
+bool setForceKernels(const char *name) {
+    const ForceKernels *kernels = findKernels(name);
+    if (!kernels)
+        return false;
+    active_kernels = kernels;
+    return true;
+}
@@ -0,0 +1,423 @@
+/**
+ * @file headless.cpp
+ * @brief Render-less batch driver for the N-body simulation
+ *
+ * @details Runs the same planetary system as the viewer without SFML,
+ * stepping as fast as the cores allow. Intended for compute nodes.
+ *
+ * Usage:
+ * ```
+ * nbody_headless [--steps N] [--time T] [--dt DT] [--debris N]
+ *                [--threads N] [--log-every N] [--tree pointer|linear]
+ *                [--theta TH] [--target-error E] [--leaf-capacity N]
+ *                [--max-depth N] [--kernel NAME] [--passive-mass M]
+ *                [--multipole monopole|quadrupole] [--far-field double|float]
+ *                [--solver barnes-hut|fmm|device]
+ *                [--fmm-order P] [--fmm-theta TH]
+ *                [--integrator NAME] [--eta ETA] [--max-level N]
+ *                [--checkpoint FILE] [--checkpoint-every N] [--restart FILE]
+ *                [--trajectory FILE] [--fields SPEC] [--subset primaries|N]
+ *                [--precision double|float] [--compress LEVEL]
+ *                [--ic planetary|disk|plummer|box|FILE] [--seed S]
+ *                [--metrics FILE] [--metrics-every N]
+ *                [--diagnostics-every N] [--energy-tolerance E]
+ * ```
+ * - --steps: number of steps to take (default 100)
+ * - --time: run until this simulation time instead of a step count
+ * - --dt: timestep (default 0.01)
+ * - --debris: number of debris particles, or of all particles for the
+ *   disk, plummer and box initial conditions (default 100000)
+ * - --threads: OpenMP thread count (default: OpenMP runtime default)
+ * - --log-every: print progress every N steps (default 10, 0 to disable)
+ * - --tree: QuadTree updated incrementally (pointer, default) or
+ *   LinearQuadTree rebuilt each step (linear)
+ * - --theta: Barnes-Hut opening angle (default 0.05; initial value when adaptive)
+ * - --target-error: adapt theta to this mean relative force error
+ * - --leaf-capacity: particles per tree leaf (default 50)
+ * - --max-depth: maximum tree depth (default 15)
+ * - --kernel: force kernels: auto (default), scalar, avx2, avx512 or neon
+ * - --passive-mass: particles lighter than this are also passive (the
+ *   debris is always passive)
+ * - --multipole: order of the accepted cells' expansion (default
+ *   monopole); quadrupole reaches the same force error at a larger theta
+ * - --far-field: precision of the accepted cells' interactions (default
+ *   double); float evaluates them relative to each target group in
+ *   single precision (SolverConfig::mixed_precision)
+ * - --solver: Barnes-Hut tree walk (default), fast multipole method, or
+ *   direct summation on an offload device (builds with NBODY_OFFLOAD)
+ * - --fmm-order: FMM expansion order, 2 to 12 (default 6)
+ * - --fmm-theta: FMM well-separation parameter (default 0.5)
+ * - --integrator: rk2, yoshida, hermite (default) or block-hermite
+ * - --eta: block timestep accuracy parameter (default 0.02)
+ * - --max-level: deepest block timestep level, steps down to dt/2^N
+ *   (default 10); with block-hermite, --dt is the longest step
+ * - --checkpoint: snapshot file written every --checkpoint-every steps
+ *   (default 1000) in the background, and at the end of the run
+ * - --restart: continue from a snapshot instead of fresh initial
+ *   conditions; time, dt, theta, tree and integrator come from the file
+ *   unless given explicitly, and --steps counts from the saved step
+ * - --trajectory: stream particle fields to this file (see
+ *   trajectory_writer.h for the format)
+ * - --fields: output cadence per field in steps, e.g. pos=1,vel=10,mass=100
+ *   (default pos=1); fields are pos, vel, acc, mass and radius
+ * - --subset: only primary bodies, or only every Nth particle ID
+ * - --precision: store real-valued fields as double (default) or float
+ * - --compress: zstd level for the trajectory (needs NBODY_WITH_ZSTD)
+ * - --ic: initial conditions: star, planets and debris (planetary,
+ *   default), a star and a debris disk (disk), a Plummer sphere (plummer)
+ *   or a uniform box (box) of --debris particles, or a CSV or snapshot
+ *   file (see loadInitialConditions)
+ * - --seed: seed of the parallel generators (default 5, the system the
+ *   viewer shows)
+ * - --metrics: log per-step phase times, interaction counters and tree
+ *   size to this file (CSV, or JSON lines for a .json name); needs a build
+ *   with NBODY_PROFILING
+ * - --metrics-every: log every N steps (default 10)
+ * - --diagnostics-every: measure the total energy every N steps (default
+ *   0, off) and report its relative drift (dE/E); Yoshida and RK2 take
+ *   one extra force evaluation on these steps
+ * - --energy-tolerance: halve dt whenever the energy changes by more than
+ *   this between two measurements (needs --diagnostics-every)
+ */
+
+#include "initial_conditions.h"
+#include "simulation.h"
+#include "force_kernels.h"
+#ifdef NBODY_OFFLOAD
+#include "device_solver.h"
+#endif
+#include "snapshot.h"
+#include "trajectory_writer.h"
+#include "profiler.h"
+#include <cstring>
+
+/**
+ * @brief Print command line usage
+ * @param prog Program name
+ */
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--steps N] [--time T] [--dt DT] [--debris N] [--threads N] "
+            "[--log-every N] [--tree pointer|linear] [--theta TH] [--target-error E] "
+            "[--leaf-capacity N] [--max-depth N] [--kernel NAME] [--passive-mass M] "
+            "[--multipole monopole|quadrupole] [--far-field double|float] "
+            "[--solver barnes-hut|fmm|device] [--fmm-order P] "
+            "[--fmm-theta TH] "
+            "[--integrator rk2|yoshida|hermite|block-hermite] [--eta ETA] [--max-level N] "
+            "[--checkpoint FILE] [--checkpoint-every N] [--restart FILE] "
+            "[--trajectory FILE] [--fields SPEC] [--subset primaries|N] "
+            "[--precision double|float] [--compress LEVEL] "
+            "[--ic planetary|disk|plummer|box|FILE] [--seed S] "
+            "[--metrics FILE] [--metrics-every N] "
+            "[--diagnostics-every N] [--energy-tolerance E]\n",
+            prog);
+}
+
+/**
+ * @brief Print a progress line
+ * @param sim Simulation being run
+ * @param wall Wall time since the start of the run (seconds)
+ * @param first_step Step count at the start of the run
+ */
+static void report(const Simulation &sim, double wall, long first_step) {
+    fprintf(stdout, "step %8ld  time %10.4f  particles %8zu  wall %9.3f s  %8.2f steps/s",
+            sim.getStepCount(), sim.getTime(),
+            sim.getParticles().size(), wall,
+            wall > 0 ? (sim.getStepCount() - first_step) / wall : 0.0);
+    if (sim.getConfig().adaptive_theta)
+        fprintf(stdout, "  theta %.4f  error %.2e", sim.getConfig().theta, sim.getForceError());
+    if (sim.getConfig().diagnostics_interval > 0)
+        fprintf(stdout, "  dE/E %+.3e  dt %g", sim.getEnergyDrift(), sim.getDt());
+    fprintf(stdout, "\n");
+    fflush(stdout);
+}
+
+/**
+ * @brief Entry point for headless runs
+ *
+ * @return 0 on success, 1 on bad arguments
+ */
+int main(int argc, char **argv) {
+    long nsteps = 100;
+    double t_end = -1;
+    double dt = 0.01;
+    int n_debris = 100000;
+    int threads = 0;
+    long log_every = 10;
+    tree_type tree = POINTER_TREE;
+    SolverConfig config;
+    const char *checkpoint = nullptr;
+    long checkpoint_every = 1000;
+    const char *restart = nullptr;
+    const char *trajectory = nullptr;
+    TrajectoryConfig output;
+    const char *ic = "planetary";
+    uint64_t seed = 5;
+    const char *metrics = nullptr;
+    long metrics_every = 10;
+    bool tree_set = false, integrator_set = false, dt_set = false, theta_set = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (!strcmp(argv[i], "--steps"))
+            nsteps = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--time"))
+            t_end = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--dt")) {
+            dt = atof(argv[++i]);
+            dt_set = true;
+        }
+        else if (!strcmp(argv[i], "--debris"))
+            n_debris = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads"))
+            threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--log-every"))
+            log_every = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--theta")) {
+            config.theta = atof(argv[++i]);
+            theta_set = true;
+        }
+        else if (!strcmp(argv[i], "--checkpoint"))
+            checkpoint = argv[++i];
+        else if (!strcmp(argv[i], "--checkpoint-every"))
+            checkpoint_every = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--restart"))
+            restart = argv[++i];
+        else if (!strcmp(argv[i], "--ic"))
+            ic = argv[++i];
+        else if (!strcmp(argv[i], "--seed"))
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--metrics"))
+            metrics = argv[++i];
+        else if (!strcmp(argv[i], "--metrics-every"))
+            metrics_every = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--trajectory"))
+            trajectory = argv[++i];
+        else if (!strcmp(argv[i], "--fields")) {
+            if (!parseTrajectoryFields(argv[++i], output)) {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--subset")) {
+            ++i;
+            if (!strcmp(argv[i], "primaries"))
+                output.primaries_only = true;
+            else
+                output.id_stride = atoi(argv[i]);
+        }
+        else if (!strcmp(argv[i], "--precision")) {
+            ++i;
+            if (!strcmp(argv[i], "float"))
+                output.float32 = true;
+            else if (!strcmp(argv[i], "double"))
+                output.float32 = false;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--compress"))
+            output.compression = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--target-error")) {
+            config.adaptive_theta = true;
+            config.target_error = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--leaf-capacity"))
+            config.leaf_capacity = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--max-depth"))
+            config.max_depth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--passive-mass"))
+            config.passive_mass = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--multipole")) {
+            ++i;
+            if (!strcmp(argv[i], "monopole"))
+                config.quadrupole = false;
+            else if (!strcmp(argv[i], "quadrupole"))
+                config.quadrupole = true;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--far-field")) {
+            ++i;
+            if (!strcmp(argv[i], "double"))
+                config.mixed_precision = false;
+            else if (!strcmp(argv[i], "float"))
+                config.mixed_precision = true;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--solver")) {
+            ++i;
+            if (!strcmp(argv[i], "barnes-hut"))
+                config.method = BARNES_HUT;
+            else if (!strcmp(argv[i], "fmm"))
+                config.method = FAST_MULTIPOLE;
+            else if (!strcmp(argv[i], "device")) {
+#ifdef NBODY_OFFLOAD
+                config.method = DEVICE_DIRECT;
+#else
+                fprintf(stderr, "Device solver not built (configure with -DNBODY_ENABLE_OFFLOAD=ON)\n");
+                return 1;
+#endif
+            }
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--fmm-order"))
+            config.fmm_order = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--fmm-theta"))
+            config.fmm_theta = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--diagnostics-every"))
+            config.diagnostics_interval = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--energy-tolerance"))
+            config.energy_tolerance = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--eta"))
+            config.timestep_eta = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--max-level"))
+            config.max_block_level = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--integrator")) {
+            ++i;
+            integrator_set = true;
+            if (!strcmp(argv[i], "rk2"))
+                TRANSPORT_TYPE = RK2;
+            else if (!strcmp(argv[i], "yoshida"))
+                TRANSPORT_TYPE = YOSHIDA;
+            else if (!strcmp(argv[i], "hermite"))
+                TRANSPORT_TYPE = HERMITE;
+            else if (!strcmp(argv[i], "block-hermite"))
+                TRANSPORT_TYPE = BLOCK_HERMITE;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--kernel")) {
+            ++i;
+            if (!setForceKernels(argv[i])) {
+                fprintf(stderr, "Force kernels '%s' not available on this CPU\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "--tree")) {
+            ++i;
+            tree_set = true;
+            if (!strcmp(argv[i], "pointer"))
+                tree = POINTER_TREE;
+            else if (!strcmp(argv[i], "linear"))
+                tree = LINEAR_TREE;
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (dt <= 0 || nsteps < 0 || n_debris < 0 || config.theta <= 0 || config.target_error <= 0 ||
+        config.leaf_capacity < 1 || config.max_depth < 1 || config.timestep_eta <= 0 ||
+        config.fmm_order < 2 || config.fmm_order > FMM_MAX_ORDER || config.fmm_theta <= 0 ||
+        config.max_block_level < 0 || config.max_block_level > BLOCK_MAX_LEVEL ||
+        checkpoint_every < 1 || output.id_stride < 1 || metrics_every < 1 ||
+        config.diagnostics_interval < 0 || config.energy_tolerance < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (threads > 0)
+        omp_set_num_threads(threads);
+
+    std::unique_ptr<Simulation> owned;
+    if (restart) {
+        transport_type integrator = TRANSPORT_TYPE;
+        owned = loadSnapshot(restart, config);
+        if (!owned)
+            return 1;
+        if (integrator_set)
+            TRANSPORT_TYPE = integrator;
+        if (dt_set)
+            owned->setDt(dt);
+        if (theta_set) {
+            SolverConfig adjusted = owned->getConfig();
+            adjusted.theta = config.theta;
+            owned->setConfig(adjusted);
+        }
+        if (!tree_set)
+            tree = owned->getTreeType();
+        dt = owned->getDt();
+    } else {
+        owned = std::make_unique<Simulation>(-250, -250, 500, 500, dt, config);
+        if (!createInitialConditions(*owned, ic, n_debris, seed))
+            return 1;
+    }
+    Simulation &sim = *owned;
+    if (tree != sim.getTreeType())
+        sim.setTreeType(tree);
+
+    char solver_label[64] = "";
+    if (sim.getConfig().method == FAST_MULTIPOLE)
+        snprintf(solver_label, sizeof(solver_label), ", fmm order %d theta %g",
+                 sim.getConfig().fmm_order, sim.getConfig().fmm_theta);
+#ifdef NBODY_OFFLOAD
+    if (sim.getConfig().method == DEVICE_DIRECT)
+        snprintf(solver_label, sizeof(solver_label), ", device direct sum%s",
+                 DeviceSolver::hasDevice() ? "" : " (host fallback)");
+#endif
+    fprintf(stdout,
+            "nbody_headless: %zu particles, dt = %g, %d threads, %s tree, theta = %g%s, "
+            "%s kernels%s%s%s%s\n",
+            sim.getParticles().size(), dt, omp_get_max_threads(),
+            tree == LINEAR_TREE ? "linear" : "pointer", sim.getConfig().theta,
+            config.adaptive_theta ? " (adaptive)" : "", forceKernels().name,
+            sim.getConfig().quadrupole ? ", quadrupoles" : "",
+            sim.getConfig().mixed_precision ? ", float far field" : "",
+            solver_label,
+            restart ? ", restarted" : "");
+
+    SnapshotWriter writer;
+    TrajectoryWriter stream;
+    if (trajectory) {
+        if (!stream.open(trajectory, output))
+            return 1;
+        stream.capture(sim);
+    }
+    MetricsLog metrics_log;
+    if (metrics && !metrics_log.open(metrics))
+        return 1;
+    double start = omp_get_wtime();
+    const long first_step = sim.getStepCount();
+    long target = t_end >= 0 ? -1 : nsteps;
+
+    // Report every log_every steps and checkpoint every checkpoint_every
+    while (target < 0 ? sim.getTime() + 0.5 * sim.getDt() < t_end : sim.getStepCount() < target) {
+        sim.step();
+        long done = sim.getStepCount();
+        stream.capture(sim);
+        if (metrics && done % metrics_every == 0 && lastStepMetrics())
+            metrics_log.write(*lastStepMetrics());
+        if (checkpoint && done % checkpoint_every == 0)
+            writer.write(sim, checkpoint);
+        if (log_every > 0 && done % log_every == 0)
+            report(sim, omp_get_wtime() - start, first_step);
+    }
+
+    if (log_every <= 0 || sim.getStepCount() % log_every != 0)
+        report(sim, omp_get_wtime() - start, first_step);
+    if (checkpoint && sim.getStepCount() % checkpoint_every != 0)
+        writer.write(sim, checkpoint);
+    if (!writer.wait() || !stream.close())
+        return 1;
+    return 0;
+}
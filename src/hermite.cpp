@@ -17,18 +17,17 @@
 #include "hermite.h"
 #include "barneshut.h"
 
-void getAccelerationAndJerk(std::vector<std::shared_ptr<Particle>> &particles,
-                           QuadTree<Particle> *tree)
+template <class Tree>
+void getAccelerationAndJerk(ParticleSet &particles, Tree *tree, const SolverConfig &config)
 {
-#pragma omp parallel for schedule(dynamic, CHUNK_SIZE)
-    for (int i = 0; i < static_cast<int>(particles.size()); i++)
-    {
-        particles[i]->acceleration.zero();
-        particles[i]->jerk.zero();
-        BarnesHutForceAndJerk(particles[i].get(), tree, 0.05);
-    }
+    computeForces(tree, storeTargets(particles, true), static_cast<int>(particles.size()),
+                  config.theta);
 }
 
+template void getAccelerationAndJerk(ParticleSet &, QuadTree<ParticleSet> *, const SolverConfig &);
+template void getAccelerationAndJerk(ParticleSet &, LinearQuadTree<ParticleSet> *,
+                                     const SolverConfig &);
+
 /**
  * @brief One timestep of Hermite 4th order integration
  *
@@ -40,95 +39,259 @@ void getAccelerationAndJerk(std::vector<std::shared_ptr<Particle>> &particles,
  * - v_p = v + a·dt + ½j·dt²
  *
  * **Stage 2 - Evaluator:**
- * Calculate forces at predicted positions
+ * Calculate forces at predicted positions, with the solver refitted to them
  *
  * **Stage 3 - Corrector:**
  * Update using average of old and new derivatives:
  * - v_new = v + ½(a₀+a₁)·dt + 1/12(j₀-j₁)·dt²
  * - x_new = x + ½(v₀+v₁)·dt + 1/12(a₀-a₁)·dt²
  *
- * @param particles Particle array to integrate
- * @param tree QuadTree for force calculation
+ * @param particles Particle store to integrate
+ * @param solver Force solver
  * @param dt Timestep size
  *
  * @note Requires particles to have jerk initialized from previous step
  * @note Thread-safe with OpenMP parallelization
  * @note Cost: ~2 force evaluations (predictor + corrector)
  */
-void hermiteStep(std::vector<std::shared_ptr<Particle>> &particles,
-                QuadTree<Particle> *tree, double dt)
+template <ForceSolver Solver> void hermiteStep(ParticleSet &particles, Solver &solver, double dt)
 {
+    const int n = static_cast<int>(particles.size());
+
     // PREDICTOR: Predict positions and velocities at t + dt
-#pragma omp parallel for schedule(dynamic, CHUNK_SIZE)
-    for (int i = 0; i < static_cast<int>(particles.size()); i++)
+    // x_pred = x + v*dt + (1/2)*a*dt² + (1/6)*jerk*dt³
+    // v_pred = v + a*dt + (1/2)*jerk*dt²
+    const double dt2 = 0.5 * dt * dt;
+    const double dt3 = dt * dt * dt / 6.0;
+#pragma omp parallel for simd schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++)
     {
-        auto &p = particles[i];
-
-        // 4th order predictor
-        // x_pred = x + v*dt + (1/2)*a*dt² + (1/6)*jerk*dt³
-        // v_pred = v + a*dt + (1/2)*jerk*dt²
+        particles.x_pred[i] = particles.x[i] + particles.vx[i] * dt +
+                              particles.ax[i] * dt2 + particles.jx[i] * dt3;
+        particles.y_pred[i] = particles.y[i] + particles.vy[i] * dt +
+                              particles.ay[i] * dt2 + particles.jy[i] * dt3;
 
-        p->position_pred = p->position +
-                          p->velocity * dt +
-                          p->acceleration * (0.5 * dt * dt) +
-                          p->jerk * (dt * dt * dt / 6.0);
-
-        p->velocity_pred = p->velocity +
-                          p->acceleration * dt +
-                          p->jerk * (0.5 * dt * dt);
+        particles.vx_pred[i] = particles.vx[i] + particles.ax[i] * dt + particles.jx[i] * dt2;
+        particles.vy_pred[i] = particles.vy[i] + particles.ay[i] * dt + particles.jy[i] * dt2;
     }
 
     // EVALUATOR: Calculate forces and jerks at predicted positions
-    // Temporarily swap positions for force calculation
-#pragma omp parallel for schedule(dynamic, CHUNK_SIZE)
-    for (int i = 0; i < static_cast<int>(particles.size()); i++)
+    // Swap the predicted arrays in so the solver sees them as sources
+    std::swap(particles.x, particles.x_pred);
+    std::swap(particles.y, particles.y_pred);
+    std::swap(particles.vx, particles.vx_pred);
+    std::swap(particles.vy, particles.vy_pred);
+    solver.refit();
+
+    // Store old acceleration and jerk
+    std::vector<double> a0x(particles.ax), a0y(particles.ay);
+    std::vector<double> j0x(particles.jx), j0y(particles.jy);
+
+    // Calculate new accelerations and jerks at predicted positions
+    solver.accelerationsAndJerks(particles);
+
+    // Swap back to get original positions/velocities
+    std::swap(particles.x, particles.x_pred);
+    std::swap(particles.y, particles.y_pred);
+    std::swap(particles.vx, particles.vx_pred);
+    std::swap(particles.vy, particles.vy_pred);
+
+    // CORRECTOR: Correct positions and velocities using improved estimates
+    // v_new = v_old + (a0 + a1)*dt/2 + (jerk0 - jerk1)*dt²/12
+    // x_new = x_old + (v_old + v_new)*dt/2 + (a0 - a1)*dt²/12
+    const double dt12 = dt * dt / 12.0;
+#pragma omp parallel for simd schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++)
     {
-        auto &p = particles[i];
-        std::swap(p->position, p->position_pred);
-        std::swap(p->velocity, p->velocity_pred);
+        double vx_old = particles.vx[i];
+        double vy_old = particles.vy[i];
+
+        particles.vx[i] = vx_old + (a0x[i] + particles.ax[i]) * (0.5 * dt) +
+                          (j0x[i] - particles.jx[i]) * dt12;
+        particles.vy[i] = vy_old + (a0y[i] + particles.ay[i]) * (0.5 * dt) +
+                          (j0y[i] - particles.jy[i]) * dt12;
+
+        particles.x[i] += (vx_old + particles.vx[i]) * (0.5 * dt) +
+                          (a0x[i] - particles.ax[i]) * dt12;
+        particles.y[i] += (vy_old + particles.vy[i]) * (0.5 * dt) +
+                          (a0y[i] - particles.ay[i]) * dt12;
     }
+}
 
-    // Store old acceleration and jerk
-    std::vector<vector2D> old_acc(particles.size());
-    std::vector<vector2D> old_jerk(particles.size());
+template void hermiteStep(ParticleSet &, TreeSolver<QuadTree<ParticleSet>> &, double);
+template void hermiteStep(ParticleSet &, TreeSolver<LinearQuadTree<ParticleSet>> &, double);
+template void hermiteStep(ParticleSet &, DirectSolver &, double);
+template void hermiteStep(ParticleSet &, FmmSolver<QuadTree<ParticleSet>> &, double);
+template void hermiteStep(ParticleSet &, FmmSolver<LinearQuadTree<ParticleSet>> &, double);
+#ifdef NBODY_OFFLOAD
+template void hermiteStep(ParticleSet &, DeviceSolver &, double);
+#endif
+#ifdef NBODY_MPI
+template void hermiteStep(ParticleSet &, DistributedSolver &, double);
+#endif
 
-#pragma omp parallel for schedule(static, CHUNK_SIZE)
-    for (int i = 0; i < static_cast<int>(particles.size()); i++)
+/**
+ * @brief Block level whose step satisfies the timestep criterion
+ *
+ * @param ax Acceleration x
+ * @param ay Acceleration y
+ * @param jx Jerk x
+ * @param jy Jerk y
+ * @param dt Step at level 0
+ * @param eta Accuracy parameter (SolverConfig::timestep_eta)
+ * @param max_level Deepest level to return
+ * @return Smallest level with dt/2^level <= eta*|a|/|jerk|
+ */
+static int blockLevel(double ax, double ay, double jx, double jy, double dt, double eta,
+                      int max_level)
+{
+    const double a = std::hypot(ax, ay);
+    const double j = std::hypot(jx, jy);
+    if (!(j > 0))
+        return 0;
+    const double step = eta * a / j;
+    if (step >= dt)
+        return 0;
+    if (!(step > 0))
+        return max_level;
+    return std::min(static_cast<int>(std::ceil(std::log2(dt / step))), max_level);
+}
+
+/**
+ * @brief One synchronization step of block timestep Hermite integration
+ *
+ * @details Time within the step is counted in integer ticks of
+ * dt/2^max_level, so block times and step ends compare exactly. A particle
+ * at level L advances by 2^(max_level - L) ticks per step.
+ */
+template <ForceSolver Solver>
+void blockHermiteStep(ParticleSet &particles, Solver &solver, double dt, const SolverConfig &config)
+{
+    const int n = static_cast<int>(particles.size());
+    const int max_level = std::clamp(config.max_block_level, 0, BLOCK_MAX_LEVEL);
+    const int64_t ticks = int64_t(1) << max_level;
+    const double tick = dt / static_cast<double>(ticks);
+
+    std::vector<uint8_t> active(n);
+    std::vector<int64_t> t_last(n, 0);
+    ForceTargets targets = storeTargets(particles, true);
+    targets.active = active.data();
+
+    // Particles without force history start from forces at the current state
+    int fresh = 0;
+#pragma omp parallel for schedule(static, CHUNK_SIZE) reduction(+ : fresh)
+    for (int i = 0; i < n; i++)
     {
-        old_acc[i] = particles[i]->acceleration;
-        old_jerk[i] = particles[i]->jerk;
+        active[i] = particles.ax[i] == 0 && particles.ay[i] == 0 &&
+                    particles.jx[i] == 0 && particles.jy[i] == 0;
+        fresh += active[i];
     }
+    if (fresh > 0)
+        solver.forces(targets, n);
 
-    // Calculate new accelerations and jerks at predicted positions
-    getAccelerationAndJerk(particles, tree);
+#pragma omp parallel for schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++)
+    {
+        int level = active[i] ? blockLevel(particles.ax[i], particles.ay[i], particles.jx[i],
+                                           particles.jy[i], dt, config.timestep_eta, max_level)
+                              : particles.level[i];
+        particles.level[i] = static_cast<uint8_t>(std::min(level, max_level));
+    }
 
-    // CORRECTOR: Correct positions and velocities using improved estimates
-#pragma omp parallel for schedule(dynamic, CHUNK_SIZE)
-    for (int i = 0; i < static_cast<int>(particles.size()); i++)
+    std::vector<double> a0x(n), a0y(n), j0x(n), j0y(n);
+    int64_t now = 0;
+    while (now < ticks)
     {
-        auto &p = particles[i];
+        // Next block time: the earliest end of any particle's step
+        int64_t next = ticks;
+#pragma omp parallel for schedule(static, CHUNK_SIZE) reduction(min : next)
+        for (int i = 0; i < n; i++)
+            next = std::min(next, t_last[i] + (ticks >> particles.level[i]));
+
+        // PREDICTOR: every particle to the block time, as sources and targets
+#pragma omp parallel for simd schedule(static, CHUNK_SIZE)
+        for (int i = 0; i < n; i++)
+        {
+            const double d = static_cast<double>(next - t_last[i]) * tick;
+            const double d2 = 0.5 * d * d;
+            const double d3 = d * d * d / 6.0;
+            particles.x_pred[i] = particles.x[i] + particles.vx[i] * d +
+                                  particles.ax[i] * d2 + particles.jx[i] * d3;
+            particles.y_pred[i] = particles.y[i] + particles.vy[i] * d +
+                                  particles.ay[i] * d2 + particles.jy[i] * d3;
+            particles.vx_pred[i] = particles.vx[i] + particles.ax[i] * d + particles.jx[i] * d2;
+            particles.vy_pred[i] = particles.vy[i] + particles.ay[i] * d + particles.jy[i] * d2;
 
-        vector2D a0 = old_acc[i];
-        vector2D a1 = p->acceleration;
-        vector2D jerk0 = old_jerk[i];
-        vector2D jerk1 = p->jerk;
+            a0x[i] = particles.ax[i];
+            a0y[i] = particles.ay[i];
+            j0x[i] = particles.jx[i];
+            j0y[i] = particles.jy[i];
+            active[i] = t_last[i] + (ticks >> particles.level[i]) == next;
+        }
 
-        // Swap back to get original positions/velocities
-        std::swap(p->position, p->position_pred);
-        std::swap(p->velocity, p->velocity_pred);
+        // EVALUATOR: forces on the active particles at the predicted state
+        std::swap(particles.x, particles.x_pred);
+        std::swap(particles.y, particles.y_pred);
+        std::swap(particles.vx, particles.vx_pred);
+        std::swap(particles.vy, particles.vy_pred);
+        solver.refit();
+        targets = storeTargets(particles, true);
+        targets.active = active.data();
+        solver.forces(targets, n);
+        std::swap(particles.x, particles.x_pred);
+        std::swap(particles.y, particles.y_pred);
+        std::swap(particles.vx, particles.vx_pred);
+        std::swap(particles.vy, particles.vy_pred);
 
-        // 4th order corrector using both old and new derivatives
-        // v_new = v_old + (a0 + a1)*dt/2 + (jerk0 - jerk1)*dt²/12
-        // x_new = x_old + (v_old + v_new)*dt/2 + (a0 - a1)*dt²/12
+        // CORRECTOR: active particles over their own step, then a new level
+#pragma omp parallel for schedule(static, CHUNK_SIZE)
+        for (int i = 0; i < n; i++)
+        {
+            if (!active[i])
+                continue;
+            const double d = static_cast<double>(next - t_last[i]) * tick;
+            const double d12 = d * d / 12.0;
+            const double vx_old = particles.vx[i];
+            const double vy_old = particles.vy[i];
 
-        vector2D v_old = p->velocity;
+            particles.vx[i] = vx_old + (a0x[i] + particles.ax[i]) * (0.5 * d) +
+                              (j0x[i] - particles.jx[i]) * d12;
+            particles.vy[i] = vy_old + (a0y[i] + particles.ay[i]) * (0.5 * d) +
+                              (j0y[i] - particles.jy[i]) * d12;
+            particles.x[i] += (vx_old + particles.vx[i]) * (0.5 * d) +
+                              (a0x[i] - particles.ax[i]) * d12;
+            particles.y[i] += (vy_old + particles.vy[i]) * (0.5 * d) +
+                              (a0y[i] - particles.ay[i]) * d12;
+            t_last[i] = next;
 
-        p->velocity = v_old +
-                     (a0 + a1) * (0.5 * dt) +
-                     (jerk0 - jerk1) * (dt * dt / 12.0);
+            // Shorter steps are taken at once; longer ones one level at a
+            // time and only where the longer step starts on a block boundary
+            const int level = particles.level[i];
+            const int wanted = blockLevel(particles.ax[i], particles.ay[i], particles.jx[i],
+                                          particles.jy[i], dt, config.timestep_eta, max_level);
+            if (wanted > level)
+                particles.level[i] = static_cast<uint8_t>(wanted);
+            else if (wanted < level && next % (ticks >> (level - 1)) == 0)
+                particles.level[i] = static_cast<uint8_t>(level - 1);
+        }
 
-        p->position = p->position +
-                     (v_old + p->velocity) * (0.5 * dt) +
-                     (a0 - a1) * (dt * dt / 12.0);
+        now = next;
     }
 }
+
+template void blockHermiteStep(ParticleSet &, TreeSolver<QuadTree<ParticleSet>> &, double,
+                               const SolverConfig &);
+template void blockHermiteStep(ParticleSet &, TreeSolver<LinearQuadTree<ParticleSet>> &, double,
+                               const SolverConfig &);
+template void blockHermiteStep(ParticleSet &, DirectSolver &, double, const SolverConfig &);
+template void blockHermiteStep(ParticleSet &, FmmSolver<QuadTree<ParticleSet>> &, double,
+                               const SolverConfig &);
+template void blockHermiteStep(ParticleSet &, FmmSolver<LinearQuadTree<ParticleSet>> &, double,
+                               const SolverConfig &);
+#ifdef NBODY_OFFLOAD
+template void blockHermiteStep(ParticleSet &, DeviceSolver &, double, const SolverConfig &);
+#endif
+#ifdef NBODY_MPI
+template void blockHermiteStep(ParticleSet &, DistributedSolver &, double,
+                               const SolverConfig &);
+#endif
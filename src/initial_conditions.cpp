@@ -0,0 +1,327 @@
+/**
+ * @file initial_conditions.cpp
+ * @brief Implementation of the built-in initial conditions
+ */
+
+#include "initial_conditions.h"
+#include "philox.h"
+#include "snapshot.h"
+#include <cstring>
+#include <string>
+
+/// @name Random streams of the generators (CounterRNG stream numbers)
+/// @{
+#define STREAM_PLANETS 0
+#define STREAM_DISK 1
+#define STREAM_PLUMMER 2
+#define STREAM_BOX 3
+/// @}
+
+/**
+ * @brief First unused particle ID
+ * @param particles Particle store
+ * @return One past the largest ID in the store (0 if empty)
+ */
+static int nextId(const ParticleSet &particles) {
+    if (particles.empty())
+        return 0;
+    return *std::max_element(particles.id.begin(), particles.id.end()) + 1;
+}
+
+/**
+ * @brief Append particles and fill them in parallel
+ *
+ * @param particles Store to append to
+ * @param count Number of particles
+ * @param fill Callable (slot, id) writing the new particle's fields; the
+ *             other fields are zero
+ * @return Slot index of the first new particle
+ */
+template <class F> static int appendParallel(ParticleSet &particles, int count, F &&fill) {
+    const int first = static_cast<int>(particles.size());
+    const int first_id = nextId(particles);
+    particles.resize(first + std::max(count, 0));
+
+#pragma omp parallel for schedule(static, CHUNK_SIZE)
+    for (int k = 0; k < count; k++) {
+        particles.id[first + k] = first_id + k;
+        fill(first + k, first_id + k);
+    }
+    return first;
+}
+
+int generateKeplerDisk(ParticleSet &particles, const KeplerDisk &disk, uint64_t seed) {
+    const CounterRNG rng(seed, STREAM_DISK);
+    const uint8_t flags = (disk.passive ? PARTICLE_PASSIVE : 0) | (disk.primary ? PARTICLE_PRIMARY : 0);
+    return appendParallel(particles, disk.count, [&](int i, int id) {
+        std::array<double, 2> u = rng.uniform2(id, 0);
+        double dist = disk.r_min + u[0] * (disk.r_max - disk.r_min);
+        double angle = u[1] * 2 * M_PI;
+        particles.x[i] = dist * cos(angle);
+        particles.y[i] = dist * sin(angle);
+
+        // Circular orbit velocity
+        double speed = sqrt(GRAV_G * disk.central_mass / dist);
+        particles.vx[i] = -sin(angle) * speed;
+        particles.vy[i] = cos(angle) * speed;
+        particles.mass[i] = disk.mass;
+        particles.radius[i] = disk.radius;
+        particles.flags[i] = flags;
+    });
+}
+
+int generatePlummerSphere(ParticleSet &particles, const PlummerSphere &cluster, uint64_t seed) {
+    const CounterRNG rng(seed, STREAM_PLUMMER);
+    const double a = cluster.scale;
+    const double c = cluster.cutoff;
+    const double enclosed_max = c * c * c / std::pow(1 + c * c, 1.5); // Mass fraction inside the cutoff
+    return appendParallel(particles, cluster.count, [&](int i, int id) {
+        // Radius from the cumulative mass M(r)/M = r³ / (r² + a²)^(3/2)
+        std::array<double, 2> u = rng.uniform2(id, 0);
+        double m = u[0] * enclosed_max;
+        double r = m > 0 ? a / sqrt(std::pow(m, -2.0 / 3.0) - 1) : 0;
+        double cos_theta = 2 * u[1] - 1;
+        u = rng.uniform2(id, 1);
+        double phi = 2 * M_PI * u[0];
+        double sin_theta = sqrt(std::max(0.0, 1 - cos_theta * cos_theta));
+        particles.x[i] = r * sin_theta * cos(phi);
+        particles.y[i] = r * sin_theta * sin(phi);
+
+        // Speed q*v_esc with q drawn from q²(1-q²)^(7/2) by rejection
+        double q = 0;
+        for (uint32_t draw = 3;; draw++) {
+            std::array<double, 2> w = rng.uniform2(id, draw);
+            if (0.1 * w[1] < w[0] * w[0] * std::pow(1 - w[0] * w[0], 3.5)) {
+                q = w[0];
+                break;
+            }
+        }
+        double speed = q * sqrt(2 * GRAV_G * cluster.total_mass) * std::pow(r * r + a * a, -0.25);
+        double cos_vtheta = 2 * u[1] - 1;
+        double vphi = 2 * M_PI * rng.uniform2(id, 2)[0];
+        double sin_vtheta = sqrt(std::max(0.0, 1 - cos_vtheta * cos_vtheta));
+        particles.vx[i] = speed * sin_vtheta * cos(vphi);
+        particles.vy[i] = speed * sin_vtheta * sin(vphi);
+        particles.mass[i] = cluster.total_mass / cluster.count;
+        particles.radius[i] = cluster.radius;
+    });
+}
+
+int generateUniformBox(ParticleSet &particles, const UniformBox &box, uint64_t seed) {
+    const CounterRNG rng(seed, STREAM_BOX);
+    const uint8_t flags = box.passive ? PARTICLE_PASSIVE : 0;
+    return appendParallel(particles, box.count, [&](int i, int id) {
+        std::array<double, 2> u = rng.uniform2(id, 0);
+        particles.x[i] = box.xmin + u[0] * box.width;
+        particles.y[i] = box.ymin + u[1] * box.height;
+        u = rng.uniform2(id, 1);
+        particles.vx[i] = (2 * u[0] - 1) * box.speed;
+        particles.vy[i] = (2 * u[1] - 1) * box.speed;
+        particles.mass[i] = box.mass;
+        particles.radius[i] = box.radius;
+        particles.flags[i] = flags;
+    });
+}
+
+void createPlanetarySystem(Simulation &sim, int n_debris, uint64_t seed)
+{
+    ParticleSet &particles = sim.getParticles();
+    const CounterRNG rng(seed, STREAM_PLANETS);
+
+    // Central star
+    Particle star(0, 0, 0, 0, nextId(particles), PRIMARY_PARTICLE);
+    star.mass = 1;
+    star.radius = 0.005;
+    particles.add(star);
+
+    // 5 planets in circular Keplerian orbits
+    for (int i = 0; i < 5; i++)
+    {
+        const int id = nextId(particles);
+        std::array<double, 2> u = rng.uniform2(id, 0);
+        double dist = u[0] * 5.5 + 0.5;   // Radius [0.5, 6]
+        double angle = u[1] * 2 * M_PI;
+        double speed = sqrt(GRAV_G * star.mass / dist);
+
+        Particle planet(dist * cos(angle), dist * sin(angle), -sin(angle) * speed,
+                        cos(angle) * speed, id, PRIMARY_PARTICLE);
+        planet.mass = rng.uniform2(id, 1)[0] * 0.001;  // Mass [0, 0.001]
+        planet.radius = 0.0005;
+        particles.add(planet);
+    }
+
+    // Debris disk
+    KeplerDisk debris;
+    debris.count = n_debris;
+    debris.central_mass = star.mass;
+    generateKeplerDisk(particles, debris, seed);
+
+    sim.rebuildTree();
+}
+
+/// @brief Columns understood by loadParticlesCSV
+enum csv_column { CSV_X, CSV_Y, CSV_VX, CSV_VY, CSV_MASS, CSV_RADIUS, CSV_ID, CSV_PRIMARY, CSV_PASSIVE,
+                  CSV_IGNORED };
+
+/// @brief Header names of the csv_column values, in enum order
+static const char *const CSV_NAMES[CSV_IGNORED] = {"x", "y", "vx", "vy", "mass", "radius", "id",
+                                                   "primary", "passive"};
+
+bool loadParticlesCSV(const char *path, ParticleSet &particles) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Cannot read initial conditions %s\n", path);
+        return false;
+    }
+    std::string text;
+    char block[1 << 16];
+    for (std::size_t got; (got = fread(block, 1, sizeof(block), file)) > 0;)
+        text.append(block, got);
+    fclose(file);
+
+    // Line extents, skipping blank lines and comments
+    std::vector<std::pair<std::size_t, std::size_t>> lines;
+    for (std::size_t begin = 0; begin < text.size();) {
+        std::size_t end = text.find('\n', begin);
+        if (end == std::string::npos)
+            end = text.size();
+        std::size_t stop = end;
+        while (stop > begin && (text[stop - 1] == '\r' || text[stop - 1] == ' '))
+            stop--;
+        if (stop > begin && text[begin] != '#')
+            lines.emplace_back(begin, stop);
+        begin = end + 1;
+    }
+    if (lines.empty()) {
+        fprintf(stderr, "%s: no CSV header\n", path);
+        return false;
+    }
+
+    // Header: map every column to a field
+    std::vector<csv_column> columns;
+    bool present[CSV_IGNORED] = {false};
+    for (std::size_t begin = lines[0].first; begin <= lines[0].second;) {
+        std::size_t end = std::min(text.find(',', begin), lines[0].second);
+        std::size_t a = begin, b = end;
+        while (a < b && text[a] == ' ')
+            a++;
+        while (b > a && text[b - 1] == ' ')
+            b--;
+        csv_column column = CSV_IGNORED;
+        for (int k = 0; k < CSV_IGNORED; k++) {
+            if (text.compare(a, b - a, CSV_NAMES[k]) == 0)
+                column = static_cast<csv_column>(k);
+        }
+        if (column != CSV_IGNORED)
+            present[column] = true;
+        columns.push_back(column);
+        begin = end + 1;
+    }
+    for (int k = CSV_X; k <= CSV_MASS; k++) {
+        if (!present[k]) {
+            fprintf(stderr, "%s: missing CSV column '%s'\n", path, CSV_NAMES[k]);
+            return false;
+        }
+    }
+
+    const int count = static_cast<int>(lines.size()) - 1;
+    const int first = static_cast<int>(particles.size());
+    const int first_id = nextId(particles);
+    particles.resize(first + count);
+    int bad_row = count;
+
+#pragma omp parallel for schedule(static, CHUNK_SIZE) reduction(min : bad_row)
+    for (int row = 0; row < count; row++) {
+        const int i = first + row;
+        const char *p = text.c_str() + lines[row + 1].first;
+        const char *line_end = text.c_str() + lines[row + 1].second;
+        double value[CSV_IGNORED] = {0};
+        bool ok = true;
+        for (std::size_t k = 0; k < columns.size() && ok; k++) {
+            if (columns[k] == CSV_IGNORED) {
+                // Unknown columns may hold anything but commas
+                const char *comma = static_cast<const char *>(memchr(p, ',', line_end - p));
+                ok = (comma != nullptr) == (k + 1 < columns.size());
+                p = comma ? comma + 1 : line_end;
+                continue;
+            }
+            char *end;
+            double v = strtod(p, &end);
+            while (end < line_end && *end == ' ')
+                end++;
+            // An empty field would make strtod skip ahead into the next line
+            ok = end > p && end <= line_end && (k + 1 < columns.size() ? *end == ',' : end == line_end);
+            value[columns[k]] = v;
+            p = end + 1;
+        }
+        if (!ok) {
+            bad_row = std::min(bad_row, row);
+            continue;
+        }
+        particles.x[i] = value[CSV_X];
+        particles.y[i] = value[CSV_Y];
+        particles.vx[i] = value[CSV_VX];
+        particles.vy[i] = value[CSV_VY];
+        particles.mass[i] = value[CSV_MASS];
+        particles.radius[i] = value[CSV_RADIUS];
+        particles.id[i] = present[CSV_ID] ? static_cast<int>(value[CSV_ID]) : first_id + row;
+        particles.flags[i] = (value[CSV_PRIMARY] != 0 ? PARTICLE_PRIMARY : 0) |
+                             (value[CSV_PASSIVE] != 0 ? PARTICLE_PASSIVE : 0);
+    }
+
+    if (bad_row < count) {
+        fprintf(stderr, "%s: malformed CSV row %d\n", path, bad_row + 1);
+        particles.resize(first);
+        return false;
+    }
+    return true;
+}
+
+bool loadInitialConditions(Simulation &sim, const char *path) {
+    char magic[8] = {0};
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Cannot read initial conditions %s\n", path);
+        return false;
+    }
+    const bool snapshot = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+                          std::memcmp(magic, "NBODYSNP", sizeof(magic)) == 0;
+    fclose(file);
+
+    SnapshotHeader header;
+    if (snapshot ? !readSnapshotParticles(path, sim.getParticles(), header)
+                 : !loadParticlesCSV(path, sim.getParticles()))
+        return false;
+    sim.rebuildTree();
+    return true;
+}
+
+bool createInitialConditions(Simulation &sim, const char *ic, int count, uint64_t seed) {
+    ParticleSet &particles = sim.getParticles();
+    if (!strcmp(ic, "planetary")) {
+        createPlanetarySystem(sim, count, seed);
+        return true;
+    }
+    if (!strcmp(ic, "disk")) {
+        Particle star(0, 0, 0, 0, nextId(particles), PRIMARY_PARTICLE);
+        star.mass = 1;
+        star.radius = 0.005;
+        particles.add(star);
+        KeplerDisk disk;
+        disk.count = count;
+        generateKeplerDisk(particles, disk, seed);
+    } else if (!strcmp(ic, "plummer")) {
+        PlummerSphere cluster;
+        cluster.count = count;
+        generatePlummerSphere(particles, cluster, seed);
+    } else if (!strcmp(ic, "box")) {
+        UniformBox box;
+        box.count = count;
+        box.mass = 1.0 / std::max(count, 1);
+        generateUniformBox(particles, box, seed);
+    } else {
+        return loadInitialConditions(sim, ic);
+    }
+    sim.rebuildTree();
+    return true;
+}
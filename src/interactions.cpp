@@ -3,55 +3,92 @@
  * @brief Implementation of particle interactions and collision handling
  */
 
-#include "RK2.h"
-#include "hermite.h"
 #include "interactions.h"
-#include "yoshida.h"
+#include "profiler.h"
+#include "collision_grid.h"
 
 /// @brief Selected integrator (default: Hermite 4th order)
 transport_type TRANSPORT_TYPE = transport_type::HERMITE;
 
 /**
- * @brief Main particle update: integrate and handle collisions
+ * @brief One integration timestep that leaves the end-of-step potential in particles.pot
+ *
+ * @details The Hermite integrators end on an evaluation at the end of the
+ * step, every particle active, so the potential is written along with it.
+ * The others get one more evaluation at the final positions.
  */
-void updateParticles(std::vector<std::shared_ptr<Particle>> &particles, QuadTree<Particle> *tree,
-                     double dt) {
-    transportStep(particles, tree, dt);
-
-    checkCollisions(particles, tree, dt);
+template <ForceSolver Solver>
+static void transportWithPotential(ParticleSet &particles, Solver &solver, double dt,
+                                   const SolverConfig &config, bool with_potential) {
+    const bool fused = TRANSPORT_TYPE == HERMITE || TRANSPORT_TYPE == BLOCK_HERMITE;
+    particles.with_potential = with_potential && fused;
+    transportStep(particles, solver, dt, config);
+    if (with_potential && !fused) {
+        particles.with_potential = true;
+        solver.refit();
+        solver.accelerations(particles);
+    }
+    particles.with_potential = false;
+}
 
-    double total_mass = 0, com_x = 0, com_y = 0;
-#pragma omp parallel for reduction(+ : com_x, com_y, total_mass) schedule(static, CHUNK_SIZE)
-    for (int i = 0; i < static_cast<int>(particles.size()); i++) {
-        if (tree->bounds.contains(particles[i]->position)) {
-            com_x += particles[i]->position.x * particles[i]->mass;
-            com_y += particles[i]->position.y * particles[i]->mass;
-            total_mass += particles[i]->mass;
+/**
+ * @brief Main particle update: integrate and handle collisions
+ */
+template <class Tree>
+Diagnostics updateParticles(ParticleSet &particles, Tree *tree, double dt,
+                            const SolverConfig &config, bool with_potential) {
+    {
+        NBODY_PROFILE_PHASE(PHASE_TRANSPORT);
+        if (config.method == FAST_MULTIPOLE) {
+            FmmSolver<Tree> solver(tree);
+            transportWithPotential(particles, solver, dt, config, with_potential);
+#ifdef NBODY_OFFLOAD
+        } else if (config.method == DEVICE_DIRECT) {
+            DeviceSolver solver(&particles, config.passive_mass);
+            transportWithPotential(particles, solver, dt, config, with_potential);
+#endif
+        } else {
+            TreeSolver<Tree> solver(tree, config.theta);
+            transportWithPotential(particles, solver, dt, config, with_potential);
         }
     }
 
-    com_x /= total_mass;
-    com_y /= total_mass;
+    {
+        NBODY_PROFILE_PHASE(PHASE_COLLISIONS);
+        checkCollisions(particles, tree, dt);
+    }
+
+    NBODY_PROFILE_PHASE(PHASE_RECENTER);
+    const Diagnostics diagnostics =
+        measureDiagnostics(particles, tree->bounds, config.passive_mass, with_potential);
 
-    vector2D new_com = {com_x, com_y};
-#pragma omp parallel for schedule(static, CHUNK_SIZE)
-    for (auto &particle : particles) {
-        particle->position -= new_com;
+#pragma omp parallel for simd schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < static_cast<int>(particles.size()); i++) {
+        particles.x[i] -= diagnostics.com_x;
+        particles.y[i] -= diagnostics.com_y;
     }
+    return diagnostics;
 }
 
 /**
  * @brief Dispatch to selected integrator
  */
-void transportStep(std::vector<std::shared_ptr<Particle>> &particles, QuadTree<Particle> *tree,
-                   double dt) {
-    if (TRANSPORT_TYPE == YOSHIDA) {
-        yoshidaStep(particles, tree, dt);
-    } else if (TRANSPORT_TYPE == RK2) {
-        RK2step(particles, tree, dt);
-    } else if (TRANSPORT_TYPE == HERMITE) {
-        hermiteStep(particles, tree, dt);
-    } else {
+template <ForceSolver Solver>
+void transportStep(ParticleSet &particles, Solver &solver, double dt, const SolverConfig &config) {
+    switch (TRANSPORT_TYPE) {
+    case YOSHIDA:
+        integrate<YOSHIDA>(particles, solver, dt, config);
+        break;
+    case RK2:
+        integrate<RK2>(particles, solver, dt, config);
+        break;
+    case HERMITE:
+        integrate<HERMITE>(particles, solver, dt, config);
+        break;
+    case BLOCK_HERMITE:
+        integrate<BLOCK_HERMITE>(particles, solver, dt, config);
+        break;
+    default:
         fprintf(stderr, "%d not a valid transport type\n", TRANSPORT_TYPE);
         exit(1);
     }
@@ -77,139 +114,294 @@ vector2D calcMutualAcceleration(const Particle *p1, const Particle *p2) {
     return diff * scale;
 }
 
+/**
+ * @brief Evaluate a polynomial with Horner's scheme
+ *
+ * @param c Coefficients, constant term first
+ * @param degree Polynomial degree
+ * @param t Argument
+ * @return c[0] + c[1]*t + ... + c[degree]*t^degree
+ */
+static double horner(const double *c, int degree, double t) {
+    double result = c[degree];
+    for (int k = degree - 1; k >= 0; k--)
+        result = result * t + c[k];
+    return result;
+}
+
+/**
+ * @brief Root of a polynomial that is monotonic on a bracketing interval
+ *
+ * @details Newton steps, falling back to bisection whenever a step would
+ * leave the bracket, so convergence is guaranteed and usually quadratic.
+ *
+ * @param c Coefficients, constant term first
+ * @param dc Coefficients of the derivative
+ * @param degree Degree of c
+ * @param lo Interval start
+ * @param hi Interval end (c(lo) and c(hi) of opposite signs)
+ * @return Root in [lo, hi]
+ */
+static double bracketedRoot(const double *c, const double *dc, int degree, double lo, double hi) {
+    const bool rising = horner(c, degree, lo) < 0;
+    const double tolerance = 1e-14 * std::max(std::abs(lo), std::abs(hi));
+    double t = 0.5 * (lo + hi);
+    for (int iter = 0; iter < 64 && hi - lo > tolerance; iter++) {
+        const double f = horner(c, degree, t);
+        if (f == 0)
+            return t;
+        if ((f < 0) == rising)
+            lo = t;
+        else
+            hi = t;
+        const double df = horner(dc, degree - 1, t);
+        const double next = df != 0 ? t - f / df : lo;
+        t = (next > lo && next < hi) ? next : 0.5 * (lo + hi);
+    }
+    return t;
+}
+
 // Continuous collision detection with gravitational effects
 // Uses quadratic trajectory approximation: pos(t) = p0 + v0*t + 0.5*a*t²
 CollisionInfo predictCollision(const Particle *p1, const Particle *p2, double dt) {
     CollisionInfo info;
+    info.willCollide = false;
+    info.collisionTime = dt;
 
     vector2D relPos = p1->position - p2->position;
     vector2D relVel = p1->velocity - p2->velocity;
 
-    // Calculate relative acceleration (includes gravity)
-    vector2D relAcc = calcMutualAcceleration(p1, p2);
-
     double collisionRadius = p1->radius + p2->radius;
+    double radius2 = collisionRadius * collisionRadius;
 
     // For very close particles, use simple distance check with current acceleration
-    double currentDist = relPos.norm();
-    if (currentDist < collisionRadius * 1.1) {
+    double currentDist2 = relPos.x * relPos.x + relPos.y * relPos.y;
+    if (currentDist2 < 1.21 * radius2) {
         info.willCollide = true;
         info.collisionTime = 0;
-        info.minDistance = currentDist;
+        info.minDistance = std::sqrt(currentDist2);
         return info;
     }
 
-    // Trajectory with constant acceleration: r(t) = r0 + v0*t + 0.5*a*t²
-    // We need to solve: |r(t)|² = R²
-    // This gives a quartic equation, but we can find minimum distance using calculus
-
-    // Find time of closest approach by minimizing |r(t)|²
-    // d/dt[|r(t)|²] = 0
-    // 2*r·(v + a*t) = 0
-    // r·v + r·a*t + v·a*t + a·a*t² = 0
-    // But this is approximate. For better accuracy, sample the trajectory.
-
-    const int numSamples = 10;
-    double minDist = currentDist;
-    double minDistTime = 0;
-    bool foundCollision = false;
-    double collisionTime = dt;
-
-    for (int i = 0; i <= numSamples; i++) {
-        double t = (dt * i) / numSamples;
+    // Calculate relative acceleration (includes gravity)
+    vector2D relAcc = calcMutualAcceleration(p1, p2);
 
-        // Position at time t with quadratic trajectory
-        vector2D posAtT = relPos + relVel * t + relAcc * (0.5 * t * t);
-        double distAtT = posAtT.norm();
+    // Early rejection: on either axis the separation cannot shrink by more
+    // than |v|*dt + ½|a|*dt², so the pair cannot get within collisionRadius
+    const double half_dt2 = 0.5 * dt * dt;
+    double gap_x = std::abs(relPos.x) - std::abs(relVel.x) * dt - std::abs(relAcc.x) * half_dt2;
+    double gap_y = std::abs(relPos.y) - std::abs(relVel.y) * dt - std::abs(relAcc.y) * half_dt2;
+    if (gap_x > collisionRadius || gap_y > collisionRadius) {
+        info.minDistance = std::max(gap_x, gap_y);
+        return info;
+    }
 
-        if (distAtT < minDist) {
-            minDist = distAtT;
-            minDistTime = t;
+    // Squared distance along r(t) = r0 + v*t + h*t² (h = a/2) is the quartic
+    // g(t) = h·h t⁴ + 2v·h t³ + (v·v + 2r0·h) t² + 2r0·v t + r0·r0
+    const vector2D h = relAcc * 0.5;
+    const double g[5] = {currentDist2, 2 * (relPos.x * relVel.x + relPos.y * relVel.y),
+                         relVel.x * relVel.x + relVel.y * relVel.y +
+                             2 * (relPos.x * h.x + relPos.y * h.y),
+                         2 * (relVel.x * h.x + relVel.y * h.y), h.x * h.x + h.y * h.y};
+    const double dg[4] = {g[1], 2 * g[2], 3 * g[3], 4 * g[4]};
+    const double ddg[3] = {dg[1], 2 * dg[2], 3 * dg[3]};
+
+    // g' is monotonic between the roots of the quadratic g''
+    double pieces[4] = {0};
+    int npieces = 1;
+    if (ddg[2] != 0) {
+        double disc = ddg[1] * ddg[1] - 4 * ddg[2] * ddg[0];
+        if (disc > 0) {
+            // Numerically stable quadratic roots
+            double q = -0.5 * (ddg[1] + std::copysign(std::sqrt(disc), ddg[1]));
+            double r1 = q / ddg[2];
+            double r2 = q != 0 ? ddg[0] / q : r1;
+            if (r1 > r2)
+                std::swap(r1, r2);
+            for (double r : {r1, r2}) {
+                if (r > 0 && r < dt)
+                    pieces[npieces++] = r;
+            }
         }
-
-        if (distAtT < collisionRadius && !foundCollision) {
-            foundCollision = true;
-            collisionTime = t;
+    } else if (ddg[1] != 0) {
+        double r = -ddg[0] / ddg[1];
+        if (r > 0 && r < dt)
+            pieces[npieces++] = r;
+    }
+    pieces[npieces++] = dt;
+
+    // Extrema of g: the ends and the roots of g' on each monotonic piece;
+    // g itself is monotonic between consecutive ones
+    double extrema[5] = {0};
+    int nextrema = 1;
+    for (int k = 0; k + 1 < npieces; k++) {
+        double lo = horner(dg, 3, pieces[k]);
+        double hi = horner(dg, 3, pieces[k + 1]);
+        if ((lo < 0 && hi > 0) || (lo > 0 && hi < 0))
+            extrema[nextrema++] = bracketedRoot(dg, ddg, 3, pieces[k], pieces[k + 1]);
+    }
+    extrema[nextrema++] = dt;
+
+    // The earliest crossing of g = R² lies in the first monotonic interval
+    // that ends inside the collision radius
+    const double f[5] = {g[0] - radius2, g[1], g[2], g[3], g[4]};
+    double minDist2 = currentDist2;
+    for (int k = 0; k + 1 < nextrema; k++) {
+        double end = horner(g, 4, extrema[k + 1]);
+        minDist2 = std::min(minDist2, end);
+        if (!info.willCollide && end < radius2) {
+            info.willCollide = true;
+            info.collisionTime = bracketedRoot(f, dg, 4, extrema[k], extrema[k + 1]);
         }
     }
+    info.minDistance = std::sqrt(std::max(minDist2, 0.0));
 
-    // Refine minimum distance estimate around the minimum
-    if (minDistTime > 0 && minDistTime < dt) {
-        double refineDt = dt / (2.0 * numSamples);
-        for (int i = -2; i <= 2; i++) {
-            double t = std::max(0.0, std::min(dt, minDistTime + i * refineDt));
-            vector2D posAtT = relPos + relVel * t + relAcc * (0.5 * t * t);
-            double distAtT = posAtT.norm();
-
-            if (distAtT < minDist) {
-                minDist = distAtT;
-                minDistTime = t;
-            }
+    return info;
+}
 
-            if (distAtT < collisionRadius && t < collisionTime) {
-                foundCollision = true;
-                collisionTime = t;
-            }
-        }
+/**
+ * @brief Union-find root of a slot, with path halving
+ *
+ * @param parent Parent slot of every slot (roots point to themselves)
+ * @param i Slot index
+ * @return Root slot of i's component
+ */
+static int findRoot(std::vector<int> &parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
     }
+    return i;
+}
 
-    info.willCollide = foundCollision;
-    info.collisionTime = foundCollision ? collisionTime : dt;
-    info.minDistance = minDist;
+/**
+ * @brief Merge every connected component of colliding particles
+ *
+ * @details Each component becomes its lowest-ID member, which keeps its
+ * position and takes the total mass, the total momentum and a radius
+ * grown at constant density. It stays active if any member was active.
+ * Members are combined in slot order, so the result does not depend on
+ * the order the events were found in.
+ *
+ * @param particles Particle store (absorbed particles are marked for deletion)
+ * @param events Detected collisions (sorted in place)
+ */
+static void resolveCollisions(ParticleSet &particles, std::vector<CollisionEvent> &events) {
+    std::sort(events.begin(), events.end(), [](const CollisionEvent &a, const CollisionEvent &b) {
+        return std::tie(a.time, a.i, a.j) < std::tie(b.time, b.i, b.j);
+    });
+
+    // Components, each rooted at its lowest-ID member
+    std::vector<int> parent(particles.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    std::vector<int> members;
+    members.reserve(2 * events.size());
+    for (const CollisionEvent &event : events) {
+        int a = findRoot(parent, event.i);
+        int b = findRoot(parent, event.j);
+        if (a != b) {
+            if (particles.id[b] < particles.id[a])
+                std::swap(a, b);
+            parent[b] = a;
+        }
+        members.push_back(event.i);
+        members.push_back(event.j);
+    }
+    std::sort(members.begin(), members.end());
+    members.erase(std::unique(members.begin(), members.end()), members.end());
+
+    std::vector<std::pair<int, int>> by_root(members.size());
+    for (std::size_t k = 0; k < members.size(); k++)
+        by_root[k] = {findRoot(parent, members[k]), members[k]};
+    std::sort(by_root.begin(), by_root.end());
+
+    for (std::size_t first = 0; first < by_root.size();) {
+        const int survivor = by_root[first].first;
+        std::size_t last = first;
+        double total_mass = 0, px = 0, py = 0;
+        bool active = false;
+        for (; last < by_root.size() && by_root[last].first == survivor; last++) {
+            const int i = by_root[last].second;
+            total_mass += particles.mass[i];
+            px += particles.mass[i] * particles.vx[i];
+            py += particles.mass[i] * particles.vy[i];
+            active |= !particles.isPassive(i);
+            if (i != survivor)
+                particles.markForDeletion(i);
+        }
 
-    return info;
+        // Perfectly inelastic: momentum and mass are conserved
+        particles.vx[survivor] = px / total_mass;
+        particles.vy[survivor] = py / total_mass;
+        particles.radius[survivor] *= std::cbrt(total_mass / particles.mass[survivor]);
+        particles.mass[survivor] = total_mass;
+        // Absorbing an active particle makes the survivor active
+        if (active)
+            particles.setPassive(survivor, false);
+        first = last;
+    }
 }
 
-void checkCollisions(std::vector<std::shared_ptr<Particle>> &particles, QuadTree<Particle> *tree,
-                     double dt) {
-
+std::vector<int> collideParticles(ParticleSet &particles, const Bounds &domain, double dt) {
+    // Broad phase: candidate pairs (lower ID first) from a grid sized to the
+    // particles' reach this step
+    CollisionGrid grid;
+    grid.build(particles, domain, dt);
+    const std::vector<std::pair<int, int>> &pairs = grid.pairs();
+    const int npairs = static_cast<int>(pairs.size());
+
+    // Detect: continuous collision detection on every candidate, reading
+    // the particles only; events go to per-thread buffers
+    std::vector<CollisionEvent> events;
 #pragma omp parallel
     {
-        std::vector<Particle *> query_particles;
-        query_particles.reserve(MAX_CAPACITY * 5);
-        Bounds query_bounds;
-
-#pragma omp for schedule(dynamic, CHUNK_SIZE)
-        for (int i = 0; i < static_cast<int>(particles.size()); i++) {
-            auto &particle = particles[i];
-
-            // Velocity-aware search radius: account for distance particle could travel
-            double velocityRange = particle->velocity.norm() * dt;
-            double range = 2.0 * particle->radius + velocityRange;
-
-            query_bounds.set_bounds(particle->position.x - range, particle->position.y - range,
-                                    range * 2, range * 2);
-            tree->query(query_bounds, query_particles);
-
-            for (auto *neighbour : query_particles) {
-                // Skip if same, already merged, or lower ID (prevents race condition)
-                if (particle->id == neighbour->id || neighbour->id <= particle->id ||
-                    neighbour->markForDeletion)
-                    continue;
-
-                // Use continuous collision detection
-                CollisionInfo collision = predictCollision(particle.get(), neighbour, dt);
-
-                if (collision.willCollide) {
-                    // Perform perfectly inelastic collision (merge particles)
-                    double total_mass = particle->mass + neighbour->mass;
-
-                    particle->velocity = (neighbour->velocity * neighbour->mass +
-                                          particle->velocity * particle->mass) /
-                                         total_mass;
-                    particle->radius = pow(total_mass / particle->mass, 1. / 3.) * particle->radius;
-                    particle->mass = total_mass;
-                    neighbour->markForDeletion = true;
-                    break;
-                }
-            }
-            query_particles.clear();
+        std::vector<CollisionEvent> found;
+
+#pragma omp for schedule(dynamic, 64) nowait
+        for (int k = 0; k < npairs; k++) {
+            const Particle particle = particles.get(pairs[k].first);
+            const Particle neighbour = particles.get(pairs[k].second);
+            CollisionInfo collision = predictCollision(&particle, &neighbour, dt);
+            if (collision.willCollide)
+                found.push_back({pairs[k].first, pairs[k].second, collision.collisionTime});
         }
+
+#pragma omp critical
+        events.insert(events.end(), found.begin(), found.end());
     }
 
-    /* remove the merged particles from the collision list */
-    particles.erase(
-        std::remove_if(particles.begin(), particles.end(),
-                       [&](const std::shared_ptr<Particle> &p) { return p->markForDeletion; }),
-        particles.end());
+    /* resolve, then remove the merged particles */
+    NBODY_PROFILE_COUNT(COUNTER_COLLISIONS, static_cast<long>(events.size()));
+    if (events.empty())
+        return {};
+    resolveCollisions(particles, events);
+    return particles.compact();
+}
+
+template <class Tree> void checkCollisions(ParticleSet &particles, Tree *tree, double dt) {
+    const std::vector<int> remap = collideParticles(particles, tree->bounds, dt);
+    if (!remap.empty())
+        tree->remap(remap);
 }
+
+template void checkCollisions(ParticleSet &, QuadTree<ParticleSet> *, double);
+template void checkCollisions(ParticleSet &, LinearQuadTree<ParticleSet> *, double);
+template Diagnostics updateParticles(ParticleSet &, QuadTree<ParticleSet> *, double,
+                                     const SolverConfig &, bool);
+template Diagnostics updateParticles(ParticleSet &, LinearQuadTree<ParticleSet> *, double,
+                                     const SolverConfig &, bool);
+template void transportStep(ParticleSet &, TreeSolver<QuadTree<ParticleSet>> &, double,
+                            const SolverConfig &);
+template void transportStep(ParticleSet &, TreeSolver<LinearQuadTree<ParticleSet>> &, double,
+                            const SolverConfig &);
+template void transportStep(ParticleSet &, DirectSolver &, double, const SolverConfig &);
+template void transportStep(ParticleSet &, FmmSolver<QuadTree<ParticleSet>> &, double,
+                            const SolverConfig &);
+template void transportStep(ParticleSet &, FmmSolver<LinearQuadTree<ParticleSet>> &, double,
+                            const SolverConfig &);
+#ifdef NBODY_OFFLOAD
+template void transportStep(ParticleSet &, DeviceSolver &, double, const SolverConfig &);
+#endif
+#ifdef NBODY_MPI
+template void transportStep(ParticleSet &, DistributedSolver &, double, const SolverConfig &);
+#endif
@@ -0,0 +1,178 @@
+/**
+ * @file mpi_driver.cpp
+ * @brief Distributed batch driver: run a simulation over MPI ranks
+ *
+ * Usage:
+ * ```
+ * mpirun -np 4 nbody_mpi [--steps N] [--dt DT] [--debris N] [--threads N]
+ *                        [--log-every N] [--theta TH] [--leaf-capacity N]
+ *                        [--passive-mass M] [--integrator rk2|yoshida|hermite]
+ *                        [--rebalance-every N] [--ic planetary|disk|plummer|box|FILE]
+ *                        [--seed S]
+ * ```
+ * - --steps: number of steps to take (default 100)
+ * - --dt: timestep (default 0.01)
+ * - --debris: number of debris particles, or of all particles for the
+ *   disk, plummer and box initial conditions (default 100000)
+ * - --threads: OpenMP threads per rank (default: OpenMP runtime default)
+ * - --log-every: print progress every N steps (default 10, 0 to disable)
+ * - --theta: Barnes-Hut opening angle (default 0.05)
+ * - --leaf-capacity: particles per tree leaf (default 50)
+ * - --passive-mass: particles lighter than this are also passive
+ * - --integrator: rk2, yoshida or hermite (default); block timesteps are
+ *   not supported across ranks
+ * - --rebalance-every: steps between work rebalances (default 10, 0 to
+ *   keep the initial partition)
+ * - --ic: initial conditions, generated on rank 0 and distributed (see
+ *   createInitialConditions())
+ * - --seed: seed of the parallel generators
+ */
+
+#include "distributed_simulation.h"
+#include "initial_conditions.h"
+#include "interactions.h"
+#include "simulation.h"
+#include <cstring>
+
+/**
+ * @brief Print command line usage (rank 0 only)
+ * @param prog Program name
+ */
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--steps N] [--dt DT] [--debris N] [--threads N] [--log-every N] "
+            "[--theta TH] [--leaf-capacity N] [--passive-mass M] "
+            "[--integrator rk2|yoshida|hermite] [--rebalance-every N] "
+            "[--ic planetary|disk|plummer|box|FILE] [--seed S]\n",
+            prog);
+}
+
+/**
+ * @brief Print a progress line (collective; rank 0 prints)
+ * @param sim Simulation being run
+ * @param wall Wall time since the start of the run (seconds)
+ */
+static void report(const DistributedSimulation &sim, double wall) {
+    const long count = sim.globalCount();
+    if (sim.getDomain().rank() != 0)
+        return;
+    fprintf(stdout,
+            "step %8ld  time %10.4f  particles %8ld  wall %9.3f s  %8.2f steps/s  "
+            "imbalance %.2f\n",
+            sim.getStepCount(), sim.getTime(), count, wall,
+            wall > 0 ? sim.getStepCount() / wall : 0.0, sim.getImbalance());
+    fflush(stdout);
+}
+
+/**
+ * @brief Entry point for distributed runs
+ *
+ * @return 0 on success, 1 on bad arguments or initial conditions
+ */
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    int rank, nranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+    long nsteps = 100;
+    double dt = 0.01;
+    int n_debris = 100000;
+    int threads = 0;
+    long log_every = 10;
+    int rebalance_every = 10;
+    SolverConfig config;
+    const char *ic = "planetary";
+    uint64_t seed = 5;
+    bool valid = true;
+
+    for (int i = 1; i < argc && valid; i++) {
+        if (i + 1 >= argc) {
+            valid = false;
+            break;
+        }
+        if (!strcmp(argv[i], "--steps"))
+            nsteps = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--dt"))
+            dt = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--debris"))
+            n_debris = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads"))
+            threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--log-every"))
+            log_every = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--theta"))
+            config.theta = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--leaf-capacity"))
+            config.leaf_capacity = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--passive-mass"))
+            config.passive_mass = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--rebalance-every"))
+            rebalance_every = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--ic"))
+            ic = argv[++i];
+        else if (!strcmp(argv[i], "--seed"))
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--integrator")) {
+            ++i;
+            if (!strcmp(argv[i], "rk2"))
+                TRANSPORT_TYPE = RK2;
+            else if (!strcmp(argv[i], "yoshida"))
+                TRANSPORT_TYPE = YOSHIDA;
+            else if (!strcmp(argv[i], "hermite"))
+                TRANSPORT_TYPE = HERMITE;
+            else
+                valid = false;
+        }
+        else
+            valid = false;
+    }
+    if (dt <= 0 || nsteps < 0 || n_debris < 0 || config.theta <= 0 || config.leaf_capacity < 1 ||
+        rebalance_every < 0)
+        valid = false;
+    if (!valid) {
+        if (rank == 0)
+            usage(argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (threads > 0)
+        omp_set_num_threads(threads);
+
+    DistributedSimulation sim(MPI_COMM_WORLD, -250, -250, 500, 500, dt, config);
+    sim.setRebalanceInterval(rebalance_every);
+
+    // Initial conditions come from the single-process generators on rank 0
+    int loaded = 1;
+    if (rank == 0) {
+        Simulation initial(-250, -250, 500, 500, dt, config);
+        loaded = createInitialConditions(initial, ic, n_debris, seed);
+        if (loaded)
+            sim.getParticles() = initial.getParticles();
+    }
+    MPI_Bcast(&loaded, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!loaded) {
+        MPI_Finalize();
+        return 1;
+    }
+    sim.distribute();
+
+    const long count = sim.globalCount();
+    if (rank == 0) {
+        fprintf(stdout, "nbody_mpi: %ld particles, dt = %g, %d ranks x %d threads, theta = %g\n",
+                count, dt, nranks, omp_get_max_threads(), config.theta);
+    }
+
+    double start = MPI_Wtime();
+    while (sim.getStepCount() < nsteps) {
+        sim.step();
+        if (log_every > 0 && sim.getStepCount() % log_every == 0)
+            report(sim, MPI_Wtime() - start);
+    }
+    if (log_every <= 0 || sim.getStepCount() % log_every != 0)
+        report(sim, MPI_Wtime() - start);
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file profiler.cpp
+ * @brief Implementation of the step metrics and their log
+ */
+
+#include "profiler.h"
+
+/// @brief Names of the profile_phase values, in enum order
+static const char *const PHASE_NAMES[PHASE_COUNT] = {"step",   "tree",       "moments",
+                                                     "theta",  "transport",  "forces",
+                                                     "collisions", "recenter"};
+
+/// @brief Names of the profile_counter values, in enum order
+static const char *const COUNTER_NAMES[COUNTER_COUNT] = {"targets", "cells", "particles",
+                                                         "collisions"};
+
+const char *phaseName(int phase) { return PHASE_NAMES[phase]; }
+
+const char *counterName(int counter) { return COUNTER_NAMES[counter]; }
+
+#ifdef NBODY_PROFILING
+Profiler &profiler() {
+    static Profiler instance;
+    return instance;
+}
+#endif
+
+bool MetricsLog::open(const std::string &path) {
+    close();
+#ifndef NBODY_PROFILING
+    fprintf(stderr, "Step metrics need a build with NBODY_PROFILING\n");
+    return false;
+#endif
+    file = fopen(path.c_str(), "w");
+    if (!file) {
+        fprintf(stderr, "Cannot open metrics log %s\n", path.c_str());
+        return false;
+    }
+    json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (!json) {
+        fprintf(file, "step,particles");
+        for (int k = 0; k < PHASE_COUNT; k++)
+            fprintf(file, ",%s_s", PHASE_NAMES[k]);
+        for (int k = 0; k < COUNTER_COUNT; k++)
+            fprintf(file, ",%s", COUNTER_NAMES[k]);
+        fprintf(file, ",tree_nodes,tree_depth,imbalance\n");
+    }
+    return true;
+}
+
+void MetricsLog::write(const StepMetrics &metrics) {
+    if (!file)
+        return;
+    if (json) {
+        fprintf(file, "{\"step\":%ld,\"particles\":%zu,\"seconds\":{", metrics.step,
+                metrics.particles);
+        for (int k = 0; k < PHASE_COUNT; k++)
+            fprintf(file, "%s\"%s\":%.6e", k ? "," : "", PHASE_NAMES[k], metrics.seconds[k]);
+        fprintf(file, "},\"counts\":{");
+        for (int k = 0; k < COUNTER_COUNT; k++)
+            fprintf(file, "%s\"%s\":%ld", k ? "," : "", COUNTER_NAMES[k], metrics.counts[k]);
+        fprintf(file, "},\"tree_nodes\":%d,\"tree_depth\":%d,\"imbalance\":%.4f}\n",
+                metrics.tree_nodes, metrics.tree_depth, metrics.imbalance());
+    } else {
+        fprintf(file, "%ld,%zu", metrics.step, metrics.particles);
+        for (int k = 0; k < PHASE_COUNT; k++)
+            fprintf(file, ",%.6e", metrics.seconds[k]);
+        for (int k = 0; k < COUNTER_COUNT; k++)
+            fprintf(file, ",%ld", metrics.counts[k]);
+        fprintf(file, ",%d,%d,%.4f\n", metrics.tree_nodes, metrics.tree_depth, metrics.imbalance());
+    }
+    fflush(file);
+}
+
+void MetricsLog::close() {
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+}
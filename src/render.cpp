@@ -7,12 +7,13 @@
  * - Interactive particle tracking
  * - QuadTree visualization
  * - Zoom and pan controls
- * - Performance-optimized rendering (vertex arrays for 100k+ particles)
+ * - Performance-optimized rendering (tree culling and level of detail)
  */
 
 #include "arial_ttf.h"
 #include "global.h"
 #include "render.h"
+#include "profiler.h"
 
 sf::Color BACKGROUND_COLOR(0, 0, 0);      ///< Black background
 sf::Color PARTICLE_COLOR(255, 255, 255);  ///< White for bound particles
@@ -68,23 +69,73 @@ vector2D invtransform(vector2D vec) {
  * @details Used for visualizing QuadTree query results or other debug info.
  * Renders all particles as 2-pixel green circles.
  *
- * @param particles Vector of particle pointers to render
+ * @param indices Slot indices of the particles to render
  */
-void Render::renderTestParticles(const std::vector<Particle *> particles) {
+void Render::renderTestParticles(const std::vector<int> &indices) {
     const float size = 2;
-    for (auto const &p : particles) {
+    for (int i : indices) {
         sf::CircleShape circle(size);
 
         circle.setFillColor(sf::Color(0, 255, 0));
         circle.setPosition(
-            transform(p->position) -
+            transform(particles->position(i)) -
             sf::Vector2<float>({static_cast<float>(size) / 2, static_cast<float>(size) / 2}));
         window.draw(circle);
     }
 }
 
 /**
- * @brief Render all particles with intelligent coloring
+ * @brief Brightness of a cell drawn as one point
+ *
+ * @param count Particles in the cell
+ * @return Color scale, logarithmic in count and saturating at LOD_FULL_COUNT
+ */
+static double lodBrightness(int count) {
+    return std::min(1.0, 0.25 + 0.75 * std::log2(1.0 + count) / std::log2(1.0 + LOD_FULL_COUNT));
+}
+
+sf::Color Render::particleColor(int i) const {
+    vector2D position = particles->position(i);
+    // Bound if |v - v_c| < sqrt(2*G*M / r), squared twice to avoid roots
+    double dist2 = (position - central_position).dot(position - central_position);
+    vector2D relative = particles->velocity(i) - central_velocity;
+    double speed2 = relative.dot(relative);
+    return speed2 * speed2 * dist2 < two_mu * two_mu ? PARTICLE_COLOR : sf::Color::Red;
+}
+
+void Render::addPoint(vector2D position, sf::Color color, double brightness) {
+    color.r = static_cast<sf::Uint8>(color.r * brightness);
+    color.g = static_cast<sf::Uint8>(color.g * brightness);
+    color.b = static_cast<sf::Uint8>(color.b * brightness);
+    points.append(sf::Vertex(transform(position), color));
+}
+
+void Render::collectPoints(const LinearQuadTree<ParticleSet> *tree, int index) {
+    const LinearNode &node = tree->nodes[index];
+    if (node.count == 0 || !node.bounds.intersects(global_bounds))
+        return;
+    // A cell drawn as one point is debris in aggregate: its first member
+    // may be any particle (a primary is drawn on its own)
+    if (node.bounds.width < lod_width) {
+        const vector2D center(node.bounds.xmin + 0.5 * node.bounds.width,
+                              node.bounds.ymin + 0.5 * node.bounds.height);
+        addPoint(center, PARTICLE_COLOR, lodBrightness(node.count));
+        return;
+    }
+    if (node.firstChild >= 0) {
+        for (int c = 0; c < 4; c++)
+            collectPoints(tree, node.firstChild + c);
+        return;
+    }
+    for (int k = node.first; k < node.first + node.count; k++) {
+        int i = tree->order[k];
+        if (!particles->isPrimary(i) && global_bounds.contains(particles->position(i)))
+            addPoint(particles->position(i), particleColor(i), 1.0);
+    }
+}
+
+/**
+ * @brief Render the visible particles with intelligent coloring
  *
  * @details Rendering strategy:
  * - **Primary particles** (isPrimary=true): Rendered as colored circles
@@ -99,69 +150,71 @@ void Render::renderTestParticles(const std::vector<Particle *> particles) {
  * - Particles with v < v_escape are gravitationally bound
  *
  * Performance optimization:
- * - Uses SFML VertexArray for efficient point rendering
- * - Only renders particles within global_bounds
- *
- * @param particles Vector of all particles
+ * - Test particles are found by walking the frame's tree, skipping cells
+ *   outside global_bounds
+ * - Cells narrower than LOD_PIXELS on screen become one debris-colored
+ *   point at the cell center, brighter the more particles they hold
+ *   (lodBrightness())
+ * - The point buffer persists across frames; the tree and the primary
+ *   slots come with the frame from the stepping thread
  */
-void Render::renderParticles(const std::vector<std::shared_ptr<Particle>> &particles) {
-    Particle *central_particle;
-    track_particle ? central_particle = track_particle : central_particle = particles[0].get();
-    double two_mu = 2 * GRAV_G * central_particle->mass;  // 2*G*M for escape velocity
-    sf::VertexArray points(sf::Points, particles.size());
-    std::vector<sf::CircleShape> circles;
-    circles.reserve(15);
-
-    for (int i = 0; i < particles.size(); ++i) {
-        const auto &p = particles[i];
-        if (!global_bounds.contains(p->position))
-            continue;
-        if (p->isPrimary) {
-            double size = (log10(p->radius) + 5);
-            sf::CircleShape circle(size);
-
-            circle.setFillColor(PRIMARY_COLOR);
-            circle.setPosition(
-                transform(p->position) -
-                sf::Vector2<float>({static_cast<float>(size) / 2, static_cast<float>(size) / 2}));
+void Render::renderParticles() {
+    if (!particles || particles->empty())
+        return;
+    int central = trackIndex();
+    if (central < 0)
+        central = 0;
+    two_mu = 2 * GRAV_G * particles->mass[central];  // 2*G*M for escape velocity
+    central_position = particles->position(central);
+    central_velocity = particles->velocity(central);
+    lod_width = LOD_PIXELS * global_bounds.width / (GRID_SIZE * CELL_SIZE - 2 * START);
+
+    points.clear();
+    if (!frame->tree.nodes.empty())
+        collectPoints(&frame->tree, 0);
+    window.draw(points);
 
-            circles.push_back(std::move(circle));
-        } else {
-            points[i].position = transform(p->position);
-            double dist = (p->position - central_particle->position).norm();
-            if ((p->velocity - central_particle->velocity).norm() < sqrt(two_mu / dist)) {
-                points[i].color = PARTICLE_COLOR;
-            } else {
-                points[i].color = sf::Color::Red;
-            }
-        }
-    }
+    for (int i : frame->primaries) {
+        vector2D position = particles->position(i);
+        if (!global_bounds.contains(position))
+            continue;
+        double size = (log10(particles->radius[i]) + 5);
+        sf::CircleShape circle(size);
 
-    window.draw(points);
-    // Serial draw loop
-    for (auto &circle : circles)
+        circle.setFillColor(PRIMARY_COLOR);
+        circle.setPosition(
+            transform(position) -
+            sf::Vector2<float>({static_cast<float>(size) / 2, static_cast<float>(size) / 2}));
         window.draw(circle);
+    }
 }
 
 /**
- * @brief Recursively render QuadTree structure
+ * @brief Render LinearQuadTree structure
  *
- * @details Visualizes the spatial partitioning by drawing bounding boxes
- * of leaf nodes. Only draws nodes that intersect the viewing region.
+ * @details Walks down from the root, skipping subtrees outside the viewing
+ * region: draws the bounds of every visible non-empty leaf, or of a
+ * visible cell narrower than LOD_PIXELS on screen.
  *
- * @param tree Root or subtree to render
+ * @param tree LinearQuadTree to render
  *
  * @note Toggled with 'T' key (shouldRenderTree flag)
  */
-void Render::renderTree(QuadTree<Particle> *tree) {
-    if (tree->is_divided) {
-        for (auto const &child : tree->children) {
-            renderTree(child);
+void Render::renderTree(const LinearQuadTree<ParticleSet> *tree) {
+    if (tree->nodes.empty())
+        return;
+    std::vector<int> stack = {0};
+    while (!stack.empty()) {
+        const LinearNode &node = tree->nodes[stack.back()];
+        stack.pop_back();
+        if (node.count == 0 || !node.bounds.intersects(global_bounds))
+            continue;
+        if (node.firstChild >= 0 && node.bounds.width >= lod_width) {
+            for (int c = 0; c < 4; c++)
+                stack.push_back(node.firstChild + c);
+        } else {
+            renderBounds(node.bounds);
         }
-    } else {
-        if (!tree->bounds.intersects(global_bounds))
-            return;
-        renderBounds(tree->bounds);
     }
 }
 
@@ -200,11 +253,14 @@ void Render::renderLine(vector2D position1, vector2D position2) {
  * @brief Render simulation time display
  *
  * @details Displays elapsed simulation time at top center of window.
- * Font is loaded from embedded Arial TTF data on first call.
+ * Font is loaded from embedded Arial TTF data on first call. Profiling
+ * builds (NBODY_PROFILING) add the last step's phase times, interaction
+ * counts and tree size in the upper-left corner.
  *
- * @param time Elapsed simulation time (arbitrary units, labeled "years")
+ * @param frame Current frame: its time (arbitrary units, labeled "years")
+ *              and the step metrics captured with it
  */
-void Render::renderTime(double time) {
+void Render::renderTime(const Frame &frame) {
     static int initialized;
     static sf::Font font;
     char message[200];
@@ -217,7 +273,7 @@ void Render::renderTime(double time) {
         initialized = 1;
     }
 
-    sprintf(message, "Time: %.2f years", time);
+    sprintf(message, "Time: %.2f years", frame.time);
 
     sf::Text text;
     text.setFont(font);
@@ -228,6 +284,29 @@ void Render::renderTime(double time) {
     text.setOrigin(textRect.width / 2, textRect.height / 2);
     text.setPosition(GRID_SIZE / 2, START / 2);
     window.draw(text);
+
+    if (!frame.with_metrics)
+        return;
+    const StepMetrics *metrics = &frame.metrics;
+    std::string overlay;
+    char line[200];
+    for (int k = 0; k < PHASE_COUNT; k++) {
+        sprintf(line, "%-10s %7.2f ms\n", phaseName(k), 1e3 * metrics->seconds[k]);
+        overlay += line;
+    }
+    sprintf(line, "cells %.3g  particles %.3g\nnodes %d  depth %d  imbalance %.2f",
+            static_cast<double>(metrics->counts[COUNTER_CELLS]),
+            static_cast<double>(metrics->counts[COUNTER_PARTICLES]), metrics->tree_nodes,
+            metrics->tree_depth, metrics->imbalance());
+    overlay += line;
+
+    sf::Text stats;
+    stats.setFont(font);
+    stats.setString(overlay);
+    stats.setCharacterSize(12);
+    stats.setFillColor(sf::Color::White);
+    stats.setPosition(10, 10);
+    window.draw(stats);
 }
 
 /**
@@ -240,9 +319,9 @@ void Render::renderTime(double time) {
  *
  * Only shown when a particle is being tracked (clicked).
  *
- * @param particle Pointer to tracked particle
+ * @param particle Gathered copy of the tracked particle
  */
-void Render::renderParticleInfo(Particle *particle) {
+void Render::renderParticleInfo(const Particle &particle) {
     static int initialized;
     static sf::Font font;
     char id_message[200], position_message[200], velocity_message[200];
@@ -255,11 +334,11 @@ void Render::renderParticleInfo(Particle *particle) {
         initialized = 1;
     }
 
-    sprintf(id_message, "Particle ID: %6d  Mass: %5.3e", particle->id, particle->mass);
-    sprintf(position_message, "Position: (%5.2f, %5.2f)", particle->position.x,
-            particle->position.y);
-    sprintf(velocity_message, "Velocity: (%5.2f, %5.2f) %5.2f", particle->velocity.x,
-            particle->velocity.y, particle->velocity.norm());
+    sprintf(id_message, "Particle ID: %6d  Mass: %5.3e", particle.id, particle.mass);
+    sprintf(position_message, "Position: (%5.2f, %5.2f)", particle.position.x,
+            particle.position.y);
+    sprintf(velocity_message, "Velocity: (%5.2f, %5.2f) %5.2f", particle.velocity.x,
+            particle.velocity.y, particle.velocity.norm());
 
     sf::Text id_text, position_text, velocity_text;
     id_text.setFont(font);
@@ -294,13 +373,13 @@ void Render::renderParticleInfo(Particle *particle) {
 /**
  * @brief Main rendering and event loop
  *
- * @details Each frame:
- * 1. Update QuadTree structure (remove/reinsert displaced particles)
- * 2. Calculate center of mass for Barnes-Hut
- * 3. Integrate physics (if not paused)
- * 4. Process events (mouse, keyboard)
- * 5. Update view bounds (zoom, pan, tracking)
- * 6. Render all elements
+ * @details The simulation steps on a SimulationThread, started here and
+ * stopped when the window closes. Each frame:
+ * 1. Take the latest published Frame, if there is a new one
+ *    (acquireFrame)
+ * 2. Process events (mouse, keyboard)
+ * 3. Update view bounds (zoom, pan, tracking)
+ * 4. Render all elements from the frame
  *
  * **Keyboard Controls:**
  * - **Space**: Toggle pause/resume simulation
@@ -314,37 +393,22 @@ void Render::renderParticleInfo(Particle *particle) {
  * **View Modes:**
  * - Normal: View centered at origin
  * - Tracking: View follows selected particle
- *
- * @param dt Integration timestep
  */
-void Render::run(double dt) {
-    double time = 0;
+void Render::run() {
     view_center = {0, 0};
+    stepper.start();
+    omp_set_num_threads(RENDER_THREADS);
 
     while (window.isOpen()) {
         sf::Event event;
 
-        // Update QuadTree: remove particles that left their cells
-        std::vector<std::shared_ptr<Particle>> particlesToRemove;
-        particlesToRemove.reserve(10000);
-
-        tree->updateParticles(particlesToRemove);
-
-        // Reinsert displaced particles
-        for (auto &particle : particlesToRemove) {
-            tree->insert(particle);
-        }
-        tree->calculateCOM();
-
-        // Integrate physics (if not paused)
-        if (!pauseSim) {
-            updateParticles(particles, tree, dt);
-            time += dt;
-        }
+        // Latest state of the simulation thread (never waits for it)
+        acquireFrame();
 
         // Update view center (track particle or origin)
-        if (track_particle != nullptr) {
-            view_center = track_particle->position;
+        int track_index = trackIndex();
+        if (track_index >= 0) {
+            view_center = particles->position(track_index);
         } else {
             view_center = {0, 0};
         }
@@ -375,9 +439,9 @@ void Render::run(double dt) {
                 if (event.key.code == sf::Keyboard::T)
                     shouldRenderTree = !shouldRenderTree;  // Toggle tree visualization
                 if (event.key.code == sf::Keyboard::C)
-                    track_particle = nullptr;  // Clear tracking
+                    track_id = -1;  // Clear tracking
                 if (event.key.code == sf::Keyboard::Space)
-                    pauseSim = !pauseSim;  // Pause/resume
+                    stepper.setPaused(!stepper.isPaused());  // Pause/resume
             }
 
             // Mouse wheel: zoom
@@ -399,16 +463,39 @@ void Render::run(double dt) {
 
         // Render frame
         window.clear(BACKGROUND_COLOR);
-        renderParticles(particles);
+        renderParticles();
 
-        if (track_particle)
-            renderParticleInfo(track_particle);
+        if (track_index >= 0)
+            renderParticleInfo(particles->get(track_index));
 
-        renderTime(time);
+        renderTime(frames.readFrame());
         if (shouldRenderTree)
-            renderTree(tree);
+            renderTree(&frame->tree);
         window.display();
     }
+    stepper.stop();
+}
+
+/**
+ * @brief Switch to the latest published frame
+ *
+ * @details The frame's tree, built by the stepping thread, serves the
+ * culling, the tree overlay and the picking queries, so the viewer never
+ * touches the live simulation. The tracked particle keeps its slot unless
+ * compaction moved it; only then is it searched for by ID.
+ */
+void Render::acquireFrame() {
+    if (!frames.acquire())
+        return;
+    frame = &frames.readFrame();
+    particles = &frame->particles;
+    // Particles are tracked by ID because slot indices change when merged
+    // particles are compacted out of the store
+    if (track_id >= 0 && (track_slot < 0 || track_slot >= static_cast<int>(particles->size()) ||
+                          particles->id[track_slot] != track_id))
+        track_slot = particles->indexOf(track_id);
+    if (track_slot < 0)
+        track_id = -1; // Merged away
 }
 
 /**
@@ -417,9 +504,9 @@ void Render::run(double dt) {
  * @details Algorithm:
  * 1. Convert mouse position from screen to simulation coordinates
  * 2. Create search region (10% of view width, centered on cursor)
- * 3. Query QuadTree for particles in region
+ * 3. Query the frame's tree for particles in region
  * 4. Find particle closest to cursor
- * 5. Set as tracked particle
+ * 5. Set its ID as the tracked particle
  *
  * The tracked particle will be:
  * - Followed by the camera (view_center = particle position)
@@ -437,17 +524,18 @@ void Render::findTrackParticle() {
                             mouseLocation.y - 0.05 * view_width, 0.1 * view_width,
                             0.1 * view_width);
 
-    // Query tree for nearby particles
+    // Query the frame's tree for nearby particles
     query_particles.clear();
-    tree->query(query_bounds, query_particles);
+    frame->tree.query(query_bounds, query_particles);
 
     // Find closest particle
     double dist = 1e10;
-    for (auto const &particle : query_particles) {
-        vector2D diff = mouseLocation - particle->position;
+    for (int particle : query_particles) {
+        vector2D diff = mouseLocation - particles->position(particle);
         if (diff.norm() < dist) {
             dist = diff.norm();
-            track_particle = particle;
+            track_id = particles->id[particle];
+            track_slot = particle;
         }
     }
 }
@@ -0,0 +1,150 @@
+/**
+ * @file simulation.cpp
+ * @brief Implementation of the N-body stepping engine
+ */
+
+#include "simulation.h"
+#include "interactions.h"
+#include "barneshut.h"
+#include "profiler.h"
+
+bool Simulation::addParticle(const Particle &particle) {
+    int index = particles.add(particle);
+    if (tree_kind == POINTER_TREE)
+        return tree.insert(index);
+    // The linear tree is rebuilt at the start of every step
+    return linear_tree.bounds.contains(particle.position);
+}
+
+void Simulation::setTreeType(tree_type type) {
+    tree_kind = type;
+    if (type == POINTER_TREE) {
+        tree.clear();
+        std::vector<int> all(particles.size());
+        std::iota(all.begin(), all.end(), 0);
+        tree.insertMany(all);
+    } else {
+        linear_tree.build();
+    }
+}
+
+void Simulation::resume(double _time, long _step_count, double _dt_set,
+                        const EnergyTracking &_energy) {
+    time = _time;
+    step_count = _step_count;
+    dt_set = _dt_set;
+    energy = _energy;
+    rebuildTree();
+}
+
+void Simulation::setConfig(const SolverConfig &_config) {
+    config = _config;
+    rebuildTree();
+}
+
+void Simulation::query(Bounds query_bounds, std::vector<int> &query_particles) const {
+    if (tree_kind == POINTER_TREE)
+        tree.query(query_bounds, query_particles);
+    else
+        linear_tree.query(query_bounds, query_particles);
+}
+
+void Simulation::updateTree() {
+    // Update QuadTree: remove particles that left their cells
+    {
+        NBODY_PROFILE_PHASE(PHASE_TREE);
+        std::vector<int> particlesToRemove;
+        particlesToRemove.reserve(10000);
+
+        tree.updateParticles(particlesToRemove);
+
+        // Reinsert displaced particles
+        tree.insertMany(particlesToRemove);
+    }
+    NBODY_PROFILE_PHASE(PHASE_MOMENTS);
+    tree.calculateCOM();
+}
+
+template <class Tree> void Simulation::adaptTheta(const Tree *active) {
+    if (!config.adaptive_theta || step_count % std::max(config.error_interval, 1) != 0)
+        return;
+
+    NBODY_PROFILE_PHASE(PHASE_THETA);
+    force_error = estimateForceError(particles, active, config.theta, config.error_samples);
+    double factor = 2.0;
+    if (force_error > 0) {
+        double ratio = config.target_error / force_error;
+        factor = config.quadrupole ? std::cbrt(ratio) : std::sqrt(ratio);
+    }
+    factor = std::clamp(factor, 0.5, 2.0);
+    config.theta = std::clamp(config.theta * factor, config.theta_min, config.theta_max);
+}
+
+void Simulation::checkEnergy() {
+    const double e = diagnostics.energy();
+    if (energy.count < 0)
+        energy.reference = e;
+    // Collisions dissipate energy: only intervals without them count
+    if (diagnostics.count != energy.count || energy.last == 0) {
+        energy.last = e;
+        energy.count = diagnostics.count;
+        return;
+    }
+    const double change = (e - energy.last) / std::abs(energy.last);
+    if (energy.reference != 0)
+        energy.drift += (e - energy.last) / std::abs(energy.reference);
+    energy.last = e;
+    if (config.energy_tolerance > 0 && std::abs(change) > config.energy_tolerance)
+        dt = std::max(dt * DT_REDUCTION, dt_set * DT_MIN_FRACTION);
+}
+
+void Simulation::step() {
+    NBODY_PROFILE_ONLY(profiler().beginStep();)
+    const bool measure =
+        config.diagnostics_interval > 0 && (step_count + 1) % config.diagnostics_interval == 0;
+    {
+        NBODY_PROFILE_PHASE(PHASE_STEP);
+        if (tree_kind == POINTER_TREE) {
+            updateTree();
+            adaptTheta(&tree);
+            diagnostics = updateParticles(particles, &tree, dt, config, measure);
+        } else {
+            {
+                NBODY_PROFILE_PHASE(PHASE_TREE);
+                linear_tree.build();
+            }
+            {
+                NBODY_PROFILE_PHASE(PHASE_MOMENTS);
+                linear_tree.calculateCOM();
+            }
+            adaptTheta(&linear_tree);
+            diagnostics = updateParticles(particles, &linear_tree, dt, config, measure);
+        }
+    }
+    time += dt;
+    step_count++;
+    if (measure)
+        checkEnergy();
+
+#ifdef NBODY_PROFILING
+    int nodes = 0, depth = 0;
+    if (tree_kind == POINTER_TREE)
+        tree.countNodes(nodes, depth);
+    else
+        linear_tree.countNodes(nodes, depth);
+    profiler().endStep(step_count, particles.size(), nodes, depth);
+#endif
+}
+
+void Simulation::run(long nsteps) {
+    for (long i = 0; i < nsteps; i++) {
+        step();
+    }
+}
+
+void Simulation::runUntil(double t_end) {
+    // Half-step tolerance so accumulated round-off in time does not add a step
+    while (time + 0.5 * dt < t_end) {
+        step();
+    }
+}
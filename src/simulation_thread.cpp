@@ -0,0 +1,90 @@
+/**
+ * @file simulation_thread.cpp
+ * @brief Implementation of the stepping thread and the frame triple buffer
+ */
+
+#include "simulation_thread.h"
+#include <chrono>
+
+void captureFrame(const Simulation &sim, Frame &frame) {
+    const ParticleSet &particles = sim.getParticles();
+    ParticleSet &copy = frame.particles;
+    const int n = static_cast<int>(particles.size());
+    copy.resize(n);
+
+#pragma omp parallel for simd schedule(static, CHUNK_SIZE)
+    for (int i = 0; i < n; i++) {
+        copy.x[i] = particles.x[i];
+        copy.y[i] = particles.y[i];
+        copy.vx[i] = particles.vx[i];
+        copy.vy[i] = particles.vy[i];
+        copy.mass[i] = particles.mass[i];
+        copy.radius[i] = particles.radius[i];
+        copy.id[i] = particles.id[i];
+        copy.flags[i] = particles.flags[i];
+    }
+
+    frame.tree_config = sim.getConfig();
+    frame.tree.bounds = sim.getBounds();
+    frame.tree.build();
+    frame.primaries.clear();
+    for (int i = 0; i < n; i++) {
+        if (copy.isPrimary(i))
+            frame.primaries.push_back(i);
+    }
+
+    frame.time = sim.getTime();
+    frame.step_count = sim.getStepCount();
+    const StepMetrics *metrics = lastStepMetrics();
+    frame.with_metrics = metrics != nullptr;
+    if (metrics)
+        frame.metrics = *metrics;
+}
+
+void FrameBuffer::publish() {
+    // Release: the frame's contents are visible to whoever acquires it
+    write_index = spare_index.exchange(write_index | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
+
+bool FrameBuffer::acquire() {
+    if (!(spare_index.load(std::memory_order_relaxed) & FRESH))
+        return false;
+    read_index = spare_index.exchange(read_index, std::memory_order_acq_rel) & ~FRESH;
+    return true;
+}
+
+void SimulationThread::start() {
+    if (worker.joinable())
+        return;
+    stopping.store(false, std::memory_order_relaxed);
+    publish();
+    worker = std::thread(&SimulationThread::loop, this);
+}
+
+void SimulationThread::stop() {
+    if (!worker.joinable())
+        return;
+    stopping.store(true, std::memory_order_relaxed);
+    worker.join();
+}
+
+void SimulationThread::loop() {
+    omp_set_num_threads(threads);
+    while (!stopping.load(std::memory_order_relaxed)) {
+        if (paused.load(std::memory_order_relaxed)) {
+            if (published_step != sim.getStepCount())
+                publish();
+            std::this_thread::sleep_for(std::chrono::milliseconds(FRAME_IDLE_MS));
+            continue;
+        }
+        sim.step();
+        if (sim.getStepCount() % publish_interval == 0)
+            publish();
+    }
+}
+
+void SimulationThread::publish() {
+    captureFrame(sim, frames.writeFrame());
+    frames.publish();
+    published_step = sim.getStepCount();
+}
@@ -0,0 +1,260 @@
+/**
+ * @file snapshot.cpp
+ * @brief Implementation of binary checkpoint/restart snapshots
+ */
+
+#include "snapshot.h"
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SNAPSHOT_POSIX 1
+#endif
+
+/// @brief Byte order marker as written by this machine
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+/**
+ * @brief Apply a function to every saved column, in file order
+ *
+ * @param particles Particle store (const for writing, mutable for loading)
+ * @param f Callable taking a std::vector<> by reference
+ */
+template <class Set, class F> static void forEachColumn(Set &particles, F &&f) {
+    f(particles.x); f(particles.y); f(particles.vx); f(particles.vy);
+    f(particles.ax); f(particles.ay); f(particles.jx); f(particles.jy);
+    f(particles.mass); f(particles.radius); f(particles.id);
+    f(particles.flags); f(particles.level);
+}
+
+/// @brief Bytes of a column of n elements, padded to 8-byte alignment
+static std::size_t columnBytes(std::size_t n, std::size_t element) {
+    return (n * element + 7) & ~std::size_t(7);
+}
+
+void encodeSnapshot(const Simulation &sim, std::vector<char> &image) {
+    const ParticleSet &particles = sim.getParticles();
+    const std::size_t n = particles.size();
+
+    std::size_t bytes = sizeof(SnapshotHeader);
+    forEachColumn(particles, [&](const auto &column) {
+        bytes += columnBytes(n, sizeof(column[0]));
+    });
+    image.assign(bytes, 0);
+
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, "NBODYSNP", 8);
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.count = n;
+    header.file_bytes = bytes;
+    header.time = sim.getTime();
+    header.step_count = sim.getStepCount();
+    header.dt = sim.getDt();
+    header.theta = sim.getConfig().theta;
+    const Bounds &domain = sim.getBounds();
+    header.domain[0] = domain.xmin;
+    header.domain[1] = domain.ymin;
+    header.domain[2] = domain.width;
+    header.domain[3] = domain.height;
+    header.transport = TRANSPORT_TYPE;
+    header.tree = sim.getTreeType();
+    header.dt_set = sim.getDtSet();
+    const EnergyTracking &energy = sim.getEnergyTracking();
+    header.energy_reference = energy.reference;
+    header.energy_last = energy.last;
+    header.energy_drift = energy.drift;
+    header.energy_count = energy.count;
+    std::memcpy(image.data(), &header, sizeof(header));
+
+    std::size_t offset = sizeof(SnapshotHeader);
+    forEachColumn(particles, [&](const auto &column) {
+        if (n > 0)
+            std::memcpy(image.data() + offset, column.data(), n * sizeof(column[0]));
+        offset += columnBytes(n, sizeof(column[0]));
+    });
+}
+
+/**
+ * @brief Write an encoded image to path atomically
+ *
+ * @param image Snapshot bytes
+ * @param path Output file
+ * @return False on any I/O error (reported on stderr)
+ */
+static bool writeImage(const std::vector<char> &image, const std::string &path) {
+    const std::string tmp = path + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Cannot open snapshot file %s\n", tmp.c_str());
+        return false;
+    }
+    bool ok = fwrite(image.data(), 1, image.size(), file) == image.size();
+    ok = fflush(file) == 0 && ok;
+#ifdef SNAPSHOT_POSIX
+    ok = fsync(fileno(file)) == 0 && ok;
+#endif
+    ok = fclose(file) == 0 && ok;
+    if (ok)
+        ok = std::rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        fprintf(stderr, "Failed to write snapshot %s\n", path.c_str());
+        std::remove(tmp.c_str());
+    }
+    return ok;
+}
+
+bool writeSnapshot(const Simulation &sim, const char *path) {
+    std::vector<char> image;
+    encodeSnapshot(sim, image);
+    return writeImage(image, path);
+}
+
+/**
+ * @brief Snapshot file contents, memory-mapped where supported
+ */
+class SnapshotFile
+{
+public:
+    /**
+     * @brief Open and map a file
+     * @param path File to read
+     */
+    explicit SnapshotFile(const char *path) {
+#ifdef SNAPSHOT_POSIX
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                bytes = static_cast<const char *>(mapped);
+                size = static_cast<std::size_t>(st.st_size);
+            }
+        }
+        close(fd);
+#else
+        FILE *file = fopen(path, "rb");
+        if (!file)
+            return;
+        char chunk[1 << 16];
+        std::size_t got;
+        while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+            buffer.insert(buffer.end(), chunk, chunk + got);
+        fclose(file);
+        bytes = buffer.data();
+        size = buffer.size();
+#endif
+    }
+
+    SnapshotFile(const SnapshotFile &) = delete;
+    SnapshotFile &operator=(const SnapshotFile &) = delete;
+
+    ~SnapshotFile() {
+#ifdef SNAPSHOT_POSIX
+        if (bytes)
+            munmap(const_cast<char *>(bytes), size);
+#endif
+    }
+
+    const char *bytes = nullptr; ///< File contents (null if it could not be read)
+    std::size_t size = 0;        ///< File size
+
+private:
+#ifndef SNAPSHOT_POSIX
+    std::vector<char> buffer; ///< File contents without mmap
+#endif
+};
+
+bool readSnapshotParticles(const char *path, ParticleSet &particles, SnapshotHeader &header) {
+    SnapshotFile file(path);
+    if (!file.bytes) {
+        fprintf(stderr, "Cannot read snapshot %s\n", path);
+        return false;
+    }
+
+    if (file.size < sizeof(header)) {
+        fprintf(stderr, "%s: not a snapshot\n", path);
+        return false;
+    }
+    std::memcpy(&header, file.bytes, sizeof(header));
+    if (std::memcmp(header.magic, "NBODYSNP", 8) != 0) {
+        fprintf(stderr, "%s: not a snapshot\n", path);
+        return false;
+    }
+    if (header.version != SNAPSHOT_VERSION || header.byte_order != SNAPSHOT_BYTE_ORDER) {
+        fprintf(stderr, "%s: snapshot version %u or byte order not supported\n", path,
+                header.version);
+        return false;
+    }
+    if (header.file_bytes != file.size) {
+        fprintf(stderr, "%s: truncated snapshot\n", path);
+        return false;
+    }
+
+    const std::size_t n = header.count;
+    std::size_t bytes = sizeof(SnapshotHeader);
+    ParticleSet layout;
+    forEachColumn(layout, [&](const auto &column) {
+        bytes += columnBytes(n, sizeof(column[0]));
+    });
+    if (bytes != file.size) {
+        fprintf(stderr, "%s: snapshot size does not match its particle count\n", path);
+        return false;
+    }
+
+    const std::size_t first = particles.size();
+    particles.resize(first + n);
+    std::size_t offset = sizeof(SnapshotHeader);
+    forEachColumn(particles, [&](auto &column) {
+        if (n > 0)
+            std::memcpy(column.data() + first, file.bytes + offset, n * sizeof(column[0]));
+        offset += columnBytes(n, sizeof(column[0]));
+    });
+    return true;
+}
+
+std::unique_ptr<Simulation> loadSnapshot(const char *path, const SolverConfig &config) {
+    SnapshotHeader header;
+    ParticleSet loaded;
+    if (!readSnapshotParticles(path, loaded, header))
+        return nullptr;
+    if (header.transport < RK2 || header.transport > BLOCK_HERMITE ||
+        (header.tree != POINTER_TREE && header.tree != LINEAR_TREE)) {
+        fprintf(stderr, "%s: unknown integrator or tree in snapshot\n", path);
+        return nullptr;
+    }
+
+    SolverConfig restored = config;
+    restored.theta = header.theta;
+    auto sim = std::make_unique<Simulation>(header.domain[0], header.domain[1], header.domain[2],
+                                            header.domain[3], header.dt, restored);
+    if (header.tree != POINTER_TREE)
+        sim->setTreeType(static_cast<tree_type>(header.tree));
+    std::swap(sim->getParticles(), loaded);
+
+    TRANSPORT_TYPE = static_cast<transport_type>(header.transport);
+    EnergyTracking energy;
+    energy.reference = header.energy_reference;
+    energy.last = header.energy_last;
+    energy.drift = header.energy_drift;
+    energy.count = static_cast<long>(header.energy_count);
+    sim->resume(header.time, header.step_count, header.dt_set, energy);
+    return sim;
+}
+
+void SnapshotWriter::write(const Simulation &sim, const std::string &path) {
+    wait();
+    encodeSnapshot(sim, image);
+    worker = std::thread([this, path] { ok = writeImage(image, path); });
+}
+
+bool SnapshotWriter::wait() {
+    if (worker.joinable())
+        worker.join();
+    return ok;
+}
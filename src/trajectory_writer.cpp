@@ -0,0 +1,241 @@
+/**
+ * @file trajectory_writer.cpp
+ * @brief Implementation of the streaming trajectory output
+ */
+
+#include "trajectory_writer.h"
+#include <cstring>
+
+#ifdef NBODY_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/// @brief Field names accepted by parseTrajectoryFields, in bit order
+static const char *const FIELD_NAMES[TRAJECTORY_FIELDS] = {"pos", "vel", "acc", "mass", "radius"};
+
+bool parseTrajectoryFields(const char *spec, TrajectoryConfig &config) {
+    std::string list(spec);
+    std::size_t begin = 0;
+    while (begin <= list.size()) {
+        std::size_t end = list.find(',', begin);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string entry = list.substr(begin, end - begin);
+        std::size_t eq = entry.find('=');
+        if (eq == std::string::npos)
+            return false;
+
+        int field = -1;
+        for (int k = 0; k < TRAJECTORY_FIELDS; k++) {
+            if (entry.compare(0, eq, FIELD_NAMES[k]) == 0 && eq == strlen(FIELD_NAMES[k]))
+                field = k;
+        }
+        char *rest;
+        long every = strtol(entry.c_str() + eq + 1, &rest, 10);
+        if (field < 0 || *rest != '\0' || rest == entry.c_str() + eq + 1 || every < 0)
+            return false;
+        config.every[field] = static_cast<int>(every);
+        begin = end + 1;
+    }
+    return true;
+}
+
+/**
+ * @struct ChunkHeader
+ * @brief Header in front of every chunk in the file
+ */
+struct ChunkHeader {
+    uint32_t codec;        ///< 0 raw, 1 zstd
+    uint32_t frames;       ///< Frames in the chunk
+    uint64_t raw_bytes;    ///< Payload size before compression
+    uint64_t stored_bytes; ///< Payload size in the file
+};
+static_assert(sizeof(ChunkHeader) == 24, "chunk header must stay 24 bytes");
+
+/// @brief Append the bytes of a value to a buffer
+template <class V> static void append(std::vector<char> &buffer, const V &value) {
+    const char *bytes = reinterpret_cast<const char *>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(V));
+}
+
+/**
+ * @brief Append one column of the selected particles
+ *
+ * @param buffer Chunk to append to
+ * @param column Source array (indexed by slot)
+ * @param slots Selected slots
+ * @param float32 Store as float instead of the column's own type
+ */
+template <class V>
+static void appendColumn(std::vector<char> &buffer, const std::vector<V> &column,
+                         const std::vector<int> &slots, bool float32) {
+    const std::size_t n = slots.size();
+    const std::size_t start = buffer.size();
+    if (float32) {
+        buffer.resize(start + n * sizeof(float));
+        float *out = reinterpret_cast<float *>(buffer.data() + start);
+        for (std::size_t k = 0; k < n; k++)
+            out[k] = static_cast<float>(column[slots[k]]);
+    } else {
+        buffer.resize(start + n * sizeof(V));
+        V *out = reinterpret_cast<V *>(buffer.data() + start);
+        for (std::size_t k = 0; k < n; k++)
+            out[k] = column[slots[k]];
+    }
+}
+
+bool TrajectoryWriter::open(const std::string &path, const TrajectoryConfig &_config) {
+    close();
+#ifndef NBODY_HAVE_ZSTD
+    if (_config.compression > 0) {
+        fprintf(stderr, "Trajectory compression needs a build with NBODY_WITH_ZSTD\n");
+        return false;
+    }
+#endif
+    config = _config;
+    config.id_stride = std::max(config.id_stride, 1);
+    config.frames_per_chunk = std::max(config.frames_per_chunk, 1);
+
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "Cannot open trajectory file %s\n", path.c_str());
+        return false;
+    }
+    std::vector<char> header;
+    header.insert(header.end(), "NBODYTRJ", "NBODYTRJ" + 8);
+    append(header, static_cast<uint32_t>(TRAJECTORY_VERSION));
+    append(header, static_cast<uint32_t>(config.float32 ? TRAJECTORY_FLOAT32 : 0));
+    // Flushed, so a full disk fails here rather than at close()
+    ok = fwrite(header.data(), 1, header.size(), file) == header.size() && fflush(file) == 0;
+    if (!ok) {
+        fprintf(stderr, "Failed to write trajectory header to %s\n", path.c_str());
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    filling.clear();
+    filling_frames = 0;
+    pending_frames = 0;
+    stopping = false;
+    worker = std::thread(&TrajectoryWriter::run, this);
+    return true;
+}
+
+void TrajectoryWriter::capture(const Simulation &sim) {
+    if (!file)
+        return;
+    const long step = sim.getStepCount();
+    uint32_t mask = 0;
+    for (int k = 0; k < TRAJECTORY_FIELDS; k++) {
+        if (config.every[k] > 0 && step % config.every[k] == 0)
+            mask |= 1u << k;
+    }
+    if (mask == 0)
+        return;
+
+    const ParticleSet &particles = sim.getParticles();
+    selected.clear();
+    for (int i = 0; i < static_cast<int>(particles.size()); i++) {
+        if ((!config.primaries_only || particles.isPrimary(i)) &&
+            particles.id[i] % config.id_stride == 0)
+            selected.push_back(i);
+    }
+
+    append(filling, sim.getTime());
+    append(filling, static_cast<int64_t>(step));
+    append(filling, static_cast<uint32_t>(selected.size()));
+    append(filling, mask);
+    appendColumn(filling, particles.id, selected, false);
+    const bool f32 = config.float32;
+    if (mask & TRAJECTORY_POSITION) {
+        appendColumn(filling, particles.x, selected, f32);
+        appendColumn(filling, particles.y, selected, f32);
+    }
+    if (mask & TRAJECTORY_VELOCITY) {
+        appendColumn(filling, particles.vx, selected, f32);
+        appendColumn(filling, particles.vy, selected, f32);
+    }
+    if (mask & TRAJECTORY_ACCELERATION) {
+        appendColumn(filling, particles.ax, selected, f32);
+        appendColumn(filling, particles.ay, selected, f32);
+    }
+    if (mask & TRAJECTORY_MASS)
+        appendColumn(filling, particles.mass, selected, f32);
+    if (mask & TRAJECTORY_RADIUS)
+        appendColumn(filling, particles.radius, selected, f32);
+
+    if (++filling_frames >= config.frames_per_chunk)
+        handOff();
+}
+
+void TrajectoryWriter::handOff() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this] { return pending_frames == 0; });
+    std::swap(filling, pending);
+    pending_frames = filling_frames;
+    filling.clear();
+    filling_frames = 0;
+    cond.notify_all();
+}
+
+void TrajectoryWriter::run() {
+    std::vector<char> chunk, stored;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait(lock, [this] { return pending_frames > 0 || stopping; });
+        if (pending_frames == 0)
+            break;
+        std::swap(chunk, pending);
+        const uint32_t frames = static_cast<uint32_t>(pending_frames);
+        pending_frames = 0;
+        const int level = config.compression;
+        cond.notify_all();
+        lock.unlock();
+
+        // Compress and write outside the lock while the next chunk fills
+        uint32_t codec = 0;
+        const std::vector<char> *payload = &chunk;
+#ifdef NBODY_HAVE_ZSTD
+        if (level > 0) {
+            stored.resize(ZSTD_compressBound(chunk.size()));
+            std::size_t size = ZSTD_compress(stored.data(), stored.size(), chunk.data(),
+                                             chunk.size(), level);
+            if (!ZSTD_isError(size)) {
+                stored.resize(size);
+                payload = &stored;
+                codec = 1;
+            }
+        }
+#else
+        (void)level;
+#endif
+        const ChunkHeader header{codec, frames, chunk.size(), payload->size()};
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       fwrite(payload->data(), 1, payload->size(), file) == payload->size();
+        chunk.clear();
+
+        lock.lock();
+        ok = ok && written;
+    }
+}
+
+bool TrajectoryWriter::close() {
+    if (!file)
+        return ok;
+    if (filling_frames > 0)
+        handOff();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cond.notify_all();
+    worker.join();
+
+    bool closed = fclose(file) == 0;
+    file = nullptr;
+    ok = ok && closed;
+    if (!ok)
+        fprintf(stderr, "Failed to write trajectory output\n");
+    return ok;
+}
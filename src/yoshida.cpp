@@ -8,22 +8,22 @@
 /**
  * @brief Drift: advance positions by velocity
  */
-void drift(std::vector<std::shared_ptr<Particle>> &particles, double dt) {
-#pragma omp parallel for schedule(dynamic, CHUNK_SIZE)
+void drift(ParticleSet &particles, double dt) {
+#pragma omp parallel for simd schedule(static, CHUNK_SIZE)
     for (int i = 0; i < static_cast<int>(particles.size()); i++) {
-        auto &p = particles[i];
-        p->position += p->velocity * dt;
+        particles.x[i] += particles.vx[i] * dt;
+        particles.y[i] += particles.vy[i] * dt;
     }
 }
 
 /**
  * @brief Kick: advance velocities by acceleration
  */
-void kick(std::vector<std::shared_ptr<Particle>> &particles, double dt) {
-#pragma omp parallel for schedule(dynamic, CHUNK_SIZE)
+void kick(ParticleSet &particles, double dt) {
+#pragma omp parallel for simd schedule(static, CHUNK_SIZE)
     for (int i = 0; i < static_cast<int>(particles.size()); i++) {
-        auto &p = particles[i];
-        p->velocity += p->acceleration * dt;
+        particles.vx[i] += particles.ax[i] * dt;
+        particles.vy[i] += particles.ay[i] * dt;
     }
 }
 
@@ -33,23 +33,40 @@ void kick(std::vector<std::shared_ptr<Particle>> &particles, double dt) {
  * @details Performs composition of drift and kick operations with
  * specially chosen coefficients for 4th order accuracy while maintaining
  * symplectic properties.
+ *
+ * The solver is refitted after every drift, so each force evaluation sees
+ * centers of mass at the drifted positions without a rebuild.
  */
-void yoshidaStep(std::vector<std::shared_ptr<Particle>> &particles, QuadTree<Particle> *tree,
-                 double dt) {
+template <ForceSolver Solver> void yoshidaStep(ParticleSet &particles, Solver &solver, double dt) {
     // First stage
     drift(particles, c1 * dt);
-    getAcceleration(particles, tree);
+    solver.refit();
+    solver.accelerations(particles);
     kick(particles, d1 * dt);
 
     // Second stage
     drift(particles, c2 * dt);
-    getAcceleration(particles, tree);
+    solver.refit();
+    solver.accelerations(particles);
     kick(particles, d2 * dt);
 
     // Third stage
     drift(particles, c3 * dt);
-    getAcceleration(particles, tree);
+    solver.refit();
+    solver.accelerations(particles);
     kick(particles, d3 * dt);
 
     drift(particles, c4 * dt);
 }
+
+template void yoshidaStep(ParticleSet &, TreeSolver<QuadTree<ParticleSet>> &, double);
+template void yoshidaStep(ParticleSet &, TreeSolver<LinearQuadTree<ParticleSet>> &, double);
+template void yoshidaStep(ParticleSet &, DirectSolver &, double);
+template void yoshidaStep(ParticleSet &, FmmSolver<QuadTree<ParticleSet>> &, double);
+template void yoshidaStep(ParticleSet &, FmmSolver<LinearQuadTree<ParticleSet>> &, double);
+#ifdef NBODY_OFFLOAD
+template void yoshidaStep(ParticleSet &, DeviceSolver &, double);
+#endif
+#ifdef NBODY_MPI
+template void yoshidaStep(ParticleSet &, DistributedSolver &, double);
+#endif